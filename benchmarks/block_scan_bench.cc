@@ -0,0 +1,153 @@
+// 数据块解码的微基准：整块顺序扫描、块内 Seek，以及单独的 varint32 解析。
+//
+// 值长度取 16、100、400 字节：前两种条目头是三个单字节 varint，
+// 400 字节时 value_length 占两个字节，走 DecodeEntry 的整字解析路径。
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "util/coding.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+namespace {
+
+// 构造约 block_size 字节的块，键为定长的递增数字
+std::string BuildBlock(size_t value_size, size_t block_size, int* entries) {
+  Options options;
+  BlockBuilder builder(&options);
+  Random rnd(301);
+  std::string value(value_size, 'x');
+  char key[32];
+  int n = 0;
+  while (builder.CurrentSizeEstimate() < block_size) {
+    std::snprintf(key, sizeof(key), "key%012d", n);
+    value[rnd.Uniform(value_size)] = static_cast<char>('a' + rnd.Uniform(26));
+    builder.Add(key, value);
+    n++;
+  }
+  *entries = n;
+  return builder.Finish().ToString();
+}
+
+void BM_BlockScan(benchmark::State& state) {
+  int entries;
+  const std::string data = BuildBlock(state.range(0), 64 << 10, &entries);
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  size_t bytes = 0;
+  for (auto _ : state) {
+    Iterator* iter = block.NewIterator(BytewiseComparator());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      bytes += iter->value().size();
+    }
+    delete iter;
+  }
+  benchmark::DoNotOptimize(bytes);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          data.size());
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * entries);
+}
+
+void BM_BlockSeek(benchmark::State& state) {
+  int entries;
+  const std::string data = BuildBlock(state.range(0), 64 << 10, &entries);
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  Random rnd(42);
+  char key[32];
+  Iterator* iter = block.NewIterator(BytewiseComparator());
+  for (auto _ : state) {
+    std::snprintf(key, sizeof(key), "key%012d",
+                  static_cast<int>(rnd.Uniform(entries)));
+    iter->Seek(key);
+    benchmark::DoNotOptimize(iter->Valid());
+  }
+  delete iter;
+  state.SetItemsProcessed(state.iterations());
+}
+
+// 逐字节解析，作为 GetVarint32Ptr 的对照
+const char* ByteLoopVarint32(const char* p, const char* limit, uint32_t* v) {
+  uint32_t result = 0;
+  for (uint32_t shift = 0; shift <= 28 && p < limit; shift += 7) {
+    const uint32_t byte = *reinterpret_cast<const uint8_t*>(p);
+    p++;
+    if (byte & 128) {
+      result |= ((byte & 127) << shift);
+    } else {
+      result |= (byte << shift);
+      *v = result;
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+// 编码 N 个随机长度（1 到 5 字节）的 varint32
+std::string RandomVarints(int n) {
+  Random rnd(301);
+  std::string s;
+  for (int i = 0; i < n; i++) {
+    PutVarint32(&s, rnd.Next() >> (7 * rnd.Uniform(5)));
+  }
+  return s;
+}
+
+void BM_Varint32ByteLoop(benchmark::State& state) {
+  const std::string s = RandomVarints(4096);
+  const char* limit = s.data() + s.size();
+  uint32_t sum = 0;
+  for (auto _ : state) {
+    uint32_t v;
+    for (const char* p = s.data(); p != nullptr && p < limit;) {
+      p = ByteLoopVarint32(p, limit, &v);
+      sum += v;
+    }
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * 4096);
+}
+
+void BM_Varint32(benchmark::State& state) {
+  const std::string s = RandomVarints(4096);
+  const char* limit = s.data() + s.size();
+  uint32_t sum = 0;
+  for (auto _ : state) {
+    uint32_t v;
+    for (const char* p = s.data(); p != nullptr && p < limit;) {
+      p = GetVarint32Ptr(p, limit, &v);
+      sum += v;
+    }
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * 4096);
+}
+
+BENCHMARK(BM_BlockScan)->Arg(16)->Arg(100)->Arg(400);
+BENCHMARK(BM_BlockSeek)->Arg(16)->Arg(100)->Arg(400);
+BENCHMARK(BM_Varint32ByteLoop);
+BENCHMARK(BM_Varint32);
+
+}  // namespace
+
+}  // namespace leveldb
+
+BENCHMARK_MAIN();
@@ -0,0 +1,631 @@
+#include "leveldb/backup_engine.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <set>
+
+#include "db/blob_file.h"
+#include "db/filename.h"
+#include "db/log_reader.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+#include "leveldb/table.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/logging.h"
+
+namespace leveldb {
+
+BackupEngine::~BackupEngine() = default;
+
+namespace {
+// 备份引用的一个文件
+struct BackupFile {
+  std::string path;  // 相对于备份目录
+  uint64_t size;
+  uint32_t crc;  // 文件内容的 crc32c
+};
+
+struct BackupMeta {
+  uint64_t timestamp = 0;
+  std::vector<BackupFile> files;
+};
+
+// 记录日志格式文件（日志与 MANIFEST）中遇到的第一个错误
+struct LogReporter : public log::Reader::Reporter {
+  Status status;
+  void Corruption(size_t bytes, const Status& s) override {
+    if (status.ok()) {
+      status = s;
+    }
+  }
+};
+
+std::string BaseName(const std::string& path) {
+  const size_t pos = path.rfind('/');
+  return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+// 共享文件的文件名中带有文件末尾 kTailBytes 字节的校验和，如 000005.ldb
+// 存为 000005_<crc>.ldb。表文件的末尾是索引与 footer，记录了各个块的
+// 位置与分隔键，编号与长度相同、内容不同的文件（例如从旧备份恢复后
+// 重新生成的编号）几乎不可能有相同的末尾，不会被当作已经备份过，也不会
+// 覆盖其他备份引用的文件。只读末尾使增量备份不必读取已经备份过的文件
+const uint64_t kTailBytes = 4096;
+
+std::string SharedFileName(const std::string& name, uint32_t crc) {
+  const size_t dot = name.rfind('.');
+  const size_t stem = (dot == std::string::npos) ? name.size() : dot;
+  std::string result = name.substr(0, stem);
+  result.push_back('_');
+  AppendNumberTo(&result, crc);
+  result.append(name, stem, std::string::npos);
+  return result;
+}
+
+// 返回备份中的文件在数据库目录中的文件名
+std::string DBFileName(const std::string& path) {
+  std::string name = BaseName(path);
+  if (Slice(path).starts_with("shared/")) {
+    const size_t dot = name.rfind('.');
+    const size_t underscore = name.rfind('_', dot);
+    if (underscore != std::string::npos) {
+      name.erase(underscore, (dot == std::string::npos ? name.size() : dot) -
+                                 underscore);
+    }
+  }
+  return name;
+}
+
+// 计算长度为 size 的文件 fname 末尾 kTailBytes 字节（不足时为全部）的 crc32c
+Status TailChecksum(Env* env, const std::string& fname, uint64_t size,
+                    uint32_t* crc) {
+  RandomAccessFile* file;
+  Status s = env->NewRandomAccessFile(fname, &file);
+  if (!s.ok()) {
+    return s;
+  }
+  const size_t n = static_cast<size_t>(std::min(size, kTailBytes));
+  char* buffer = new char[n];
+  Slice tail;
+  s = file->Read(size - n, n, &tail, buffer);
+  if (s.ok() && tail.size() != n) {
+    s = Status::Corruption(fname, "file is shorter than expected");
+  }
+  if (s.ok()) {
+    *crc = crc32c::Value(tail.data(), tail.size());
+  }
+  delete[] buffer;
+  delete file;
+  return s;
+}
+
+// 计算 fname 前 size 个字节的 crc32c
+Status FileChecksum(Env* env, const std::string& fname, uint64_t size,
+                    uint32_t* crc) {
+  SequentialFile* file;
+  Status s = env->NewSequentialFile(fname, &file);
+  if (!s.ok()) {
+    return s;
+  }
+  static const size_t kBufferSize = 64 * 1024;
+  char* buffer = new char[kBufferSize];
+  *crc = 0;
+  while (s.ok() && size > 0) {
+    const size_t n =
+        static_cast<size_t>(std::min<uint64_t>(size, kBufferSize));
+    Slice fragment;
+    s = file->Read(n, &fragment, buffer);
+    if (s.ok() && fragment.empty()) {
+      s = Status::Corruption(fname, "file is shorter than expected");
+    }
+    if (s.ok()) {
+      *crc = crc32c::Extend(*crc, fragment.data(), fragment.size());
+      size -= fragment.size();
+    }
+  }
+  delete[] buffer;
+  delete file;
+  return s;
+}
+
+// 返回 input 开头的 blob 记录的总长度，记录头不完整时返回 false
+bool BlobRecordSize(Slice input, uint64_t* size) {
+  if (input.size() < 4) {
+    return false;
+  }
+  input.remove_prefix(4);
+  const char* header = input.data();
+  uint32_t key_size, value_size;
+  if (!GetVarint32(&input, &key_size) || !GetVarint32(&input, &value_size)) {
+    return false;
+  }
+  *size = 4 + (input.data() - header) + key_size + value_size;
+  return true;
+}
+
+// 按块读取 blob 文件并逐条校验记录，内存占用不超过一条记录加一个块
+Status VerifyBlobFile(Env* env, const std::string& fname, uint64_t size) {
+  SequentialFile* file;
+  Status s = env->NewSequentialFile(fname, &file);
+  if (!s.ok()) {
+    return s;
+  }
+  static const size_t kBufferSize = 64 * 1024;
+  static const size_t kMaxHeaderSize = 4 + 2 * 5;
+  char* scratch = new char[kBufferSize];
+  std::string buffer;
+  size_t pos = 0;
+  while (s.ok()) {
+    Slice input(buffer.data() + pos, buffer.size() - pos);
+    uint64_t record_size;
+    const bool has_header = BlobRecordSize(input, &record_size);
+    if (has_header && input.size() >= record_size) {
+      Slice key, value;
+      s = DecodeBlobRecord(Slice(input.data(), record_size), &key, &value);
+      pos += record_size;
+      continue;
+    }
+    if (size == 0) {
+      if (!input.empty()) {
+        s = Status::Corruption("truncated blob record");
+      }
+      break;
+    }
+    if (!has_header && input.size() >= kMaxHeaderSize) {
+      s = Status::Corruption("bad blob record header");
+      break;
+    }
+    // 丢弃已经校验过的记录后读入下一块
+    buffer.erase(0, pos);
+    pos = 0;
+    const size_t n =
+        static_cast<size_t>(std::min<uint64_t>(size, kBufferSize));
+    Slice fragment;
+    s = file->Read(n, &fragment, scratch);
+    if (s.ok() && fragment.empty()) {
+      s = Status::Corruption(fname, "file is shorter than expected");
+    }
+    if (s.ok()) {
+      buffer.append(fragment.data(), fragment.size());
+      size -= fragment.size();
+    }
+  }
+  delete[] scratch;
+  delete file;
+  return s;
+}
+
+class BackupEngineImpl : public BackupEngine {
+ public:
+  BackupEngineImpl(Env* env, const std::string& backup_dir)
+      : env_(env), dir_(backup_dir) {}
+  ~BackupEngineImpl() override = default;
+
+  // 创建目录结构，读取已有的备份并清理中断的备份留下的文件
+  Status Initialize();
+
+  Status CreateNewBackup(DB* db, uint32_t* backup_id) override;
+  void GetBackupInfo(std::vector<BackupInfo>* backup_info) override;
+  Status VerifyBackup(uint32_t backup_id) override;
+  Status DeleteBackup(uint32_t backup_id) override;
+  Status RestoreDBFromBackup(uint32_t backup_id,
+                             const std::string& db_dir) override;
+  Status RestoreDBFromLatestBackup(const std::string& db_dir) override;
+
+ private:
+  std::string SharedDir() const { return dir_ + "/shared"; }
+  std::string PrivateDir(uint32_t id) const {
+    return dir_ + "/private/" + NumberToString(id);
+  }
+  std::string MetaFileName(uint32_t id) const {
+    return dir_ + "/meta/" + NumberToString(id);
+  }
+
+  Status ReadMeta(uint32_t id, BackupMeta* meta);
+  Status WriteMeta(uint32_t id, const BackupMeta& meta);
+  // 按文件类型用文件自带的校验和检查内容
+  Status VerifyFileContents(const std::string& fname, FileType type,
+                            uint64_t size);
+  // 删除不再被任何备份引用的文件与目录
+  void GarbageCollect();
+
+  Env* const env_;
+  const std::string dir_;
+  std::map<uint32_t, BackupMeta> backups_;
+};
+
+Status BackupEngineImpl::Initialize() {
+  env_->CreateDir(dir_);  // 已存在时忽略错误
+  env_->CreateDir(dir_ + "/shared");
+  env_->CreateDir(dir_ + "/private");
+  env_->CreateDir(dir_ + "/meta");
+
+  std::vector<std::string> children;
+  Status s = env_->GetChildren(dir_ + "/meta", &children);
+  for (size_t i = 0; i < children.size() && s.ok(); i++) {
+    Slice in(children[i]);
+    uint64_t id;
+    if (!ConsumeDecimalNumber(&in, &id) || !in.empty()) {
+      continue;  // 写到一半的临时文件等
+    }
+    BackupMeta meta;
+    s = ReadMeta(static_cast<uint32_t>(id), &meta);
+    if (s.ok()) {
+      backups_[static_cast<uint32_t>(id)] = meta;
+    }
+  }
+  if (s.ok()) {
+    GarbageCollect();
+  }
+  return s;
+}
+
+Status BackupEngineImpl::ReadMeta(uint32_t id, BackupMeta* meta) {
+  const std::string fname = MetaFileName(id);
+  std::string contents;
+  Status s = ReadFileToString(env_, fname, &contents);
+  if (!s.ok()) {
+    return s;
+  }
+  // 第一行为 "timestamp <秒>"，之后每行为 "<路径> <字节数> <crc32c>"
+  Slice input(contents);
+  const Slice kTimestamp("timestamp ");
+  if (!input.starts_with(kTimestamp)) {
+    return Status::Corruption(fname, "missing timestamp");
+  }
+  input.remove_prefix(kTimestamp.size());
+  if (!ConsumeDecimalNumber(&input, &meta->timestamp) || input.empty() ||
+      input[0] != '\n') {
+    return Status::Corruption(fname, "bad timestamp");
+  }
+  input.remove_prefix(1);
+  while (!input.empty()) {
+    const char* space =
+        static_cast<const char*>(memchr(input.data(), ' ', input.size()));
+    if (space == nullptr) {
+      return Status::Corruption(fname, "bad file entry");
+    }
+    BackupFile f;
+    f.path.assign(input.data(), space - input.data());
+    input.remove_prefix(f.path.size() + 1);
+    uint64_t crc;
+    if (!ConsumeDecimalNumber(&input, &f.size) || input.empty() ||
+        input[0] != ' ') {
+      return Status::Corruption(fname, "bad file size");
+    }
+    input.remove_prefix(1);
+    if (!ConsumeDecimalNumber(&input, &crc) || crc > UINT32_MAX ||
+        input.empty() || input[0] != '\n') {
+      return Status::Corruption(fname, "bad file checksum");
+    }
+    input.remove_prefix(1);
+    f.crc = static_cast<uint32_t>(crc);
+    meta->files.push_back(f);
+  }
+  return Status::OK();
+}
+
+Status BackupEngineImpl::WriteMeta(uint32_t id, const BackupMeta& meta) {
+  std::string contents = "timestamp ";
+  AppendNumberTo(&contents, meta.timestamp);
+  contents.push_back('\n');
+  for (const BackupFile& f : meta.files) {
+    contents.append(f.path);
+    contents.push_back(' ');
+    AppendNumberTo(&contents, f.size);
+    contents.push_back(' ');
+    AppendNumberTo(&contents, f.crc);
+    contents.push_back('\n');
+  }
+  // 先写临时文件再改名，备份要么完整出现，要么不出现
+  const std::string fname = MetaFileName(id);
+  const std::string tmp = fname + ".tmp";
+  Status s = WriteStringToFileSync(env_, contents, tmp);
+  if (s.ok()) {
+    s = env_->RenameFile(tmp, fname);
+  }
+  if (!s.ok()) {
+    env_->RemoveFile(tmp);
+  }
+  return s;
+}
+
+Status BackupEngineImpl::CreateNewBackup(DB* db, uint32_t* backup_id) {
+  const uint32_t id = backups_.empty() ? 1 : backups_.rbegin()->first + 1;
+  std::vector<LiveFile> files;
+  Status s = db->GetLiveFiles(&files);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // 已有备份中共享文件的完整校验和，引用这些文件时不必重新读取
+  std::map<std::string, uint32_t> shared_crcs;
+  for (const auto& kvp : backups_) {
+    for (const BackupFile& f : kvp.second.files) {
+      shared_crcs[f.path] = f.crc;
+    }
+  }
+
+  BackupMeta meta;
+  meta.timestamp = env_->NowMicros() / 1000000;
+  env_->CreateDir(PrivateDir(id));
+  for (size_t i = 0; i < files.size() && s.ok(); i++) {
+    const LiveFile& f = files[i];
+    uint64_t number;
+    FileType type;
+    if (!ParseFileName(f.name, &number, &type)) {
+      continue;
+    }
+    BackupFile backup_file;
+    backup_file.size = f.size;
+    if (type == kTableFile || type == kBlobFile) {
+      // 不可变文件：编号、长度与末尾的校验和都相同的文件已经备份过，
+      // 直接引用；完整内容的校验和只在复制时计算
+      uint32_t tail_crc;
+      s = TailChecksum(env_, f.path, f.size, &tail_crc);
+      if (!s.ok()) {
+        break;
+      }
+      backup_file.path = "shared/" + SharedFileName(f.name, tail_crc);
+      const std::string target = dir_ + "/" + backup_file.path;
+      auto known = shared_crcs.find(backup_file.path);
+      uint64_t existing_size;
+      if (known != shared_crcs.end() &&
+          env_->GetFileSize(target, &existing_size).ok() &&
+          existing_size == f.size) {
+        backup_file.crc = known->second;
+      } else {
+        const std::string tmp = target + ".tmp";
+        s = CopyFile(env_, f.path, tmp, f.size, &backup_file.crc);
+        if (s.ok()) {
+          s = env_->RenameFile(tmp, target);
+        }
+        if (s.ok()) {
+          shared_crcs[backup_file.path] = backup_file.crc;
+        }
+      }
+    } else {
+      backup_file.path = "private/" + NumberToString(id) + "/" + f.name;
+      s = CopyFile(env_, f.path, dir_ + "/" + backup_file.path, f.size,
+                   &backup_file.crc);
+    }
+    meta.files.push_back(backup_file);
+  }
+  db->ReleaseLiveFiles();
+
+  if (s.ok()) {
+    s = WriteMeta(id, meta);
+  }
+  if (s.ok()) {
+    backups_[id] = meta;
+    if (backup_id != nullptr) {
+      *backup_id = id;
+    }
+  } else {
+    // 清理复制了一半的文件
+    GarbageCollect();
+  }
+  return s;
+}
+
+void BackupEngineImpl::GetBackupInfo(std::vector<BackupInfo>* backup_info) {
+  backup_info->clear();
+  for (const auto& kvp : backups_) {
+    BackupInfo info;
+    info.backup_id = kvp.first;
+    info.timestamp = kvp.second.timestamp;
+    info.number_files = static_cast<uint32_t>(kvp.second.files.size());
+    for (const BackupFile& f : kvp.second.files) {
+      info.size += f.size;
+    }
+    backup_info->push_back(info);
+  }
+}
+
+Status BackupEngineImpl::VerifyFileContents(const std::string& fname,
+                                            FileType type, uint64_t size) {
+  Status s;
+  if (type == kTableFile) {
+    RandomAccessFile* file;
+    s = env_->NewRandomAccessFile(fname, &file);
+    if (!s.ok()) {
+      return s;
+    }
+    Options options;
+    options.env = env_;
+    options.paranoid_checks = true;
+    Table* table;
+    s = Table::Open(options, file, size, &table);
+    if (s.ok()) {
+      ReadOptions read_options;
+      read_options.verify_checksums = true;
+      read_options.fill_cache = false;
+      Iterator* iter = table->NewIterator(read_options);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      }
+      s = iter->status();
+      delete iter;
+      delete table;
+    }
+    delete file;
+  } else if (type == kBlobFile) {
+    s = VerifyBlobFile(env_, fname, size);
+  } else if (type == kLogFile || type == kDescriptorFile) {
+    SequentialFile* file;
+    s = env_->NewSequentialFile(fname, &file);
+    if (!s.ok()) {
+      return s;
+    }
+    LogReporter reporter;
+    log::Reader reader(file, &reporter, true /*checksum*/,
+                       0 /*initial_offset*/);
+    Slice record;
+    std::string scratch;
+    while (reader.ReadRecord(&record, &scratch) && reporter.status.ok()) {
+    }
+    s = reporter.status;
+    delete file;
+  }
+  if (!s.ok()) {
+    s = Status::Corruption(fname, s.ToString());
+  }
+  return s;
+}
+
+Status BackupEngineImpl::VerifyBackup(uint32_t backup_id) {
+  auto it = backups_.find(backup_id);
+  if (it == backups_.end()) {
+    return Status::NotFound("backup " + NumberToString(backup_id));
+  }
+  Status s;
+  for (const BackupFile& f : it->second.files) {
+    const std::string fname = dir_ + "/" + f.path;
+    uint64_t size;
+    s = env_->GetFileSize(fname, &size);
+    if (s.ok() && size != f.size) {
+      s = Status::Corruption(fname, "size mismatch");
+    }
+    uint32_t crc;
+    if (s.ok()) {
+      s = FileChecksum(env_, fname, f.size, &crc);
+    }
+    if (s.ok() && crc != f.crc) {
+      s = Status::Corruption(fname, "checksum mismatch");
+    }
+    uint64_t number;
+    FileType type;
+    if (s.ok() && ParseFileName(DBFileName(f.path), &number, &type)) {
+      s = VerifyFileContents(fname, type, f.size);
+    }
+    if (!s.ok()) {
+      break;
+    }
+  }
+  return s;
+}
+
+Status BackupEngineImpl::DeleteBackup(uint32_t backup_id) {
+  auto it = backups_.find(backup_id);
+  if (it == backups_.end()) {
+    return Status::NotFound("backup " + NumberToString(backup_id));
+  }
+  Status s = env_->RemoveFile(MetaFileName(backup_id));
+  if (s.ok()) {
+    backups_.erase(it);
+    GarbageCollect();
+  }
+  return s;
+}
+
+void BackupEngineImpl::GarbageCollect() {
+  std::set<std::string> live;
+  for (const auto& kvp : backups_) {
+    for (const BackupFile& f : kvp.second.files) {
+      live.insert(f.path);
+    }
+  }
+
+  std::vector<std::string> children;
+  env_->GetChildren(SharedDir(), &children);  // 出错时忽略
+  for (const std::string& child : children) {
+    if (child != "." && child != ".." &&
+        live.find("shared/" + child) == live.end()) {
+      env_->RemoveFile(SharedDir() + "/" + child);
+    }
+  }
+
+  std::vector<std::string> ids;
+  env_->GetChildren(dir_ + "/private", &ids);
+  std::set<uint64_t> orphans;
+  for (const std::string& id_name : ids) {
+    // 有的 Env 会连同子目录中的文件一起返回，如 "3/MANIFEST-000005"
+    Slice in(id_name);
+    uint64_t id;
+    if (ConsumeDecimalNumber(&in, &id) && (in.empty() || in[0] == '/') &&
+        backups_.find(static_cast<uint32_t>(id)) == backups_.end()) {
+      orphans.insert(id);
+    }
+  }
+  for (uint64_t id : orphans) {
+    const std::string private_dir = PrivateDir(static_cast<uint32_t>(id));
+    env_->GetChildren(private_dir, &children);
+    for (const std::string& child : children) {
+      if (child != "." && child != "..") {
+        env_->RemoveFile(private_dir + "/" + child);
+      }
+    }
+    env_->RemoveDir(private_dir);
+  }
+}
+
+Status BackupEngineImpl::RestoreDBFromBackup(uint32_t backup_id,
+                                             const std::string& db_dir) {
+  auto it = backups_.find(backup_id);
+  if (it == backups_.end()) {
+    return Status::NotFound("backup " + NumberToString(backup_id));
+  }
+
+  // 删除目标目录中已有的数据库文件
+  env_->CreateDir(db_dir);
+  std::vector<std::string> children;
+  env_->GetChildren(db_dir, &children);
+  uint64_t number;
+  FileType type;
+  for (const std::string& child : children) {
+    if (ParseFileName(child, &number, &type) && type != kDBLockFile) {
+      env_->RemoveFile(db_dir + "/" + child);
+    }
+  }
+
+  Status s;
+  uint64_t manifest_number = 0;
+  bool has_manifest = false;
+  for (const BackupFile& f : it->second.files) {
+    const std::string name = DBFileName(f.path);
+    if (ParseFileName(name, &number, &type) && type == kDescriptorFile) {
+      manifest_number = number;
+      has_manifest = true;
+    }
+    s = CopyFile(env_, dir_ + "/" + f.path, db_dir + "/" + name, f.size);
+    if (!s.ok()) {
+      break;
+    }
+  }
+  if (s.ok() && !has_manifest) {
+    s = Status::Corruption("backup " + NumberToString(backup_id),
+                           "no MANIFEST");
+  }
+  if (s.ok()) {
+    s = SetCurrentFile(env_, db_dir, manifest_number);
+  }
+  return s;
+}
+
+Status BackupEngineImpl::RestoreDBFromLatestBackup(const std::string& db_dir) {
+  if (backups_.empty()) {
+    return Status::NotFound("no backups");
+  }
+  return RestoreDBFromBackup(backups_.rbegin()->first, db_dir);
+}
+
+}  // namespace
+
+Status BackupEngine::Open(Env* env, const std::string& backup_dir,
+                          BackupEngine** result) {
+  *result = nullptr;
+  BackupEngineImpl* impl = new BackupEngineImpl(env, backup_dir);
+  Status s = impl->Initialize();
+  if (s.ok()) {
+    *result = impl;
+  } else {
+    delete impl;
+  }
+  return s;
+}
+
+}  // namespace leveldb
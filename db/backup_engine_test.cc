@@ -0,0 +1,280 @@
+#include "leveldb/backup_engine.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "db/filename.h"
+#include "helpers/memenv/memenv.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "util/logging.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+// 统计从名字以 prefix 开头的文件中读取的字节数
+class ReadCountingEnv : public EnvWrapper {
+ public:
+  ReadCountingEnv(Env* base, const std::string& prefix)
+      : EnvWrapper(base), prefix_(prefix), bytes_read_(0) {}
+
+  Status NewSequentialFile(const std::string& f,
+                           SequentialFile** r) override {
+    Status s = target()->NewSequentialFile(f, r);
+    if (s.ok() && Slice(f).starts_with(prefix_)) {
+      *r = new CountingSequentialFile(*r, &bytes_read_);
+    }
+    return s;
+  }
+
+  Status NewRandomAccessFile(const std::string& f,
+                             RandomAccessFile** r) override {
+    Status s = target()->NewRandomAccessFile(f, r);
+    if (s.ok() && Slice(f).starts_with(prefix_)) {
+      *r = new CountingRandomAccessFile(*r, &bytes_read_);
+    }
+    return s;
+  }
+
+  uint64_t bytes_read() const { return bytes_read_; }
+  void ResetBytesRead() { bytes_read_ = 0; }
+
+ private:
+  class CountingSequentialFile : public SequentialFile {
+   public:
+    CountingSequentialFile(SequentialFile* base, uint64_t* counter)
+        : base_(base), counter_(counter) {}
+    ~CountingSequentialFile() override { delete base_; }
+    Status Read(size_t n, Slice* result, char* scratch) override {
+      Status s = base_->Read(n, result, scratch);
+      *counter_ += result->size();
+      return s;
+    }
+    Status Skip(uint64_t n) override { return base_->Skip(n); }
+
+   private:
+    SequentialFile* const base_;
+    uint64_t* const counter_;
+  };
+
+  class CountingRandomAccessFile : public RandomAccessFile {
+   public:
+    CountingRandomAccessFile(RandomAccessFile* base, uint64_t* counter)
+        : base_(base), counter_(counter) {}
+    ~CountingRandomAccessFile() override { delete base_; }
+    Status Read(uint64_t offset, size_t n, Slice* result,
+                char* scratch) const override {
+      Status s = base_->Read(offset, n, result, scratch);
+      *counter_ += result->size();
+      return s;
+    }
+
+   private:
+    RandomAccessFile* const base_;
+    uint64_t* const counter_;
+  };
+
+  const std::string prefix_;
+  uint64_t bytes_read_;
+};
+
+class BackupEngineTest : public testing::Test {
+ public:
+  BackupEngineTest()
+      : env_(NewMemEnv(Env::Default())),
+        dbname_("/db"),
+        backup_dir_("/backup"),
+        db_(nullptr),
+        backup_engine_(nullptr) {
+    options_.env = env_;
+    options_.create_if_missing = true;
+    options_.compression = kNoCompression;
+    options_.min_blob_size = 100;
+    EXPECT_LEVELDB_OK(DB::Open(options_, dbname_, &db_));
+    EXPECT_LEVELDB_OK(BackupEngine::Open(env_, backup_dir_, &backup_engine_));
+  }
+
+  ~BackupEngineTest() {
+    delete backup_engine_;
+    delete db_;
+    delete env_;
+  }
+
+  Status Put(const std::string& k, const std::string& v) {
+    return db_->Put(WriteOptions(), k, v);
+  }
+
+  std::string Get(DB* db, const std::string& k) {
+    std::string result;
+    Status s = db->Get(ReadOptions(), k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  // 备份目录下 shared/ 中的文件数
+  int CountSharedFiles() {
+    std::vector<std::string> children;
+    EXPECT_LEVELDB_OK(env_->GetChildren(backup_dir_ + "/shared", &children));
+    return static_cast<int>(children.size());
+  }
+
+  Env* env_;
+  Options options_;
+  std::string dbname_;
+  std::string backup_dir_;
+  DB* db_;
+  BackupEngine* backup_engine_;
+};
+
+TEST_F(BackupEngineTest, BackupAndRestore) {
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  ASSERT_LEVELDB_OK(Put("b", std::string(200, 'b')));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_LEVELDB_OK(Put("c", "v3"));  // 只在日志中
+  uint32_t id;
+  ASSERT_LEVELDB_OK(backup_engine_->CreateNewBackup(db_, &id));
+  ASSERT_EQ(1, id);
+  ASSERT_LEVELDB_OK(backup_engine_->VerifyBackup(id));
+
+  ASSERT_LEVELDB_OK(Put("a", "new"));
+  ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), "b"));
+  delete db_;
+  db_ = nullptr;
+
+  ASSERT_LEVELDB_OK(backup_engine_->RestoreDBFromLatestBackup(dbname_));
+  Options options = options_;
+  options.create_if_missing = false;
+  ASSERT_LEVELDB_OK(DB::Open(options, dbname_, &db_));
+  ASSERT_EQ("v1", Get(db_, "a"));
+  ASSERT_EQ(std::string(200, 'b'), Get(db_, "b"));
+  ASSERT_EQ("v3", Get(db_, "c"));
+}
+
+TEST_F(BackupEngineTest, IncrementalBackupSharesFiles) {
+  for (int i = 0; i < 3; i++) {
+    ASSERT_LEVELDB_OK(Put("k" + NumberToString(i), "v"));
+    db_->CompactRange(nullptr, nullptr);
+  }
+  ASSERT_LEVELDB_OK(backup_engine_->CreateNewBackup(db_));
+  const int shared = CountSharedFiles();
+  ASSERT_GT(shared, 0);
+
+  // 没有新的表文件时不复制任何共享文件
+  ASSERT_LEVELDB_OK(Put("memtable-only", "v"));
+  ASSERT_LEVELDB_OK(backup_engine_->CreateNewBackup(db_));
+  ASSERT_EQ(shared, CountSharedFiles());
+
+  std::vector<BackupInfo> infos;
+  backup_engine_->GetBackupInfo(&infos);
+  ASSERT_EQ(2, infos.size());
+  ASSERT_EQ(1, infos[0].backup_id);
+  ASSERT_EQ(2, infos[1].backup_id);
+
+  // 重新打开后仍能看到这两个备份；删除它们后共享文件被回收
+  delete backup_engine_;
+  ASSERT_LEVELDB_OK(BackupEngine::Open(env_, backup_dir_, &backup_engine_));
+  backup_engine_->GetBackupInfo(&infos);
+  ASSERT_EQ(2, infos.size());
+  ASSERT_LEVELDB_OK(backup_engine_->DeleteBackup(1));
+  ASSERT_EQ(shared, CountSharedFiles());
+  ASSERT_LEVELDB_OK(backup_engine_->DeleteBackup(2));
+  ASSERT_EQ(0, CountSharedFiles());
+  ASSERT_TRUE(backup_engine_->DeleteBackup(2).IsNotFound());
+}
+
+TEST_F(BackupEngineTest, IncrementalBackupReadsOnlyNewFiles) {
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_LEVELDB_OK(Put("k" + NumberToString(i), std::string(50, 'v')));
+  }
+  // 跨越读取块边界的 blob 记录，校验时分块读取
+  for (int i = 0; i < 5; i++) {
+    ASSERT_LEVELDB_OK(Put("blob" + NumberToString(i), std::string(30000, 'b')));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  uint64_t table_bytes = 0;
+  std::vector<std::string> children;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &children));
+  for (const std::string& child : children) {
+    uint64_t size;
+    if (child.find(".ldb") != std::string::npos &&
+        env_->GetFileSize(dbname_ + "/" + child, &size).ok()) {
+      table_bytes += size;
+    }
+  }
+  ASSERT_GT(table_bytes, 40000);
+
+  ReadCountingEnv counting_env(env_, dbname_ + "/");
+  BackupEngine* engine;
+  ASSERT_LEVELDB_OK(BackupEngine::Open(&counting_env, "/backup2", &engine));
+  ASSERT_LEVELDB_OK(engine->CreateNewBackup(db_));
+  ASSERT_LEVELDB_OK(engine->VerifyBackup(1));
+  ASSERT_GE(counting_env.bytes_read(), table_bytes);
+
+  // 已经备份过的表文件只读取末尾，新的备份只需读取 MANIFEST 与日志
+  ASSERT_LEVELDB_OK(Put("memtable-only", "v"));
+  counting_env.ResetBytesRead();
+  ASSERT_LEVELDB_OK(engine->CreateNewBackup(db_));
+  ASSERT_LT(counting_env.bytes_read(), table_bytes / 2);
+  ASSERT_LEVELDB_OK(engine->VerifyBackup(2));
+  delete engine;
+}
+
+TEST_F(BackupEngineTest, VerifyDetectsCorruption) {
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  db_->CompactRange(nullptr, nullptr);
+  uint32_t id;
+  ASSERT_LEVELDB_OK(backup_engine_->CreateNewBackup(db_, &id));
+
+  std::vector<std::string> children;
+  ASSERT_LEVELDB_OK(env_->GetChildren(backup_dir_ + "/shared", &children));
+  std::string table;
+  for (const std::string& child : children) {
+    if (child.find(".ldb") != std::string::npos) {
+      table = backup_dir_ + "/shared/" + child;
+    }
+  }
+  ASSERT_FALSE(table.empty());
+
+  // 改写表文件中的一个字节，长度不变
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, table, &contents));
+  contents[0] ^= 0x80;
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, contents, table));
+  ASSERT_TRUE(backup_engine_->VerifyBackup(id).IsCorruption());
+}
+
+TEST_F(BackupEngineTest, SameNameAndSizeWithDifferentContents) {
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_LEVELDB_OK(backup_engine_->CreateNewBackup(db_));
+
+  // 重建的数据库按同样的顺序生成文件，表文件的编号与长度都与之前相同
+  delete db_;
+  ASSERT_LEVELDB_OK(DestroyDB(dbname_, options_));
+  ASSERT_LEVELDB_OK(DB::Open(options_, dbname_, &db_));
+  ASSERT_LEVELDB_OK(Put("a", "v2"));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_LEVELDB_OK(backup_engine_->CreateNewBackup(db_));
+  delete db_;
+  db_ = nullptr;
+
+  Options options = options_;
+  options.create_if_missing = false;
+  ASSERT_LEVELDB_OK(backup_engine_->RestoreDBFromBackup(2, dbname_));
+  ASSERT_LEVELDB_OK(DB::Open(options, dbname_, &db_));
+  ASSERT_EQ("v2", Get(db_, "a"));
+  delete db_;
+  db_ = nullptr;
+
+  ASSERT_LEVELDB_OK(backup_engine_->VerifyBackup(1));
+  ASSERT_LEVELDB_OK(backup_engine_->RestoreDBFromBackup(1, dbname_));
+  ASSERT_LEVELDB_OK(DB::Open(options, dbname_, &db_));
+  ASSERT_EQ("v1", Get(db_, "a"));
+}
+
+}  // namespace leveldb
@@ -0,0 +1,93 @@
+#include "db/blob_file.h"
+
+#include "leveldb/env.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+
+namespace leveldb {
+void BlobIndex::EncodeTo(std::string* dst) const {
+  PutVarint64(dst, file_number);
+  PutVarint64(dst, offset);
+  PutVarint64(dst, size);
+}
+
+bool BlobIndex::DecodeFrom(Slice input) {
+  return GetVarint64(&input, &file_number) && GetVarint64(&input, &offset) &&
+         GetVarint64(&input, &size) && input.empty();
+}
+
+Status DecodeBlobRecord(const Slice& record, Slice* key, Slice* value) {
+  if (record.size() < 4) {
+    return Status::Corruption("truncated blob record");
+  }
+  const uint32_t expected = crc32c::Unmask(DecodeFixed32(record.data()));
+  Slice input(record.data() + 4, record.size() - 4);
+  if (crc32c::Value(input.data(), input.size()) != expected) {
+    return Status::Corruption("blob record checksum mismatch");
+  }
+  uint32_t key_size, value_size;
+  if (!GetVarint32(&input, &key_size) || !GetVarint32(&input, &value_size) ||
+      input.size() != static_cast<size_t>(key_size) + value_size) {
+    return Status::Corruption("bad blob record");
+  }
+  *key = Slice(input.data(), key_size);
+  *value = Slice(input.data() + key_size, value_size);
+  return Status::OK();
+}
+
+Status ConsumeBlobRecord(Slice* input, Slice* key, Slice* value) {
+  if (input->size() < 4) {
+    return Status::Corruption("truncated blob record");
+  }
+  // 记录长度 = 校验和 + 两个长度前缀 + 键 + 值
+  Slice header(input->data() + 4, input->size() - 4);
+  uint32_t key_size, value_size;
+  if (!GetVarint32(&header, &key_size) || !GetVarint32(&header, &value_size) ||
+      header.size() < static_cast<size_t>(key_size) + value_size) {
+    return Status::Corruption("truncated blob record");
+  }
+  const size_t record_size =
+      (header.data() - input->data()) + key_size + value_size;
+  Status s = DecodeBlobRecord(Slice(input->data(), record_size), key, value);
+  if (s.ok()) {
+    input->remove_prefix(record_size);
+  }
+  return s;
+}
+
+BlobFileBuilder::BlobFileBuilder(WritableFile* file, uint64_t file_number)
+    : file_(file), file_number_(file_number), num_entries_(0), file_size_(0) {}
+
+Status BlobFileBuilder::Add(const Slice& user_key, const Slice& value,
+                            std::string* blob_index) {
+  record_.assign(4, '\0');  // 为校验和预留位置
+  PutVarint32(&record_, user_key.size());
+  PutVarint32(&record_, value.size());
+  record_.append(user_key.data(), user_key.size());
+  record_.append(value.data(), value.size());
+  const uint32_t crc = crc32c::Value(record_.data() + 4, record_.size() - 4);
+  EncodeFixed32(&record_[0], crc32c::Mask(crc));
+
+  Status s = file_->Append(record_);
+  if (s.ok()) {
+    BlobIndex index;
+    index.file_number = file_number_;
+    index.offset = file_size_;
+    index.size = record_.size();
+    blob_index->clear();
+    index.EncodeTo(blob_index);
+    file_size_ += record_.size();
+    num_entries_++;
+  }
+  return s;
+}
+
+Status BlobFileBuilder::Finish() {
+  Status s = file_->Flush();
+  if (s.ok()) {
+    s = file_->Sync();
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,75 @@
+#ifndef STORAGE_LEVELDB_DB_BLOB_FILE_H_
+#define STORAGE_LEVELDB_DB_BLOB_FILE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+class WritableFile;
+
+// 键值分离：超过 Options::min_blob_size 的值写入只追加的 blob 文件，
+// sstable 中只保存类型为 kTypeBlobIndex 的索引。
+//
+// blob 文件由连续的记录组成，每条记录为
+//    checksum:   fixed32   // 其余部分的 crc32c（已 mask）
+//    key_size:   varint32
+//    value_size: varint32
+//    key:        char[key_size]
+//    value:      char[value_size]
+// 记录中保存用户键是为了便于校验与离线检查。
+//
+// 索引编码为 file_number varint64 | offset varint64 | size varint64，
+// 指向一条完整的记录。
+struct BlobIndex {
+  BlobIndex() : file_number(0), offset(0), size(0) {}
+
+  void EncodeTo(std::string* dst) const;
+  bool DecodeFrom(Slice input);
+
+  uint64_t file_number;
+  uint64_t offset;
+  uint64_t size;
+};
+
+// 解析一条完整的 blob 记录，校验失败时返回 Corruption。
+// *key 与 *value 指向 "record" 中的数据。
+Status DecodeBlobRecord(const Slice& record, Slice* key, Slice* value);
+
+// 解析 "*input" 开头的一条 blob 记录并将 *input 前移到下一条记录。
+// *key 与 *value 指向 "*input" 中的数据。
+Status ConsumeBlobRecord(Slice* input, Slice* key, Slice* value);
+
+// 顺序写出一个 blob 文件。非线程安全。
+class BlobFileBuilder {
+ public:
+  // 不接管 "file" 的所有权，调用者需在 Finish() 之后关闭并删除它。
+  BlobFileBuilder(WritableFile* file, uint64_t file_number);
+
+  BlobFileBuilder(const BlobFileBuilder&) = delete;
+  BlobFileBuilder& operator=(const BlobFileBuilder&) = delete;
+
+  // 追加一条记录，并将指向它的索引编码后存入 *blob_index。
+  Status Add(const Slice& user_key, const Slice& value,
+             std::string* blob_index);
+
+  // 将已写入的数据刷到稳定存储。
+  Status Finish();
+
+  uint64_t file_number() const { return file_number_; }
+  uint64_t NumEntries() const { return num_entries_; }
+  uint64_t FileSize() const { return file_size_; }
+
+ private:
+  WritableFile* file_;
+  const uint64_t file_number_;
+  uint64_t num_entries_;
+  uint64_t file_size_;
+  std::string record_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_BLOB_FILE_H_
@@ -1,5 +1,8 @@
 #include "db/builder.h"
 
+#include <algorithm>
+
+#include "db/blob_file.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/table_cache.h"
@@ -10,32 +13,124 @@
 namespace leveldb {
 
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta,
+                  BlobFileMetaData* blob) {
   Status s;
   meta->file_size = 0;
+  if (blob != nullptr) {
+    blob->total_count = 0;
+    blob->total_bytes = 0;
+  }
+  WritableFile* blob_file = nullptr;
+  BlobFileBuilder* blob_builder = nullptr;
   iter->SeekToFirst();
+  if (range_del_iter != nullptr) {
+    range_del_iter->SeekToFirst();
+  }
+  const bool has_range_dels =
+      range_del_iter != nullptr && range_del_iter->Valid();
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() || has_range_dels) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
       return s;
     }
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    meta->num_entries = 0;
+    meta->num_deletions = 0;
+    meta->num_range_deletions = 0;
+    meta->largest_seqno = 0;
     Slice key;
+    ParsedInternalKey ikey;
+    if (iter->Valid()) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
+    InternalKey blob_key;
+    std::string blob_index;
     for (; iter->Valid(); iter->Next()) {
       key = iter->key();
-      builder->Add(key, iter->value());
+      const bool parsed = ParseInternalKey(key, &ikey);
+      if (parsed && blob != nullptr && ikey.type == kTypeValue &&
+          iter->value().size() >= options.min_blob_size) {
+        // 大 value 写入 blob 文件，表中只保存指向它的索引
+        if (blob_builder == nullptr) {
+          s = env->NewWritableFile(BlobFileName(dbname, blob->number),
+                                   &blob_file);
+          if (!s.ok()) {
+            break;
+          }
+          blob_builder = new BlobFileBuilder(blob_file, blob->number);
+        }
+        s = blob_builder->Add(ikey.user_key, iter->value(), &blob_index);
+        if (!s.ok()) {
+          break;
+        }
+        blob_key.SetFrom(
+            ParsedInternalKey(ikey.user_key, ikey.sequence, kTypeBlobIndex));
+        builder->Add(blob_key.Encode(), blob_index);
+      } else {
+        builder->Add(key, iter->value());
+      }
+      meta->num_entries++;
+      if (parsed) {
+        if (ikey.type == kTypeDeletion) {
+          meta->num_deletions++;
+        }
+        meta->largest_seqno = std::max(meta->largest_seqno, ikey.sequence);
+      }
     }
     if (!key.empty()) {
       meta->largest.DecodeFrom(key);
     }
 
-    s = builder->Finish();
+    // 范围删除标记写入独立的块，并扩展文件的键范围以覆盖 [begin, end)。
+    // end 是开区间，用序列号最大的哨兵键作为上界。
+    if (has_range_dels) {
+      const Comparator* icmp = options.comparator;
+      bool has_bounds = meta->num_entries > 0;
+      for (; range_del_iter->Valid(); range_del_iter->Next()) {
+        if (!ParseInternalKey(range_del_iter->key(), &ikey)) {
+          continue;
+        }
+        builder->AddRangeTombstone(range_del_iter->key(),
+                                   range_del_iter->value());
+        meta->num_range_deletions++;
+        meta->largest_seqno = std::max(meta->largest_seqno, ikey.sequence);
+        InternalKey end(range_del_iter->value(), kMaxSequenceNumber,
+                        kTypeRangeDeletion);
+        if (!has_bounds ||
+            icmp->Compare(range_del_iter->key(), meta->smallest.Encode()) < 0) {
+          meta->smallest.DecodeFrom(range_del_iter->key());
+        }
+        if (!has_bounds ||
+            icmp->Compare(end.Encode(), meta->largest.Encode()) > 0) {
+          meta->largest = end;
+        }
+        has_bounds = true;
+      }
+    }
+
+    if (s.ok() && blob_builder != nullptr) {
+      s = blob_builder->Finish();
+      if (s.ok()) {
+        s = blob_file->Close();
+      }
+      blob->total_count = blob_builder->NumEntries();
+      blob->total_bytes = blob_builder->FileSize();
+    }
+    delete blob_builder;
+    delete blob_file;
+
     if (s.ok()) {
-      meta->file_size = builder->FileSize();
-      assert(meta->file_size > 0);
+      s = builder->Finish();
+      if (s.ok()) {
+        meta->file_size = builder->FileSize();
+        assert(meta->file_size > 0);
+      }
+    } else {
+      builder->Abandon();
     }
 
     delete builder;
@@ -59,8 +154,16 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
   if (!iter->status().ok()) {
     s = iter->status();
   }
+  if (range_del_iter != nullptr && !range_del_iter->status().ok()) {
+    s = range_del_iter->status();
+  }
   if (!(s.ok() && meta->file_size > 0)) {
     env->RemoveFile(fname);
+    if (blob != nullptr && blob->total_count > 0) {
+      env->RemoveFile(BlobFileName(dbname, blob->number));
+      blob->total_count = 0;
+      blob->total_bytes = 0;
+    }
   }
   return s;
 }
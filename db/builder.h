@@ -6,6 +6,7 @@
 namespace leveldb {
 struct Options;
 struct FileMetaData;
+struct BlobFileMetaData;
 class Env;
 class Iterator;
 class TableCache;
@@ -13,9 +14,14 @@ class VersionEdit;
 
 // 从 *iter 的内容构建一个表文件。生成的文件将根据 meta->number 命名。
 // 成功后，*meta 的其余部分将填充生成表的元数据。
-// 如果 *iter 中没有数据，meta->file_size 将被设置为零，并且不会生成表文件。
+// "*range_del_iter"（可以为 nullptr）中的范围删除标记会写入表的范围删除块。
+// 如果两个迭代器中都没有数据，meta->file_size 将被设置为零，并且不会生成表文件。
+// "blob" 不为 nullptr 时，不小于 options.min_blob_size 的值写入按 blob->number
+// 命名的 blob 文件，表中只保留索引；blob->total_count 为 0 表示没有生成 blob 文件。
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta,
+                  BlobFileMetaData* blob = nullptr);
 }  // namespace leveldb
 
 #endif
\ No newline at end of file
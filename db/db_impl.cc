@@ -4,10 +4,12 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "db/blob_file.h"
 #include "db/builder.h"
 #include "db/db_iter.h"
 #include "db/dbformat.h"
@@ -15,14 +17,18 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
+#include "leveldb/write_buffer_manager.h"
 #include "port/port.h"
 #include "table/block.h"
 #include "table/merger.h"
@@ -30,16 +36,21 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/parallel.h"
 
 namespace leveldb {
 const int kNumNonTableCacheFiles = 10;
 
+// 恢复时同时重放的日志数。每个日志占用一个 memtable 与一个读取线程。
+const int kMaxRecoveryThreads = 4;
+
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr), sync(false), disable_wal(false), done(false), cv(mu) {}
   Status status;
   WriteBatch* batch;
   bool sync;
+  bool disable_wal;
   bool done;
   port::CondVar cv;
 };
@@ -50,16 +61,34 @@ struct DBImpl::CompactionState {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    uint64_t num_entries;
+    uint64_t num_deletions;
+    uint64_t num_range_deletions;
+    SequenceNumber largest_seqno;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
 
-  explicit CompactionState(Compaction* c)
+  CompactionState(Compaction* c, const InternalKeyComparator* icmp)
       : compaction(c),
         smallest_snapshot(0),
+        newest_snapshot(0),
+        range_dels(icmp),
+        output_range_dels(icmp),
+        has_output_lower_bound(false),
         outfile(nullptr),
         builder(nullptr),
-        total_bytes(0) {}
+        total_bytes(0),
+        blob_outfile(nullptr),
+        blob_builder(nullptr) {}
+
+  // 记录 "index" 指向的 blob 记录已不再被引用
+  void AddBlobGarbage(const BlobIndex& index) {
+    BlobFileMetaData& g = blob_garbage[index.file_number];
+    g.number = index.file_number;
+    g.garbage_count++;
+    g.garbage_bytes += index.size;
+  }
 
   Compaction* const compaction;
 
@@ -68,12 +97,50 @@ struct DBImpl::CompactionState {
   // smallest_snapshot， 我们可以删除同一键的所有序列号 < S 的条目。
   SequenceNumber smallest_snapshot;
 
+  // 最新快照的序列号，没有快照时为 0。序列号更大的条目不会被任何快照看到
+  SequenceNumber newest_snapshot;
+
+  // 输入文件中的所有范围删除标记，用于丢弃被覆盖的条目
+  RangeTombstoneList range_dels;
+  // 其中需要写入输出文件的标记
+  RangeTombstoneList output_range_dels;
+  // 下一个输出文件的用户键下界，即上一个输出文件的上界
+  std::string output_lower_bound;
+  bool has_output_lower_bound;
+
   std::vector<Output> outputs;
 
   WritableFile* outfile;
   TableBuilder* builder;
 
   uint64_t total_bytes;
+
+  // 键值分离：压缩写出的 blob 文件，最后一个可能仍在写入
+  std::vector<BlobFileMetaData> blob_outputs;
+  WritableFile* blob_outfile;
+  BlobFileBuilder* blob_builder;
+  // 输入中成为垃圾的 blob 记录，以文件编号为键
+  std::map<uint64_t, BlobFileMetaData> blob_garbage;
+  // 垃圾比例达到 Options::blob_gc_ratio 的 blob 文件，其中的存活记录会被重写
+  std::set<uint64_t> blob_files_to_gc;
+};
+
+// 恢复时一个日志文件的重放结果
+struct DBImpl::LogRecovery {
+  LogRecovery()
+      : db(nullptr), number(0), last_log(false), max_sequence(0), mem(nullptr) {}
+
+  DBImpl* db;
+  uint64_t number;
+  bool last_log;
+  Status status;
+  SequenceNumber max_sequence;
+  // 按写出顺序排列的 level-0 表，以及与每个表同时写出的 blob 文件
+  // （total_count 为零表示没有）
+  std::vector<FileMetaData> tables;
+  std::vector<BlobFileMetaData> blobs;
+  // reuse_logs 时最后一个日志没有写出的 memtable，可能继续作为 mem_ 使用
+  MemTable* mem;
 };
 
 // 修正用户提供的选项，使其合理
@@ -94,7 +161,8 @@ Options SanitizeOptions(const std::string& dbname,
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
-  ClipToRange(&result.max_file_size, 64 + kNumNonTableCacheFiles, 50000);
+  ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
+  ClipToRange(&result.max_file_opening_threads, 1, 64);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
@@ -109,6 +177,10 @@ Options SanitizeOptions(const std::string& dbname,
   if (result.block_cache == nullptr) {
     result.block_cache = NewLRUCache(8 << 20);
   }
+  if (result.compaction_style == kCompactionStyleFIFO) {
+    // FIFO 直接丢弃整个表文件，无法统计其中 blob 索引产生的垃圾
+    result.min_blob_size = 0;
+  }
   return result;
 }
 
@@ -117,7 +189,8 @@ static int TableCacheSize(const Options& santized_options) {
   return santized_options.max_open_files - kNumNonTableCacheFiles;
 }
 
-DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
+DBImpl::DBImpl(const Options& raw_options, const std::string& dbname,
+               bool bulk_load)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
@@ -135,20 +208,55 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       has_imm_(false),
       logfile_(nullptr),
       logfile_number_(0),
+      log_(nullptr),
       seed_(0),
+      bulk_load_(bulk_load),
+      mem_has_unlogged_writes_(false),
+      imm_has_unlogged_writes_(false),
+      mem_charged_(0),
+      imm_charged_(0),
+      group_commit_waiting_(false),
+      sync_micros_(0),
+      last_sync_group_size_(0),
       tmp_batch_(new WriteBatch()),
       background_compaction_scheduled_(false),
       manual_compaction_(nullptr),
+      bg_compaction_paused_(0),
+      obsolete_files_deletion_paused_(0),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)) {
+  if (options_.write_buffer_manager != nullptr) {
+    options_.write_buffer_manager->RegisterDB();
+  }
+}
 
 DBImpl::~DBImpl() {
-  // 等待后台进程结束
+  // 没有写入日志的数据在重新打开后无法恢复，先将其刷到磁盘
   mutex_.Lock();
+  if (mem_has_unlogged_writes_ && bg_error_.ok()) {
+    mutex_.Unlock();
+    Status s = TEST_CompactMemTable();
+    if (!s.ok()) {
+      Log(options_.info_log, "Flushing unlogged writes failed: %s",
+          s.ToString().c_str());
+    }
+    mutex_.Lock();
+  }
+  // imm_ 中的未记日志数据由后台线程刷写，必须在 shutting_down_ 之前等它完成
+  while (imm_has_unlogged_writes_ && imm_ != nullptr && bg_error_.ok()) {
+    background_work_finished_signal_.Wait();
+  }
+
+  // 等待后台进程结束
   shutting_down_.store(true, std::memory_order_release);
   while (background_compaction_scheduled_) {
     background_work_finished_signal_.Wait();
   }
+  if (options_.write_buffer_manager != nullptr) {
+    options_.write_buffer_manager->ScheduleFreeMem(mem_charged_);
+    options_.write_buffer_manager->FreeMem(mem_charged_ + imm_charged_);
+    options_.write_buffer_manager->UnregisterDB();
+  }
   mutex_.Unlock();
 
   if (db_lock_ != nullptr) {
@@ -225,6 +333,10 @@ void DBImpl::RemoveObsoleteFiles() {
     // 在发生后台错误后，我们不知道是否可能已经提交了新版本，因此我们无法安全地进行垃圾回收。
     return;
   }
+  if (obsolete_files_deletion_paused_ > 0) {
+    // 正在创建检查点，稍后再删除
+    return;
+  }
 
   std::set<uint64_t> live = pending_outputs_;
   versions_->AddLiveFiles(&live);
@@ -248,11 +360,14 @@ void DBImpl::RemoveObsoleteFiles() {
           keep = (number >= versions_->ManifestFileNumber());
           break;
         case kTableFile:
+        case kBlobFile:
           keep = (live.find(number) != live.end());
+          break;
         case kTempFile:
           // 任何当前正在写入的临时文件都必须记录在 pending_outputs_
           // 中，并插入到 "live" 中。
           keep = (live.find(number) != live.end());
+          break;
         case kCurrentFile:
         case kDBLockFile:
         case kInfoLogFile:
@@ -261,7 +376,7 @@ void DBImpl::RemoveObsoleteFiles() {
       }
       if (!keep) {
         files_to_delete.push_back(std::move(filename));
-        if (type == kTableFile) {
+        if (type == kTableFile || type == kBlobFile) {
           table_cache_->Evict(number);
         }
         Log(options_.info_log, "Delete type=%d #%lld\n", static_cast<int>(type),
@@ -278,6 +393,177 @@ void DBImpl::RemoveObsoleteFiles() {
   mutex_.Lock();
 }
 
+namespace {
+
+struct LogReporter : public log::Reader::Reporter {
+  Env* env;
+  Logger* info_log;
+  const char* fname;
+  Status* status;
+  void Corruption(size_t bytes, const Status& s) override {
+    Log(info_log, "%s%s: dropping %d bytes; %s",
+        (this->status == nullptr ? "(ignoring error) " : ""), fname,
+        static_cast<int>(bytes), s.ToString().c_str());
+    if (this->status != nullptr && this->status->ok()) {
+      *this->status = s;
+    }
+  }
+};
+
+// 恢复时的日志预读：读取线程解析日志块并校验 CRC，按原顺序将记录分批
+// 交给重放线程，使读取与插入 memtable 重叠进行。
+class LogReadAhead {
+ public:
+  // reporter 报告的错误写入 *status，之后停止读取
+  LogReadAhead(log::Reader* reader, LogReporter* reporter, Status* status)
+      : reader_(reader),
+        reporter_(reporter),
+        status_(status),
+        cv_(&mu_),
+        stop_(false),
+        done_(false) {}
+
+  LogReadAhead(const LogReadAhead&) = delete;
+  LogReadAhead& operator=(const LogReadAhead&) = delete;
+
+  void Start(Env* env) { env->StartThread(&LogReadAhead::ReadWork, this); }
+
+  // 取出下一批记录。所有记录都已取出时返回 false。
+  bool Next(std::vector<std::string>* records) {
+    MutexLock l(&mu_);
+    while (batches_.empty() && !done_) {
+      cv_.Wait();
+    }
+    if (batches_.empty()) {
+      return false;
+    }
+    records->swap(batches_.front());
+    batches_.pop_front();
+    cv_.SignalAll();
+    return true;
+  }
+
+  // 停止读取并等待读取线程退出。销毁前必须调用。
+  void Stop() {
+    MutexLock l(&mu_);
+    stop_ = true;
+    cv_.SignalAll();
+    while (!done_) {
+      cv_.Wait();
+    }
+  }
+
+ private:
+  // 每批记录的大小与最多缓存的批数
+  static const size_t kBatchBytes = 1 << 20;
+  static const size_t kMaxBatches = 4;
+
+  static void ReadWork(void* arg) {
+    reinterpret_cast<LogReadAhead*>(arg)->Read();
+  }
+
+  void Read() {
+    std::string scratch;
+    Slice record;
+    std::vector<std::string> batch;
+    size_t batch_bytes = 0;
+    bool stop = false;
+    while (!stop && reader_->ReadRecord(&record, &scratch) && status_->ok()) {
+      if (record.size() < 12) {
+        reporter_->Corruption(record.size(),
+                              Status::Corruption("log record too small"));
+        continue;
+      }
+      batch.push_back(record.ToString());
+      batch_bytes += record.size();
+      if (batch_bytes >= kBatchBytes) {
+        stop = !Push(&batch);
+        batch_bytes = 0;
+      }
+    }
+    if (!stop && !batch.empty()) {
+      Push(&batch);
+    }
+    MutexLock l(&mu_);
+    done_ = true;
+    cv_.SignalAll();
+  }
+
+  // 队列已满时等待。已停止时丢弃 *batch 并返回 false。
+  bool Push(std::vector<std::string>* batch) {
+    MutexLock l(&mu_);
+    while (batches_.size() >= kMaxBatches && !stop_) {
+      cv_.Wait();
+    }
+    if (stop_) {
+      return false;
+    }
+    batches_.emplace_back();
+    batches_.back().swap(*batch);
+    cv_.SignalAll();
+    return true;
+  }
+
+  log::Reader* const reader_;
+  LogReporter* const reporter_;
+  // 读取线程运行期间只由读取线程访问
+  Status* const status_;
+
+  port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  std::deque<std::vector<std::string>> batches_ GUARDED_BY(mu_);
+  bool stop_ GUARDED_BY(mu_);
+  bool done_ GUARDED_BY(mu_);
+};
+
+}  // namespace
+
+namespace {
+
+struct TablePrefetch {
+  TableCache* table_cache;
+  Logger* info_log;
+  std::vector<std::pair<uint64_t, uint64_t>> files;  // 文件编号与大小
+};
+
+void PrefetchTableWork(void* arg, size_t i) {
+  TablePrefetch* prefetch = reinterpret_cast<TablePrefetch*>(arg);
+  const uint64_t number = prefetch->files[i].first;
+  Status s = prefetch->table_cache->Prefetch(number, prefetch->files[i].second);
+  if (!s.ok()) {
+    // 读取该文件时会再次报告错误
+    Log(prefetch->info_log, "Prefetch table #%llu: %s",
+        (unsigned long long)number, s.ToString().c_str());
+  }
+}
+
+}  // namespace
+
+void DBImpl::PrefetchTables() {
+  const uint64_t start_micros = env_->NowMicros();
+  TablePrefetch prefetch;
+  prefetch.table_cache = table_cache_;
+  prefetch.info_log = options_.info_log;
+  // 低层的文件更新、被读取得更频繁，优先打开
+  const size_t capacity = TableCacheSize(options_);
+  {
+    MutexLock l(&mutex_);
+    Version* current = versions_->current();
+    for (int level = 0; level < config::kNumLevels; level++) {
+      for (FileMetaData* f : current->files(level)) {
+        if (prefetch.files.size() < capacity) {
+          prefetch.files.emplace_back(f->number, f->file_size);
+        }
+      }
+    }
+  }
+  ParallelFor(env_, prefetch.files.size(), options_.max_file_opening_threads,
+              &PrefetchTableWork, &prefetch);
+  Log(options_.info_log, "Prefetched %d tables in %llu micros",
+      static_cast<int>(prefetch.files.size()),
+      static_cast<unsigned long long>(env_->NowMicros() - start_micros));
+}
+
 Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   mutex_.AssertHeld();
   // 忽略 CreateDir 的错误，因为只有在创建描述符时才会提交数据库的创建，
@@ -349,17 +635,28 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   }
 
   std::sort(logs.begin(), logs.end());
+  std::vector<LogRecovery> recovered(logs.size());
   for (size_t i = 0; i < logs.size(); i++) {
-    // 按日志生成的顺序进行恢复
-    s = RecoverLogFile(logs[i], (i == logs.size() - 1), save_manifest, edit,
-                       &max_sequence);
-    if (!s.ok()) {
-      return s;
-    }
+    recovered[i].db = this;
+    recovered[i].number = logs[i];
+    recovered[i].last_log = (i == logs.size() - 1);
     // 之前的实例在分配此日志编号后可能没有写入任何 MANIFEST 记录。
-    // 因此，我们手动更新 VersionSet 中的文件编号分配计数器。
+    // 因此，我们手动更新 VersionSet 中的文件编号分配计数器，
+    // 避免重放时写出的表与日志编号冲突。
     versions_->MarkFileNumberUsed(logs[i]);
   }
+
+  // 各日志的序列号区间互不相交，可以分别重放到独立的 memtable 中，
+  // 再按日志生成的顺序安装结果。数据库尚未返回给调用者，释放 mutex_
+  // 不会有其他线程访问。
+  mutex_.Unlock();
+  ParallelFor(env_, recovered.size(), kMaxRecoveryThreads,
+              &DBImpl::RecoverLogFileWork, &recovered);
+  mutex_.Lock();
+  s = InstallRecoveredLogs(&recovered, save_manifest, edit, &max_sequence);
+  if (!s.ok()) {
+    return s;
+  }
   if (versions_->LastSequence() < max_sequence) {
     versions_->SetLastSequence(max_sequence);
   }
@@ -367,32 +664,19 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   return Status::OK();
 }
 
-Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
-                              bool* save_manifest, VersionEdit* edit,
-                              SequenceNumber* max_sequence) {
-  struct LogReporter : public log::Reader::Reporter {
-    Env* env;
-    Logger* info_log;
-    const char* fname;
-    Status* status;
-    void Corruption(size_t bytes, const Status& s) override {
-      Log(info_log, "%s%s: dropping %d bytes; %s",
-          (this->status == nullptr ? "(ignoring error) " : ""), fname,
-          static_cast<int>(bytes), s.ToString().c_str());
-      if (this->status != nullptr && this->status->ok()) {
-        *this->status = s;
-      }
-    }
-  };
-
-  mutex_.AssertHeld();
+void DBImpl::RecoverLogFileWork(void* arg, size_t i) {
+  LogRecovery* log = &(*reinterpret_cast<std::vector<LogRecovery>*>(arg))[i];
+  log->db->RecoverLogFile(log);
+}
 
-  std::string fname = LogFileName(dbname_, log_number);
+void DBImpl::RecoverLogFile(LogRecovery* log) {
+  std::string fname = LogFileName(dbname_, log->number);
   SequentialFile* file;
   Status status = env_->NewSequentialFile(fname, &file);
   if (!status.ok()) {
     MaybeIgnordError(&status);
-    return status;
+    log->status = status;
+    return;
   }
 
   // 创建读取器
@@ -400,123 +684,240 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   reporter.env = env_;
   reporter.info_log = options_.info_log;
   reporter.fname = fname.c_str();
-  reporter.status = options_.paranoid_checks ? &status : nullptr;
+  Status read_status;
+  reporter.status = options_.paranoid_checks ? &read_status : nullptr;
   // 即使 paranoid_checks==false，我们也故意让 log::Reader 进行校验和，
   // 以便在出现损坏时跳过整个提交，而不是传播错误信息（例如过大的序列号）。
   log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/);
   Log(options_.info_log, "Recovering log #%llu",
-      (unsigned long long)log_number);
+      (unsigned long long)log->number);
 
-  // 读取记录 添加至memtable
-  std::string scratch;
-  Slice record;
+  // 读取线程解析并校验记录，本线程按顺序将其添加至 memtable
+  LogReadAhead read_ahead(&reader, &reporter, &read_status);
+  read_ahead.Start(env_);
+  std::vector<std::string> records;
   WriteBatch batch;
-  int compactions = 0;
   MemTable* mem = nullptr;
-  while (reader.ReadRecord(&record, &scratch) && status.ok()) {
-    if (record.size() < 12) {
-      reporter.Corruption(record.size(),
-                          Status::Corruption("log record too small"));
-      continue;
+  while (status.ok() && read_ahead.Next(&records)) {
+    for (size_t i = 0; i < records.size(); i++) {
+      WriteBatchInternal::SetContents(&batch, records[i]);
+      if (mem == nullptr) {
+        mem = new MemTable(internal_comparator_, options_);
+        mem->Ref();
+      }
+      status = WriteBatchInternal::InsertInto(&batch, mem);
+      MaybeIgnordError(&status);
+      if (!status.ok()) {
+        break;
+      }
+      const SequenceNumber last_seq = WriteBatchInternal::Sequence(&batch) +
+                                      WriteBatchInternal::Count(&batch) - 1;
+      if (last_seq > log->max_sequence) {
+        log->max_sequence = last_seq;
+      }
+      if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
+        status = WriteRecoveredTable(mem, log);
+        mem->Unref();
+        mem = nullptr;
+        if (!status.ok()) {
+          // 立即反映错误，以便在文件系统已满等情况下使 DB::Open() 失败。
+          break;
+        }
+      }
     }
-    WriteBatchInternal::SetContents(&batch, record);
+  }
+  read_ahead.Stop();
+  delete file;
+  if (status.ok()) {
+    status = read_status;
+  }
+
+  // 是否继续重用最后一个日志文件由 InstallRecoveredLogs() 决定
+  if (status.ok() && options_.reuse_logs && log->last_log &&
+      log->tables.empty()) {
     if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
+      mem = new MemTable(internal_comparator_, options_);
       mem->Ref();
     }
-    status = WriteBatchInternal::InsertInto(&batch, mem);
-    MaybeIgnordError(&status);
-    if (!status.ok()) {
-      break;
+    log->mem = mem;
+    mem = nullptr;
+  }
+
+  if (mem != nullptr) {
+    if (status.ok()) {
+      status = WriteRecoveredTable(mem, log);
+    }
+    mem->Unref();
+  }
+  log->status = status;
+}
+
+Status DBImpl::WriteRecoveredTable(MemTable* mem, LogRecovery* log) {
+  MutexLock l(&mutex_);
+  const uint64_t start_micros = env_->NowMicros();
+  FileMetaData meta;
+  BlobFileMetaData blob;
+  Status s = BuildLevel0Table(mem, &meta, &blob);
+  if (s.ok() && meta.file_size > 0) {
+    meta.creation_time = env_->NowMicros() / 1000000;
+    log->tables.push_back(meta);
+    log->blobs.push_back(blob);
+  }
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros;
+  stats.bytes_written = meta.file_size + blob.total_bytes;
+  stats_[0].Add(stats);
+  return s;
+}
+
+Status DBImpl::InstallRecoveredLogs(std::vector<LogRecovery>* logs,
+                                    bool* save_manifest, VersionEdit* edit,
+                                    SequenceNumber* max_sequence) {
+  mutex_.AssertHeld();
+  Status s;
+  for (size_t i = 0; i < logs->size() && s.ok(); i++) {
+    s = (*logs)[i].status;
+  }
+
+  // level-0 中的文件按编号决定新旧，而各日志的表是并发分配编号的。
+  // 若编号不是按日志顺序递增的，则按顺序重新分配编号并重命名表文件。
+  // blob 文件只通过编号被引用，不需要有序。
+  std::vector<FileMetaData*> tables;
+  for (size_t i = 0; i < logs->size(); i++) {
+    for (size_t j = 0; j < (*logs)[i].tables.size(); j++) {
+      tables.push_back(&(*logs)[i].tables[j]);
     }
-    const SequenceNumber last_seq = WriteBatchInternal::Sequence(&batch) +
-                                    WriteBatchInternal::Count(&batch) - 1;
-    if (last_seq > *max_sequence) {
-      *max_sequence = last_seq;
+  }
+  bool ordered = true;
+  for (size_t i = 1; i < tables.size(); i++) {
+    if (tables[i - 1]->number > tables[i]->number) {
+      ordered = false;
     }
-    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
-      compactions++;
+  }
+  for (size_t i = 0; s.ok() && !ordered && i < tables.size(); i++) {
+    const uint64_t number = versions_->NewFileNumber();
+    s = env_->RenameFile(TableFileName(dbname_, tables[i]->number),
+                         TableFileName(dbname_, number));
+    if (s.ok()) {
+      table_cache_->Evict(tables[i]->number);
+      tables[i]->number = number;
+    }
+  }
+
+  for (size_t i = 0; s.ok() && i < logs->size(); i++) {
+    const LogRecovery& log = (*logs)[i];
+    for (size_t j = 0; j < log.tables.size(); j++) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
-      mem->Unref();
-      mem = nullptr;
-      if (!status.ok()) {
-        // 立即反映错误，以便在文件系统已满等情况下使 DB::Open() 失败。
-        break;
+      edit->AddFile(0, log.tables[j]);
+      const BlobFileMetaData& blob = log.blobs[j];
+      if (blob.total_count > 0) {
+        edit->AddBlobFile(blob.number, blob.total_count, blob.total_bytes);
       }
     }
+    if (log.max_sequence > *max_sequence) {
+      *max_sequence = log.max_sequence;
+    }
   }
 
-  delete file;
-
   // 查看是否应该继续重用最后一个日志文件。
-  if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
+  MemTable* mem = logs->empty() ? nullptr : logs->back().mem;
+  if (mem != nullptr && s.ok()) {
     assert(logfile_ == nullptr);
     assert(log_ == nullptr);
     assert(mem_ == nullptr);
+    const std::string fname = LogFileName(dbname_, logs->back().number);
     uint64_t lfile_size;
     if (env_->GetFileSize(fname, &lfile_size).ok() &&
         env_->NewAppendableFile(fname, &logfile_).ok()) {
       Log(options_.info_log, "Reusing old log %s \n", fname.c_str());
       log_ = new log::Writer(logfile_, lfile_size);
-      logfile_number_ = log_number;
-      if (mem != nullptr) {
-        mem_ = mem;
-        mem = nullptr;
-      } else {
-        mem_ = new MemTable(internal_comparator_);
-        mem_->Ref();
-      }
+      logfile_number_ = logs->back().number;
+      mem_ = mem;
+      mem = nullptr;
+    } else {
+      *save_manifest = true;
+      s = WriteLevel0Table(mem, edit, nullptr);
     }
   }
-
   if (mem != nullptr) {
-    if (status.ok()) {
-      *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
-    }
     mem->Unref();
   }
-  return status;
+  return s;
 }
 
-Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+Status DBImpl::BuildLevel0Table(MemTable* mem, FileMetaData* meta,
+                                BlobFileMetaData* blob) {
   mutex_.AssertHeld();
-  const uint64_t start_micros = env_->NowMicros();
-  FileMetaData meta;
-  meta.number = versions_->NewFileNumber();
-  pending_outputs_.insert(meta.number);
-  Iterator* iter = mem->NewIterator();
+  meta->number = versions_->NewFileNumber();
+  pending_outputs_.insert(meta->number);
+  // 启用键值分离时，大 value 写入与表文件同时生成的 blob 文件
+  const bool separate_blobs = options_.min_blob_size > 0;
+  if (separate_blobs) {
+    blob->number = versions_->NewFileNumber();
+    pending_outputs_.insert(blob->number);
+  }
+  // 落盘之后 mem 不再被写入
+  mem->MarkImmutable();
   Log(options_.info_log, "Level-0 table #%llu: started",
-      (unsigned long long)meta.number);
+      (unsigned long long)meta->number);
   Status s;
+  Iterator* iter;
+  Iterator* range_del_iter;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    // kVectorRep 在创建迭代器时排序，不持有锁
+    iter = mem->NewIterator();
+    range_del_iter = mem->NewRangeTombstoneIterator();
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter, range_del_iter,
+                   meta, separate_blobs ? blob : nullptr);
     mutex_.Lock();
   }
 
   Log(options_.info_log, "Level-0 table #%llu: %lld bytes %s",
-      (unsigned long long)meta.number, (unsigned long long)meta.file_size,
+      (unsigned long long)meta->number, (unsigned long long)meta->file_size,
       s.ToString().c_str());
+  if (blob->total_count > 0) {
+    Log(options_.info_log, "Level-0 blob file #%llu: %lld records %lld bytes",
+        (unsigned long long)blob->number,
+        (unsigned long long)blob->total_count,
+        (unsigned long long)blob->total_bytes);
+  }
   delete iter;
-  pending_outputs_.erase(meta.number);
+  delete range_del_iter;
+  pending_outputs_.erase(meta->number);
+  if (separate_blobs) {
+    pending_outputs_.erase(blob->number);
+  }
+  return s;
+}
+
+Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
+                                Version* base) {
+  mutex_.AssertHeld();
+  const uint64_t start_micros = env_->NowMicros();
+  FileMetaData meta;
+  BlobFileMetaData blob;
+  Status s = BuildLevel0Table(mem, &meta, &blob);
 
   // 请注意，如果 file_size 为零，则该文件已被删除，不应添加到清单中。
   int level = 0;
   if (s.ok() && meta.file_size > 0) {
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
-    if (base != nullptr) {
+    // FIFO 风格下所有文件都留在 level-0
+    if (base != nullptr &&
+        options_.compaction_style != kCompactionStyleFIFO) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
-    edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+    meta.creation_time = env_->NowMicros() / 1000000;
+    edit->AddFile(level, meta);
+    if (blob.total_count > 0) {
+      edit->AddBlobFile(blob.number, blob.total_count, blob.total_bytes);
+    }
   }
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
-  stats.bytes_written = meta.file_size;
+  stats.bytes_written = meta.file_size + blob.total_bytes;
   stats_[level].Add(stats);
   return s;
 }
@@ -544,7 +945,12 @@ void DBImpl::CompactMemTable() {
   if (s.ok()) {
     imm_->Unref();
     imm_ = nullptr;
+    imm_has_unlogged_writes_ = false;
     has_imm_.store(false, std::memory_order_release);
+    if (options_.write_buffer_manager != nullptr) {
+      options_.write_buffer_manager->FreeMem(imm_charged_);
+      imm_charged_ = 0;
+    }
 
     RemoveObsoleteFiles();
   } else {
@@ -564,68 +970,613 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
     }
   }
   TEST_CompactMemTable();
+  if (options_.compaction_style == kCompactionStyleFIFO) {
+    // FIFO 风格从不合并文件
+    return;
+  }
   for (int level = 0; level < max_level_with_files; level++) {
     TEST_CompactRange(level, begin, end);
   }
 }
 
-void DBImpl::TEST_CompactRange(int level, const Slice* begin,
-                               const Slice* end) {
-  assert(level >= 0);
-  assert(level + 1 < config::kNumLevels);
-
-  InternalKey begin_storage, end_storage;
+void DBImpl::TEST_CompactRange(int level, const Slice* begin,
+                               const Slice* end) {
+  assert(level >= 0);
+  assert(level + 1 < config::kNumLevels);
+
+  InternalKey begin_storage, end_storage;
+
+  ManualCompaction manual;
+  manual.level = level;
+  manual.done = false;
+  if (begin == nullptr) {
+    manual.begin = nullptr;
+  } else {
+    begin_storage = InternalKey(*begin, kMaxSequenceNumber, kValueTypeForSeek);
+    manual.begin = &begin_storage;
+  }
+  if (end == nullptr) {
+    manual.end = nullptr;
+  } else {
+    end_storage = InternalKey(*end, 0, static_cast<ValueType>(0));
+    manual.end = &end_storage;
+  }
+
+  MutexLock l(&mutex_);
+  while (!manual.done && !shutting_down_.load(std::memory_order_acquire) &&
+         bg_error_.ok()) {
+    if (manual_compaction_ == nullptr) {  // Idle
+      manual_compaction_ = &manual;
+      MaybeScheduleCompaction();
+    } else {  // Running either my compaction or another compaction.
+      background_work_finished_signal_.Wait();
+    }
+  }
+  // Finish current background compaction in the case where
+  // `background_work_finished_signal_` was signalled due to an error.
+  while (background_compaction_scheduled_) {
+    background_work_finished_signal_.Wait();
+  }
+  if (manual_compaction_ == &manual) {
+    // Cancel my manual compaction since we aborted early for some reason.
+    manual_compaction_ = nullptr;
+  }
+}
+
+Status DBImpl::TEST_CompactMemTable() {
+  // nullptr batch means just wait for earlier writes to be done
+  Status s = Write(WriteOptions(), nullptr);
+  if (s.ok()) {
+    // Wait until the compaction completes
+    MutexLock l(&mutex_);
+    while (imm_ != nullptr && bg_error_.ok()) {
+      background_work_finished_signal_.Wait();
+    }
+    if (imm_ != nullptr) {
+      s = bg_error_;
+    }
+  }
+  return s;
+}
+
+struct DBImpl::ExternalFile {
+  std::string path;
+  std::string smallest;  // 用户键
+  std::string largest;   // 用户键
+  uint64_t file_size;
+  FileMetaData meta;      // 转换生成的表
+  BlobFileMetaData blob;  // 键值分离时转换生成的 blob 文件
+};
+
+namespace {
+// 将外部表中的用户键转换为带有统一序列号的内部键
+class IngestedKeyIterator : public Iterator {
+ public:
+  IngestedKeyIterator(Iterator* iter, SequenceNumber sequence)
+      : iter_(iter), sequence_(sequence) {}
+  ~IngestedKeyIterator() override { delete iter_; }
+
+  bool Valid() const override { return iter_->Valid(); }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    Update();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    Update();
+  }
+  void Seek(const Slice& target) override {
+    iter_->Seek(ExtractUserKey(target));
+    Update();
+  }
+  void Next() override {
+    iter_->Next();
+    Update();
+  }
+  void Prev() override {
+    iter_->Prev();
+    Update();
+  }
+  Slice key() const override { return key_.Encode(); }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  void Update() {
+    if (iter_->Valid()) {
+      key_.SetFrom(ParsedInternalKey(iter_->key(), sequence_, kTypeValue));
+    }
+  }
+
+  Iterator* const iter_;
+  const SequenceNumber sequence_;
+  InternalKey key_;
+};
+
+// 如果 memtable 中有落在 [smallest, largest] 内的条目则返回 true
+bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                      const Slice& smallest, const Slice& largest) {
+  Iterator* iter = mem->NewIterator();
+  InternalKey start(smallest, kMaxSequenceNumber, kValueTypeForSeek);
+  iter->Seek(start.Encode());
+  const bool overlaps =
+      iter->Valid() && ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0;
+  delete iter;
+  return overlaps;
+}
+}  // anonymous namespace
+
+Status DBImpl::IngestExternalFile(const std::vector<std::string>& files) {
+  if (files.empty()) {
+    return Status::OK();
+  }
+
+  // 在不持有锁的情况下校验每个文件并记录其键范围
+  const Comparator* ucmp = user_comparator();
+  Options table_options = options_;
+  table_options.comparator = ucmp;
+  table_options.filter_policy = nullptr;
+  table_options.block_cache = nullptr;
+  std::vector<ExternalFile> inputs(files.size());
+  Status s;
+  for (size_t i = 0; i < files.size() && s.ok(); i++) {
+    ExternalFile* f = &inputs[i];
+    f->path = files[i];
+    s = env_->GetFileSize(f->path, &f->file_size);
+    RandomAccessFile* file = nullptr;
+    if (s.ok()) {
+      s = env_->NewRandomAccessFile(f->path, &file);
+    }
+    Table* table = nullptr;
+    if (s.ok()) {
+      s = Table::Open(table_options, file, f->file_size, &table);
+    }
+    if (s.ok()) {
+      Iterator* iter = table->NewIterator(ReadOptions());
+      uint64_t count = 0;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        if (count > 0 && ucmp->Compare(f->largest, iter->key()) >= 0) {
+          s = Status::InvalidArgument(f->path, "keys are not strictly increasing");
+          break;
+        }
+        if (count == 0) {
+          f->smallest = iter->key().ToString();
+        }
+        f->largest = iter->key().ToString();
+        count++;
+      }
+      if (s.ok()) {
+        s = iter->status();
+      }
+      if (s.ok() && count == 0) {
+        s = Status::InvalidArgument(f->path, "empty table");
+      }
+      delete iter;
+    }
+    delete table;
+    delete file;
+    if (!s.ok() && !s.IsInvalidArgument()) {
+      s = Status::InvalidArgument(f->path, s.ToString());
+    }
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  std::sort(inputs.begin(), inputs.end(),
+            [ucmp](const ExternalFile& a, const ExternalFile& b) {
+              return ucmp->Compare(a.smallest, b.smallest) < 0;
+            });
+  for (size_t i = 1; i < inputs.size(); i++) {
+    if (ucmp->Compare(inputs[i - 1].largest, inputs[i].smallest) >= 0) {
+      return Status::InvalidArgument(inputs[i].path,
+                                     "key range overlaps with another file");
+    }
+  }
+
+  Writer w(&mutex_);
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+  // 在写入队列头部刷写重叠的 memtable 并预留序列号，之后的写入都比导入的
+  // 数据新，转换文件期间不再阻塞写入
+  SequenceNumber sequence = 0;
+  s = ReserveIngestion(&inputs, &sequence);
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  if (s.ok()) {
+    mutex_.Unlock();
+    s = ConvertExternalFiles(&inputs, sequence);
+    mutex_.Lock();
+  }
+
+  if (s.ok()) {
+    // 只在选择层级与安装时占据写入队列并暂停后台压缩
+    writers_.push_back(&w);
+    while (&w != writers_.front()) {
+      w.cv.Wait();
+    }
+    bg_compaction_paused_++;
+    while (background_compaction_scheduled_) {
+      background_work_finished_signal_.Wait();
+    }
+    if (ExternalFilesConflict(inputs, sequence)) {
+      // 少见的情况：在队列中用新的序列号重新转换，刷写 memtable 需要后台线程
+      Log(options_.info_log, "Ingest conflicts with writes at #%llu, retrying",
+          (unsigned long long)sequence);
+      ReleaseIngestion(inputs);
+      bg_compaction_paused_--;
+      s = ReserveIngestion(&inputs, &sequence);
+      bg_compaction_paused_++;
+      while (background_compaction_scheduled_) {
+        background_work_finished_signal_.Wait();
+      }
+      if (s.ok()) {
+        mutex_.Unlock();
+        s = ConvertExternalFiles(&inputs, sequence);
+        mutex_.Lock();
+      }
+    }
+    if (s.ok()) {
+      s = InstallExternalFiles(inputs);
+    }
+    bg_compaction_paused_--;
+    MaybeScheduleCompaction();
+    background_work_finished_signal_.SignalAll();
+    writers_.pop_front();
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+  }
+
+  ReleaseIngestion(inputs);
+  if (!s.ok()) {
+    // 删除已经生成但没有安装的文件
+    RemoveObsoleteFiles();
+  }
+  return s;
+}
+
+Status DBImpl::ReserveIngestion(std::vector<ExternalFile>* files,
+                                SequenceNumber* sequence) {
+  mutex_.AssertHeld();
+  // memtable 中与导入范围重叠的旧数据会遮盖导入的数据，先将其刷到磁盘
+  const Comparator* ucmp = user_comparator();
+  bool overlaps = false;
+  for (size_t i = 0; i < files->size() && !overlaps; i++) {
+    const ExternalFile& f = (*files)[i];
+    overlaps = MemTableOverlaps(mem_, ucmp, f.smallest, f.largest) ||
+               (imm_ != nullptr &&
+                MemTableOverlaps(imm_, ucmp, f.smallest, f.largest));
+  }
+  Status s;
+  if (overlaps) {
+    s = MakeRoomForWrite(true /* force */);
+    while (s.ok() && imm_ != nullptr && bg_error_.ok()) {
+      background_work_finished_signal_.Wait();
+    }
+    if (s.ok()) {
+      s = bg_error_;
+    }
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  *sequence = versions_->LastSequence() + 1;
+  versions_->SetLastSequence(*sequence);
+  // 文件编号也在此时分配，放在 level-0 时排在之后刷写的文件之前
+  for (ExternalFile& f : *files) {
+    f.meta = FileMetaData();
+    f.meta.number = versions_->NewFileNumber();
+    pending_outputs_.insert(f.meta.number);
+    f.blob = BlobFileMetaData();
+    if (options_.min_blob_size > 0) {
+      f.blob.number = versions_->NewFileNumber();
+      pending_outputs_.insert(f.blob.number);
+    }
+  }
+  return s;
+}
+
+void DBImpl::ReleaseIngestion(const std::vector<ExternalFile>& files) {
+  mutex_.AssertHeld();
+  for (const ExternalFile& f : files) {
+    pending_outputs_.erase(f.meta.number);
+    if (f.blob.number != 0) {
+      pending_outputs_.erase(f.blob.number);
+    }
+  }
+}
+
+Status DBImpl::ConvertExternalFiles(std::vector<ExternalFile>* files,
+                                   SequenceNumber sequence) {
+  const bool separate_blobs = options_.min_blob_size > 0;
+  Options table_options = options_;
+  table_options.comparator = user_comparator();
+  table_options.filter_policy = nullptr;
+  table_options.block_cache = nullptr;
+  Status s;
+  for (size_t i = 0; i < files->size() && s.ok(); i++) {
+    ExternalFile* f = &(*files)[i];
+    RandomAccessFile* file = nullptr;
+    Table* table = nullptr;
+    s = env_->NewRandomAccessFile(f->path, &file);
+    if (s.ok()) {
+      s = Table::Open(table_options, file, f->file_size, &table);
+    }
+    if (s.ok()) {
+      IngestedKeyIterator iter(table->NewIterator(ReadOptions()), sequence);
+      s = BuildTable(dbname_, env_, options_, table_cache_, &iter, nullptr,
+                     &f->meta, separate_blobs ? &f->blob : nullptr);
+    }
+    delete table;
+    delete file;
+    if (s.ok() && f->meta.file_size == 0) {
+      s = Status::Corruption(f->path, "converted table is empty");
+    }
+  }
+  return s;
+}
+
+bool DBImpl::ExternalFilesConflict(const std::vector<ExternalFile>& files,
+                                   SequenceNumber sequence) {
+  mutex_.AssertHeld();
+  // 预留序列号之后创建、仍未释放的快照，会在安装前后看到不同的内容
+  if (!snapshots_.empty() &&
+      snapshots_.newset()->sequence_number() >= sequence) {
+    return true;
+  }
+
+  // 之后写入同一范围、又被压缩到 level-1 及以下的数据比导入的数据新，
+  // 导入的文件无法放到这些数据之下。level-0 的文件按编号排序，不受影响
+  Version* base = versions_->current();
+  std::vector<std::pair<FileMetaData*, const ExternalFile*>> candidates;
+  std::vector<FileMetaData*> overlaps;
+  for (const ExternalFile& f : files) {
+    InternalKey begin(f.smallest, kMaxSequenceNumber, kValueTypeForSeek);
+    InternalKey end(f.largest, 0, static_cast<ValueType>(0));
+    for (int level = 1; level < config::kNumLevels; level++) {
+      base->GetOverlappingInputs(level, &begin, &end, &overlaps);
+      for (FileMetaData* g : overlaps) {
+        if (g->largest_seqno >= sequence) {
+          candidates.emplace_back(g, &f);
+        }
+      }
+    }
+  }
+  if (candidates.empty()) {
+    return false;
+  }
+
+  // 键范围重叠不代表有键落在导入的范围内，逐个检查这些文件
+  const Comparator* ucmp = user_comparator();
+  base->Ref();
+  mutex_.Unlock();
+  bool conflict = false;
+  for (size_t i = 0; i < candidates.size() && !conflict; i++) {
+    FileMetaData* g = candidates[i].first;
+    const ExternalFile* f = candidates[i].second;
+    if (g->num_range_deletions > 0) {
+      conflict = true;
+      break;
+    }
+    Iterator* iter =
+        table_cache_->NewIterator(ReadOptions(), g->number, g->file_size);
+    InternalKey start(f->smallest, kMaxSequenceNumber, kValueTypeForSeek);
+    for (iter->Seek(start.Encode()); iter->Valid(); iter->Next()) {
+      ParsedInternalKey ikey;
+      if (!ParseInternalKey(iter->key(), &ikey)) {
+        conflict = true;
+        break;
+      }
+      if (ucmp->Compare(ikey.user_key, f->largest) > 0) {
+        break;
+      }
+      if (ikey.sequence >= sequence) {
+        conflict = true;
+        break;
+      }
+    }
+    if (!iter->status().ok()) {
+      conflict = true;
+    }
+    delete iter;
+  }
+  mutex_.Lock();
+  base->Unref();
+  return conflict;
+}
+
+Status DBImpl::InstallExternalFiles(const std::vector<ExternalFile>& files) {
+  mutex_.AssertHeld();
+  const uint64_t start_micros = env_->NowMicros();
+  const bool fifo = (options_.compaction_style == kCompactionStyleFIFO);
+  Version* base = versions_->current();
+
+  VersionEdit edit;
+  for (const ExternalFile& f : files) {
+    // 选择与键范围不重叠的最深层级
+    const Slice smallest(f.smallest), largest(f.largest);
+    int level = 0;
+    if (!fifo && !base->OverlapInLevel(0, &smallest, &largest)) {
+      while (level + 1 < config::kNumLevels &&
+             !base->OverlapInLevel(level + 1, &smallest, &largest)) {
+        level++;
+      }
+    }
+
+    Log(options_.info_log, "Ingest %s: level-%d table #%llu: %lld bytes",
+        f.path.c_str(), level, (unsigned long long)f.meta.number,
+        (unsigned long long)f.meta.file_size);
+    FileMetaData meta = f.meta;
+    meta.creation_time = env_->NowMicros() / 1000000;
+    edit.AddFile(level, meta);
+    if (f.blob.total_count > 0) {
+      edit.AddBlobFile(f.blob.number, f.blob.total_count, f.blob.total_bytes);
+    }
+    CompactionStats stats;
+    stats.bytes_written = f.meta.file_size + f.blob.total_bytes;
+    stats_[level].Add(stats);
+  }
+
+  Status s = versions_->LogAndApply(&edit, &mutex_);
+  if (s.ok()) {
+    Log(options_.info_log, "Ingested %d files in %llu micros",
+        static_cast<int>(files.size()),
+        (unsigned long long)(env_->NowMicros() - start_micros));
+  }
+  return s;
+}
+
+Status DBImpl::GetLiveFiles(std::vector<LiveFile>* files) {
+  files->clear();
+  Status s;
+
+  // 占据写入队列头部并暂停后台压缩，使日志与 MANIFEST 的长度在收集期间不变
+  Writer w(&mutex_);
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  // 没有写入日志的数据只能通过刷写 memtable 保存下来
+  if (mem_has_unlogged_writes_ || imm_has_unlogged_writes_) {
+    if (mem_has_unlogged_writes_) {
+      s = MakeRoomForWrite(true /* force */);
+    }
+    while (s.ok() && imm_ != nullptr && bg_error_.ok()) {
+      background_work_finished_signal_.Wait();
+    }
+    if (s.ok()) {
+      s = bg_error_;
+    }
+  }
+
+  if (s.ok()) {
+    bg_compaction_paused_++;
+    while (background_compaction_scheduled_) {
+      background_work_finished_signal_.Wait();
+    }
+
+    std::set<uint64_t> live;
+    versions_->AddLiveFiles(&live);
+    std::vector<std::string> filenames;
+    s = env_->GetChildren(dbname_, &filenames);
+    uint64_t number;
+    FileType type;
+    for (size_t i = 0; i < filenames.size() && s.ok(); i++) {
+      if (!ParseFileName(filenames[i], &number, &type)) {
+        continue;
+      }
+      bool keep = false;
+      switch (type) {
+        case kTableFile:
+        case kBlobFile:
+          keep = (live.find(number) != live.end());
+          break;
+        case kLogFile:
+          keep = (number >= versions_->LogNumber()) ||
+                 (number == versions_->PrevLogNumber());
+          break;
+        case kDescriptorFile:
+          keep = (number == versions_->ManifestFileNumber());
+          break;
+        default:
+          break;
+      }
+      if (keep) {
+        LiveFile f;
+        f.name = filenames[i];
+        f.path = dbname_ + "/" + f.name;
+        s = env_->GetFileSize(f.path, &f.size);
+        files->push_back(f);
+      }
+    }
+    if (s.ok()) {
+      // 在调用者复制完这些文件之前不删除它们
+      obsolete_files_deletion_paused_++;
+    } else {
+      files->clear();
+    }
+
+    bg_compaction_paused_--;
+    MaybeScheduleCompaction();
+    background_work_finished_signal_.SignalAll();
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
+void DBImpl::ReleaseLiveFiles() {
+  MutexLock l(&mutex_);
+  assert(obsolete_files_deletion_paused_ > 0);
+  obsolete_files_deletion_paused_--;
+  RemoveObsoleteFiles();
+}
 
-  ManualCompaction manual;
-  manual.level = level;
-  manual.done = false;
-  if (begin == nullptr) {
-    manual.begin = nullptr;
-  } else {
-    begin_storage = InternalKey(*begin, kMaxSequenceNumber, kValueTypeForSeek);
-    manual.begin = &begin_storage;
+Status DBImpl::CreateCheckpoint(const std::string& checkpoint_dir) {
+  if (env_->FileExists(checkpoint_dir)) {
+    return Status::InvalidArgument(checkpoint_dir, "already exists");
   }
-  if (end == nullptr) {
-    manual.end = nullptr;
-  } else {
-    end_storage = InternalKey(*end, 0, static_cast<ValueType>(0));
-    manual.end = &end_storage;
+
+  std::vector<LiveFile> files;
+  Status s = GetLiveFiles(&files);
+  if (!s.ok()) {
+    return s;
   }
 
-  MutexLock l(&mutex_);
-  while (!manual.done && !shutting_down_.load(std::memory_order_acquire) &&
-         bg_error_.ok()) {
-    if (manual_compaction_ == nullptr) {  // Idle
-      manual_compaction_ = &manual;
-      MaybeScheduleCompaction();
-    } else {  // Running either my compaction or another compaction.
-      background_work_finished_signal_.Wait();
+  // 在不持有锁的情况下建立链接或复制文件。日志与 MANIFEST 只追加，
+  // 复制收集时的前缀即可得到一致的状态。
+  Log(options_.info_log, "Checkpoint %s: %d files", checkpoint_dir.c_str(),
+      static_cast<int>(files.size()));
+  s = env_->CreateDir(checkpoint_dir);
+  std::vector<std::string> created;
+  uint64_t manifest_number = 0;
+  for (size_t i = 0; i < files.size() && s.ok(); i++) {
+    const LiveFile& f = files[i];
+    const std::string& src = f.path;
+    const std::string target = checkpoint_dir + "/" + f.name;
+    uint64_t number;
+    FileType type;
+    ParseFileName(f.name, &number, &type);
+    if (type == kDescriptorFile) {
+      manifest_number = number;
+    }
+    // 不可变的表文件与 blob 文件使用硬链接
+    s = (type == kTableFile || type == kBlobFile)
+            ? env_->LinkFile(src, target)
+            : Status::NotSupported(src);
+    if (!s.ok()) {
+      // 不支持硬链接（或跨文件系统）时退化为复制
+      s = CopyFile(env_, src, target, f.size);
+    }
+    if (s.ok()) {
+      created.push_back(target);
     }
   }
-  // Finish current background compaction in the case where
-  // `background_work_finished_signal_` was signalled due to an error.
-  while (background_compaction_scheduled_) {
-    background_work_finished_signal_.Wait();
-  }
-  if (manual_compaction_ == &manual) {
-    // Cancel my manual compaction since we aborted early for some reason.
-    manual_compaction_ = nullptr;
-  }
-}
-
-Status DBImpl::TEST_CompactMemTable() {
-  // nullptr batch means just wait for earlier writes to be done
-  Status s = Write(WriteOptions(), nullptr);
   if (s.ok()) {
-    // Wait until the compaction completes
-    MutexLock l(&mutex_);
-    while (imm_ != nullptr && bg_error_.ok()) {
-      background_work_finished_signal_.Wait();
-    }
-    if (imm_ != nullptr) {
-      s = bg_error_;
+    s = SetCurrentFile(env_, checkpoint_dir, manifest_number);
+  }
+  if (!s.ok()) {
+    for (const std::string& fname : created) {
+      env_->RemoveFile(fname);
     }
+    env_->RemoveDir(checkpoint_dir);
   }
+  Log(options_.info_log, "Checkpoint %s: %s", checkpoint_dir.c_str(),
+      s.ToString().c_str());
+
+  ReleaseLiveFiles();
   return s;
 }
 
@@ -645,9 +1596,11 @@ void DBImpl::MaybeScheduleCompaction() {
     // DB is being deleted; no more background compactions
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
+  } else if (bg_compaction_paused_ > 0) {
+    // 导入外部文件期间暂停
   } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
+             (bulk_load_ || !versions_->NeedsCompaction())) {
+    // No work to be done (批量导入模式下只刷写 memtable 与执行手动压缩)
   } else {
     background_compaction_scheduled_ = true;
     env_->Schedule(&DBImpl::BGWork, this);
@@ -700,6 +1653,9 @@ void DBImpl::BackgroundCompaction() {
         m->level, (m->begin ? m->begin->DebugString().c_str() : "(begin)"),
         (m->end ? m->end->DebugString().c_str() : "(end)"),
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
+  } else if (bulk_load_) {
+    // 批量导入模式下不自动压缩
+    c = nullptr;
   } else {
     c = versions_->PickCompaction();
   }
@@ -707,13 +1663,25 @@ void DBImpl::BackgroundCompaction() {
   Status status;
   if (c == nullptr) {
     // Nothing to do
+  } else if (c->IsDeletionCompaction()) {
+    // 直接删除最旧的文件，不产生任何输出
+    c->AddInputDeletions(c->edit());
+    status = versions_->LogAndApply(c->edit(), &mutex_);
+    if (!status.ok()) {
+      RecordBackgroundError(status);
+    }
+    VersionSet::LevelSummaryStorage tmp;
+    Log(options_.info_log, "FIFO dropped %d files: %s %s\n",
+        c->num_input_files(0), status.ToString().c_str(),
+        versions_->LevelSummary(&tmp));
+    c->ReleaseInputs();
+    RemoveObsoleteFiles();
   } else if (!is_manual && c->IsTrivialMove()) {
     // Move file to next level
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
+    c->edit()->AddFile(c->level() + 1, *f);
     status = versions_->LogAndApply(c->edit(), &mutex_);
     if (!status.ok()) {
       RecordBackgroundError(status);
@@ -724,7 +1692,7 @@ void DBImpl::BackgroundCompaction() {
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
   } else {
-    CompactionState* compact = new CompactionState(c);
+    CompactionState* compact = new CompactionState(c, &internal_comparator_);
     status = DoCompactionWork(compact);
     if (!status.ok()) {
       RecordBackgroundError(status);
@@ -772,6 +1740,11 @@ void DBImpl::CleanupCompaction(CompactionState* compact) {
     const CompactionState::Output& out = compact->outputs[i];
     pending_outputs_.erase(out.number);
   }
+  delete compact->blob_builder;
+  delete compact->blob_outfile;
+  for (const BlobFileMetaData& b : compact->blob_outputs) {
+    pending_outputs_.erase(b.number);
+  }
   delete compact;
 }
 
@@ -787,6 +1760,10 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.num_entries = 0;
+    out.num_deletions = 0;
+    out.num_range_deletions = 0;
+    out.largest_seqno = 0;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -801,17 +1778,42 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
 }
 
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input, const Slice* upper) {
   assert(compact != nullptr);
   assert(compact->outfile != nullptr);
   assert(compact->builder != nullptr);
 
-  const uint64_t output_number = compact->current_output()->number;
+  CompactionState::Output* out = compact->current_output();
+  const uint64_t output_number = out->number;
   assert(output_number != 0);
 
   // Check for iterator errors
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
+  if (s.ok() && !compact->output_range_dels.empty()) {
+    Slice lower_storage(compact->output_lower_bound);
+    const Slice* lower =
+        compact->has_output_lower_bound ? &lower_storage : nullptr;
+    InternalKey smallest, largest;
+    SequenceNumber largest_seqno;
+    const int n = compact->output_range_dels.AddToTable(
+        compact->builder, lower, upper, &smallest, &largest, &largest_seqno);
+    if (n > 0) {
+      const InternalKeyComparator* icmp = &internal_comparator_;
+      if (current_entries == 0 || icmp->Compare(smallest, out->smallest) < 0) {
+        out->smallest = smallest;
+      }
+      if (current_entries == 0 || icmp->Compare(largest, out->largest) > 0) {
+        out->largest = largest;
+      }
+      out->num_range_deletions = n;
+      out->largest_seqno = std::max(out->largest_seqno, largest_seqno);
+    }
+  }
+  if (upper != nullptr) {
+    compact->output_lower_bound.assign(upper->data(), upper->size());
+    compact->has_output_lower_bound = true;
+  }
   if (s.ok()) {
     s = compact->builder->Finish();
   } else {
@@ -849,6 +1851,57 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   return s;
 }
 
+Status DBImpl::AddCompactionBlob(CompactionState* compact,
+                                 const Slice& user_key, const Slice& value,
+                                 std::string* blob_index) {
+  if (compact->blob_builder == nullptr) {
+    uint64_t file_number;
+    {
+      mutex_.Lock();
+      file_number = versions_->NewFileNumber();
+      pending_outputs_.insert(file_number);
+      BlobFileMetaData b;
+      b.number = file_number;
+      compact->blob_outputs.push_back(b);
+      mutex_.Unlock();
+    }
+    Status s = env_->NewWritableFile(BlobFileName(dbname_, file_number),
+                                     &compact->blob_outfile);
+    if (!s.ok()) {
+      return s;
+    }
+    compact->blob_builder =
+        new BlobFileBuilder(compact->blob_outfile, file_number);
+  }
+  Status s = compact->blob_builder->Add(user_key, value, blob_index);
+  if (s.ok() && compact->blob_builder->FileSize() >=
+                    compact->compaction->MaxOutputFileSize()) {
+    s = FinishCompactionBlobFile(compact);
+  }
+  return s;
+}
+
+Status DBImpl::FinishCompactionBlobFile(CompactionState* compact) {
+  assert(compact->blob_builder != nullptr);
+  Status s = compact->blob_builder->Finish();
+  if (s.ok()) {
+    s = compact->blob_outfile->Close();
+  }
+  BlobFileMetaData* out = &compact->blob_outputs.back();
+  out->total_count = compact->blob_builder->NumEntries();
+  out->total_bytes = compact->blob_builder->FileSize();
+  delete compact->blob_builder;
+  compact->blob_builder = nullptr;
+  delete compact->blob_outfile;
+  compact->blob_outfile = nullptr;
+  if (s.ok()) {
+    Log(options_.info_log, "Generated blob file #%llu: %lld records, %lld bytes",
+        (unsigned long long)out->number, (unsigned long long)out->total_count,
+        (unsigned long long)out->total_bytes);
+  }
+  return s;
+}
+
 Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
   Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
@@ -859,10 +1912,30 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
   const int level = compact->compaction->level();
+  const uint64_t now = env_->NowMicros() / 1000000;
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+    FileMetaData f;
+    f.number = out.number;
+    f.file_size = out.file_size;
+    f.smallest = out.smallest;
+    f.largest = out.largest;
+    f.creation_time = now;
+    f.num_entries = out.num_entries;
+    f.num_deletions = out.num_deletions;
+    f.num_range_deletions = out.num_range_deletions;
+    f.largest_seqno = out.largest_seqno;
+    compact->compaction->edit()->AddFile(level + 1, f);
+  }
+  for (const BlobFileMetaData& b : compact->blob_outputs) {
+    if (b.total_count > 0) {
+      compact->compaction->edit()->AddBlobFile(b.number, b.total_count,
+                                               b.total_bytes);
+    }
+  }
+  for (const auto& kvp : compact->blob_garbage) {
+    compact->compaction->edit()->AddBlobGarbage(
+        kvp.first, kvp.second.garbage_count, kvp.second.garbage_bytes);
   }
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
 }
@@ -881,8 +1954,47 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   assert(compact->outfile == nullptr);
   if (snapshots_.empty()) {
     compact->smallest_snapshot = versions_->LastSequence();
+    compact->newest_snapshot = 0;
   } else {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+    compact->newest_snapshot = snapshots_.newset()->sequence_number();
+  }
+
+  // 读取输入中的范围删除标记。被标记完整覆盖的输入文件无需读取，
+  // 直接随压缩一起删除。
+  Compaction* const c = compact->compaction;
+  Status status = c->AddRangeTombstones(&compact->range_dels);
+  if (!status.ok()) {
+    return status;
+  }
+  if (!compact->range_dels.empty()) {
+    // 被跳过的文件不会被读取，无法统计其中 blob 索引产生的垃圾，
+    // 因此存在 blob 文件时逐条处理
+    if (c->input_version()->blob_files().empty()) {
+      const int skipped =
+          c->SkipCoveredInputs(compact->range_dels, compact->smallest_snapshot);
+      if (skipped > 0) {
+        Log(options_.info_log,
+            "Dropping %d input files covered by range deletions", skipped);
+      }
+    }
+    // 所有快照都能看到的标记，如果更深层没有与之重叠的数据，
+    // 在丢弃被覆盖的条目后就不再需要
+    for (const RangeTombstone& t : compact->range_dels.tombstones()) {
+      if (t.sequence > compact->smallest_snapshot ||
+          !c->IsBaseLevelForRange(t.begin, t.end)) {
+        compact->output_range_dels.Add(t.begin, t.end, t.sequence);
+      }
+    }
+  }
+
+  // 根据版本中记录的垃圾统计选出需要回收的 blob 文件
+  for (const auto& kvp : c->input_version()->blob_files()) {
+    const BlobFileMetaData& b = kvp.second;
+    if (b.garbage_count > 0 &&
+        b.garbage_bytes >= options_.blob_gc_ratio * b.total_bytes) {
+      compact->blob_files_to_gc.insert(b.number);
+    }
   }
 
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
@@ -891,11 +2003,135 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   mutex_.Unlock();
 
   input->SeekToFirst();
-  Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  // 当前条目是否为该用户键最新的条目
+  bool newest_for_key = false;
+  // 当前输出文件应在下一个新的用户键之前结束
+  bool split_output = false;
+  // 将一个条目写入当前输出文件
+  auto add_to_output = [&](const Slice& key, const Slice& value) -> Status {
+    // Open output file if necessary
+    if (compact->builder == nullptr) {
+      Status s = OpenCompactionOutputFile(compact);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    CompactionState::Output* out = compact->current_output();
+    if (compact->builder->NumEntries() == 0) {
+      out->smallest.DecodeFrom(key);
+    }
+    out->largest.DecodeFrom(key);
+    compact->builder->Add(key, value);
+    out->num_entries++;
+    ParsedInternalKey parsed;
+    if (ParseInternalKey(key, &parsed)) {
+      if (parsed.type == kTypeDeletion) {
+        out->num_deletions++;
+      }
+      out->largest_seqno = std::max(out->largest_seqno, parsed.sequence);
+    }
+
+    // Close output file if it is big enough
+    if (compact->builder->FileSize() >=
+        compact->compaction->MaxOutputFileSize()) {
+      split_output = true;
+    }
+    return Status::OK();
+  };
+  // 写入一个值：不小于 Options::min_blob_size 的值写入 blob 文件，
+  // 输出中只保存指向它的索引
+  const size_t min_blob_size = options_.min_blob_size;
+  std::string blob_index;
+  auto add_value_to_output = [&](const Slice& user_key, SequenceNumber sequence,
+                                 const Slice& value) -> Status {
+    if (min_blob_size == 0 || value.size() < min_blob_size) {
+      InternalKey value_key(user_key, sequence, kTypeValue);
+      return add_to_output(value_key.Encode(), value);
+    }
+    Status s = AddCompactionBlob(compact, user_key, value, &blob_index);
+    if (!s.ok()) {
+      return s;
+    }
+    InternalKey index_key(user_key, sequence, kTypeBlobIndex);
+    return add_to_output(index_key.Encode(), blob_index);
+  };
+  // 将任何快照都看不到的最新值交给 compaction_filter 处理后写入输出。
+  // 快照能看到的值即使过期也要保留，否则快照读到的内容会改变。
+  // blob 索引在需要过滤或所指文件需要回收时取回真实值后重新写出。
+  const CompactionFilter* const compaction_filter = options_.compaction_filter;
+  std::string filtered_value;
+  std::string blob_value;
+  int64_t filtered_entries = 0;
+  auto add_filtered_to_output = [&](const Slice& key, const Slice& value,
+                                    bool newest) -> Status {
+    ParsedInternalKey parsed;
+    if (!ParseInternalKey(key, &parsed) ||
+        (parsed.type != kTypeValue && parsed.type != kTypeBlobIndex)) {
+      return add_to_output(key, value);
+    }
+    const bool filter = compaction_filter != nullptr && newest &&
+                        parsed.sequence > compact->newest_snapshot;
+    const bool is_blob_index = (parsed.type == kTypeBlobIndex);
+    BlobIndex index;
+    bool rewrite = false;  // blob 索引是否需要重新写出
+    Slice user_value = value;
+    if (is_blob_index) {
+      if (!index.DecodeFrom(value)) {
+        return Status::Corruption("bad blob index for ", parsed.user_key);
+      }
+      rewrite = compact->blob_files_to_gc.count(index.file_number) > 0;
+      if (!filter && !rewrite) {
+        return add_to_output(key, value);
+      }
+      Status s = table_cache_->GetBlob(index, &blob_value);
+      if (!s.ok()) {
+        return s;
+      }
+      user_value = blob_value;
+    } else if (!filter &&
+               (min_blob_size == 0 || value.size() < min_blob_size)) {
+      return add_to_output(key, value);
+    }
+    if (filter) {
+      switch (compaction_filter->Filter(c->level() + 1, parsed.user_key,
+                                        user_value, &filtered_value)) {
+        case CompactionFilter::kKeep:
+          break;
+        case CompactionFilter::kChangeValue:
+          user_value = filtered_value;
+          rewrite = true;
+          break;
+        case CompactionFilter::kRemove: {
+          filtered_entries++;
+          if (is_blob_index) {
+            compact->AddBlobGarbage(index);
+          }
+          if (c->IsBaseLevelForKey(parsed.user_key)) {
+            // 更深层没有该键的数据，直接丢弃
+            return Status::OK();
+          }
+          // 写入删除标记，遮住更深层中该键的旧值
+          InternalKey deletion(parsed.user_key, parsed.sequence,
+                               kTypeDeletion);
+          return add_to_output(deletion.Encode(), Slice());
+        }
+      }
+    }
+    if (is_blob_index) {
+      if (!rewrite) {
+        return add_to_output(key, value);
+      }
+      compact->AddBlobGarbage(index);
+    }
+    return add_value_to_output(parsed.user_key, parsed.sequence, user_value);
+  };
+  // 折叠合并操作数时暂存的条目（从新到旧）
+  std::vector<std::string> merge_keys;
+  std::vector<std::string> merge_operands;
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
     // Prioritize immutable compaction work
     if (has_imm_.load(std::memory_order_relaxed)) {
@@ -913,7 +2149,17 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     Slice key = input->key();
     if (compact->compaction->ShouldStopBefore(key) &&
         compact->builder != nullptr) {
-      status = FinishCompactionOutputFile(compact, input);
+      split_output = true;
+    }
+    // 同一用户键的所有条目必须留在同一个输出文件中：范围删除标记按文件边界
+    // 截断后，只有这样才能保证覆盖某个键的标记与该键的条目在同一个文件里
+    if (split_output && compact->builder != nullptr &&
+        ParseInternalKey(key, &ikey) &&
+        user_comparator()->Compare(
+            ikey.user_key, compact->current_output()->largest.user_key()) !=
+            0) {
+      split_output = false;
+      status = FinishCompactionOutputFile(compact, input, &ikey.user_key);
       if (!status.ok()) {
         break;
       }
@@ -926,6 +2172,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       current_user_key.clear();
       has_current_user_key = false;
       last_sequence_for_key = kMaxSequenceNumber;
+      newest_for_key = false;
     } else {
       if (!has_current_user_key ||
           user_comparator()->Compare(ikey.user_key, Slice(current_user_key)) !=
@@ -934,6 +2181,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
         last_sequence_for_key = kMaxSequenceNumber;
+        newest_for_key = true;
+      } else {
+        newest_for_key = false;
       }
 
       if (last_sequence_for_key <= compact->smallest_snapshot) {
@@ -947,9 +2197,18 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         // (2) 更低层级的数据将具有更大的序列号
         // (3) 在这里被压缩的层中的数据具有较小的序列号，将在此循环的接下来的几次迭代中被删除（根据上面的规则(A)）。 因此，这个删除标记已经过时，可以删除。
         drop = true;
+      } else if (!compact->range_dels.empty() &&
+                 compact->range_dels.MaxCoveringSeq(
+                     ikey.user_key, compact->smallest_snapshot) >
+                     ikey.sequence) {
+        // 被所有快照都能看到的范围删除标记覆盖
+        drop = true;
       }
 
-      last_sequence_for_key = ikey.sequence;
+      // 合并操作数不会隐藏更早的条目，读取时还需要与它们合并
+      if (ikey.type != kTypeMerge || drop) {
+        last_sequence_for_key = ikey.sequence;
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -961,28 +2220,87 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
-    if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == nullptr) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
+    if (!drop && has_current_user_key && ikey.type == kTypeMerge &&
+        ikey.sequence <= compact->smallest_snapshot &&
+        options_.merge_operator != nullptr) {
+      // 没有快照能看到这个操作数与更早条目之间的状态，
+      // 将它与同一用户键更早的操作数及值折叠为一个条目
+      const SequenceNumber merge_sequence = ikey.sequence;
+      merge_keys.clear();
+      merge_operands.clear();
+      bool reached_base = false;  // 是否遇到了值、删除记录或被覆盖的条目
+      bool has_base = false;
+      std::string base;
+      do {
+        merge_keys.push_back(input->key().ToString());
+        merge_operands.push_back(input->value().ToString());
+        input->Next();
+        if (!input->Valid() || !ParseInternalKey(input->key(), &ikey) ||
+            user_comparator()->Compare(ikey.user_key, current_user_key) != 0) {
           break;
         }
+        const bool covered =
+            !compact->range_dels.empty() &&
+            compact->range_dels.MaxCoveringSeq(
+                ikey.user_key, compact->smallest_snapshot) > ikey.sequence;
+        if (ikey.type == kTypeValue && !covered) {
+          has_base = true;
+          base = input->value().ToString();
+        } else if (ikey.type == kTypeBlobIndex && !covered) {
+          has_base = true;
+          status = ReadBlob(input->value(), &base);
+        }
+        reached_base = (ikey.type != kTypeMerge || covered);
+      } while (!reached_base);
+      if (!status.ok()) {
+        break;
       }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
-      }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
 
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
+      // 没有遇到更早的值时，只有更深层不存在该键的数据才能完整合并
+      std::string merged;
+      bool full_merged = false;
+      if (reached_base ||
+          compact->compaction->IsBaseLevelForKey(current_user_key)) {
+        Slice existing(base);
+        full_merged = MergeOperands(options_.merge_operator, current_user_key,
+                                    has_base ? &existing : nullptr,
+                                    merge_operands, &merged)
+                          .ok();
+      }
+      if (full_merged) {
+        // 更早的条目已并入结果，按规则 (A) 丢弃
+        last_sequence_for_key = merge_sequence;
+        InternalKey merged_key(current_user_key, merge_sequence, kTypeValue);
+        status =
+            add_filtered_to_output(merged_key.Encode(), merged, newest_for_key);
+      } else if (PartialMergeOperands(options_.merge_operator,
+                                      current_user_key, merge_operands,
+                                      &merged)) {
+        InternalKey merged_key(current_user_key, merge_sequence, kTypeMerge);
+        status = add_to_output(merged_key.Encode(), merged);
+      } else {
+        for (size_t i = 0; i < merge_keys.size() && status.ok(); i++) {
+          status = add_to_output(merge_keys[i], merge_operands[i]);
         }
       }
+      if (!status.ok()) {
+        break;
+      }
+      // input 已指向下一个待处理的条目
+      continue;
+    }
+
+    if (!drop) {
+      status = add_filtered_to_output(key, input->value(), newest_for_key);
+      if (!status.ok()) {
+        break;
+      }
+    } else if (ikey.type == kTypeBlobIndex) {
+      // 被丢弃的 blob 索引所指的记录成为垃圾
+      BlobIndex index;
+      if (index.DecodeFrom(input->value())) {
+        compact->AddBlobGarbage(index);
+      }
     }
 
     input->Next();
@@ -991,8 +2309,24 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (filtered_entries > 0) {
+    Log(options_.info_log, "Compaction filter removed %lld entries",
+        static_cast<long long>(filtered_entries));
+  }
+  if (status.ok() && compact->builder == nullptr) {
+    // 最后一个输出文件之后仍有需要保留的范围删除标记
+    Slice lower_storage(compact->output_lower_bound);
+    if (compact->output_range_dels.Overlaps(
+            compact->has_output_lower_bound ? &lower_storage : nullptr,
+            nullptr)) {
+      status = OpenCompactionOutputFile(compact);
+    }
+  }
   if (status.ok() && compact->builder != nullptr) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, nullptr);
+  }
+  if (status.ok() && compact->blob_builder != nullptr) {
+    status = FinishCompactionBlobFile(compact);
   }
   if (status.ok()) {
     status = input->status();
@@ -1010,6 +2344,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     stats.bytes_written += compact->outputs[i].file_size;
   }
+  for (const BlobFileMetaData& b : compact->blob_outputs) {
+    stats.bytes_written += b.total_bytes;
+  }
 
   mutex_.Lock();
   stats_[compact->compaction->level() + 1].Add(stats);
@@ -1053,7 +2390,8 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+                                      uint32_t* seed,
+                                      RangeTombstoneSet** range_dels) {
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
 
@@ -1070,11 +2408,42 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
   versions_->current()->Ref();
 
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
+  MemTable* const mem = mem_;
+  MemTable* const imm = imm_;
+  Version* const current = versions_->current();
+  IterState* cleanup = new IterState(&mutex_, mem, imm, current);
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
 
+  if (fifo_ttl_enabled()) {
+    MaybeScheduleCompaction();
+  }
   *seed = ++seed_;
   mutex_.Unlock();
+
+  // 范围删除标记必须取自与内部迭代器相同的 memtable 与版本，否则压缩
+  // 可能在两者之间丢弃标记，使被覆盖的数据重新可见。它们已被上面的
+  // 引用保留，不必持有锁；版本中的标记只在第一次读取时加载
+  if (range_dels != nullptr) {
+    *range_dels = nullptr;
+    RangeTombstoneSet* set = new RangeTombstoneSet;
+    set->Add(mem->RangeTombstones());
+    if (imm != nullptr) {
+      set->Add(imm->RangeTombstones());
+    }
+    std::shared_ptr<const FragmentedRangeTombstones> fragments;
+    Status s = current->RangeTombstones(&fragments);
+    if (!s.ok()) {
+      delete set;
+      delete internal_iter;
+      return NewErrorIterator(s);
+    }
+    set->Add(fragments);
+    if (set->empty()) {
+      delete set;
+    } else {
+      *range_dels = set;
+    }
+  }
   return internal_iter;
 }
 
@@ -1089,6 +2458,11 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+uint64_t DBImpl::TEST_ManifestFileNumber() {
+  MutexLock l(&mutex_);
+  return versions_->ManifestFileNumber();
+}
+
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
   Status s;
@@ -1116,19 +2490,35 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
+    // 已知覆盖该键的范围删除标记的最大序列号，从新到旧依次更新
+    SequenceNumber max_covering_tombstone_seq = 0;
+    // 沿途遇到的合并操作数（从新到旧）
+    std::vector<std::string> merge_operands;
+    if (mem->Get(lkey, value, &s, &max_covering_tombstone_seq,
+                 &merge_operands)) {
       // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
+    } else if (imm != nullptr && imm->Get(lkey, value, &s,
+                                          &max_covering_tombstone_seq,
+                                          &merge_operands)) {
       // Done
     } else {
-      s = current->Get(options, lkey, value, &stats);
+      s = current->Get(options, lkey, max_covering_tombstone_seq, value,
+                       &merge_operands, &stats);
       have_stat_update = true;
     }
+    if (!merge_operands.empty() && (s.ok() || s.IsNotFound())) {
+      Slice existing(*value);
+      s = MergeOperands(options_.merge_operator, key, s.ok() ? &existing : nullptr,
+                        merge_operands, value);
+    }
     mutex_.Lock();
   }
 
   if (have_stat_update && current->UpdateStats(stats)) {
     MaybeScheduleCompaction();
+  } else if (fifo_ttl_enabled()) {
+    // 没有写入时也要按时删除过期文件
+    MaybeScheduleCompaction();
   }
   mem->Unref();
   if (imm != nullptr) imm->Unref();
@@ -1139,8 +2529,11 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
-  return NewDBIterator(this, user_comparator(), iter,
+  RangeTombstoneSet* range_dels;
+  Iterator* iter =
+      NewInternalIterator(options, &latest_snapshot, &seed, &range_dels);
+  return NewDBIterator(this, user_comparator(), options_.merge_operator, iter,
+                       range_dels,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
@@ -1155,6 +2548,14 @@ void DBImpl::RecordReadSample(Slice key) {
   }
 }
 
+Status DBImpl::ReadBlob(const Slice& blob_index, std::string* value) {
+  BlobIndex index;
+  if (!index.DecodeFrom(blob_index)) {
+    return Status::Corruption("bad blob index");
+  }
+  return table_cache_->GetBlob(index, value);
+}
+
 const Snapshot* DBImpl::GetSnapshot() {
   MutexLock l(&mutex_);
   return snapshots_.New(versions_->LastSequence());
@@ -1174,14 +2575,37 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::DeleteRange(const WriteOptions& options, const Slice& begin,
+                           const Slice& end) {
+  const int r = user_comparator()->Compare(begin, end);
+  if (r > 0) {
+    return Status::InvalidArgument("DeleteRange: begin is after end");
+  } else if (r == 0) {
+    return Status::OK();
+  }
+  return DB::DeleteRange(options, begin, end);
+}
+
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  if (options_.merge_operator == nullptr) {
+    return Status::NotSupported("Merge: no merge operator configured");
+  }
+  return DB::Merge(options, key, value);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
+  w.disable_wal = options.disable_wal || bulk_load_;
   w.done = false;
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
+  if (group_commit_waiting_) {
+    writers_.front()->cv.Signal();
+  }
   while (!w.done && &w != writers_.front()) {
     w.cv.Wait();
   }
@@ -1191,6 +2615,10 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   // May temporarily unlock and wait.
   Status status = MakeRoomForWrite(updates == nullptr);
+  const bool sync_log = w.sync && !w.disable_wal;
+  if (status.ok() && updates != nullptr && sync_log) {
+    WaitForGroupCommit();
+  }
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
@@ -1204,10 +2632,15 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     // into mem_.
     {
       mutex_.Unlock();
-      status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
       bool sync_error = false;
-      if (status.ok() && options.sync) {
+      uint64_t sync_micros = 0;
+      if (!w.disable_wal) {
+        status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+      }
+      if (status.ok() && sync_log) {
+        const uint64_t sync_start = env_->NowMicros();
         status = logfile_->Sync();
+        sync_micros = env_->NowMicros() - sync_start;
         if (!status.ok()) {
           sync_error = true;
         }
@@ -1216,6 +2649,9 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         status = WriteBatchInternal::InsertInto(write_batch, mem_);
       }
       mutex_.Lock();
+      if (sync_log && status.ok()) {
+        sync_micros_ = (sync_micros_ * 7 + sync_micros) / 8;
+      }
       if (sync_error) {
         // The state of the log file is indeterminate: the log record we
         // just added may or may not show up when the DB is re-opened.
@@ -1224,13 +2660,19 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
       }
     }
     if (write_batch == tmp_batch_) tmp_batch_->Clear();
+    UpdateWriteBufferUsage();
+    if (w.disable_wal) {
+      mem_has_unlogged_writes_ = true;
+    }
 
     versions_->SetLastSequence(last_sequence);
   }
 
+  int group_size = 0;
   while (true) {
     Writer* ready = writers_.front();
     writers_.pop_front();
+    group_size++;
     if (ready != &w) {
       ready->status = status;
       ready->done = true;
@@ -1238,6 +2680,9 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     }
     if (ready == last_writer) break;
   }
+  if (sync_log) {
+    last_sync_group_size_ = group_size;
+  }
 
   // Notify new head of write queue
   if (!writers_.empty()) {
@@ -1247,6 +2692,38 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+void DBImpl::WaitForGroupCommit() {
+  mutex_.AssertHeld();
+  // 只有最近的同步写入确实组成过多个写入的组时才等待，避免单线程的
+  // 同步写入每次都白白等待
+  const uint64_t delay =
+      std::min(options_.group_commit_max_delay_micros, sync_micros_);
+  if (delay == 0 || last_sync_group_size_ <= 1) {
+    return;
+  }
+  Writer* leader = writers_.front();
+  const uint64_t deadline = env_->NowMicros() + delay;
+  size_t bytes = WriteBatchInternal::ByteSize(leader->batch);
+  size_t counted = 1;
+  while (true) {
+    // 统计新加入且能并入本组的写入，遇到不能合并的写入时组已确定
+    for (; counted < writers_.size(); counted++) {
+      Writer* w = writers_[counted];
+      if (w->batch == nullptr || w->disable_wal) {
+        return;
+      }
+      bytes += WriteBatchInternal::ByteSize(w->batch);
+    }
+    const uint64_t now = env_->NowMicros();
+    if (bytes >= options_.group_commit_max_bytes || now >= deadline) {
+      return;
+    }
+    group_commit_waiting_ = true;
+    leader->cv.TimedWait(deadline - now);
+    group_commit_waiting_ = false;
+  }
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
@@ -1276,22 +2753,30 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       break;
     }
 
-    if (w->batch != nullptr) {
-      size += WriteBatchInternal::ByteSize(w->batch);
-      if (size > max_size) {
-        // Do not make batch too big
-        break;
-      }
+    if (w->disable_wal != first->disable_wal) {
+      // 记录日志与不记录日志的写入不能合并到同一组
+      break;
+    }
 
-      // Append to *result
-      if (result == first->batch) {
-        // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
-        assert(WriteBatchInternal::Count(result) == 0);
-        WriteBatchInternal::Append(result, first->batch);
-      }
-      WriteBatchInternal::Append(result, w->batch);
+    if (w->batch == nullptr) {
+      // 不吸收切换 memtable 或导入外部文件的请求，它们需要自己处于队列头部
+      break;
+    }
+
+    size += WriteBatchInternal::ByteSize(w->batch);
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
+    }
+
+    // Append to *result
+    if (result == first->batch) {
+      // Switch to temporary batch instead of disturbing caller's batch
+      result = tmp_batch_;
+      assert(WriteBatchInternal::Count(result) == 0);
+      WriteBatchInternal::Append(result, first->batch);
     }
+    WriteBatchInternal::Append(result, w->batch);
     *last_writer = w;
   }
   return result;
@@ -1303,14 +2788,19 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   bool allow_delay = !force;
+  // FIFO 风格下 level-0 文件数量由容量与存活时间限制，不需要限速；
+  // 批量导入模式下 level-0 文件留到最后统一压缩，同样不限速
+  const bool no_l0_limit =
+      (options_.compaction_style == kCompactionStyleFIFO) || bulk_load_;
   Status s;
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
+    } else if (allow_delay && !no_l0_limit &&
+               versions_->NumLevelFiles(0) >=
+                   config::kL0_SlowdownWritesTrigger) {
       // We are getting close to hitting a hard limit on the number of
       // L0 files.  Rather than delaying a single write by several
       // seconds when we hit the hard limit, start delaying each
@@ -1322,7 +2812,8 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       allow_delay = false;  // Do not delay a single write more than once
       mutex_.Lock();
     } else if (!force &&
-               (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
+               (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size) &&
+               !WriteBufferManagerWantsFlush()) {
       // There is room in current memtable
       break;
     } else if (imm_ != nullptr) {
@@ -1330,7 +2821,8 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
       background_work_finished_signal_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+    } else if (!no_l0_limit &&
+               versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
       background_work_finished_signal_.Wait();
@@ -1364,10 +2856,20 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       logfile_ = lfile;
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
+      if (options_.write_buffer_manager != nullptr) {
+        UpdateWriteBufferUsage();
+        options_.write_buffer_manager->ScheduleFreeMem(mem_charged_);
+        imm_charged_ = mem_charged_;
+        mem_charged_ = 0;
+      }
       imm_ = mem_;
+      imm_->MarkImmutable();
       has_imm_.store(true, std::memory_order_release);
-      mem_ = new MemTable(internal_comparator_);
+      imm_has_unlogged_writes_ = mem_has_unlogged_writes_;
+      mem_has_unlogged_writes_ = false;
+      mem_ = new MemTable(internal_comparator_, options_);
       mem_->Ref();
+      UpdateWriteBufferUsage();
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
@@ -1375,6 +2877,40 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   return s;
 }
 
+void DBImpl::UpdateWriteBufferUsage() {
+  mutex_.AssertHeld();
+  WriteBufferManager* manager = options_.write_buffer_manager;
+  if (manager == nullptr || mem_ == nullptr) {
+    return;
+  }
+  // memtable 只增不减，记入增量即可
+  const size_t usage = mem_->ApproximateMemoryUsage();
+  if (usage > mem_charged_) {
+    manager->ReserveMem(usage - mem_charged_);
+    mem_charged_ = usage;
+  }
+}
+
+bool DBImpl::WriteBufferManagerWantsFlush() {
+  mutex_.AssertHeld();
+  WriteBufferManager* manager = options_.write_buffer_manager;
+  if (manager == nullptr || imm_ != nullptr || !manager->ShouldFlush()) {
+    return false;
+  }
+  // 预算只是软上限：level-0 文件过多时切换会在 MakeRoomForWrite 中等待，
+  // 此时不因预算提前切换
+  const bool no_l0_limit =
+      (options_.compaction_style == kCompactionStyleFIFO) || bulk_load_;
+  if (!no_l0_limit &&
+      versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+    return false;
+  }
+  // 只切换不小于平均值的 memtable，免得别的库占满预算时本库每次写入都
+  // 落盘一个很小的表；占用最多的库写入时一定会切换
+  return mem_charged_ * manager->num_dbs() >=
+         manager->mutable_memtable_memory_usage();
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   value->clear();
 
@@ -1419,6 +2955,22 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
+  } else if (in == "blob-stats") {
+    uint64_t total_bytes = 0;
+    uint64_t garbage_bytes = 0;
+    const auto& blob_files = versions_->current()->blob_files();
+    for (const auto& kvp : blob_files) {
+      total_bytes += kvp.second.total_bytes;
+      garbage_bytes += kvp.second.garbage_bytes;
+    }
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Blob files: %d\nTotal bytes: %llu\nGarbage bytes: %llu\n",
+                  static_cast<int>(blob_files.size()),
+                  static_cast<unsigned long long>(total_bytes),
+                  static_cast<unsigned long long>(garbage_bytes));
+    value->append(buf);
+    return true;
   } else if (in == "approximate-memory-usage") {
     size_t total_usage = options_.block_cache->TotalCharge();
     if (mem_) {
@@ -1469,17 +3021,51 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+                       const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
+  return DBImpl::OpenImpl(options, dbname, false, dbptr);
+}
+
+Status DB::OpenForBulkLoad(const Options& options, const std::string& dbname,
+                           DB** dbptr) {
+  return DBImpl::OpenImpl(options, dbname, true, dbptr);
+}
+
+Status DBImpl::OpenImpl(const Options& options, const std::string& dbname,
+                        bool bulk_load, DB** dbptr) {
   *dbptr = nullptr;
 
-  DBImpl* impl = new DBImpl(options, dbname);
+  DBImpl* impl = new DBImpl(options, dbname, bulk_load);
   impl->mutex_.Lock();
   VersionEdit edit;
   // Recover handles create_if_missing, error_if_exists
   bool save_manifest = false;
   Status s = impl->Recover(&edit, &save_manifest);
+  if (s.ok() && options.compaction_style == kCompactionStyleFIFO) {
+    // FIFO 风格只会删除 level-0 上的文件，其他层级的文件将永远不会被删除
+    for (int level = 1; level < config::kNumLevels; level++) {
+      if (impl->versions_->NumLevelFiles(level) > 0) {
+        s = Status::InvalidArgument(
+            dbname, "FIFO compaction requires all table files in level-0");
+        break;
+      }
+    }
+  }
   if (s.ok() && impl->mem_ == nullptr) {
     // Create new log and a corresponding memtable.
     uint64_t new_log_number = impl->versions_->NewFileNumber();
@@ -1491,7 +3077,7 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->mem_ = new MemTable(impl->internal_comparator_, impl->options_);
       impl->mem_->Ref();
     }
   }
@@ -1501,7 +3087,14 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
   }
   if (s.ok()) {
+    impl->UpdateWriteBufferUsage();
     impl->RemoveObsoleteFiles();
+    if (impl->options_.prefetch_tables_on_open) {
+      // 在调度压缩之前进行，文件不会在打开期间被删除
+      impl->mutex_.Unlock();
+      impl->PrefetchTables();
+      impl->mutex_.Lock();
+    }
     impl->MaybeScheduleCompaction();
   }
   impl->mutex_.Unlock();
@@ -5,6 +5,7 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
@@ -15,7 +16,10 @@
 #include "port/thread_annotations.h"
 
 namespace leveldb {
+struct BlobFileMetaData;
+struct FileMetaData;
 class MemTable;
+class RangeTombstoneSet;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -23,7 +27,9 @@ class VersionSet;
 
 class DBImpl : public DB {
  public:
-  DBImpl(const Options& options, const std::string& dbname);
+  // "bulk_load" 为 true 时以批量导入模式运行，参见 DB::OpenForBulkLoad
+  DBImpl(const Options& options, const std::string& dbname,
+         bool bulk_load = false);
   DBImpl(const DBImpl&) = delete;
   DBImpl& operator=(const DBImpl&) = delete;
 
@@ -33,6 +39,10 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status DeleteRange(const WriteOptions&, const Slice& begin,
+                     const Slice& end) override;
+  Status Merge(const WriteOptions&, const Slice& key,
+               const Slice& value) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
@@ -42,6 +52,10 @@ class DBImpl : public DB {
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
+  Status IngestExternalFile(const std::vector<std::string>& files) override;
+  Status CreateCheckpoint(const std::string& checkpoint_dir) override;
+  Status GetLiveFiles(std::vector<LiveFile>* files) override;
+  void ReleaseLiveFiles() override;
 
   // 其他方法
 
@@ -58,6 +72,9 @@ class DBImpl : public DB {
   // 当不再需要时，应删除返回的迭代器。
   Iterator* TEST_NewInternalIterator();
 
+  // 当前 MANIFEST 的文件编号。
+  uint64_t TEST_ManifestFileNumber();
+
   // 返回下一级别的最大重叠数据（以字节为单位），适用于级别 >= 1 的任何文件。
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
@@ -65,11 +82,18 @@ class DBImpl : public DB {
   // 样本大约每读取 config::kReadBytesPeriod 字节采集一次。
   void RecordReadSample(Slice key);
 
+  // 读取编码后的 blob 索引 "blob_index" 指向的值，存入 *value。
+  Status ReadBlob(const Slice& blob_index, std::string* value);
+
  private:
   friend class DB;
   struct CompactionState;
   struct Writer;
 
+  // DB::Open 与 DB::OpenForBulkLoad 的共同实现
+  static Status OpenImpl(const Options& options, const std::string& dbname,
+                         bool bulk_load, DB** dbptr);
+
   struct ManualCompaction {
     int level;
     bool done;
@@ -94,9 +118,12 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
+  // 如果 range_dels 非空，还会将同一组 memtable 与文件中的范围删除标记
+  // 存入 *range_dels（没有标记时为 nullptr），由调用者负责删除。
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeTombstoneSet** range_dels = nullptr);
 
   Status NewDB();
 
@@ -107,6 +134,9 @@ class DBImpl : public DB {
 
   void MaybeIgnordError(Status* s) const;
 
+  // 打开时并行打开表文件，参见 Options::prefetch_tables_on_open。
+  void PrefetchTables() LOCKS_EXCLUDED(mutex_);
+
   // 删除任何不需要的文件和过时的内存条目。
   void RemoveObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -114,19 +144,43 @@ class DBImpl : public DB {
   // 错误记录在 bg_error_ 中。
   void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
-                        VersionEdit* edit, SequenceNumber* max_sequence)
+  struct LogRecovery;
+  static void RecoverLogFileWork(void* arg, size_t i);
+  // 在工作线程中重放一个日志文件，写满的 memtable 直接写成 level-0 表。
+  // 结果存入 *log，由 InstallRecoveredLogs() 按日志顺序安装。
+  void RecoverLogFile(LogRecovery* log) LOCKS_EXCLUDED(mutex_);
+  Status WriteRecoveredTable(MemTable* mem, LogRecovery* log)
+      LOCKS_EXCLUDED(mutex_);
+  Status InstallRecoveredLogs(std::vector<LogRecovery>* logs,
+                              bool* save_manifest, VersionEdit* edit,
+                              SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // 将 mem 写成一个新的表文件（以及可能的 blob 文件），元数据存入
+  // *meta 与 *blob。写文件期间释放 mutex_。
+  Status BuildLevel0Table(MemTable* mem, FileMetaData* meta,
+                          BlobFileMetaData* blob)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* 即使有空间也要压缩？*/)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // 把 mem_ 新增的内存记入 write_buffer_manager
+  void UpdateWriteBufferUsage() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // 共享的 memtable 预算超出，并且本库的 mem_ 不小于各库的平均值时
+  // 返回 true，此时即使 mem_ 没有写满也应切换。切换需要等待时（imm_
+  // 还在落盘，或 level-0 文件数达到停写阈值）返回 false，预算不会阻塞写入。
+  bool WriteBufferManagerWantsFlush() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   WriteBatch* BuildBatchGroup(Writer** last_writer)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // 队列头部的同步写入等待更多写入加入同一组，参见
+  // Options::group_commit_max_delay_micros。
+  void WaitForGroupCommit() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -139,14 +193,50 @@ class DBImpl : public DB {
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // 完成当前输出文件。与 [上一个输出的上界, *upper) 相交的范围删除标记
+  // 会截断后写入该文件；upper 为 nullptr 表示这是最后一个输出。
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* upper);
+  // 将一个大 value 写入压缩输出的 blob 文件，必要时打开或切换文件。
+  // 指向它的索引存入 *blob_index。
+  Status AddCompactionBlob(CompactionState* compact, const Slice& user_key,
+                           const Slice& value, std::string* blob_index);
+  Status FinishCompactionBlobFile(CompactionState* compact);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  struct ExternalFile;
+  // 刷写与外部文件重叠的 memtable，为导入预留序列号与文件编号。
+  // 要求：位于写入队列头部
+  Status ReserveIngestion(std::vector<ExternalFile>* files,
+                          SequenceNumber* sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // 归还 ReserveIngestion 预留的文件编号
+  void ReleaseIngestion(const std::vector<ExternalFile>& files)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // 以 "sequence" 为序列号将外部文件转换为数据库中的表，不持有锁
+  Status ConvertExternalFiles(std::vector<ExternalFile>* files,
+                              SequenceNumber sequence);
+  // 预留序列号之后的写入或快照使转换的文件无法正确安装时返回 true。
+  // 要求：位于写入队列头部，且没有正在运行的后台压缩
+  bool ExternalFilesConflict(const std::vector<ExternalFile>& files,
+                             SequenceNumber sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // 将转换好的文件安装到当前版本中与其键范围不重叠的最深层级。
+  // 要求：位于写入队列头部，且没有正在运行的后台压缩
+  Status InstallExternalFiles(const std::vector<ExternalFile>& files)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   const Comparator* user_comparator() const {
     return internal_comparator_.user_comparator();
   }
 
+  // FIFO 风格下文件会随时间过期，读取时也需要检查是否该删除
+  bool fifo_ttl_enabled() const {
+    return options_.compaction_style == kCompactionStyleFIFO &&
+           options_.fifo_ttl_seconds > 0;
+  }
+
   // 创建实例后不再修改
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
@@ -173,8 +263,22 @@ class DBImpl : public DB {
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
   uint32_t seed_ GUARDED_BY(mutex_);
+  // 批量导入模式：不写日志、不限制 level-0 文件数、不自动压缩
+  const bool bulk_load_;
+  // mem_ 中是否有没有写入日志的数据，关闭数据库时需要先刷写
+  bool mem_has_unlogged_writes_ GUARDED_BY(mutex_);
+  // imm_ 中是否有没有写入日志的数据，imm_ 落盘后清除
+  bool imm_has_unlogged_writes_ GUARDED_BY(mutex_);
+  // 已记入 write_buffer_manager 的 mem_ 与 imm_ 内存
+  size_t mem_charged_ GUARDED_BY(mutex_);
+  size_t imm_charged_ GUARDED_BY(mutex_);
 
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
+  // 组提交：队列头部是否正在等待更多写入、测得的 Sync 平均耗时，
+  // 以及最近一组同步写入包含的写入数
+  bool group_commit_waiting_ GUARDED_BY(mutex_);
+  uint64_t sync_micros_ GUARDED_BY(mutex_);
+  int last_sync_group_size_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
@@ -185,6 +289,12 @@ class DBImpl : public DB {
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
+  // 大于 0 时不安排新的后台压缩（如导入外部文件期间）
+  int bg_compaction_paused_ GUARDED_BY(mutex_);
+  // 大于 0 时 RemoveObsoleteFiles 不删除任何文件（GetLiveFiles 的调用者
+  // 复制文件期间）
+  int obsolete_files_deletion_paused_ GUARDED_BY(mutex_);
+
   VersionSet* const versions_ GUARDED_BY(mutex_);
 
   // 我们是否在偏执模式下遇到了后台错误？
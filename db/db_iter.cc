@@ -1,8 +1,12 @@
 #include "db/db_iter.h"
 
+#include <algorithm>
+
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/merge_helper.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -20,34 +24,48 @@ class DBIter : public Iterator {
  public:
   // 迭代器当前移动的方向是哪个？
   // (1) 当向前移动时，内部迭代器定位在生成 this->key(), this->value()
-  // 的确切条目。 (2) 当向后移动时，内部迭代器定位在所有用户键等于 this->key()
+  // 的确切条目；若当前条目由合并操作数合并而来，内部迭代器定位在参与合并的
+  // 最旧条目之后，当前键值保存在 saved_key_/saved_value_ 中；若当前值是从
+  // blob 文件取回的，内部迭代器仍定位在该条目，值保存在 saved_value_ 中。
+  // (2) 当向后移动时，内部迭代器定位在所有用户键等于 this->key()
   // 的条目之前。
   enum Direction { kForward, kReverse };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
+  DBIter(DBImpl* db, const Comparator* cmp, const MergeOperator* merge_operator,
+         Iterator* iter, RangeTombstoneSet* range_dels, SequenceNumber s,
          uint32_t seed)
       : db_(db),
         user_comparator_(cmp),
+        merge_operator_(merge_operator),
         iter_(iter),
+        range_dels_(range_dels),
         sequence_(s),
         direction_(kForward),
         valid_(false),
+        merged_(false),
+        blob_value_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
 
-  ~DBIter() override { delete iter_; }
+  ~DBIter() override {
+    delete iter_;
+    delete range_dels_;
+  }
 
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key())
+                                                : saved_key_;
   }
   Slice value() const override {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !merged_ && !blob_value_)
+               ? iter_->value()
+               : saved_value_;
   }
   Status status() const override {
     if (status_.ok()) {
@@ -66,8 +84,16 @@ class DBIter : public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  void MergeForward(const ParsedInternalKey& ikey);
   bool ParseKey(ParsedInternalKey* key);
 
+  // 条目是否被快照可见的范围删除标记覆盖？
+  bool IsCovered(const ParsedInternalKey& ikey) const {
+    return range_dels_ != nullptr &&
+           range_dels_->MaxCoveringSeq(ikey.user_key, sequence_) >
+               ikey.sequence;
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -89,13 +115,18 @@ class DBIter : public Iterator {
 
   DBImpl* db_;
   const Comparator* const user_comparator_;
+  const MergeOperator* const merge_operator_;
   Iterator* const iter_;
+  RangeTombstoneSet* const range_dels_;  // 没有范围删除标记时为 nullptr
   SequenceNumber const sequence_;
   Status status_;
   std::string saved_key_;    // 当 direction_==kReverse 时，等于当前键
   std::string saved_value_;  // 当 direction_==kReverse 时，等于当前原始值
+  std::vector<std::string> merge_operands_;  // 合并时暂存的操作数
   Direction direction_;
   bool valid_;
+  bool merged_;  // 正向移动时，当前条目是否由合并得到
+  bool blob_value_;  // 正向移动时，当前值是否为从 blob 文件取回的值
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -120,6 +151,7 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
 
 void DBIter::Next() {
   assert(valid_);
+  blob_value_ = false;
   if (direction_ == kReverse) {
     // iter_ 指向 this->key() 条目之前，
     // 因此进入 this->key() 条目的范围，然后使用下面的正常跳过代码。
@@ -135,6 +167,15 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ 已经包含要跳过的键。
+  } else if (merged_) {
+    // saved_key_ 已经是当前键，iter_ 已越过参与合并的条目
+    merged_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      ClearSavedValue();
+      return;
+    }
   } else {
     // 将当前键存储在 saved_key_ 中，以便在下面跳过它。
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -165,15 +206,44 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           skipping = true;
           break;
         case kTypeValue:
+        case kTypeBlobIndex:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // 此键已被隐藏
+          } else if (IsCovered(ikey)) {
+            // 被范围删除标记覆盖，此键更旧的条目序列号更小，同样被覆盖
+            SaveKey(ikey.user_key, skip);
+            skipping = true;
           } else {
-            valid_ = true;
             saved_key_.clear();
+            if (ikey.type == kTypeBlobIndex) {
+              Status s = db_->ReadBlob(iter_->value(), &saved_value_);
+              if (!s.ok()) {
+                status_ = s;
+                valid_ = false;
+                return;
+              }
+              blob_value_ = true;
+            }
+            valid_ = true;
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // 此键已被隐藏
+          } else if (IsCovered(ikey)) {
+            SaveKey(ikey.user_key, skip);
+            skipping = true;
+          } else {
+            MergeForward(ikey);
+            return;
+          }
+          break;
+        case kTypeRangeDeletion:
+          // 范围删除标记不在内部迭代器中
+          break;
       }
     }
     iter_->Next();
@@ -181,25 +251,81 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   saved_value_.clear();
   valid_ = false;
 }
+
+void DBIter::MergeForward(const ParsedInternalKey& ikey) {
+  // 从最新的操作数开始，向更旧的条目收集同一用户键的操作数，
+  // 直到遇到值、删除记录、被范围删除覆盖的条目或其他用户键
+  SaveKey(ikey.user_key, &saved_key_);
+  merge_operands_.clear();
+  merge_operands_.push_back(iter_->value().ToString());
+  bool has_base = false;
+  std::string base;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey older;
+    if (!ParseKey(&older)) {
+      valid_ = false;
+      return;
+    }
+    if (user_comparator_->Compare(older.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (older.type == kTypeDeletion || IsCovered(older)) {
+      break;
+    } else if (older.type == kTypeValue) {
+      has_base = true;
+      base = iter_->value().ToString();
+      break;
+    } else if (older.type == kTypeBlobIndex) {
+      has_base = true;
+      Status s = db_->ReadBlob(iter_->value(), &base);
+      if (!s.ok()) {
+        status_ = s;
+        valid_ = false;
+        return;
+      }
+      break;
+    } else if (older.type == kTypeMerge) {
+      merge_operands_.push_back(iter_->value().ToString());
+    }
+  }
+  Slice existing(base);
+  Status s = MergeOperands(merge_operator_, saved_key_,
+                           has_base ? &existing : nullptr, merge_operands_,
+                           &saved_value_);
+  merge_operands_.clear();
+  if (!s.ok()) {
+    status_ = s;
+    valid_ = false;
+    return;
+  }
+  merged_ = true;
+  valid_ = true;
+}
 void DBIter::Prev() {
   assert(valid_);
+  blob_value_ = false;
   if (direction_ == kForward) {
     // iter_指向当前条目。向后扫描直到键发生变化，以便我们可以使用正常的反向扫描代码。
-    assert(iter_->Valid());
-    SaveKey(ExtractUserKey(iter_->key()),
-            &saved_key_);  // 保存的是当前的条目，还不是目标条目
-    while (true) {
-      iter_->Prev();
+    if (merged_) {
+      // saved_key_ 已经是当前键，iter_ 位于参与合并的条目之后
+      merged_ = false;
       if (!iter_->Valid()) {
-        valid_ = false;
-        saved_key_.clear();
-        ClearSavedValue();
-        return;
-      }
-      if (user_comparator_->Compare(ExtractUserKey(iter_->key()), saved_key_) <
-          0) {
-        break;
+        iter_->SeekToLast();
       }
+    } else {
+      assert(iter_->Valid());
+      SaveKey(ExtractUserKey(iter_->key()),
+              &saved_key_);  // 保存的是当前的条目，还不是目标条目
+    }
+    while (iter_->Valid() && user_comparator_->Compare(
+                                 ExtractUserKey(iter_->key()), saved_key_) >= 0) {
+      iter_->Prev();
+    }
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      ClearSavedValue();
+      return;
     }
     direction_ = kReverse;
   }
@@ -209,6 +335,11 @@ void DBIter::Prev() {
 void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
   ValueType value_type = kTypeDeletion;
+  // 反向扫描时同一用户键的条目从旧到新出现：合并操作数按从旧到新收集，
+  // saved_value_ 中保存它们之前的值（has_base 为 true 时）
+  bool has_base = false;
+  bool base_is_blob = false;  // saved_value_ 中的值是否为 blob 索引
+  merge_operands_.clear();
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
@@ -218,11 +349,24 @@ void DBIter::FindPrevUserEntry() {
           break;
         }
         value_type = ikey.type;
+        if ((value_type == kTypeValue || value_type == kTypeMerge ||
+             value_type == kTypeBlobIndex) &&
+            IsCovered(ikey)) {
+          value_type = kTypeDeletion;
+        }
         // 如果删除，当前键清空，下个键必定不进入上面的if
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+          has_base = false;
+          merge_operands_.clear();
+        } else if (value_type == kTypeMerge) {
+          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+          merge_operands_.push_back(iter_->value().ToString());
         } else {
+          has_base = true;
+          base_is_blob = (value_type == kTypeBlobIndex);
+          merge_operands_.clear();
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
             std::string empty;
@@ -235,6 +379,29 @@ void DBIter::FindPrevUserEntry() {
       iter_->Prev();
     } while (iter_->Valid());
   }
+  if (has_base && base_is_blob &&
+      (value_type == kTypeBlobIndex || value_type == kTypeMerge)) {
+    // 从 blob 文件取回真实值
+    Status s = db_->ReadBlob(saved_value_, &saved_value_);
+    if (!s.ok()) {
+      status_ = s;
+      valid_ = false;
+      return;
+    }
+  }
+  if (value_type == kTypeMerge) {
+    std::reverse(merge_operands_.begin(), merge_operands_.end());
+    Slice existing(saved_value_);
+    Status s = MergeOperands(merge_operator_, saved_key_,
+                             has_base ? &existing : nullptr, merge_operands_,
+                             &saved_value_);
+    merge_operands_.clear();
+    if (!s.ok()) {
+      status_ = s;
+      valid_ = false;
+      return;
+    }
+  }
   if (value_type == kTypeDeletion) {
     // End
     valid_ = false;
@@ -248,6 +415,8 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  merged_ = false;
+  blob_value_ = false;
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
@@ -262,6 +431,8 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
+  blob_value_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -273,14 +444,18 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  merged_ = false;
+  blob_value_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
 }
 }  // namespace
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
-                        Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        const MergeOperator* merge_operator,
+                        Iterator* internal_iter, RangeTombstoneSet* range_dels,
+                        SequenceNumber sequence, uint32_t seed) {
+  return new DBIter(db, user_key_comparator, merge_operator, internal_iter,
+                    range_dels, sequence, seed);
 }
 }  // namespace leveldb
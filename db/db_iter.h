@@ -8,12 +8,18 @@
 
 namespace leveldb {
 class DBImpl;
+class MergeOperator;
+class RangeTombstoneSet;
 
 // 返回一个新的迭代器，该迭代器将指定 "sequence" 号时存活的内部键（由
 // "*internal_iter" 生成）转换为适当的用户键。
+// "*range_dels" 中的范围删除标记会隐藏它们覆盖的条目；没有标记时可以为 nullptr。
+// 合并操作数由 "merge_operator" 与更早的值合并，未配置时可以为 nullptr。
+// 返回的迭代器接管 internal_iter 与 range_dels 的所有权。
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
-                      Iterator* internal_iter, SequenceNumber sequence,
-                      uint32_t seed);
+                        const MergeOperator* merge_operator,
+                        Iterator* internal_iter, RangeTombstoneSet* range_dels,
+                        SequenceNumber sequence, uint32_t seed);
 }  // namespace leveldb
 
 #endif
\ No newline at end of file
@@ -0,0 +1,1720 @@
+#include "leveldb/db.h"
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "db/db_impl.h"
+#include "db/filename.h"
+#include "db/log_writer.h"
+#include "db/table_cache.h"
+#include "db/version_set.h"
+#include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/table_builder.h"
+#include "leveldb/write_buffer_manager.h"
+#include "table/format.h"
+#include "util/coding.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+// 可以手动拨动时钟、并统计打开随机读文件次数的环境
+class ClockEnv : public EnvWrapper {
+ public:
+  explicit ClockEnv(Env* base)
+      : EnvWrapper(base),
+        now_micros_(0),
+        random_access_files_(0),
+        schedule_delay_micros_(0) {}
+
+  uint64_t NowMicros() override {
+    const uint64_t fake = now_micros_.load(std::memory_order_acquire);
+    return fake != 0 ? fake : target()->NowMicros();
+  }
+
+  void SetNowSeconds(uint64_t seconds) {
+    now_micros_.store(seconds * 1000000, std::memory_order_release);
+  }
+
+  Status NewRandomAccessFile(const std::string& f,
+                             RandomAccessFile** r) override {
+    random_access_files_.fetch_add(1, std::memory_order_relaxed);
+    std::function<void()> hook;
+    {
+      MutexLock l(&hook_mutex_);
+      if (open_hook_ && f.find(hook_pattern_) != std::string::npos) {
+        hook = open_hook_;
+      }
+    }
+    if (hook) {
+      hook();
+    }
+    return target()->NewRandomAccessFile(f, r);
+  }
+
+  // 打开名字包含 "pattern" 的随机读文件前先调用 hook，用来在前台操作的
+  // 中途插入其他操作。hook 为空时取消
+  void SetOpenHook(const std::string& pattern, std::function<void()> hook) {
+    MutexLock l(&hook_mutex_);
+    hook_pattern_ = pattern;
+    open_hook_ = hook;
+  }
+
+  int random_access_files() const {
+    return random_access_files_.load(std::memory_order_relaxed);
+  }
+
+  // 后台任务推迟 micros 微秒再执行，用来拉开后台工作与前台的时序
+  void SetScheduleDelayMicros(int micros) {
+    schedule_delay_micros_.store(micros, std::memory_order_release);
+  }
+
+  void Schedule(void (*function)(void*), void* arg) override {
+    const int delay = schedule_delay_micros_.load(std::memory_order_acquire);
+    if (delay == 0) {
+      target()->Schedule(function, arg);
+      return;
+    }
+    target()->Schedule(&ClockEnv::DelayedCall,
+                       new DelayedWork{target(), delay, function, arg});
+  }
+
+ private:
+  struct DelayedWork {
+    Env* env;
+    int delay_micros;
+    void (*function)(void*);
+    void* arg;
+  };
+
+  static void DelayedCall(void* arg) {
+    DelayedWork* work = reinterpret_cast<DelayedWork*>(arg);
+    work->env->SleepForMicroseconds(work->delay_micros);
+    (*work->function)(work->arg);
+    delete work;
+  }
+
+  std::atomic<uint64_t> now_micros_;
+  std::atomic<int> random_access_files_;
+  std::atomic<int> schedule_delay_micros_;
+  port::Mutex hook_mutex_;
+  std::string hook_pattern_ GUARDED_BY(hook_mutex_);
+  std::function<void()> open_hook_ GUARDED_BY(hook_mutex_);
+};
+
+// 用逗号把操作数追加到已有值之后
+class StringAppendOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "test.StringAppendOperator"; }
+
+  bool FullMerge(const Slice& key, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    new_value->clear();
+    if (existing_value != nullptr) {
+      new_value->assign(existing_value->data(), existing_value->size());
+    }
+    for (const Slice& operand : operands) {
+      if (!new_value->empty()) {
+        new_value->push_back(',');
+      }
+      new_value->append(operand.data(), operand.size());
+    }
+    return true;
+  }
+
+  bool PartialMerge(const Slice& key, const std::vector<Slice>& operands,
+                    std::string* new_operand) const override {
+    return FullMerge(key, nullptr, operands, new_operand);
+  }
+};
+
+// 删除以 "expired:" 开头的值，将以 "old:" 开头的值改写为 "new:"
+class ExpiringCompactionFilter : public CompactionFilter {
+ public:
+  const char* Name() const override { return "test.ExpiringCompactionFilter"; }
+
+  Decision Filter(int level, const Slice& key, const Slice& existing_value,
+                  std::string* new_value) const override {
+    if (existing_value.starts_with("expired:")) {
+      return kRemove;
+    }
+    if (existing_value.starts_with("old:")) {
+      *new_value = "new:" + existing_value.ToString().substr(4);
+      return kChangeValue;
+    }
+    return kKeep;
+  }
+};
+
+class DBTest : public testing::Test {
+ public:
+  DBTest() : env_(Env::Default()), db_(nullptr) {
+    dbname_ = testing::TempDir() + "db_test";
+    DestroyDB(dbname_, Options());
+  }
+
+  ~DBTest() {
+    delete db_;
+    DestroyDB(dbname_, Options());
+  }
+
+  DBImpl* dbfull() { return reinterpret_cast<DBImpl*>(db_); }
+
+  Options CurrentOptions() {
+    Options options;
+    options.create_if_missing = true;
+    options.compression = kNoCompression;
+    options.env = &env_;
+    return options;
+  }
+
+  Status TryReopen(const Options& options) {
+    delete db_;
+    db_ = nullptr;
+    return DB::Open(options, dbname_, &db_);
+  }
+
+  void Reopen(const Options& options) { ASSERT_LEVELDB_OK(TryReopen(options)); }
+
+  Status Put(const std::string& k, const std::string& v) {
+    return db_->Put(WriteOptions(), k, v);
+  }
+
+  std::string Get(const std::string& k) {
+    std::string result;
+    Status s = db_->Get(ReadOptions(), k, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  Status DeleteRange(const std::string& begin, const std::string& end) {
+    return db_->DeleteRange(WriteOptions(), begin, end);
+  }
+
+  Status Merge(const std::string& k, const std::string& v) {
+    return db_->Merge(WriteOptions(), k, v);
+  }
+
+  // 以 "k=v " 的形式返回迭代器可见的全部内容，并检查反向遍历结果一致
+  std::string Contents(const Snapshot* snapshot = nullptr) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    Iterator* iter = db_->NewIterator(options);
+    std::string forward;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      forward += iter->key().ToString() + "=" + iter->value().ToString() + " ";
+    }
+    std::vector<std::string> backward;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      backward.push_back(iter->key().ToString() + "=" +
+                         iter->value().ToString() + " ");
+    }
+    EXPECT_LEVELDB_OK(iter->status());
+    delete iter;
+    std::string reversed;
+    for (auto it = backward.rbegin(); it != backward.rend(); ++it) {
+      reversed += *it;
+    }
+    EXPECT_EQ(forward, reversed);
+    return forward;
+  }
+
+  // 统计内部迭代器中的点条目数（包括被覆盖但尚未清理的条目）
+  int CountInternalEntries() {
+    Iterator* iter = dbfull()->TEST_NewInternalIterator();
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    delete iter;
+    return count;
+  }
+
+  int NumTableFilesAtLevel(int level) {
+    std::string property;
+    EXPECT_TRUE(db_->GetProperty(
+        "leveldb.num-files-at-level" + NumberToString(level), &property));
+    return std::stoi(property);
+  }
+
+  int TotalTableFiles() {
+    int result = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      result += NumTableFilesAtLevel(level);
+    }
+    return result;
+  }
+
+  // 写入一个 key 并落盘，生成一个新的 level-0 文件
+  void FlushFile(const std::string& k, const std::string& v) {
+    ASSERT_LEVELDB_OK(Put(k, v));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+
+  // 统计数据库中（不含 memtable 中已合并部分）删除标记的数量
+  int CountDeletions() {
+    Iterator* iter = dbfull()->TEST_NewInternalIterator();
+    int count = 0;
+    ParsedInternalKey ikey;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      if (ParseInternalKey(iter->key(), &ikey) && ikey.type == kTypeDeletion) {
+        count++;
+      }
+    }
+    delete iter;
+    return count;
+  }
+
+  // 统计数据库目录中的 blob 文件数
+  int CountBlobFiles() {
+    std::vector<std::string> filenames;
+    EXPECT_LEVELDB_OK(env_.GetChildren(dbname_, &filenames));
+    uint64_t number;
+    FileType type;
+    int count = 0;
+    for (const std::string& filename : filenames) {
+      if (ParseFileName(filename, &number, &type) && type == kBlobFile) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  // 统计使用分区索引的表文件数，依据是 footer 中的魔数
+  int CountPartitionedIndexTables() {
+    std::vector<std::string> filenames;
+    EXPECT_LEVELDB_OK(env_.GetChildren(dbname_, &filenames));
+    uint64_t number;
+    FileType type;
+    int count = 0;
+    for (const std::string& filename : filenames) {
+      if (ParseFileName(filename, &number, &type) && type == kTableFile) {
+        std::string contents;
+        EXPECT_LEVELDB_OK(ReadFileToString(
+            &env_, TableFileName(dbname_, number), &contents));
+        if (contents.size() >= 8 &&
+            DecodeFixed64(contents.data() + contents.size() - 8) ==
+                kPartitionedIndexMagicNumber) {
+          count++;
+        }
+      }
+    }
+    return count;
+  }
+
+  // 统计内部迭代器中的 blob 索引条目数
+  int CountBlobIndexes() {
+    Iterator* iter = dbfull()->TEST_NewInternalIterator();
+    int count = 0;
+    ParsedInternalKey ikey;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      if (ParseInternalKey(iter->key(), &ikey) &&
+          ikey.type == kTypeBlobIndex) {
+        count++;
+      }
+    }
+    delete iter;
+    return count;
+  }
+
+  // 轮询等待 "level" 层的文件数不超过 "n"，后台删除是异步完成的
+  int WaitForFilesAtLevel(int level, int n) {
+    int files = NumTableFilesAtLevel(level);
+    for (int i = 0; i < 1000 && files > n; i++) {
+      env_.SleepForMicroseconds(1000);
+      files = NumTableFilesAtLevel(level);
+    }
+    return files;
+  }
+
+  // 用公开的 TableBuilder 生成一个外部表文件，键值按给定顺序写入
+  std::string BuildExternalFile(
+      const std::string& name,
+      const std::vector<std::pair<std::string, std::string>>& kvs) {
+    const std::string path = testing::TempDir() + "db_test_" + name + ".sst";
+    WritableFile* file;
+    EXPECT_LEVELDB_OK(env_.NewWritableFile(path, &file));
+    Options options;
+    options.compression = kNoCompression;
+    TableBuilder builder(options, file);
+    for (const auto& kv : kvs) {
+      builder.Add(kv.first, kv.second);
+    }
+    EXPECT_LEVELDB_OK(builder.Finish());
+    EXPECT_LEVELDB_OK(file->Close());
+    delete file;
+    return path;
+  }
+
+  ClockEnv env_;
+  std::string dbname_;
+  DB* db_;
+};
+
+TEST_F(DBTest, FIFOKeepsAllFilesInLevel0) {
+  Options options = CurrentOptions();
+  options.compaction_style = kCompactionStyleFIFO;
+  Reopen(options);
+
+  for (int i = 0; i < 2 * config::kL0_StopWritesTrigger; i++) {
+    FlushFile("key" + NumberToString(i), std::string(1000, 'v'));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(2 * config::kL0_StopWritesTrigger, NumTableFilesAtLevel(0));
+  ASSERT_EQ(2 * config::kL0_StopWritesTrigger, TotalTableFiles());
+  ASSERT_EQ(std::string(1000, 'v'), Get("key0"));
+}
+
+TEST_F(DBTest, FIFODropsOldestFilesOverSizeLimit) {
+  Options options = CurrentOptions();
+  options.compaction_style = kCompactionStyleFIFO;
+  options.fifo_max_table_files_size = 10 * 1100;
+  Reopen(options);
+
+  for (int i = 0; i < 20; i++) {
+    FlushFile("key" + NumberToString(i), std::string(1000, 'v'));
+  }
+  const int files = WaitForFilesAtLevel(0, 10);
+  ASSERT_LE(files, 10);
+  ASSERT_GT(files, 0);
+  ASSERT_EQ("NOT_FOUND", Get("key0"));
+  ASSERT_EQ(std::string(1000, 'v'), Get("key19"));
+}
+
+TEST_F(DBTest, FIFODropsExpiredFiles) {
+  Options options = CurrentOptions();
+  options.compaction_style = kCompactionStyleFIFO;
+  options.fifo_ttl_seconds = 100;
+  env_.SetNowSeconds(1000);
+  Reopen(options);
+
+  FlushFile("old1", "v");
+  FlushFile("old2", "v");
+  env_.SetNowSeconds(1050);
+  FlushFile("new", "v");
+  ASSERT_EQ(3, NumTableFilesAtLevel(0));
+
+  // 重新打开时保留文件创建时间，过期检查同样有效
+  Reopen(options);
+  env_.SetNowSeconds(1120);
+  FlushFile("newest", "v");
+  ASSERT_EQ(2, WaitForFilesAtLevel(0, 2));
+  ASSERT_EQ("NOT_FOUND", Get("old1"));
+  ASSERT_EQ("NOT_FOUND", Get("old2"));
+  ASSERT_EQ("v", Get("new"));
+  ASSERT_EQ("v", Get("newest"));
+}
+
+TEST_F(DBTest, FIFOExpiresFilesWithoutWrites) {
+  Options options = CurrentOptions();
+  options.compaction_style = kCompactionStyleFIFO;
+  options.fifo_ttl_seconds = 100;
+  env_.SetNowSeconds(1000);
+  Reopen(options);
+
+  FlushFile("old", "v");
+  env_.SetNowSeconds(1050);
+  FlushFile("new", "v");
+  ASSERT_EQ(2, NumTableFilesAtLevel(0));
+
+  // 之后只有读取，过期的文件同样会被删除
+  env_.SetNowSeconds(1120);
+  ASSERT_EQ("NOT_FOUND", Get("missing"));
+  ASSERT_EQ(1, WaitForFilesAtLevel(0, 1));
+  ASSERT_EQ("NOT_FOUND", Get("old"));
+  ASSERT_EQ("v", Get("new"));
+
+  env_.SetNowSeconds(1200);
+  delete db_->NewIterator(ReadOptions());
+  ASSERT_EQ(0, WaitForFilesAtLevel(0, 0));
+  ASSERT_EQ("", Contents());
+}
+
+TEST_F(DBTest, FIFORejectsFilesAboveLevel0) {
+  Reopen(CurrentOptions());
+  ASSERT_LEVELDB_OK(Put("a", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+
+  // 其他层级的文件在 FIFO 风格下永远不会被删除
+  Options options = CurrentOptions();
+  options.compaction_style = kCompactionStyleFIFO;
+  ASSERT_TRUE(TryReopen(options).IsInvalidArgument());
+
+  // 数据库仍可以按分层风格打开
+  Reopen(CurrentOptions());
+  ASSERT_EQ("v", Get("a"));
+}
+
+TEST_F(DBTest, TombstoneDenseFileIsCompacted) {
+  Options options = CurrentOptions();
+  options.tombstone_compaction_ratio = 0.5;
+  Reopen(options);
+
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), "k" + NumberToString(i)));
+  }
+  ASSERT_LEVELDB_OK(Put("z", "vz"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+
+  // 后台会不断把这个文件压到下一层，直到删除标记全部被丢弃
+  int deletions = CountDeletions();
+  for (int i = 0; i < 1000 && deletions > 0; i++) {
+    env_.SleepForMicroseconds(1000);
+    deletions = CountDeletions();
+  }
+  ASSERT_EQ(0, deletions);
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vz", Get("z"));
+  ASSERT_EQ("NOT_FOUND", Get("k5"));
+}
+
+TEST_F(DBTest, VerifyChecksumsOnTableRead) {
+  Reopen(CurrentOptions());
+  FlushFile("a", "v1");
+  FlushFile("b", "v2");
+
+  // 块的校验和覆盖块内容与类型字节，与 ReadBlock 的校验一致
+  ReadOptions read_options;
+  read_options.verify_checksums = true;
+  std::string value;
+  ASSERT_LEVELDB_OK(db_->Get(read_options, "a", &value));
+  ASSERT_EQ("v1", value);
+  Iterator* iter = db_->NewIterator(read_options);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  ASSERT_EQ(2, count);
+  delete iter;
+}
+
+TEST_F(DBTest, MinOverlappingRatio) {
+  Options options = CurrentOptions();
+  options.compaction_pri = kMinOverlappingRatio;
+  options.write_buffer_size = 10000;
+  options.max_file_size = 10000;
+  Reopen(options);
+
+  Random rnd(301);
+  std::string values[500];
+  for (int round = 0; round < 20; round++) {
+    for (int i = 0; i < 500; i++) {
+      const int k = rnd.Uniform(500);
+      test::RandomString(&rnd, 100, &values[k]);
+      ASSERT_LEVELDB_OK(Put("key" + NumberToString(k), values[k]));
+    }
+  }
+  Reopen(options);
+  for (int k = 0; k < 500; k++) {
+    const std::string expected = values[k].empty() ? "NOT_FOUND" : values[k];
+    ASSERT_EQ(expected, Get("key" + NumberToString(k)));
+  }
+}
+TEST_F(DBTest, DeleteRangeInMemTable) {
+  Reopen(CurrentOptions());
+  for (char c = 'a'; c <= 'h'; c++) {
+    ASSERT_LEVELDB_OK(Put(std::string(1, c), "v"));
+  }
+  ASSERT_LEVELDB_OK(DeleteRange("c", "f"));
+  ASSERT_EQ("v", Get("b"));
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+  ASSERT_EQ("NOT_FOUND", Get("e"));
+  ASSERT_EQ("v", Get("f"));
+  ASSERT_EQ("a=v b=v f=v g=v h=v ", Contents());
+
+  // 之后的写入不受影响
+  ASSERT_LEVELDB_OK(Put("d", "new"));
+  ASSERT_EQ("new", Get("d"));
+  ASSERT_EQ("a=v b=v d=new f=v g=v h=v ", Contents());
+}
+
+TEST_F(DBTest, DeleteRangeInvalidArguments) {
+  Reopen(CurrentOptions());
+  ASSERT_LEVELDB_OK(Put("a", "v"));
+  ASSERT_TRUE(DeleteRange("b", "a").IsInvalidArgument());
+  ASSERT_LEVELDB_OK(DeleteRange("a", "a"));
+  ASSERT_EQ("v", Get("a"));
+}
+
+TEST_F(DBTest, DeleteRangeRespectsSnapshots) {
+  Reopen(CurrentOptions());
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  ASSERT_LEVELDB_OK(Put("b", "v1"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(DeleteRange("a", "z"));
+  ASSERT_EQ("", Contents());
+  ASSERT_EQ("a=v1 b=v1 ", Contents(snapshot));
+
+  // 标记与被覆盖的数据经过落盘与压缩后，快照仍能看到旧值
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ReadOptions options;
+  options.snapshot = snapshot;
+  std::string value;
+  ASSERT_LEVELDB_OK(db_->Get(options, "a", &value));
+  ASSERT_EQ("v1", value);
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("a=v1 b=v1 ", Contents(snapshot));
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST_F(DBTest, DeleteRangeSurvivesFlushAndReopen) {
+  Options options = CurrentOptions();
+  Reopen(options);
+  for (int i = 0; i < 10; i++) {
+    ASSERT_LEVELDB_OK(Put("key" + NumberToString(i), "v"));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  // 只含范围删除标记的 memtable 也会生成一个文件
+  ASSERT_LEVELDB_OK(DeleteRange("key2", "key5"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(2, TotalTableFiles());
+  ASSERT_EQ("NOT_FOUND", Get("key3"));
+  ASSERT_EQ("v", Get("key5"));
+
+  Reopen(options);
+  ASSERT_EQ("v", Get("key1"));
+  ASSERT_EQ("NOT_FOUND", Get("key2"));
+  ASSERT_EQ("NOT_FOUND", Get("key4"));
+  ASSERT_EQ("key0=v key1=v key5=v key6=v key7=v key8=v key9=v ", Contents());
+}
+
+TEST_F(DBTest, DeleteRangeCompactionDropsCoveredEntries) {
+  Reopen(CurrentOptions());
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put("key" + NumberToString(1000 + i), "v"));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(DeleteRange("key1010", "key1090"));
+  ASSERT_LEVELDB_OK(Put("key1050", "new"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(101, CountInternalEntries());
+
+  db_->CompactRange(nullptr, nullptr);
+  // 被覆盖的条目与已无用的标记都被丢弃
+  ASSERT_EQ(21, CountInternalEntries());
+  ASSERT_EQ("v", Get("key1009"));
+  ASSERT_EQ("NOT_FOUND", Get("key1010"));
+  ASSERT_EQ("new", Get("key1050"));
+  ASSERT_EQ("v", Get("key1090"));
+
+  Reopen(CurrentOptions());
+  ASSERT_EQ("NOT_FOUND", Get("key1089"));
+  ASSERT_EQ("new", Get("key1050"));
+}
+
+TEST_F(DBTest, DeleteRangeDropsCoveredFiles) {
+  Options options = CurrentOptions();
+  Reopen(options);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put("key" + NumberToString(1000 + i), "v"));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(1, TotalTableFiles());
+
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(DeleteRange("key", "kez"));
+  ASSERT_LEVELDB_OK(Put("z", "vz"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(2, CountInternalEntries());
+  ASSERT_EQ("a=va z=vz ", Contents());
+  Reopen(options);
+  ASSERT_EQ("a=va z=vz ", Contents());
+}
+
+TEST_F(DBTest, MergeWithoutOperator) {
+  Reopen(CurrentOptions());
+  ASSERT_TRUE(Merge("a", "1").IsNotSupported());
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+}
+
+TEST_F(DBTest, MergeInMemTable) {
+  StringAppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a", "1"));
+  ASSERT_LEVELDB_OK(Merge("a", "2"));
+  ASSERT_LEVELDB_OK(Merge("a", "3"));
+  ASSERT_LEVELDB_OK(Merge("b", "x"));
+  ASSERT_LEVELDB_OK(Put("c", "v"));
+  ASSERT_EQ("1,2,3", Get("a"));
+  ASSERT_EQ("x", Get("b"));
+  ASSERT_EQ("a=1,2,3 b=x c=v ", Contents());
+
+  ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), "a"));
+  ASSERT_LEVELDB_OK(Merge("a", "4"));
+  ASSERT_EQ("4", Get("a"));
+  ASSERT_EQ("a=4 b=x c=v ", Contents());
+}
+
+TEST_F(DBTest, MergeAcrossFilesAndCompaction) {
+  StringAppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a", "1"));
+  ASSERT_LEVELDB_OK(Put("b", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Merge("a", "2"));
+  ASSERT_LEVELDB_OK(Merge("c", "x"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Merge("a", "3"));
+  ASSERT_LEVELDB_OK(Merge("c", "y"));
+  ASSERT_EQ("1,2,3", Get("a"));
+  ASSERT_EQ("x,y", Get("c"));
+  ASSERT_EQ("a=1,2,3 b=v c=x,y ", Contents());
+
+  db_->CompactRange(nullptr, nullptr);
+  // 操作数已折叠为普通的值
+  ASSERT_EQ(3, CountInternalEntries());
+  ASSERT_EQ("a=1,2,3 b=v c=x,y ", Contents());
+
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Merge("a", "4"));
+  ASSERT_EQ("1,2,3,4", Get("a"));
+  ASSERT_EQ("a=1,2,3,4 b=v c=x,y ", Contents());
+}
+
+TEST_F(DBTest, MergeRespectsSnapshots) {
+  StringAppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a", "1"));
+  ASSERT_LEVELDB_OK(Merge("a", "2"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Merge("a", "3"));
+  ASSERT_LEVELDB_OK(Merge("a", "4"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+
+  db_->CompactRange(nullptr, nullptr);
+  ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  std::string value;
+  ASSERT_LEVELDB_OK(db_->Get(read_options, "a", &value));
+  ASSERT_EQ("1,2", value);
+  ASSERT_EQ("a=1,2 ", Contents(snapshot));
+  ASSERT_EQ("1,2,3,4", Get("a"));
+  // 快照之前的条目合并为一个值，快照之后的操作数保持原样
+  ASSERT_EQ(3, CountInternalEntries());
+
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_EQ("a=1,2,3,4 ", Contents());
+}
+
+TEST_F(DBTest, MergeWithDeleteRange) {
+  StringAppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a", "1"));
+  ASSERT_LEVELDB_OK(Merge("b", "2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(DeleteRange("a", "c"));
+  ASSERT_LEVELDB_OK(Merge("a", "3"));
+  ASSERT_EQ("3", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("a=3 ", Contents());
+
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("3", Get("a"));
+  ASSERT_EQ("a=3 ", Contents());
+}
+
+TEST_F(DBTest, MergeIteratorDirectionChanges) {
+  StringAppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Merge("b", "2"));
+  ASSERT_LEVELDB_OK(Merge("c", "3"));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("b");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("b", iter->key().ToString());
+  ASSERT_EQ("1,2", iter->value().ToString());
+  iter->Next();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("c", iter->key().ToString());
+  ASSERT_EQ("3", iter->value().ToString());
+  iter->Prev();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("b", iter->key().ToString());
+  ASSERT_EQ("1,2", iter->value().ToString());
+  iter->Prev();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("a", iter->key().ToString());
+  iter->Next();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("b", iter->key().ToString());
+  ASSERT_EQ("1,2", iter->value().ToString());
+  iter->Seek("c");
+  iter->Prev();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("b", iter->key().ToString());
+  iter->Next();
+  iter->Next();
+  ASSERT_FALSE(iter->Valid());
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+}
+
+TEST_F(DBTest, CompactionFilterRemovesAndChangesValues) {
+  ExpiringCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a", "keep"));
+  ASSERT_LEVELDB_OK(Put("b", "expired:1"));
+  ASSERT_LEVELDB_OK(Put("d", "expired:2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("c", "old:1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  // memtable 落盘时不调用过滤器
+  ASSERT_EQ("a=keep b=expired:1 c=old:1 d=expired:2 ", Contents());
+
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("a=keep c=new:1 ", Contents());
+  // 更深层没有数据，被删除的键直接丢弃，不留下删除标记
+  ASSERT_EQ(2, CountInternalEntries());
+}
+
+TEST_F(DBTest, CompactionFilterHidesDeeperValues) {
+  ExpiringCompactionFilter filter;
+  Options options = CurrentOptions();
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  ASSERT_LEVELDB_OK(Put("z", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_EQ(1, NumTableFilesAtLevel(3));
+  ASSERT_LEVELDB_OK(Put("a", "v2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("a", "v3"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+
+  options.compaction_filter = &filter;
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a", "expired:1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int level = 0; level <= 3; level++) {
+    ASSERT_EQ(1, NumTableFilesAtLevel(level));
+  }
+
+  // 更深层还有 "a" 的旧值，被删除的值变成删除标记
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("z=v1 ", Contents());
+}
+
+TEST_F(DBTest, CompactionFilterRespectsSnapshots) {
+  ExpiringCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a", "v"));
+  ASSERT_LEVELDB_OK(Put("b", "expired:1"));
+  ASSERT_LEVELDB_OK(Put("c", "old:1"));
+  ASSERT_LEVELDB_OK(Put("e", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Put("d", "expired:2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+
+  // 快照能看到的值不交给过滤器，快照之后写入的值照常过滤
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("a=v b=expired:1 c=old:1 e=v ", Contents(snapshot));
+  ASSERT_EQ("a=v b=expired:1 c=old:1 e=v ", Contents());
+  db_->ReleaseSnapshot(snapshot);
+
+  ASSERT_LEVELDB_OK(Put("a", "v2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("a=v2 c=new:1 e=v ", Contents());
+}
+TEST_F(DBTest, BlobSeparatesLargeValues) {
+  StringAppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.min_blob_size = 100;
+  options.merge_operator = &merge_operator;
+  Reopen(options);
+  const std::string big1(200, '1');
+  const std::string big2(300, '2');
+  ASSERT_LEVELDB_OK(Put("a", "small"));
+  ASSERT_LEVELDB_OK(Put("b", big1));
+  ASSERT_LEVELDB_OK(Put("c", big2));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, CountBlobFiles());
+  ASSERT_EQ(2, CountBlobIndexes());
+  ASSERT_EQ(big1, Get("b"));
+  ASSERT_EQ("a=small b=" + big1 + " c=" + big2 + " ", Contents());
+
+  // 合并操作数与 blob 中的值合并
+  ASSERT_LEVELDB_OK(Merge("c", "x"));
+  ASSERT_EQ(big2 + ",x", Get("c"));
+  ASSERT_EQ("a=small b=" + big1 + " c=" + big2 + ",x ", Contents());
+
+  Reopen(options);
+  ASSERT_EQ(big1, Get("b"));
+  ASSERT_EQ(big2 + ",x", Get("c"));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("a=small b=" + big1 + " c=" + big2 + ",x ", Contents());
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.blob-stats", &property));
+  ASSERT_NE(std::string::npos, property.find("Blob files: "));
+}
+
+TEST_F(DBTest, BlobFilesDeletedWhenFullyGarbage) {
+  Options options = CurrentOptions();
+  options.min_blob_size = 100;
+  options.blob_gc_ratio = 2;  // 不重写存活记录
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a", std::string(200, 'a')));
+  ASSERT_LEVELDB_OK(Put("b", std::string(200, 'b')));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("a", std::string(200, 'A')));
+  ASSERT_LEVELDB_OK(Put("b", std::string(200, 'B')));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(2, CountBlobFiles());
+
+  // 旧值被丢弃后第一个 blob 文件全部成为垃圾
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(1, CountBlobFiles());
+  ASSERT_EQ(std::string(200, 'A'), Get("a"));
+  ASSERT_EQ(std::string(200, 'B'), Get("b"));
+
+  Reopen(options);
+  ASSERT_EQ(1, CountBlobFiles());
+  ASSERT_EQ(std::string(200, 'B'), Get("b"));
+}
+
+TEST_F(DBTest, BlobGarbageCollectionRelocatesLiveValues) {
+  Options options = CurrentOptions();
+  options.min_blob_size = 100;
+  options.blob_gc_ratio = 0.5;
+  Reopen(options);
+  for (int i = 0; i < 10; i++) {
+    ASSERT_LEVELDB_OK(Put("k" + NumberToString(i), std::string(200, 'a' + i)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 6; i++) {
+    ASSERT_LEVELDB_OK(Put("k" + NumberToString(i), std::string(200, 'A' + i)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  // 第一个 blob 文件中 6 条记录成为垃圾，超过回收比例
+  ASSERT_EQ(2, CountBlobFiles());
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.blob-stats", &property));
+  ASSERT_EQ(std::string::npos, property.find("Garbage bytes: 0\n"));
+
+  // 下一次压缩将剩余的存活记录重写到新的 blob 文件
+  ASSERT_LEVELDB_OK(Put("k55", "small"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(2, CountBlobFiles());
+  ASSERT_TRUE(db_->GetProperty("leveldb.blob-stats", &property));
+  ASSERT_NE(std::string::npos, property.find("Garbage bytes: 0\n"));
+  for (int i = 0; i < 10; i++) {
+    const char c = static_cast<char>(i < 6 ? 'A' + i : 'a' + i);
+    ASSERT_EQ(std::string(200, c), Get("k" + NumberToString(i)));
+  }
+}
+
+TEST_F(DBTest, IngestExternalFile) {
+  Options options = CurrentOptions();
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("a", "old"));
+  ASSERT_LEVELDB_OK(Put("c", "old"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+
+  const std::string f1 =
+      BuildExternalFile("ext1", {{"b", "v1"}, {"c", "v1"}, {"d", "v1"}});
+  const std::string f2 = BuildExternalFile("ext2", {{"x", "v2"}, {"y", "v2"}});
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile({f2, f1}));
+
+  // 与 memtable 重叠的文件会先触发刷盘，导入的数据覆盖旧值
+  ASSERT_EQ("a=old b=v1 c=v1 d=v1 x=v2 y=v2 ", Contents());
+  ASSERT_EQ("v1", Get("c"));
+  ASSERT_EQ("a=old c=old ", Contents(snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  // 与任何文件都不重叠的 f2 被放到最深层
+  ASSERT_EQ(1, NumTableFilesAtLevel(config::kNumLevels - 1));
+
+  // 源文件保持不变，可以再次导入
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile({f2}));
+  ASSERT_EQ("v2", Get("y"));
+
+  Reopen(options);
+  ASSERT_EQ("a=old b=v1 c=v1 d=v1 x=v2 y=v2 ", Contents());
+  ASSERT_LEVELDB_OK(Put("y", "new"));
+  ASSERT_EQ("new", Get("y"));
+  env_.RemoveFile(f1);
+  env_.RemoveFile(f2);
+}
+
+TEST_F(DBTest, IngestExternalFileDoesNotBlockWrites) {
+  Options options = CurrentOptions();
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("c", "old"));
+  const std::string f1 =
+      BuildExternalFile("ext1", {{"b", "v1"}, {"c", "v1"}, {"d", "v1"}});
+
+  // 第一次打开外部文件是校验，第二次是转换。转换期间写入不被阻塞，
+  // 且比导入的数据新
+  int opens = 0;
+  env_.SetOpenHook("db_test_ext1", [&]() {
+    if (++opens == 2) {
+      ASSERT_LEVELDB_OK(Put("d", "during"));
+      ASSERT_LEVELDB_OK(Put("z", "during"));
+    }
+  });
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile({f1}));
+  env_.SetOpenHook("", nullptr);
+  ASSERT_EQ(2, opens);
+  ASSERT_EQ("b=v1 c=v1 d=during z=during ", Contents());
+  ASSERT_EQ("during", Get("d"));
+
+  Reopen(options);
+  ASSERT_EQ("b=v1 c=v1 d=during z=during ", Contents());
+  env_.RemoveFile(f1);
+}
+
+TEST_F(DBTest, IngestExternalFileRetriesOnConflict) {
+  Options options = CurrentOptions();
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("c", "old"));
+  const std::string f1 =
+      BuildExternalFile("ext1", {{"b", "v1"}, {"c", "v1"}, {"d", "v1"}});
+
+  // 转换期间写入同一范围的数据被压缩到 level-1 以下，导入的文件无法放到
+  // 它们之下，只能用新的序列号重新转换，导入的数据因此更新
+  int opens = 0;
+  env_.SetOpenHook("db_test_ext1", [&]() {
+    if (++opens == 2) {
+      ASSERT_LEVELDB_OK(Put("d", "during"));
+      ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+      dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+      ASSERT_EQ(0, NumTableFilesAtLevel(0));
+    }
+  });
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile({f1}));
+  ASSERT_EQ(3, opens);
+  ASSERT_EQ("b=v1 c=v1 d=v1 ", Contents());
+  ASSERT_EQ("v1", Get("d"));
+
+  // 转换期间创建的快照在安装前后看到的内容必须一致
+  const std::string f2 = BuildExternalFile("ext2", {{"c", "v2"}});
+  const Snapshot* snapshot = nullptr;
+  opens = 0;
+  env_.SetOpenHook("db_test_ext2", [&]() {
+    if (++opens == 2) {
+      snapshot = db_->GetSnapshot();
+    }
+  });
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile({f2}));
+  env_.SetOpenHook("", nullptr);
+  ASSERT_EQ(3, opens);
+  ASSERT_EQ("b=v1 c=v1 d=v1 ", Contents(snapshot));
+  ASSERT_EQ("b=v1 c=v2 d=v1 ", Contents());
+  db_->ReleaseSnapshot(snapshot);
+
+  Reopen(options);
+  ASSERT_EQ("b=v1 c=v2 d=v1 ", Contents());
+  env_.RemoveFile(f1);
+  env_.RemoveFile(f2);
+}
+
+TEST_F(DBTest, IngestExternalFileRejectsInvalidInput) {
+  Options options = CurrentOptions();
+  Reopen(options);
+  ASSERT_LEVELDB_OK(Put("k", "v"));
+  const std::string garbage = testing::TempDir() + "db_test_garbage.sst";
+  ASSERT_LEVELDB_OK(
+      WriteStringToFile(&env_, std::string(100, 'x'), garbage));
+  const std::string empty = BuildExternalFile("empty", {});
+  const std::string f1 = BuildExternalFile("ext1", {{"a", "1"}, {"m", "1"}});
+  const std::string f2 = BuildExternalFile("ext2", {{"k", "2"}, {"z", "2"}});
+  ASSERT_TRUE(db_->IngestExternalFile({garbage}).IsInvalidArgument());
+  ASSERT_TRUE(db_->IngestExternalFile({empty}).IsInvalidArgument());
+  ASSERT_TRUE(db_->IngestExternalFile({f1, f2}).IsInvalidArgument());
+  ASSERT_TRUE(db_->IngestExternalFile({testing::TempDir() + "db_test_missing"})
+                  .IsInvalidArgument());
+  ASSERT_EQ("k=v ", Contents());
+  ASSERT_EQ(0, TotalTableFiles());
+  env_.RemoveFile(garbage);
+  env_.RemoveFile(empty);
+  env_.RemoveFile(f1);
+  env_.RemoveFile(f2);
+}
+
+TEST_F(DBTest, DisableWAL) {
+  Options options = CurrentOptions();
+  Reopen(options);
+  WriteOptions write_options;
+  write_options.disable_wal = true;
+  ASSERT_LEVELDB_OK(db_->Put(write_options, "foo", "v1"));
+  ASSERT_LEVELDB_OK(db_->Put(write_options, "bar", "v2"));
+  ASSERT_EQ("v1", Get("foo"));
+
+  // 日志文件中没有任何记录
+  std::vector<std::string> filenames;
+  ASSERT_LEVELDB_OK(env_.GetChildren(dbname_, &filenames));
+  uint64_t number;
+  FileType type;
+  int logs = 0;
+  for (const std::string& filename : filenames) {
+    if (ParseFileName(filename, &number, &type) && type == kLogFile) {
+      uint64_t size;
+      ASSERT_LEVELDB_OK(env_.GetFileSize(dbname_ + "/" + filename, &size));
+      ASSERT_EQ(0, size);
+      logs++;
+    }
+  }
+  ASSERT_EQ(1, logs);
+
+  // 关闭数据库时刷写 memtable，数据不会丢失
+  Reopen(options);
+  ASSERT_EQ("bar=v2 foo=v1 ", Contents());
+}
+
+TEST_F(DBTest, DisableWALInImmutableMemTable) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 64 << 10;
+  Reopen(options);
+
+  // 未记日志的数据写满 memtable，随后一次记日志的写入把它切换为 imm_
+  WriteOptions unlogged;
+  unlogged.disable_wal = true;
+  const int kNum = 50;
+  const std::string value(1000, 'x');
+  for (int i = 0; i < kNum; i++) {
+    ASSERT_LEVELDB_OK(db_->Put(unlogged, NumberToString(i), value));
+  }
+  ASSERT_LEVELDB_OK(db_->Put(unlogged, "big", std::string(20000, 'y')));
+  env_.SetScheduleDelayMicros(200000);
+  ASSERT_LEVELDB_OK(Put("last", "v"));
+
+  // imm_ 的刷写还没开始就关闭数据库，数据也不会丢失
+  Reopen(options);
+  env_.SetScheduleDelayMicros(0);
+  for (int i = 0; i < kNum; i++) {
+    ASSERT_EQ(value, Get(NumberToString(i)));
+  }
+  ASSERT_EQ(std::string(20000, 'y'), Get("big"));
+  ASSERT_EQ("v", Get("last"));
+}
+
+TEST_F(DBTest, OpenForBulkLoad) {
+  Options options = CurrentOptions();
+  delete db_;
+  db_ = nullptr;
+  ASSERT_LEVELDB_OK(DB::OpenForBulkLoad(options, dbname_, &db_));
+
+  // 每个 memtable 都覆盖整个键范围，level-0 文件数超过停写阈值也不会阻塞
+  const int kRounds = config::kL0_StopWritesTrigger + 4;
+  for (int r = 0; r < kRounds; r++) {
+    for (int i = 0; i < 100; i++) {
+      char key[16];
+      std::snprintf(key, sizeof(key), "key%03d", i);
+      ASSERT_LEVELDB_OK(Put(key, "v" + NumberToString(r)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_GE(NumTableFilesAtLevel(0), config::kL0_StopWritesTrigger);
+  ASSERT_EQ("v" + NumberToString(kRounds - 1), Get("key042"));
+
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_EQ(100, CountInternalEntries());
+
+  Reopen(options);
+  ASSERT_EQ("v" + NumberToString(kRounds - 1), Get("key000"));
+  ASSERT_EQ("v" + NumberToString(kRounds - 1), Get("key099"));
+}
+
+TEST_F(DBTest, CreateCheckpoint) {
+  Options options = CurrentOptions();
+  options.min_blob_size = 100;
+  Reopen(options);
+  FlushFile("a", "v1");
+  FlushFile("b", std::string(200, 'b'));
+  ASSERT_LEVELDB_OK(Put("c", "v3"));  // 只在 memtable 与日志中
+  WriteOptions unlogged;
+  unlogged.disable_wal = true;
+  ASSERT_LEVELDB_OK(db_->Put(unlogged, "d", "v4"));
+
+  const std::string checkpoint = dbname_ + "_checkpoint";
+  DestroyDB(checkpoint, Options());
+  ASSERT_LEVELDB_OK(db_->CreateCheckpoint(checkpoint));
+  ASSERT_TRUE(db_->CreateCheckpoint(checkpoint).IsInvalidArgument());
+
+  // 检查点之后的修改与压缩不影响检查点
+  ASSERT_LEVELDB_OK(Put("a", "new"));
+  ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), "b"));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("a=new c=v3 d=v4 ", Contents());
+
+  Options checkpoint_options = options;
+  checkpoint_options.create_if_missing = false;
+  DB* db = nullptr;
+  ASSERT_LEVELDB_OK(DB::Open(checkpoint_options, checkpoint, &db));
+  std::string value;
+  ASSERT_LEVELDB_OK(db->Get(ReadOptions(), "a", &value));
+  ASSERT_EQ("v1", value);
+  ASSERT_LEVELDB_OK(db->Get(ReadOptions(), "b", &value));
+  ASSERT_EQ(std::string(200, 'b'), value);
+  ASSERT_LEVELDB_OK(db->Get(ReadOptions(), "c", &value));
+  ASSERT_EQ("v3", value);
+  ASSERT_LEVELDB_OK(db->Get(ReadOptions(), "d", &value));
+  ASSERT_EQ("v4", value);
+  delete db;
+  ASSERT_LEVELDB_OK(DestroyDB(checkpoint, Options()));
+}
+
+TEST_F(DBTest, RecoverMultipleLogs) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 16 * 1024;
+  options.min_blob_size = 500;
+  Reopen(options);
+  delete db_;
+  db_ = nullptr;
+
+  // 伪造多个未写入 MANIFEST 的旧日志，每个日志都会重放成多个表。
+  // 后面的日志覆盖前面日志中的同一批键。
+  const int kLogs = 6;
+  const int kKeys = 1000;
+  SequenceNumber seq = 1;
+  for (int i = 0; i < kLogs; i++) {
+    WritableFile* file;
+    ASSERT_LEVELDB_OK(
+        env_.NewWritableFile(LogFileName(dbname_, 100 + i), &file));
+    log::Writer writer(file);
+    for (int k = 0; k < kKeys; k++) {
+      WriteBatch batch;
+      char key[20];
+      std::snprintf(key, sizeof(key), "key%06d", k);
+      const std::string value = NumberToString(i) + ":" +
+                                std::string(k % 7 == 0 ? 600 : 100, 'x');
+      batch.Put(key, value);
+      if (k % 50 == 0) {
+        batch.Delete("deleted" + NumberToString(i));
+      }
+      WriteBatchInternal::SetSequence(&batch, seq);
+      seq += WriteBatchInternal::Count(&batch);
+      ASSERT_LEVELDB_OK(writer.AddRecord(WriteBatchInternal::Contents(&batch)));
+    }
+    ASSERT_LEVELDB_OK(file->Close());
+    delete file;
+  }
+
+  Reopen(options);
+  for (int k = 0; k < kKeys; k++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", k);
+    const std::string value = NumberToString(kLogs - 1) + ":" +
+                              std::string(k % 7 == 0 ? 600 : 100, 'x');
+    ASSERT_EQ(value, Get(key));
+  }
+
+  // 新的写入使用更大的序列号
+  ASSERT_LEVELDB_OK(Put("key000000", "new"));
+  Reopen(options);
+  ASSERT_EQ("new", Get("key000000"));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("new", Get("key000000"));
+  ASSERT_EQ(NumberToString(kLogs - 1) + ":" + std::string(100, 'x'),
+            Get("key000001"));
+}
+
+TEST_F(DBTest, PrefetchTablesOnOpen) {
+  Options options = CurrentOptions();
+  Reopen(options);
+  for (int i = 0; i < 10; i++) {
+    FlushFile("key" + NumberToString(i), "v" + NumberToString(i));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  FlushFile("key0", "new");
+  FlushFile("key9", "new");
+  const int files = TotalTableFiles();
+
+  options.prefetch_tables_on_open = true;
+  options.max_file_opening_threads = 4;
+  delete db_;
+  db_ = nullptr;
+  const int before = env_.random_access_files();
+  Reopen(options);
+  ASSERT_EQ(files, env_.random_access_files() - before);
+
+  // 读取时不再打开表文件
+  ASSERT_EQ("new", Get("key0"));
+  for (int i = 1; i < 9; i++) {
+    ASSERT_EQ("v" + NumberToString(i), Get("key" + NumberToString(i)));
+  }
+  ASSERT_EQ("new", Get("key9"));
+  ASSERT_EQ(files, env_.random_access_files() - before);
+}
+
+TEST_F(DBTest, TableCachePinnedFiles) {
+  ASSERT_LEVELDB_OK(env_.CreateDir(dbname_));
+  Options options = CurrentOptions();
+  const int kFiles = 200;
+  std::vector<uint64_t> sizes(kFiles + 1);
+  for (int n = 1; n <= kFiles; n++) {
+    WritableFile* file;
+    ASSERT_LEVELDB_OK(env_.NewWritableFile(TableFileName(dbname_, n), &file));
+    TableBuilder builder(options, file);
+    builder.Add("key", "value");
+    ASSERT_LEVELDB_OK(builder.Finish());
+    sizes[n] = builder.FileSize();
+    ASSERT_LEVELDB_OK(file->Close());
+    delete file;
+  }
+
+  // 容量远小于文件数，未常驻的表会被换出
+  TableCache cache(dbname_, options, 16);
+  cache.SetPinnedFiles({1});
+  for (int n = 1; n <= kFiles; n++) {
+    ASSERT_LEVELDB_OK(cache.Prefetch(n, sizes[n]));
+  }
+  int opens = env_.random_access_files();
+  ASSERT_LEVELDB_OK(cache.Prefetch(1, sizes[1]));
+  ASSERT_EQ(opens, env_.random_access_files());
+  ASSERT_LEVELDB_OK(cache.Prefetch(2, sizes[2]));
+  ASSERT_EQ(opens + 1, env_.random_access_files());
+
+  // 不再常驻后恢复由 LRU 管理
+  cache.SetPinnedFiles({2});
+  for (int n = 3; n <= kFiles; n++) {
+    ASSERT_LEVELDB_OK(cache.Prefetch(n, sizes[n]));
+  }
+  opens = env_.random_access_files();
+  ASSERT_LEVELDB_OK(cache.Prefetch(2, sizes[2]));
+  ASSERT_EQ(opens, env_.random_access_files());
+  ASSERT_LEVELDB_OK(cache.Prefetch(1, sizes[1]));
+  ASSERT_EQ(opens + 1, env_.random_access_files());
+}
+
+TEST_F(DBTest, ManifestRollover) {
+  Options options = CurrentOptions();
+  options.max_manifest_file_size = 1000;
+  Reopen(options);
+  const uint64_t first_manifest = dbfull()->TEST_ManifestFileNumber();
+  for (int i = 0; i < 50; i++) {
+    FlushFile("key" + NumberToString(i), "v" + NumberToString(i));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_GT(dbfull()->TEST_ManifestFileNumber(), first_manifest);
+
+  // 旧的 MANIFEST 已被删除，新的 MANIFEST 保持较小
+  std::vector<std::string> filenames;
+  ASSERT_LEVELDB_OK(env_.GetChildren(dbname_, &filenames));
+  int manifests = 0;
+  for (const std::string& filename : filenames) {
+    uint64_t number;
+    FileType type;
+    if (ParseFileName(filename, &number, &type) && type == kDescriptorFile) {
+      manifests++;
+      uint64_t size;
+      ASSERT_LEVELDB_OK(env_.GetFileSize(dbname_ + "/" + filename, &size));
+      ASSERT_LT(size, 4000);
+    }
+  }
+  ASSERT_EQ(1, manifests);
+
+  Reopen(options);
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ("v" + NumberToString(i), Get("key" + NumberToString(i)));
+  }
+}
+
+namespace {
+
+struct SyncWriterState {
+  DB* db;
+  int id;
+  std::atomic<int>* done;
+};
+
+void SyncWriter(void* arg) {
+  SyncWriterState* state = reinterpret_cast<SyncWriterState*>(arg);
+  WriteOptions options;
+  options.sync = true;
+  for (int i = 0; i < 100; i++) {
+    const std::string key = NumberToString(state->id) + "." + NumberToString(i);
+    EXPECT_LEVELDB_OK(state->db->Put(options, key, "v" + key));
+  }
+  state->done->fetch_add(1);
+}
+
+}  // namespace
+
+TEST_F(DBTest, GroupCommitDelay) {
+  Options options = CurrentOptions();
+  options.group_commit_max_delay_micros = 2000;
+  options.group_commit_max_bytes = 1024;
+  Reopen(options);
+
+  const int kThreads = 8;
+  std::atomic<int> done(0);
+  SyncWriterState states[kThreads];
+  for (int id = 0; id < kThreads; id++) {
+    states[id].db = db_;
+    states[id].id = id;
+    states[id].done = &done;
+    env_.StartThread(&SyncWriter, &states[id]);
+  }
+  while (done.load() < kThreads) {
+    env_.SleepForMicroseconds(1000);
+  }
+
+  Reopen(options);
+  for (int id = 0; id < kThreads; id++) {
+    for (int i = 0; i < 100; i++) {
+      const std::string key = NumberToString(id) + "." + NumberToString(i);
+      ASSERT_EQ("v" + key, Get(key));
+    }
+  }
+}
+
+TEST_F(DBTest, MemTableRepTypes) {
+  const MemTableRepType types[] = {kSkipListRep, kHashSkipListRep,
+                                   kRadixTreeRep, kVectorRep};
+  for (MemTableRepType type : types) {
+    DestroyDB(dbname_, Options());
+    Options options = CurrentOptions();
+    options.memtable_rep = type;
+    options.memtable_prefix_length = 1;
+    Reopen(options);
+    ASSERT_LEVELDB_OK(Put("b", "v1"));
+    ASSERT_LEVELDB_OK(Put("a", "v2"));
+    ASSERT_LEVELDB_OK(Put("ab", "v3"));
+    ASSERT_LEVELDB_OK(Put("c", "v4"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Put("b", "v5"));
+    ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), "c"));
+    ASSERT_LEVELDB_OK(DeleteRange("aa", "ac"));
+    ASSERT_EQ("v5", Get("b"));
+    ASSERT_EQ("NOT_FOUND", Get("ab"));
+    ReadOptions read_options;
+    read_options.snapshot = snapshot;
+    std::string value;
+    ASSERT_LEVELDB_OK(db_->Get(read_options, "ab", &value));
+    ASSERT_EQ("v3", value);
+    ASSERT_EQ("a=v2 b=v5 ", Contents());
+    ASSERT_EQ("a=v2 ab=v3 b=v1 c=v4 ", Contents(snapshot));
+    db_->ReleaseSnapshot(snapshot);
+
+    // 落盘时按内部键顺序遍历
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("a=v2 b=v5 ", Contents());
+  }
+}
+
+TEST_F(DBTest, BlockEntryVarintWidths) {
+  // 共享前缀长度与值长度跨越 1~3 字节的 varint，覆盖条目头的各条解析路径
+  Reopen(CurrentOptions());
+  Random rnd(301);
+  const std::string prefix(300, 'p');
+  std::map<std::string, std::string> model;
+  const int value_sizes[] = {0, 5, 127, 128, 300, 16383, 16384, 40000};
+  for (int i = 0; i < 200; i++) {
+    const std::string key =
+        prefix.substr(0, rnd.Uniform(prefix.size())) + NumberToString(i);
+    std::string value;
+    test::RandomString(&rnd, value_sizes[rnd.Uniform(8)], &value);
+    ASSERT_LEVELDB_OK(Put(key, value));
+    model[key] = value;
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  std::map<std::string, std::string>::const_iterator m = model.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++m) {
+    ASSERT_TRUE(m != model.end());
+    ASSERT_EQ(m->first, iter->key().ToString());
+    ASSERT_TRUE(m->second == iter->value().ToString()) << m->first;
+  }
+  ASSERT_TRUE(m == model.end());
+  for (m = model.begin(); m != model.end(); ++m) {
+    iter->Seek(m->first);
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(m->first, iter->key().ToString());
+  }
+  delete iter;
+}
+
+TEST_F(DBTest, CacheIndexAndFilterBlocks) {
+  // 容量从宽裕到只有 1 字节，索引与过滤器块随时可能被逐出后重读
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  for (size_t capacity : {size_t{8 << 20}, size_t{1}}) {
+    Cache* cache = NewLRUCache(capacity);
+    Options options = CurrentOptions();
+    options.block_cache = cache;
+    options.filter_policy = policy;
+    options.cache_index_and_filter_blocks = true;
+    options.pin_l0_l1_index_and_filter = true;
+    Reopen(options);
+    for (int i = 0; i < 2000; i += 2) {
+      ASSERT_LEVELDB_OK(Put(NumberToString(i), "v" + NumberToString(i)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    for (int i = 1; i < 2000; i += 2) {
+      ASSERT_LEVELDB_OK(Put(NumberToString(i), "v" + NumberToString(i)));
+    }
+    Reopen(options);
+
+    for (int i = 0; i < 2000; i++) {
+      ASSERT_EQ("v" + NumberToString(i), Get(NumberToString(i)));
+      ASSERT_EQ("NOT_FOUND", Get(NumberToString(i) + "x"));
+    }
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(2000, count);
+    delete iter;
+    if (capacity > 1) {
+      ASSERT_GT(cache->TotalCharge(), 0);
+    }
+
+    delete db_;
+    db_ = nullptr;
+    delete cache;
+  }
+  delete policy;
+}
+
+TEST_F(DBTest, PartitionedIndex) {
+  // 小数据块、小索引分区，使每个表都有多个分区；依次不用缓存、用
+  // block_cache、索引与过滤器也放进 block_cache
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  Cache* cache = NewLRUCache(1 << 20);
+  for (int config = 0; config < 3; config++) {
+    delete db_;
+    db_ = nullptr;
+    DestroyDB(dbname_, Options());
+    Options options = CurrentOptions();
+    options.block_size = 256;
+    options.index_partition_size = 128;
+    if (config >= 1) {
+      options.block_cache = cache;
+    }
+    if (config == 2) {
+      options.filter_policy = policy;
+      options.cache_index_and_filter_blocks = true;
+    }
+    Reopen(options);
+
+    Random rnd(301);
+    std::map<std::string, std::string> model;
+    for (int i = 0; i < 3000; i++) {
+      const std::string key = NumberToString(rnd.Uniform(100000));
+      std::string value;
+      test::RandomString(&rnd, 20 + rnd.Uniform(80), &value);
+      ASSERT_LEVELDB_OK(Put(key, value));
+      model[key] = value;
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_GT(CountPartitionedIndexTables(), 0);
+    Reopen(options);
+
+    for (const auto& kv : model) {
+      ASSERT_EQ(kv.second, Get(kv.first));
+      ASSERT_EQ("NOT_FOUND", Get(kv.first + "x"));
+    }
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    auto m = model.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++m) {
+      ASSERT_TRUE(m != model.end());
+      ASSERT_EQ(m->first, iter->key().ToString());
+    }
+    ASSERT_TRUE(m == model.end());
+    auto r = model.rbegin();
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev(), ++r) {
+      ASSERT_TRUE(r != model.rend());
+      ASSERT_EQ(r->first, iter->key().ToString());
+    }
+    ASSERT_TRUE(r == model.rend());
+    for (int i = 0; i < 500; i++) {
+      const std::string target = NumberToString(rnd.Uniform(100000));
+      iter->Seek(target);
+      m = model.lower_bound(target);
+      ASSERT_EQ(m != model.end(), iter->Valid());
+      if (iter->Valid()) {
+        ASSERT_EQ(m->first, iter->key().ToString());
+      }
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+
+    // 近似大小随键单调增长
+    uint64_t prev_size = 0;
+    for (int i = 1; i <= 9; i++) {
+      Range range("", NumberToString(i));
+      uint64_t size;
+      db_->GetApproximateSizes(&range, 1, &size);
+      ASSERT_GE(size, prev_size);
+      prev_size = size;
+    }
+    ASSERT_GT(prev_size, 0);
+    delete db_;
+    db_ = nullptr;
+    // 关闭后不残留任何缓存条目，关闭时也不会把索引重新读入缓存
+    ASSERT_EQ(0, cache->TotalCharge());
+  }
+  delete cache;
+  delete policy;
+}
+
+TEST_F(DBTest, SharedWriteBufferManager) {
+  // 两个数据库共享 1MB 的 memtable 预算，各自的 write_buffer_size 为 4MB
+  Cache* cache = NewLRUCache(8 << 20);
+  WriteBufferManager* manager = new WriteBufferManager(1 << 20, cache);
+  Options options = CurrentOptions();
+  options.write_buffer_manager = manager;
+  options.block_cache = cache;
+  Reopen(options);
+  const std::string other_name = dbname_ + "_other";
+  DestroyDB(other_name, Options());
+  DB* other = nullptr;
+  ASSERT_LEVELDB_OK(DB::Open(options, other_name, &other));
+  ASSERT_EQ(2, manager->num_dbs());
+
+  ASSERT_LEVELDB_OK(other->Put(WriteOptions(), "other", "value"));
+  const std::string value(1000, 'v');
+  for (int i = 0; i < 3000; i++) {
+    ASSERT_LEVELDB_OK(Put(NumberToString(i), value));
+  }
+  // 只写了约 3MB，没有写满 write_buffer_size，因预算超出而落盘
+  ASSERT_GT(TotalTableFiles(), 0);
+  ASSERT_GT(manager->memory_usage(), 0);
+  ASSERT_GE(manager->cache_charge(), manager->memory_usage());
+  for (int i = 0; i < 3000; i++) {
+    ASSERT_EQ(value, Get(NumberToString(i)));
+  }
+  std::string result;
+  ASSERT_LEVELDB_OK(other->Get(ReadOptions(), "other", &result));
+  ASSERT_EQ("value", result);
+
+  // 关闭后归还全部内存
+  delete other;
+  delete db_;
+  db_ = nullptr;
+  ASSERT_EQ(0, manager->num_dbs());
+  ASSERT_EQ(0, manager->memory_usage());
+  ASSERT_EQ(0, manager->mutable_memtable_memory_usage());
+  DestroyDB(other_name, Options());
+  delete manager;
+  delete cache;
+}
+
+TEST_F(DBTest, RepairDB) {
+  Options options = CurrentOptions();
+  options.min_blob_size = 100;
+  Reopen(options);
+  FlushFile("a", "v1");
+  FlushFile("b", std::string(200, 'b'));
+  FlushFile("a", "v2");  // 修复后所有表都在 level-0，需按序列号取最新值
+  ASSERT_LEVELDB_OK(Put("c", "v3"));
+  ASSERT_LEVELDB_OK(Put("d", "v4"));
+  ASSERT_LEVELDB_OK(DeleteRange("d", "e"));  // 只在日志中
+  delete db_;
+  db_ = nullptr;
+
+  // 删除所有 MANIFEST 与 CURRENT
+  std::vector<std::string> filenames;
+  ASSERT_LEVELDB_OK(env_.GetChildren(dbname_, &filenames));
+  uint64_t number;
+  FileType type;
+  for (const std::string& filename : filenames) {
+    if (ParseFileName(filename, &number, &type) &&
+        (type == kDescriptorFile || type == kCurrentFile)) {
+      ASSERT_LEVELDB_OK(env_.RemoveFile(dbname_ + "/" + filename));
+    }
+  }
+  options.create_if_missing = false;
+  ASSERT_TRUE(TryReopen(options).IsInvalidArgument());
+
+  ASSERT_LEVELDB_OK(RepairDB(dbname_, options));
+  Reopen(options);
+  ASSERT_EQ("a=v2 b=" + std::string(200, 'b') + " c=v3 ", Contents());
+
+  // 修复后写入的序列号大于所有恢复的序列号
+  ASSERT_LEVELDB_OK(Put("a", "v5"));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("v5", Get("a"));
+  ASSERT_EQ(std::string(200, 'b'), Get("b"));
+
+  // 清理被移入 lost/ 的日志与 MANIFEST
+  const std::string lost = dbname_ + "/lost";
+  ASSERT_LEVELDB_OK(env_.GetChildren(lost, &filenames));
+  for (const std::string& filename : filenames) {
+    env_.RemoveFile(lost + "/" + filename);
+  }
+  env_.RemoveDir(lost);
+}
+
+TEST_F(DBTest, RepairDBOrdersTablesBySequence) {
+  Options options = CurrentOptions();
+  Reopen(options);
+  // 旧值 v1 与更旧的 v0 合并到 level-2 的新表中，编号大于保存新值 v2 的
+  // level-0 表
+  FlushFile("a", "v0");
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  FlushFile("a", "v1");
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  FlushFile("a", "v2");
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ(1, NumTableFilesAtLevel(0));
+  ASSERT_EQ(0, NumTableFilesAtLevel(1));
+  ASSERT_EQ(1, NumTableFilesAtLevel(2));
+  ASSERT_EQ("v2", Get("a"));
+  delete db_;
+  db_ = nullptr;
+
+  ASSERT_LEVELDB_OK(RepairDB(dbname_, options));
+  Reopen(options);
+  ASSERT_EQ("v2", Get("a"));
+
+  std::vector<std::string> filenames;
+  const std::string lost = dbname_ + "/lost";
+  ASSERT_LEVELDB_OK(env_.GetChildren(lost, &filenames));
+  for (const std::string& filename : filenames) {
+    env_.RemoveFile(lost + "/" + filename);
+  }
+  env_.RemoveDir(lost);
+}
+}  // namespace leveldb
@@ -40,12 +40,21 @@ static const int kReadBytesPeriod = 1048576;
 class InternalKey;
 
 // 不可修改 硬编码
-enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
+// kTypeRangeDeletion 只出现在范围删除标记中，不会与点数据混在一起
+// kTypeMerge 为 DB::Merge() 写入的操作数，读取时需要与更早的条目合并
+// kTypeBlobIndex 的值是指向 blob 文件中真实值的索引，只出现在 sstable 中
+enum ValueType {
+  kTypeDeletion = 0x0,
+  kTypeValue = 0x1,
+  kTypeRangeDeletion = 0x2,
+  kTypeMerge = 0x3,
+  kTypeBlobIndex = 0x4
+};
 
 // kValueTypeForSeek定义了在构造ParsedInternalKey对象以查找特定序列号时应传递的ValueType
 // 因为我们按降序排序序列号，并且值类型作为低8位嵌入在内部键的序列号中，
 // 所以我们需要使用编号最高的ValueType，而不是编号最低的
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeBlobIndex;
 
 typedef uint64_t SequenceNumber;
 
@@ -77,9 +86,12 @@ inline Slice ExtractUserKey(const Slice& internal_key) {
 }
 
 // 一个用于内部键的比较器，它使用指定的比较器来比较用户键部分，并通过降序的序列号来打破平局。
-class InternalKeyComparator : public Comparator {
+// final 使经由具体类型的调用（如 MemTable、VersionSet 中）不必走虚函数。
+// 用户比较器是 BytewiseComparator 时直接内联比较用户键。
+class InternalKeyComparator final : public Comparator {
  public:
-  explicit InternalKeyComparator(const Comparator* c) : user_comparator_(c) {}
+  explicit InternalKeyComparator(const Comparator* c)
+      : user_comparator_(c), bytewise_(c == BytewiseComparator()) {}
   const char* Name() const override;
   int Compare(const Slice& a, const Slice& b) const override;
   void FindShortestSeparator(std::string* start,
@@ -92,6 +104,7 @@ class InternalKeyComparator : public Comparator {
 
  private:
   const Comparator* user_comparator_;
+  const bool bytewise_;
 };
 
 class InternalFilterPolicy : public FilterPolicy {
@@ -138,6 +151,26 @@ class InternalKey {
   std::string rep_;
 };
 
+inline int InternalKeyComparator::Compare(const Slice& akey,
+                                          const Slice& bkey) const {
+  // key升序
+  // 序列号降序
+  // 类型降序
+  const Slice a = ExtractUserKey(akey);
+  const Slice b = ExtractUserKey(bkey);
+  int r = bytewise_ ? BytewiseCompare(a, b) : user_comparator_->Compare(a, b);
+  if (r == 0) {
+    const uint64_t anum = DecodeFixed64(akey.data() + akey.size() - 8);
+    const uint64_t bnum = DecodeFixed64(bkey.data() + bkey.size() - 8);
+    if (anum > bnum) {
+      r = -1;
+    } else if (anum < bnum) {
+      r = +1;
+    }
+  }
+  return r;
+}
+
 inline int InternalKeyComparator::Compare(const InternalKey& a,
                                           const InternalKey& b) const {
   return Compare(a.Encode(), b.Encode());
@@ -155,7 +188,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<uint8_t>(kTypeValue));
+  return (c <= static_cast<uint8_t>(kTypeBlobIndex));
 }
 
 class LookupKey {
@@ -2,6 +2,7 @@
 
 #include "gtest/gtest.h"
 #include "util/logging.h"
+#include "util/random.h"
 
 namespace leveldb {
 
@@ -61,6 +62,39 @@ TEST(FormatTest, InternalKey_EncodeDecode) {
   }
 }
 
+namespace {
+// 与 BytewiseComparator 顺序相同，但不会触发 InternalKeyComparator 的快速路径
+class PlainBytewiseComparator : public Comparator {
+ public:
+  const char* Name() const override { return "PlainBytewiseComparator"; }
+  int Compare(const Slice& a, const Slice& b) const override {
+    return a.compare(b);
+  }
+  void FindShortestSeparator(std::string*, const Slice&) const override {}
+  void FindShortSuccessor(std::string*) const override {}
+};
+}  // namespace
+
+TEST(FormatTest, InternalKeyComparatorBytewiseFastPath) {
+  PlainBytewiseComparator plain;
+  InternalKeyComparator fast(BytewiseComparator());
+  InternalKeyComparator slow(&plain);
+  Random rnd(301);
+  for (int i = 0; i < 20000; i++) {
+    std::string ua(rnd.Uniform(12), 'k');
+    std::string ub = rnd.OneIn(2) ? ua : std::string(rnd.Uniform(12), 'k');
+    if (!ua.empty() && rnd.OneIn(2)) {
+      ua[rnd.Uniform(ua.size())] = static_cast<char>(rnd.Uniform(256));
+    }
+    const std::string a = IKey(ua, rnd.Uniform(4), kTypeValue);
+    const std::string b = IKey(ub, rnd.Uniform(4), kTypeDeletion);
+    const int expected = slow.Compare(a, b);
+    const int actual = fast.Compare(a, b);
+    ASSERT_EQ(expected < 0, actual < 0) << i;
+    ASSERT_EQ(expected == 0, actual == 0) << i;
+  }
+}
+
 TEST(FormatTest, InternalKey_DecodeFromEmpty) {
   InternalKey internal_key;
 
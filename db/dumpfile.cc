@@ -2,6 +2,7 @@
 
 #include <cstdio>
 
+#include "db/blob_file.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
@@ -13,6 +14,7 @@
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/write_batch.h"
+#include "util/coding.h"
 #include "util/logging.h"
 
 namespace leveldb {
@@ -82,6 +84,22 @@ class WriteBatchItemPrinter : public WriteBatch::Handler {
     r += "'\n";
     dst_->Append(r);
   }
+  void DeleteRange(const Slice& begin, const Slice& end) override {
+    std::string r = "  delrange '";
+    AppendEscapedStringTo(&r, begin);
+    r += "' '";
+    AppendEscapedStringTo(&r, end);
+    r += "'\n";
+    dst_->Append(r);
+  }
+  void Merge(const Slice& key, const Slice& value) override {
+    std::string r = "  merge '";
+    AppendEscapedStringTo(&r, key);
+    r += "' '";
+    AppendEscapedStringTo(&r, value);
+    r += "'\n";
+    dst_->Append(r);
+  }
 
   WritableFile* dst_;
 };
@@ -138,30 +156,8 @@ Status DumpDescriptor(Env* env, const std::string& fname, WritableFile* dst) {
   return PrintLogContents(env, fname, VersionEditPrinter, dst);
 }
 
-Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
-  uint64_t file_size;
-  RandomAccessFile* file = nullptr;
-  Table* table = nullptr;
-  Status s = env->GetFileSize(fname, &file_size);
-  if (s.ok()) {
-    s = env->NewRandomAccessFile(fname, &file);
-  }
-  if (s.ok()) {
-    // We use the default comparator, which may or may not match the
-    // comparator used in this database. However this should not cause
-    // problems since we only use Table operations that do not require
-    // any comparisons.  In particular, we do not call Seek or Prev.
-    s = Table::Open(Options(), file, file_size, &table);
-  }
-  if (!s.ok()) {
-    delete table;
-    delete file;
-    return s;
-  }
-
-  ReadOptions ro;
-  ro.fill_cache = false;
-  Iterator* iter = table->NewIterator(ro);
+// 打印 table 迭代器生成的所有条目
+void DumpTableEntries(Iterator* iter, WritableFile* dst) {
   std::string r;
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
     r.clear();
@@ -183,6 +179,12 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
         r += "del";
       } else if (key.type == kTypeValue) {
         r += "val";
+      } else if (key.type == kTypeRangeDeletion) {
+        r += "delrange";
+      } else if (key.type == kTypeMerge) {
+        r += "merge";
+      } else if (key.type == kTypeBlobIndex) {
+        r += "blobindex";
       } else {
         AppendNumberTo(&r, key.type);
       }
@@ -192,16 +194,74 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
       dst->Append(r);
     }
   }
-  s = iter->status();
+  Status s = iter->status();
   if (!s.ok()) {
     dst->Append("iterator error: " + s.ToString() + "\n");
   }
+}
+
+Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
+  uint64_t file_size;
+  RandomAccessFile* file = nullptr;
+  Table* table = nullptr;
+  Status s = env->GetFileSize(fname, &file_size);
+  if (s.ok()) {
+    s = env->NewRandomAccessFile(fname, &file);
+  }
+  if (s.ok()) {
+    // We use the default comparator, which may or may not match the
+    // comparator used in this database. However this should not cause
+    // problems since we only use Table operations that do not require
+    // any comparisons.  In particular, we do not call Seek or Prev.
+    s = Table::Open(Options(), file, file_size, &table);
+  }
+  if (!s.ok()) {
+    delete table;
+    delete file;
+    return s;
+  }
 
+  ReadOptions ro;
+  ro.fill_cache = false;
+  Iterator* iter = table->NewIterator(ro);
+  DumpTableEntries(iter, dst);
+  delete iter;
+  iter = table->NewRangeTombstoneIterator();
+  DumpTableEntries(iter, dst);
   delete iter;
   delete table;
   delete file;
   return Status::OK();
 }
+
+// 逐条输出 blob 文件中的记录：偏移量、用户键与值
+Status DumpBlob(Env* env, const std::string& fname, WritableFile* dst) {
+  std::string contents;
+  Status s = ReadFileToString(env, fname, &contents);
+  if (!s.ok()) {
+    return s;
+  }
+  Slice input(contents);
+  uint64_t offset = 0;
+  while (!input.empty()) {
+    const size_t remaining = input.size();
+    Slice key, value;
+    s = ConsumeBlobRecord(&input, &key, &value);
+    if (!s.ok()) {
+      return Status::Corruption(fname, s.ToString());
+    }
+    std::string r = "@ ";
+    AppendNumberTo(&r, offset);
+    r += " '";
+    AppendEscapedStringTo(&r, key);
+    r += "' => '";
+    AppendEscapedStringTo(&r, value);
+    r += "'\n";
+    dst->Append(r);
+    offset += remaining - input.size();
+  }
+  return Status::OK();
+}
 }  // namespace
 Status DumpFile(Env* env, const std::string& fname, WritableFile* dst) {
   FileType ftype;
@@ -215,6 +275,8 @@ Status DumpFile(Env* env, const std::string& fname, WritableFile* dst) {
       return DumpDescriptor(env, fname, dst);
     case kTableFile:
       return DumpTable(env, fname, dst);
+    case kBlobFile:
+      return DumpBlob(env, fname, dst);
     default:
       break;
   }
@@ -1,10 +1,12 @@
 #include "db/filename.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 
 #include "db/dbformat.h"
 #include "leveldb/env.h"
+#include "util/crc32c.h"
 #include "util/logging.h"
 
 namespace leveldb {
@@ -34,6 +36,11 @@ std::string SSTTableFileName(const std::string& dbname, uint64_t number) {
   return MakeFileName(dbname, number, "sst");
 }
 
+std::string BlobFileName(const std::string& dbname, uint64_t number) {
+  assert(number > 0);
+  return MakeFileName(dbname, number, "blob");
+}
+
 std::string DescriptorFileName(const std::string& dbname, uint64_t number) {
   assert(number > 0);
   char buf[100];
@@ -67,7 +74,7 @@ std::string OldInfoLogFileName(const std::string& dbname) {
 //    dbname/LOG
 //    dbname/LOG.old
 //    dbname/MANIFEST-[0-9]+
-//    dbname/[0-9]+.(log|sst|ldb)
+//    dbname/[0-9]+.(log|sst|ldb|blob)
 bool ParseFileName(const std::string& filename, uint64_t* number,
                    FileType* type) {
   Slice rest(filename);
@@ -102,6 +109,8 @@ bool ParseFileName(const std::string& filename, uint64_t* number,
       *type = kLogFile;
     } else if (suffix == Slice(".sst") || suffix == Slice(".ldb")) {
       *type = kTableFile;
+    } else if (suffix == Slice(".blob")) {
+      *type = kBlobFile;
     } else if (suffix == Slice(".dbtmp")) {
       *type = kTempFile;
     } else {
@@ -130,4 +139,55 @@ Status SetCurrentFile(Env* env, const std::string& dbname,
   return s;
 }
 
+Status CopyFile(Env* env, const std::string& src, const std::string& target,
+                uint64_t size, uint32_t* crc) {
+  SequentialFile* src_file;
+  Status s = env->NewSequentialFile(src, &src_file);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* target_file;
+  s = env->NewWritableFile(target, &target_file);
+  if (!s.ok()) {
+    delete src_file;
+    return s;
+  }
+
+  static const size_t kBufferSize = 64 * 1024;
+  char* buffer = new char[kBufferSize];
+  if (crc != nullptr) {
+    *crc = 0;
+  }
+  while (s.ok() && size > 0) {
+    const size_t n =
+        static_cast<size_t>(std::min<uint64_t>(size, kBufferSize));
+    Slice fragment;
+    s = src_file->Read(n, &fragment, buffer);
+    if (s.ok() && fragment.empty()) {
+      s = Status::Corruption(src, "file is shorter than expected");
+    }
+    if (s.ok()) {
+      s = target_file->Append(fragment);
+      size -= fragment.size();
+      if (crc != nullptr) {
+        *crc = crc32c::Extend(*crc, fragment.data(), fragment.size());
+      }
+    }
+  }
+  delete[] buffer;
+  delete src_file;
+
+  if (s.ok()) {
+    s = target_file->Sync();
+  }
+  if (s.ok()) {
+    s = target_file->Close();
+  }
+  delete target_file;
+  if (!s.ok()) {
+    env->RemoveFile(target);
+  }
+  return s;
+}
+
 }  // namespace leveldb
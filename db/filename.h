@@ -18,7 +18,8 @@ enum FileType {
   kDescriptorFile,
   kCurrentFile,
   kTempFile,
-  kInfoLogFile
+  kInfoLogFile,
+  kBlobFile
 };
 
 std::string LogFileName(const std::string& dbname, uint64_t number);
@@ -28,6 +29,9 @@ std::string TableFileName(const std::string& dbname, uint64_t number);
 // sstable
 std::string SSTTableFileName(const std::string& dbname, uint64_t number);
 
+// 键值分离后存放大 value 的 blob 文件
+std::string BlobFileName(const std::string& dbname, uint64_t number);
+
 std::string DescriptorFileName(const std::string& dbname, uint64_t number);
 
 // currentfile 包含 current manifest file的名字
@@ -47,6 +51,12 @@ bool ParseFileName(const std::string& filename, uint64_t* number,
 
 Status SetCurrentFile(Env* env, const std::string& dbname,
                       uint64_t descriptor_number);
+
+// 将 src 的前 size 个字节复制到新文件 target 并同步到磁盘。
+// src 不足 size 个字节时返回 Corruption。
+// crc 不为 nullptr 时在其中存储所复制内容的 crc32c。
+Status CopyFile(Env* env, const std::string& src, const std::string& target,
+                uint64_t size, uint32_t* crc = nullptr);
 }  // namespace leveldb
 
 #endif
\ No newline at end of file
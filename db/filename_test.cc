@@ -19,6 +19,7 @@ TEST(FileNameTest, Parse) {
       {"0.log", 0, kLogFile},
       {"0.sst", 0, kTableFile},
       {"0.ldb", 0, kTableFile},
+      {"42.blob", 42, kBlobFile},
       {"CURRENT", 0, kCurrentFile},
       {"LOCK", 0, kDBLockFile},
       {"MANIFEST-2", 2, kDescriptorFile},
@@ -92,6 +93,12 @@ TEST(FileNameTest, Construction) {
   ASSERT_EQ(200, number);
   ASSERT_EQ(kTableFile, type);
 
+  fname = BlobFileName("bar", 300);
+  ASSERT_EQ("bar/", std::string(fname.data(), 4));
+  ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
+  ASSERT_EQ(300, number);
+  ASSERT_EQ(kBlobFile, type);
+
   fname = DescriptorFileName("bar", 100);
   ASSERT_EQ("bar/", std::string(fname.data(), 4));
   ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
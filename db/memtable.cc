@@ -1,10 +1,14 @@
 #include "db/memtable.h"
 
+#include <algorithm>
+
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 static Slice GetLengthPrefixedSlice(const char* data) {
@@ -14,17 +18,40 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
+// 未指定 arena_block_size 时取写缓冲区的 1/8，限制在 [4KB, 2MB] 之间，
+// 写缓冲区越大，向系统申请内存的次数越少。
+static size_t ArenaBlockSize(const Options& options) {
+  size_t block_size = options.arena_block_size;
+  if (block_size == 0) {
+    block_size = options.write_buffer_size / 8;
+  }
+  block_size = std::max<size_t>(block_size, 4 << 10);
+  block_size = std::min<size_t>(block_size, 2 << 20);
+  return block_size;
+}
+
 MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
-MemTable::~MemTable() { assert(refs_ == 0); }
+    : MemTable(comparator, Options()) {}
 
-size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
+MemTable::MemTable(const InternalKeyComparator& comparator,
+                   const Options& options)
+    : comparator_(comparator),
+      refs_(0),
+      arena_(ArenaBlockSize(options), options.memtable_huge_page,
+             options.memtable_numa_aware),
+      table_(NewMemTableRep(options, comparator_, &arena_)),
+      range_del_table_(NewSkipListRep(comparator_, &arena_)),
+      num_range_deletions_(0),
+      num_fragmented_(0) {}
 
-int MemTable::KeyComparator::operator()(const char* aptr,
-                                        const char* bptr) const {
-  Slice a = GetLengthPrefixedSlice(aptr);
-  Slice b = GetLengthPrefixedSlice(bptr);
-  return comparator.Compare(a, b);  // struct成员无下划线后缀
+MemTable::~MemTable() {
+  assert(refs_ == 0);
+  delete table_;
+  delete range_del_table_;
+}
+
+size_t MemTable::ApproximateMemoryUsage() {
+  return arena_.MemoryUsage() + table_->ApproximateMemoryUsage();
 }
 
 // 为 "target" 编码一个合适的内部键目标并返回它。
@@ -38,35 +65,41 @@ static const char* EncodeKey(std::string* scratch, const Slice& target) {
 
 class MemTableIterator : public Iterator {
  public:
-  // Table -> SkipList<key, cmp>
-  explicit MemTableIterator(MemTable::Table* table) : iter_(table) {}
+  // 接管 iter 的所有权
+  explicit MemTableIterator(MemTableRep::Iterator* iter) : iter_(iter) {}
 
   MemTableIterator(const MemTableIterator&) = delete;
   MemTableIterator& operator=(const MemTableIterator&) = delete;
 
-  ~MemTableIterator() override = default;
+  ~MemTableIterator() override { delete iter_; }
 
-  bool Valid() const override { return iter_.Valid(); }
-  void Seek(const Slice& k) override { iter_.Seek(EncodeKey(&tmp_, k)); }
-  void SeekToFirst() override { iter_.SeekToFirst(); }
-  void SeekToLast() override { iter_.SeekToLast(); }
-  void Next() override { iter_.Next(); }
-  void Prev() override { iter_.Prev(); }
-  Slice key() const override { return GetLengthPrefixedSlice(iter_.key()); }
+  bool Valid() const override { return iter_->Valid(); }
+  void Seek(const Slice& k) override { iter_->Seek(EncodeKey(&tmp_, k)); }
+  void SeekToFirst() override { iter_->SeekToFirst(); }
+  void SeekToLast() override { iter_->SeekToLast(); }
+  void Next() override { iter_->Next(); }
+  void Prev() override { iter_->Prev(); }
+  Slice key() const override { return GetLengthPrefixedSlice(iter_->key()); }
   Slice value() const override {
-    Slice key_slice = GetLengthPrefixedSlice(iter_.key());
-    // iter_.key()= keylen + key + valuelen + value ?
+    Slice key_slice = GetLengthPrefixedSlice(iter_->key());
+    // iter_->key()= keylen + key + valuelen + value ?
     return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
   }
 
   Status status() const override { return Status::OK(); }
 
  private:
-  MemTable::Table::Iterator iter_;
+  MemTableRep::Iterator* const iter_;
   std::string tmp_;
 };
 
-Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
+Iterator* MemTable::NewIterator() {
+  return new MemTableIterator(table_->NewIterator());
+}
+
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  return new MemTableIterator(range_del_table_->NewIterator());
+}
 
 void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
                    const Slice& value) {
@@ -76,6 +109,11 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   //  tag          : uint64((sequence << 8) | type)
   //  value_size   : varint32 of value.size()
   //  value bytes  : char[value.size()]
+  if (type == kTypeRangeDeletion &&
+      comparator_.comparator.user_comparator()->Compare(key, value) >= 0) {
+    // 空区间不删除任何数据
+    return;
+  }
   size_t key_size = key.size();
   size_t val_size = value.size();
   size_t internal_key_size = key_size + 8;
@@ -91,40 +129,126 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  if (type == kTypeRangeDeletion) {
+    range_del_table_->Insert(buf);
+    num_range_deletions_.fetch_add(1, std::memory_order_release);
+  } else {
+    table_->Insert(buf);
+  }
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
-  Slice memkey = key.memtable_key();
-  Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
-    // 条目格式为：
-    //    klength  varint32
-    //    userkey  char[klength]
-    //    tag      uint64
-    //    vlength  varint32
-    //    value    char[vlength]
-    // 检查它是否属于相同的用户键。我们不检查序列号，因为上面的Seek()调用应该已经跳过了所有序列号过大的条目。
-    const char* entry = iter.key();
-    uint32_t klength;
-    const char* userkey = GetVarint32Ptr(entry, entry + 5, &klength);
-    if (comparator_.comparator.user_comparator()->Compare(
-            Slice(userkey, klength - 8), key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(userkey + klength - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(userkey + klength);
-          value->assign(v.data(), v.size());
-          return true;
-        }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
-      }
+namespace {
+struct GetState {
+  const Comparator* ucmp;
+  Slice user_key;
+  SequenceNumber max_covering_tombstone_seq;
+  std::string* value;
+  Status* s;
+  std::vector<std::string>* merge_operands;
+  bool found;
+};
+}  // namespace
+
+// 对 key 之后的每个条目调用，返回 false 时停止查找
+static bool SaveValue(void* arg, const char* entry) {
+  GetState* state = reinterpret_cast<GetState*>(arg);
+  // 条目格式为：
+  //    klength  varint32
+  //    userkey  char[klength]
+  //    tag      uint64
+  //    vlength  varint32
+  //    value    char[vlength]
+  // 检查它是否属于相同的用户键。我们不检查序列号，因为查找时已经跳过了所有序列号过大的条目。
+  uint32_t klength;
+  const char* userkey = GetVarint32Ptr(entry, entry + 5, &klength);
+  if (state->ucmp->Compare(Slice(userkey, klength - 8), state->user_key) != 0) {
+    return false;
+  }
+  // Correct user key
+  const uint64_t tag = DecodeFixed64(userkey + klength - 8);
+  if ((tag >> 8) < state->max_covering_tombstone_seq) {
+    // 被更新的范围删除标记覆盖
+    *state->s = Status::NotFound(Slice());
+    state->found = true;
+    return false;
+  }
+  switch (static_cast<ValueType>(tag & 0xff)) {
+    case kTypeValue: {
+      Slice v = GetLengthPrefixedSlice(userkey + klength);
+      state->value->assign(v.data(), v.size());
+      state->found = true;
+      return false;
+    }
+    case kTypeDeletion:
+      *state->s = Status::NotFound(Slice());
+      state->found = true;
+      return false;
+    case kTypeMerge: {
+      // 合并操作数需要继续向更早的条目查找，直到遇到值、删除记录或其他用户键
+      Slice v = GetLengthPrefixedSlice(userkey + klength);
+      state->merge_operands->emplace_back(v.data(), v.size());
+      return true;
     }
+    case kTypeRangeDeletion:
+    case kTypeBlobIndex:
+      // 范围删除标记不在 table_ 中，blob 索引只出现在 sstable 中
+      return false;
   }
   return false;
 }
+
+std::shared_ptr<const FragmentedRangeTombstones> MemTable::RangeDelFragments(
+    size_t count) {
+  MutexLock l(&range_del_mutex_);
+  if (range_del_fragments_ == nullptr || num_fragmented_ < count) {
+    // 先读计数再遍历：遍历到的标记不会少于记下的数目
+    num_fragmented_ = num_range_deletions_.load(std::memory_order_acquire);
+    std::vector<RangeTombstone> tombstones;
+    MemTableIterator range_iter(range_del_table_->NewIterator());
+    ReadRangeTombstones(&range_iter, &tombstones);
+    range_del_fragments_ = std::make_shared<FragmentedRangeTombstones>(
+        comparator_.comparator.user_comparator(), tombstones);
+  }
+  return range_del_fragments_;
+}
+
+std::shared_ptr<const FragmentedRangeTombstones> MemTable::RangeTombstones() {
+  const size_t num_range_deletions =
+      num_range_deletions_.load(std::memory_order_acquire);
+  if (num_range_deletions == 0) {
+    return nullptr;
+  }
+  return RangeDelFragments(num_range_deletions);
+}
+
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   SequenceNumber* max_covering_tombstone_seq,
+                   std::vector<std::string>* merge_operands) {
+  const Comparator* ucmp = comparator_.comparator.user_comparator();
+  const size_t num_range_deletions =
+      num_range_deletions_.load(std::memory_order_acquire);
+  if (num_range_deletions > 0) {
+    std::shared_ptr<const FragmentedRangeTombstones> fragments =
+        RangeDelFragments(num_range_deletions);
+    const Slice ikey = key.internal_key();
+    const SequenceNumber snapshot =
+        DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8;
+    const SequenceNumber seq =
+        fragments->MaxCoveringSeq(key.user_key(), snapshot);
+    if (seq > *max_covering_tombstone_seq) {
+      *max_covering_tombstone_seq = seq;
+    }
+  }
+
+  GetState state;
+  state.ucmp = ucmp;
+  state.user_key = key.user_key();
+  state.max_covering_tombstone_seq = *max_covering_tombstone_seq;
+  state.value = value;
+  state.s = s;
+  state.merge_operands = merge_operands;
+  state.found = false;
+  table_->Get(key, &state, &SaveValue);
+  return state.found;
+}
 }  // namespace leveldb
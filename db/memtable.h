@@ -2,14 +2,21 @@
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
 #include <string>
+#include <vector>
+
+#include <atomic>
+#include <memory>
 
 #include "db/dbformat.h"
-#include "db/skiplist.h"
+#include "db/memtablerep.h"
 #include "leveldb/db.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
+class FragmentedRangeTombstones;
 class InternalKeyComparator;
 class Iterator;
 
@@ -19,6 +26,10 @@ class MemTable {
   // is zero and the caller must call Ref() at least once.
   explicit MemTable(const InternalKeyComparator& comparator);
 
+  // 按 options 中的 memtable_rep 选择点数据的存储结构，按 write_buffer_size、
+  // arena_block_size、memtable_huge_page 与 memtable_numa_aware 配置内存分配。
+  MemTable(const InternalKeyComparator& comparator, const Options& options);
+
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
 
@@ -36,36 +47,62 @@ class MemTable {
   // 在 MemTable 被修改时调用是安全的。
   size_t ApproximateMemoryUsage();
 
+  // 通知之后不会再有 Add()，例如 memtable 成为 imm_ 或即将落盘。
+  void MarkImmutable() { table_->MarkReadOnly(); }
+
   // 返回一个迭代器，该迭代器生成 memtable 的内容。
   //
   // 调用者必须确保在返回的迭代器存活期间，底层的 MemTable 也保持存活。
   // 该迭代器返回的键是由db/format.{h,cc}模块中的AppendInternalKey编码的内部键。
   Iterator* NewIterator();
 
+  // 返回一个迭代器，按 db/range_tombstone.h 中描述的格式生成
+  // memtable 中的范围删除标记。生命周期要求同 NewIterator()。
+  Iterator* NewRangeTombstoneIterator();
+
+  // 返回切分好的范围删除标记，没有标记时返回 nullptr。之后插入的标记
+  // 不会出现在返回的结果中。不要求持有锁。
+  std::shared_ptr<const FragmentedRangeTombstones> RangeTombstones();
+
   // 向 memtable 中添加一个条目，该条目将键映射到指定序列号和指定类型的值。
   // 通常，如果 type==kTypeDeletion，value 将为空。
+  // 如果 type==kTypeRangeDeletion，key 与 value 分别为删除区间的 begin 与 end。
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
   // 如果memtable包含键的值，则将其存储在*value中并返回 true。
   // 如果memtable包含键的删除记录，则在*status中存储一个NotFound()错误并返回true。
   // 否则，返回 false。
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  //
+  // *max_covering_tombstone_seq 为已知覆盖该键的范围删除标记的最大序列号，
+  // 会先用本 memtable 中的标记更新；序列号小于它的条目视为已删除。
+  //
+  // 遇到合并操作数时，将其追加到 *merge_operands（从新到旧）并继续向更早的
+  // 条目查找；若在找到值或删除记录之前条目已耗尽，返回 false，
+  // 由调用者在更早的数据中继续查找。
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           SequenceNumber* max_covering_tombstone_seq,
+           std::vector<std::string>* merge_operands);
 
  private:
-  friend class MemTableIterator;
-  struct KeyComparator {
-    const InternalKeyComparator comparator;
-    explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) {}
-    int operator()(const char* a, const char* b) const;
-  };
-
-  typedef SkipList<const char*, KeyComparator> Table;
   ~MemTable();
-  KeyComparator comparator_;
+
+  // 返回切分后的范围删除标记，至少包含前 count 个插入的标记
+  std::shared_ptr<const FragmentedRangeTombstones> RangeDelFragments(
+      size_t count);
+  MemTableKeyComparator comparator_;
   int refs_;
   Arena arena_;
-  Table table_;
+  MemTableRep* table_;
+  MemTableRep* range_del_table_;  // 范围删除标记，与点数据分开存放，总是跳表
+  std::atomic<size_t> num_range_deletions_;
+
+  // 查询时按需切分 range_del_table_ 中的标记，插入新标记后重建。
+  // 读者持有 shared_ptr，重建不影响正在进行的查询
+  port::Mutex range_del_mutex_;
+  std::shared_ptr<const FragmentedRangeTombstones> range_del_fragments_
+      GUARDED_BY(range_del_mutex_);
+  size_t num_fragmented_ GUARDED_BY(range_del_mutex_);
 };
 
 }  // namespace leveldb
@@ -0,0 +1,390 @@
+#include "db/memtablerep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "db/skiplist.h"
+#include "leveldb/comparator.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+#include "util/parallel.h"
+
+namespace leveldb {
+
+static Slice GetLengthPrefixedSlice(const char* data) {
+  uint32_t len;
+  const char* p = data;
+  p = GetVarint32Ptr(p, p + 5, &len);
+  return Slice(p, len);
+}
+
+int MemTableKeyComparator::operator()(const char* aptr,
+                                      const char* bptr) const {
+  Slice a = GetLengthPrefixedSlice(aptr);
+  Slice b = GetLengthPrefixedSlice(bptr);
+  return comparator.Compare(a, b);
+}
+
+void MemTableRep::Get(const LookupKey& key, void* arg,
+                      bool (*callback)(void* arg, const char* entry)) {
+  Iterator* iter = NewIterator();
+  for (iter->Seek(key.memtable_key().data());
+       iter->Valid() && callback(arg, iter->key()); iter->Next()) {
+  }
+  delete iter;
+}
+
+namespace {
+
+typedef SkipList<const char*, MemTableKeyComparator> Table;
+
+class SkipListRep : public MemTableRep {
+ public:
+  SkipListRep(const MemTableKeyComparator& cmp, Arena* arena)
+      : table_(cmp, arena) {}
+
+  void Insert(const char* entry) override { table_.Insert(entry); }
+
+  void Get(const LookupKey& key, void* arg,
+           bool (*callback)(void* arg, const char* entry)) override {
+    Table::Iterator iter(&table_);
+    for (iter.Seek(key.memtable_key().data());
+         iter.Valid() && callback(arg, iter.key()); iter.Next()) {
+    }
+  }
+
+  Iterator* NewIterator() override { return new SkipListIterator(&table_); }
+
+ private:
+  class SkipListIterator : public Iterator {
+   public:
+    explicit SkipListIterator(const Table* table) : iter_(table) {}
+
+    bool Valid() const override { return iter_.Valid(); }
+    const char* key() const override { return iter_.key(); }
+    void Next() override { iter_.Next(); }
+    void Prev() override { iter_.Prev(); }
+    void Seek(const char* memtable_key) override { iter_.Seek(memtable_key); }
+    void SeekToFirst() override { iter_.SeekToFirst(); }
+    void SeekToLast() override { iter_.SeekToLast(); }
+
+   private:
+    Table::Iterator iter_;
+  };
+
+  Table table_;
+};
+
+// 按内部键顺序比较条目
+struct EntryLess {
+  explicit EntryLess(const MemTableKeyComparator& c) : cmp(c) {}
+  bool operator()(const char* a, const char* b) const { return cmp(a, b) < 0; }
+
+  const MemTableKeyComparator& cmp;
+};
+
+// 遍历已排序的条目数组。
+class SortedVectorIterator : public MemTableRep::Iterator {
+ public:
+  // 取走 *entries 的内容。遍历的是创建时收集到的条目：之后插入的条目
+  // 序列号更大，对已经创建的数据库迭代器本来就不可见，不影响结果。
+  SortedVectorIterator(const MemTableKeyComparator& cmp,
+                       std::vector<const char*>* entries)
+      : cmp_(cmp), entries_(&owned_), pos_(0) {
+    owned_.swap(*entries);
+    pos_ = entries_->size();
+  }
+
+  // 引用不再修改的 *entries，调用者保证它比迭代器存活得久
+  SortedVectorIterator(const MemTableKeyComparator& cmp,
+                       const std::vector<const char*>* entries)
+      : cmp_(cmp), entries_(entries), pos_(entries->size()) {}
+
+  bool Valid() const override { return pos_ < entries_->size(); }
+  const char* key() const override {
+    assert(Valid());
+    return (*entries_)[pos_];
+  }
+  void Next() override {
+    assert(Valid());
+    pos_++;
+  }
+  void Prev() override {
+    assert(Valid());
+    pos_ = (pos_ == 0) ? entries_->size() : pos_ - 1;
+  }
+  void Seek(const char* memtable_key) override {
+    pos_ = std::lower_bound(entries_->begin(), entries_->end(), memtable_key,
+                            EntryLess(cmp_)) -
+           entries_->begin();
+  }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override {
+    pos_ = entries_->empty() ? 0 : entries_->size() - 1;
+  }
+
+ private:
+  const MemTableKeyComparator cmp_;
+  std::vector<const char*> owned_;
+  const std::vector<const char*>* const entries_;
+  size_t pos_;
+};
+
+class HashSkipListRep : public MemTableRep {
+ public:
+  HashSkipListRep(const MemTableKeyComparator& cmp, Arena* arena,
+                  size_t prefix_length, size_t bucket_count)
+      : cmp_(cmp),
+        arena_(arena),
+        prefix_length_(prefix_length),
+        bucket_count_(bucket_count) {
+    assert(bucket_count_ > 0);
+    char* mem = arena_->AllocateAligned(sizeof(std::atomic<Table*>) *
+                                        bucket_count_);
+    buckets_ = reinterpret_cast<std::atomic<Table*>*>(mem);
+    for (size_t i = 0; i < bucket_count_; i++) {
+      new (&buckets_[i]) std::atomic<Table*>(nullptr);
+    }
+  }
+
+  void Insert(const char* entry) override {
+    std::atomic<Table*>* bucket = Bucket(EntryUserKey(entry));
+    Table* table = bucket->load(std::memory_order_relaxed);
+    if (table == nullptr) {
+      // 跳表没有需要释放的资源，与条目一起留在 arena 中
+      char* mem = arena_->AllocateAligned(sizeof(Table));
+      table = new (mem) Table(cmp_, arena_);
+      bucket->store(table, std::memory_order_release);
+    }
+    table->Insert(entry);
+  }
+
+  void Get(const LookupKey& key, void* arg,
+           bool (*callback)(void* arg, const char* entry)) override {
+    Table* table =
+        Bucket(key.user_key())->load(std::memory_order_acquire);
+    if (table == nullptr) {
+      return;
+    }
+    Table::Iterator iter(table);
+    for (iter.Seek(key.memtable_key().data());
+         iter.Valid() && callback(arg, iter.key()); iter.Next()) {
+    }
+  }
+
+  Iterator* NewIterator() override {
+    std::vector<const char*> entries;
+    for (size_t i = 0; i < bucket_count_; i++) {
+      Table* table = buckets_[i].load(std::memory_order_acquire);
+      if (table == nullptr) {
+        continue;
+      }
+      Table::Iterator iter(table);
+      for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        entries.push_back(iter.key());
+      }
+    }
+    std::sort(entries.begin(), entries.end(), EntryLess(cmp_));
+    return new SortedVectorIterator(cmp_, &entries);
+  }
+
+ private:
+  static Slice EntryUserKey(const char* entry) {
+    return ExtractUserKey(GetLengthPrefixedSlice(entry));
+  }
+
+  std::atomic<Table*>* Bucket(const Slice& user_key) const {
+    const size_t n = std::min(user_key.size(), prefix_length_);
+    return &buckets_[Hash64(user_key.data(), n, 0) % bucket_count_];
+  }
+
+  const MemTableKeyComparator cmp_;
+  Arena* const arena_;
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+  std::atomic<Table*>* buckets_;
+};
+
+// 少于此数量的条目直接排序
+static const size_t kMinParallelSortEntries = 16 * 1024;
+
+// kVectorRep 落盘前排序使用的最大线程数
+static const int kMaxSortThreads = 8;
+
+class VectorRep : public MemTableRep {
+ public:
+  VectorRep(const MemTableKeyComparator& cmp, Env* env, int max_sort_threads)
+      : cmp_(cmp),
+        env_(env),
+        max_sort_threads_(max_sort_threads),
+        frozen_(false),
+        memory_usage_(0),
+        read_only_(false),
+        sorted_(0) {}
+
+  void Insert(const char* entry) override {
+    MutexLock l(&mu_);
+    assert(!read_only_);
+    entries_.push_back(entry);
+    memory_usage_.store(entries_.capacity() * sizeof(const char*),
+                        std::memory_order_relaxed);
+  }
+
+  void Get(const LookupKey& key, void* arg,
+           bool (*callback)(void* arg, const char* entry)) override {
+    if (frozen_.load(std::memory_order_acquire)) {
+      Scan(key, arg, callback);
+      return;
+    }
+    MutexLock l(&mu_);
+    SortLocked();
+    Scan(key, arg, callback);
+  }
+
+  Iterator* NewIterator() override {
+    if (!frozen_.load(std::memory_order_acquire)) {
+      MutexLock l(&mu_);
+      SortLocked();
+      if (!read_only_) {
+        std::vector<const char*> snapshot(entries_);
+        return new SortedVectorIterator(cmp_, &snapshot);
+      }
+      frozen_.store(true, std::memory_order_release);
+    }
+    const std::vector<const char*>* entries = &entries_;
+    return new SortedVectorIterator(cmp_, entries);
+  }
+
+  void MarkReadOnly() override {
+    MutexLock l(&mu_);
+    read_only_ = true;
+  }
+
+  size_t ApproximateMemoryUsage() override {
+    return memory_usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct SortWork {
+    EntryLess less;
+    std::vector<std::vector<const char*>::iterator> bounds;
+    size_t width;  // 本轮合并的每一段包含的块数
+
+    explicit SortWork(const MemTableKeyComparator& cmp) : less(cmp), width(0) {}
+  };
+
+  static void SortChunk(void* arg, size_t i) {
+    SortWork* work = reinterpret_cast<SortWork*>(arg);
+    std::sort(work->bounds[i], work->bounds[i + 1], work->less);
+  }
+
+  static void MergeChunks(void* arg, size_t i) {
+    SortWork* work = reinterpret_cast<SortWork*>(arg);
+    const size_t chunks = work->bounds.size() - 1;
+    const size_t lo = i * 2 * work->width;
+    const size_t mid = std::min(lo + work->width, chunks);
+    const size_t hi = std::min(lo + 2 * work->width, chunks);
+    if (mid < hi) {
+      std::inplace_merge(work->bounds[lo], work->bounds[mid], work->bounds[hi],
+                         work->less);
+    }
+  }
+
+  // 对 entries_ 中尚未排序的部分排序并与已排序的部分合并。只读之后
+  // 分块并行排序，再逐轮两两合并。
+  void SortLocked() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (sorted_ == entries_.size()) {
+      return;
+    }
+    const std::vector<const char*>::iterator mid = entries_.begin() + sorted_;
+    const size_t n = entries_.end() - mid;
+    SortWork work(cmp_);
+    size_t chunks = (max_sort_threads_ > 1) ? max_sort_threads_ : 1;
+    if (!read_only_ || n < kMinParallelSortEntries) {
+      chunks = 1;
+    }
+    for (size_t i = 0; i <= chunks; i++) {
+      work.bounds.push_back(mid + n * i / chunks);
+    }
+    ParallelFor(env_, chunks, max_sort_threads_, &SortChunk, &work);
+    for (work.width = 1; work.width < chunks; work.width *= 2) {
+      const size_t pairs = (chunks + 2 * work.width - 1) / (2 * work.width);
+      ParallelFor(env_, pairs, max_sort_threads_, &MergeChunks, &work);
+    }
+    std::inplace_merge(entries_.begin(), mid, entries_.end(), work.less);
+    sorted_ = entries_.size();
+  }
+
+  // 要求 entries_ 已排序，并且持有 mu_ 或 frozen_ 为 true
+  void Scan(const LookupKey& key, void* arg,
+            bool (*callback)(void* arg, const char* entry)) {
+    std::vector<const char*>::const_iterator iter =
+        std::lower_bound(entries_.begin(), entries_.end(),
+                         key.memtable_key().data(), EntryLess(cmp_));
+    while (iter != entries_.end() && callback(arg, *iter)) {
+      ++iter;
+    }
+  }
+
+  const MemTableKeyComparator cmp_;
+  Env* const env_;
+  const int max_sort_threads_;
+  // 只读并且已经排序，entries_ 不再改变，读取无需加锁
+  std::atomic<bool> frozen_;
+  std::atomic<size_t> memory_usage_;
+
+  port::Mutex mu_;
+  bool read_only_ GUARDED_BY(mu_);
+  std::vector<const char*> entries_;  // frozen_ 之前由 mu_ 保护
+  size_t sorted_ GUARDED_BY(mu_);     // entries_ 中已排序的前缀长度
+};
+
+}  // namespace
+
+MemTableRep* NewSkipListRep(const MemTableKeyComparator& cmp, Arena* arena) {
+  return new SkipListRep(cmp, arena);
+}
+
+MemTableRep* NewHashSkipListRep(const MemTableKeyComparator& cmp, Arena* arena,
+                                size_t prefix_length, size_t bucket_count) {
+  return new HashSkipListRep(cmp, arena, prefix_length, bucket_count);
+}
+
+MemTableRep* NewVectorRep(const MemTableKeyComparator& cmp, Env* env,
+                          int max_sort_threads) {
+  return new VectorRep(cmp, env, max_sort_threads);
+}
+
+MemTableRep* NewMemTableRep(const Options& options,
+                            const MemTableKeyComparator& cmp, Arena* arena) {
+  switch (options.memtable_rep) {
+    case kHashSkipListRep: {
+      // 桶数组约占写缓冲区的 0.2%
+      size_t buckets = options.write_buffer_size / 4096;
+      buckets = std::max<size_t>(buckets, 16);
+      buckets = std::min<size_t>(buckets, 1 << 20);
+      return NewHashSkipListRep(cmp, arena, options.memtable_prefix_length,
+                                buckets);
+    }
+    case kRadixTreeRep:
+      if (cmp.comparator.user_comparator() == BytewiseComparator()) {
+        return NewRadixTreeRep(cmp, arena);
+      }
+      // 基数树按字节序排列用户键
+      break;
+    case kVectorRep:
+      return NewVectorRep(cmp, options.env, kMaxSortThreads);
+    case kSkipListRep:
+      break;
+  }
+  return NewSkipListRep(cmp, arena);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,93 @@
+#ifndef STORAGE_LEVELDB_DB_MEMTABLEREP_H_
+#define STORAGE_LEVELDB_DB_MEMTABLEREP_H_
+
+#include "db/dbformat.h"
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+class Arena;
+class Env;
+
+// 比较 memtable 中的条目：条目以长度前缀编码的内部键开头。
+struct MemTableKeyComparator {
+  const InternalKeyComparator comparator;
+  explicit MemTableKeyComparator(const InternalKeyComparator& c)
+      : comparator(c) {}
+  int operator()(const char* a, const char* b) const;
+};
+
+// memtable 中点数据的存储结构。条目的格式见 MemTable::Add，内存来自
+// MemTable 的 arena，在 MemTableRep 销毁之前一直有效。
+//
+// 线程安全：Insert() 需要外部同步；读操作（Get 与迭代器）可以与一个
+// Insert() 并发执行，无需加锁。
+class MemTableRep {
+ public:
+  // 遍历条目的迭代器，key() 返回条目的起始地址。
+  class Iterator {
+   public:
+    Iterator() = default;
+    Iterator(const Iterator&) = delete;
+    Iterator& operator=(const Iterator&) = delete;
+    virtual ~Iterator() = default;
+
+    virtual bool Valid() const = 0;
+    virtual const char* key() const = 0;
+    virtual void Next() = 0;
+    virtual void Prev() = 0;
+    // 定位到第一个不小于 memtable_key（长度前缀编码的内部键）的条目
+    virtual void Seek(const char* memtable_key) = 0;
+    virtual void SeekToFirst() = 0;
+    virtual void SeekToLast() = 0;
+  };
+
+  MemTableRep() = default;
+  MemTableRep(const MemTableRep&) = delete;
+  MemTableRep& operator=(const MemTableRep&) = delete;
+  virtual ~MemTableRep() = default;
+
+  // 插入一个条目。要求：不存在与之相等的条目。
+  virtual void Insert(const char* entry) = 0;
+
+  // 从第一个不小于 key 的条目开始按顺序对条目调用 callback(arg, entry)，
+  // 直到 callback 返回 false 或条目耗尽。callback 遇到其他用户键时应返回
+  // false；实现也可以不再提供用户键不同的条目。默认实现使用 NewIterator()。
+  virtual void Get(const LookupKey& key, void* arg,
+                   bool (*callback)(void* arg, const char* entry));
+
+  // 返回按内部键顺序遍历所有条目的迭代器，由调用者删除。
+  virtual Iterator* NewIterator() = 0;
+
+  // 通知之后不会再有 Insert()，例如 memtable 即将落盘。
+  virtual void MarkReadOnly() {}
+
+  // 不在 arena 中分配的内存字节数。
+  virtual size_t ApproximateMemoryUsage() { return 0; }
+};
+
+// 按 options.memtable_rep 创建存储结构，内存从 *arena 分配。
+// kRadixTreeRep 要求用户比较器为 BytewiseComparator()，否则使用跳表。
+MemTableRep* NewMemTableRep(const Options& options,
+                            const MemTableKeyComparator& cmp, Arena* arena);
+
+MemTableRep* NewSkipListRep(const MemTableKeyComparator& cmp, Arena* arena);
+
+// 按用户键前 prefix_length 字节哈希到 bucket_count 个跳表。点查只搜索一个
+// 桶；NewIterator() 在创建时收集并排序全部条目。
+MemTableRep* NewHashSkipListRep(const MemTableKeyComparator& cmp, Arena* arena,
+                                size_t prefix_length, size_t bucket_count);
+
+// 以用户键为键的自适应基数树，同一用户键的条目按序列号从新到旧链接在
+// 叶子上，叶子之间按用户键顺序链接。
+MemTableRep* NewRadixTreeRep(const MemTableKeyComparator& cmp, Arena* arena);
+
+// 只追加的条目数组，插入不做比较。读取时对尚未排序的部分排序后二分
+// 查找；MarkReadOnly() 之后第一次读取时用最多 max_sort_threads 个线程
+// 并行排序一次，之后的读取不再加锁。
+MemTableRep* NewVectorRep(const MemTableKeyComparator& cmp, Env* env,
+                          int max_sort_threads);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MEMTABLEREP_H_
@@ -0,0 +1,306 @@
+#include "db/memtablerep.h"
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "db/dbformat.h"
+#include "db/memtable.h"
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "port/port.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+namespace {
+
+struct InternalKeyLess {
+  InternalKeyComparator cmp;
+  InternalKeyLess() : cmp(BytewiseComparator()) {}
+  bool operator()(const std::string& a, const std::string& b) const {
+    return cmp.Compare(a, b) < 0;
+  }
+};
+
+typedef std::map<std::string, std::string, InternalKeyLess> Model;
+
+// 键长不一，并且有互为前缀的键，覆盖基数树的各种节点与 terminal
+std::string RandomUserKey(Random* rnd) {
+  std::string key = "k";
+  const int len = rnd->Uniform(6);
+  for (int i = 0; i < len; i++) {
+    const int range = rnd->OneIn(4) ? 26 : 3;
+    key.push_back(static_cast<char>('a' + rnd->Uniform(range)));
+  }
+  if (rnd->OneIn(8)) {
+    key.push_back('\0');
+    key.push_back('\xff');
+  }
+  return key;
+}
+
+std::string IKey(const std::string& user_key, SequenceNumber seq,
+                 ValueType type) {
+  std::string result;
+  AppendInternalKey(&result, ParsedInternalKey(user_key, seq, type));
+  return result;
+}
+
+class MemTableRepTest : public testing::Test {
+ public:
+  void RunRandomized(MemTableRepType type) {
+    InternalKeyComparator icmp(BytewiseComparator());
+    Options options;
+    options.memtable_rep = type;
+    options.memtable_prefix_length = 2;
+    MemTable* mem = new MemTable(icmp, options);
+    mem->Ref();
+
+    Random rnd(test::RandomSeed());
+    Model model;
+    std::vector<std::string> user_keys;
+    const int N = 5000;
+    // 乱序的序列号，检验同一用户键内的排序
+    std::vector<SequenceNumber> seqs;
+    for (int i = 0; i < N; i++) {
+      seqs.push_back(i + 1);
+    }
+    for (int i = N - 1; i > 0; i--) {
+      std::swap(seqs[i], seqs[rnd.Uniform(i + 1)]);
+    }
+    for (int i = 0; i < N; i++) {
+      const std::string user_key = RandomUserKey(&rnd);
+      const ValueType t = rnd.OneIn(5) ? kTypeDeletion : kTypeValue;
+      const std::string value = (t == kTypeValue) ? NumberToString(i) : "";
+      mem->Add(seqs[i], t, user_key, value);
+      model[IKey(user_key, seqs[i], t)] = value;
+      user_keys.push_back(user_key);
+    }
+
+    // 正向遍历
+    Iterator* iter = mem->NewIterator();
+    Model::iterator m = model.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++m) {
+      ASSERT_TRUE(m != model.end());
+      ASSERT_EQ(EscapeString(m->first), EscapeString(iter->key()));
+      ASSERT_EQ(m->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(m == model.end());
+
+    // 反向遍历
+    Model::reverse_iterator r = model.rbegin();
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev(), ++r) {
+      ASSERT_TRUE(r != model.rend());
+      ASSERT_EQ(EscapeString(r->first), EscapeString(iter->key()));
+    }
+    ASSERT_TRUE(r == model.rend());
+
+    // Seek，再前后移动一步
+    for (int i = 0; i < 1000; i++) {
+      const std::string target =
+          IKey(RandomUserKey(&rnd), rnd.Uniform(N + 2), kValueTypeForSeek);
+      iter->Seek(target);
+      m = model.lower_bound(target);
+      if (m == model.end()) {
+        ASSERT_TRUE(!iter->Valid());
+        continue;
+      }
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(EscapeString(m->first), EscapeString(iter->key()));
+      if (rnd.OneIn(2)) {
+        iter->Next();
+        ++m;
+        ASSERT_EQ(m != model.end(), iter->Valid());
+        if (iter->Valid()) {
+          ASSERT_EQ(EscapeString(m->first), EscapeString(iter->key()));
+        }
+      } else {
+        iter->Prev();
+        if (m == model.begin()) {
+          ASSERT_TRUE(!iter->Valid());
+        } else {
+          --m;
+          ASSERT_TRUE(iter->Valid());
+          ASSERT_EQ(EscapeString(m->first), EscapeString(iter->key()));
+        }
+      }
+    }
+    delete iter;
+
+    // 在任意快照上点查
+    for (int i = 0; i < 2000; i++) {
+      const std::string user_key = rnd.OneIn(2) ? RandomUserKey(&rnd)
+                                                : user_keys[rnd.Uniform(N)];
+      const SequenceNumber snapshot = rnd.Uniform(N + 2);
+      LookupKey lkey(user_key, snapshot);
+      std::string value;
+      Status s;
+      SequenceNumber max_covering_seq = 0;
+      std::vector<std::string> operands;
+      const bool found =
+          mem->Get(lkey, &value, &s, &max_covering_seq, &operands);
+
+      m = model.lower_bound(IKey(user_key, snapshot, kValueTypeForSeek));
+      ParsedInternalKey parsed;
+      if (m == model.end() || !ParseInternalKey(m->first, &parsed) ||
+          parsed.user_key != user_key) {
+        ASSERT_TRUE(!found);
+      } else if (parsed.type == kTypeDeletion) {
+        ASSERT_TRUE(found);
+        ASSERT_TRUE(s.IsNotFound());
+      } else {
+        ASSERT_TRUE(found);
+        ASSERT_EQ(m->second, value);
+      }
+    }
+    mem->Unref();
+  }
+};
+
+}  // namespace
+
+TEST_F(MemTableRepTest, SkipList) { RunRandomized(kSkipListRep); }
+
+TEST_F(MemTableRepTest, HashSkipList) { RunRandomized(kHashSkipListRep); }
+
+TEST_F(MemTableRepTest, RadixTree) { RunRandomized(kRadixTreeRep); }
+
+TEST_F(MemTableRepTest, Vector) { RunRandomized(kVectorRep); }
+
+TEST_F(MemTableRepTest, VectorParallelSort) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  MemTableKeyComparator cmp(icmp);
+  MemTableRep* rep = NewVectorRep(cmp, Env::Default(), 4);
+  Random rnd(301);
+  std::vector<std::string> entries;
+  const int N = 100000;
+  entries.reserve(N);
+  for (int i = 0; i < N; i++) {
+    const std::string ikey =
+        IKey(NumberToString(rnd.Uniform(N / 2)), i + 1, kTypeValue);
+    std::string entry;
+    PutVarint32(&entry, ikey.size());
+    entry.append(ikey);
+    PutVarint32(&entry, 0);
+    entries.push_back(entry);
+    rep->Insert(entries.back().data());
+  }
+  ASSERT_GE(rep->ApproximateMemoryUsage(), N * sizeof(char*));
+
+  // 只读之后第一次遍历时并行排序
+  rep->MarkReadOnly();
+  MemTableRep::Iterator* iter = rep->NewIterator();
+  int count = 0;
+  const char* prev = nullptr;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (prev != nullptr) {
+      ASSERT_LT(cmp(prev, iter->key()), 0);
+    }
+    prev = iter->key();
+    count++;
+  }
+  ASSERT_EQ(N, count);
+  delete iter;
+  delete rep;
+}
+
+namespace {
+
+struct ConcurrentState {
+  MemTableRep* rep;
+  std::atomic<int> inserted{0};
+  std::atomic<bool> done{false};
+  port::Mutex mu;
+  port::CondVar cv{&mu};
+  bool reader_done = false;
+  bool ok = true;
+};
+
+std::string ConcurrentKey(int i) {
+  // 共享前缀，迫使节点不断升级
+  return "key" + NumberToString(i % 397) + "/" + NumberToString(i);
+}
+
+void ConcurrentReader(void* arg) {
+  ConcurrentState* state = reinterpret_cast<ConcurrentState*>(arg);
+  InternalKeyComparator icmp(BytewiseComparator());
+  while (!state->done.load(std::memory_order_acquire)) {
+    const int n = state->inserted.load(std::memory_order_acquire);
+    // 已发布的键必须能找到，且遍历结果有序
+    MemTableRep::Iterator* iter = state->rep->NewIterator();
+    int count = 0;
+    std::string prev;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      uint32_t len;
+      const char* p = GetVarint32Ptr(iter->key(), iter->key() + 5, &len);
+      std::string ikey(p, len);
+      if (!prev.empty() && icmp.Compare(prev, ikey) >= 0) {
+        state->ok = false;
+      }
+      prev = ikey;
+      count++;
+    }
+    if (count < n) {
+      state->ok = false;
+    }
+    if (n > 0) {
+      std::string target;
+      const std::string ikey = IKey(ConcurrentKey(n - 1), n, kTypeValue);
+      PutVarint32(&target, ikey.size());
+      target.append(ikey);
+      iter->Seek(target.data());
+      if (!iter->Valid()) {
+        state->ok = false;
+      }
+    }
+    delete iter;
+  }
+  MutexLock l(&state->mu);
+  state->reader_done = true;
+  state->cv.Signal();
+}
+
+}  // namespace
+
+TEST_F(MemTableRepTest, RadixTreeConcurrentRead) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  MemTableKeyComparator cmp(icmp);
+  Arena arena;
+  ConcurrentState state;
+  state.rep = NewRadixTreeRep(cmp, &arena);
+  Env::Default()->StartThread(&ConcurrentReader, &state);
+
+  std::vector<std::string> entries;
+  const int N = 20000;
+  entries.reserve(N);
+  for (int i = 0; i < N; i++) {
+    const std::string ikey = IKey(ConcurrentKey(i), i + 1, kTypeValue);
+    std::string entry;
+    PutVarint32(&entry, ikey.size());
+    entry.append(ikey);
+    PutVarint32(&entry, 0);
+    entries.push_back(entry);
+    state.rep->Insert(entries.back().data());
+    state.inserted.store(i + 1, std::memory_order_release);
+  }
+  state.done.store(true, std::memory_order_release);
+  {
+    MutexLock l(&state.mu);
+    while (!state.reader_done) {
+      state.cv.Wait();
+    }
+  }
+  ASSERT_TRUE(state.ok);
+  delete state.rep;
+}
+
+}  // namespace leveldb
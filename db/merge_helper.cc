@@ -0,0 +1,46 @@
+#include "db/merge_helper.h"
+
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+// MergeOperator 接受的操作数是从旧到新的
+static void OldestFirst(const std::vector<std::string>& operands,
+                        std::vector<Slice>* dst) {
+  dst->reserve(operands.size());
+  for (auto it = operands.rbegin(); it != operands.rend(); ++it) {
+    dst->emplace_back(*it);
+  }
+}
+
+Status MergeOperands(const MergeOperator* merge_operator, const Slice& user_key,
+                     const Slice* existing_value,
+                     const std::vector<std::string>& operands,
+                     std::string* result) {
+  if (merge_operator == nullptr) {
+    return Status::NotSupported("merge operand found but no merge operator",
+                                user_key);
+  }
+  std::vector<Slice> list;
+  OldestFirst(operands, &list);
+  std::string merged;
+  if (!merge_operator->FullMerge(user_key, existing_value, list, &merged)) {
+    return Status::Corruption("merge failed for key", user_key);
+  }
+  result->swap(merged);
+  return Status::OK();
+}
+
+bool PartialMergeOperands(const MergeOperator* merge_operator,
+                          const Slice& user_key,
+                          const std::vector<std::string>& operands,
+                          std::string* result) {
+  if (merge_operator == nullptr || operands.size() < 2) {
+    return false;
+  }
+  std::vector<Slice> list;
+  OldestFirst(operands, &list);
+  return merge_operator->PartialMerge(user_key, list, result);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,30 @@
+#ifndef STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+#define STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+class MergeOperator;
+
+// 读取路径按从新到旧的顺序收集同一个键的合并操作数。
+// 用 "merge_operator" 将 "operands"（从新到旧）合并到 existing_value
+// （nullptr 表示没有已有值）上，结果存入 *result。
+// 未配置 merge_operator 时返回 NotSupported，合并失败时返回 Corruption。
+Status MergeOperands(const MergeOperator* merge_operator, const Slice& user_key,
+                     const Slice* existing_value,
+                     const std::vector<std::string>& operands,
+                     std::string* result);
+
+// 尝试将多个操作数（从新到旧）合并为一个，成功时存入 *result 并返回 true。
+bool PartialMergeOperands(const MergeOperator* merge_operator,
+                          const Slice& user_key,
+                          const std::vector<std::string>& operands,
+                          std::string* result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_HELPER_H_
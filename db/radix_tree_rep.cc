@@ -0,0 +1,621 @@
+// 自适应基数树（ART）实现的 memtable 存储结构。
+//
+// 树以用户键的字节为边，内部节点按子节点数在 4/16/48/256 四种大小之间
+// 升级。叶子采用惰性展开：一个用户键在能与其他键区分的最浅位置保存为
+// 叶子，只有插入共享前缀的新键时才向下展开。恰好在某个节点处结束的
+// 用户键保存在该节点的 terminal 中，排在所有子节点之前。
+//
+// 每个叶子上按内部键顺序（序列号从新到旧）链接同一用户键的全部条目，
+// 所有叶子再按用户键顺序链接成单链表，Next() 不需要访问树。
+//
+// 线程安全与 SkipList 相同：写操作需要外部同步，读操作无需加锁。节点与
+// 叶子在发布之前完成初始化，之后只会追加子节点；节点满时复制到更大的
+// 节点再替换父节点中的指针，旧节点留在 arena 中，正在读它的线程仍然
+// 看到一致的内容。
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <new>
+
+#include "db/memtablerep.h"
+#include "leveldb/comparator.h"
+#include "util/arena.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+namespace {
+
+Slice GetLengthPrefixedSlice(const char* data) {
+  uint32_t len;
+  const char* p = data;
+  p = GetVarint32Ptr(p, p + 5, &len);
+  return Slice(p, len);
+}
+
+uint64_t EntryTag(const char* entry) {
+  Slice ikey = GetLengthPrefixedSlice(entry);
+  return DecodeFixed64(ikey.data() + ikey.size() - 8);
+}
+
+struct EntryNode {
+  explicit EntryNode(const char* e) : entry(e), next(nullptr) {}
+
+  const char* const entry;
+  std::atomic<EntryNode*> next;
+};
+
+struct Leaf {
+  explicit Leaf(const Slice& k) : key(k), entries(nullptr), next(nullptr) {}
+
+  const Slice key;                   // 用户键，指向第一个条目
+  std::atomic<EntryNode*> entries;   // 按内部键顺序
+  std::atomic<Leaf*> next;           // 按用户键顺序的下一个叶子
+};
+
+enum NodeType : uint8_t { kNode4, kNode16, kNode48, kNode256 };
+
+struct Node {
+  explicit Node(NodeType t) : type(t), count(0), terminal(nullptr) {}
+
+  const NodeType type;
+  std::atomic<int> count;
+  std::atomic<Leaf*> terminal;
+};
+
+// 子节点不排序，count 发布之后 keys[i] 与 children[i] 才对读者可见
+template <int N>
+struct SmallNode : public Node {
+  explicit SmallNode(NodeType t) : Node(t) {
+    for (int i = 0; i < N; i++) {
+      children[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  uint8_t keys[N];
+  std::atomic<void*> children[N];
+};
+
+typedef SmallNode<4> Node4;
+typedef SmallNode<16> Node16;
+
+struct Node48 : public Node {
+  Node48() : Node(kNode48) {
+    for (int i = 0; i < 256; i++) {
+      index[i].store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < 48; i++) {
+      children[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<uint8_t> index[256];  // 0 表示没有子节点，否则为下标 + 1
+  std::atomic<void*> children[48];
+};
+
+struct Node256 : public Node {
+  Node256() : Node(kNode256) {
+    for (int i = 0; i < 256; i++) {
+      children[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<void*> children[256];
+};
+
+// 子节点指针的最低位为 1 时指向叶子
+inline bool IsLeaf(const void* p) {
+  return (reinterpret_cast<uintptr_t>(p) & 1) != 0;
+}
+
+inline Leaf* AsLeaf(void* p) {
+  return reinterpret_cast<Leaf*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t{1});
+}
+
+inline void* TagLeaf(Leaf* leaf) {
+  return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(leaf) | 1);
+}
+
+template <int N>
+std::atomic<void*>* SmallNodeChild(SmallNode<N>* n, uint8_t b) {
+  const int count = n->count.load(std::memory_order_acquire);
+  for (int i = 0; i < count; i++) {
+    if (n->keys[i] == b) {
+      return &n->children[i];
+    }
+  }
+  return nullptr;
+}
+
+// 返回字节 b 对应的子节点槽位，没有时返回 nullptr
+std::atomic<void*>* ChildSlot(Node* n, uint8_t b) {
+  switch (n->type) {
+    case kNode4:
+      return SmallNodeChild(static_cast<Node4*>(n), b);
+    case kNode16:
+      return SmallNodeChild(static_cast<Node16*>(n), b);
+    case kNode48: {
+      Node48* n48 = static_cast<Node48*>(n);
+      const int i = n48->index[b].load(std::memory_order_acquire);
+      return (i == 0) ? nullptr : &n48->children[i - 1];
+    }
+    case kNode256: {
+      Node256* n256 = static_cast<Node256*>(n);
+      std::atomic<void*>* slot = &n256->children[b];
+      return (slot->load(std::memory_order_acquire) == nullptr) ? nullptr
+                                                                 : slot;
+    }
+  }
+  return nullptr;
+}
+
+void* FindChild(Node* n, uint8_t b) {
+  std::atomic<void*>* slot = ChildSlot(n, b);
+  return (slot == nullptr) ? nullptr : slot->load(std::memory_order_acquire);
+}
+
+template <int N>
+void* SmallNodeChildBefore(SmallNode<N>* n, int limit) {
+  const int count = n->count.load(std::memory_order_acquire);
+  int best = -1;
+  void* result = nullptr;
+  for (int i = 0; i < count; i++) {
+    if (n->keys[i] < limit && n->keys[i] > best) {
+      best = n->keys[i];
+      result = n->children[i].load(std::memory_order_acquire);
+    }
+  }
+  return result;
+}
+
+// 返回字节小于 limit 的子节点中字节最大的一个，limit 可以为 256
+void* ChildBefore(Node* n, int limit) {
+  switch (n->type) {
+    case kNode4:
+      return SmallNodeChildBefore(static_cast<Node4*>(n), limit);
+    case kNode16:
+      return SmallNodeChildBefore(static_cast<Node16*>(n), limit);
+    case kNode48: {
+      Node48* n48 = static_cast<Node48*>(n);
+      for (int b = limit - 1; b >= 0; b--) {
+        const int i = n48->index[b].load(std::memory_order_acquire);
+        if (i != 0) {
+          return n48->children[i - 1].load(std::memory_order_acquire);
+        }
+      }
+      return nullptr;
+    }
+    case kNode256: {
+      Node256* n256 = static_cast<Node256*>(n);
+      for (int b = limit - 1; b >= 0; b--) {
+        void* child = n256->children[b].load(std::memory_order_acquire);
+        if (child != nullptr) {
+          return child;
+        }
+      }
+      return nullptr;
+    }
+  }
+  return nullptr;
+}
+
+class RadixTreeRep : public MemTableRep {
+ public:
+  explicit RadixTreeRep(Arena* arena)
+      : arena_(arena), root_(nullptr), head_(Slice()) {}
+
+  void Insert(const char* entry) override;
+
+  void Get(const LookupKey& key, void* arg,
+           bool (*callback)(void* arg, const char* entry)) override;
+
+  Iterator* NewIterator() override { return new RadixTreeIterator(this); }
+
+ private:
+  class RadixTreeIterator : public Iterator {
+   public:
+    explicit RadixTreeIterator(const RadixTreeRep* rep)
+        : rep_(rep), leaf_(nullptr), node_(nullptr) {}
+
+    bool Valid() const override { return node_ != nullptr; }
+    const char* key() const override {
+      assert(Valid());
+      return node_->entry;
+    }
+    void Next() override;
+    void Prev() override;
+    void Seek(const char* memtable_key) override;
+    void SeekToFirst() override {
+      SetLeaf(rep_->head_.next.load(std::memory_order_acquire));
+    }
+    void SeekToLast() override;
+
+   private:
+    // 定位到 leaf 的第一个条目
+    void SetLeaf(Leaf* leaf) {
+      leaf_ = leaf;
+      node_ = (leaf == nullptr) ? nullptr
+                                : leaf->entries.load(std::memory_order_acquire);
+    }
+
+    // 定位到 leaf 的最后一个条目
+    void SeekToLastOf(Leaf* leaf) {
+      SetLeaf(leaf);
+      if (node_ == nullptr) {
+        return;
+      }
+      EntryNode* next;
+      while ((next = node_->next.load(std::memory_order_acquire)) != nullptr) {
+        node_ = next;
+      }
+    }
+
+    const RadixTreeRep* const rep_;
+    Leaf* leaf_;
+    EntryNode* node_;
+  };
+
+  // 读操作
+  Leaf* FindLeaf(const Slice& key) const;
+  // 用户键小于 key 的最后一个叶子，没有时返回 nullptr
+  Leaf* FindLessThan(const Slice& key) const;
+  static Leaf* LessThan(void* p, const Slice& key, size_t depth);
+  static Leaf* Last(void* p);
+
+  // 写操作
+  template <typename T>
+  T* New();
+  Leaf* LinkNewLeaf(const char* entry, const Slice& key);
+  void AddEntry(Leaf* leaf, const char* entry);
+  void* NewSubtree(Leaf* a, Leaf* b, size_t depth);
+  void Place(Node* n, Leaf* leaf, size_t depth);
+  void AddChild(std::atomic<void*>* slot, Node* n, uint8_t b, void* child);
+  static void AppendChild(Node* n, uint8_t b, void* child);
+  Node* Grow(Node* n);
+
+  Arena* const arena_;
+  std::atomic<void*> root_;
+  Leaf head_;  // 叶子链表的哨兵
+};
+
+template <typename T>
+T* RadixTreeRep::New() {
+  char* mem = arena_->AllocateAligned(sizeof(T));
+  return new (mem) T();
+}
+
+template <>
+Node4* RadixTreeRep::New<Node4>() {
+  char* mem = arena_->AllocateAligned(sizeof(Node4));
+  return new (mem) Node4(kNode4);
+}
+
+template <>
+Node16* RadixTreeRep::New<Node16>() {
+  char* mem = arena_->AllocateAligned(sizeof(Node16));
+  return new (mem) Node16(kNode16);
+}
+
+Leaf* RadixTreeRep::FindLeaf(const Slice& key) const {
+  void* p = root_.load(std::memory_order_acquire);
+  size_t depth = 0;
+  while (p != nullptr) {
+    if (IsLeaf(p)) {
+      Leaf* leaf = AsLeaf(p);
+      return (leaf->key == key) ? leaf : nullptr;
+    }
+    Node* n = static_cast<Node*>(p);
+    if (depth == key.size()) {
+      return n->terminal.load(std::memory_order_acquire);
+    }
+    p = FindChild(n, static_cast<uint8_t>(key[depth]));
+    depth++;
+  }
+  return nullptr;
+}
+
+Leaf* RadixTreeRep::FindLessThan(const Slice& key) const {
+  return LessThan(root_.load(std::memory_order_acquire), key, 0);
+}
+
+Leaf* RadixTreeRep::LessThan(void* p, const Slice& key, size_t depth) {
+  if (p == nullptr) {
+    return nullptr;
+  }
+  if (IsLeaf(p)) {
+    Leaf* leaf = AsLeaf(p);
+    return (leaf->key.compare(key) < 0) ? leaf : nullptr;
+  }
+  Node* n = static_cast<Node*>(p);
+  if (depth == key.size()) {
+    // 子树中的用户键都以 key 为前缀
+    return nullptr;
+  }
+  const uint8_t b = static_cast<uint8_t>(key[depth]);
+  Leaf* result = LessThan(FindChild(n, b), key, depth + 1);
+  if (result != nullptr) {
+    return result;
+  }
+  void* before = ChildBefore(n, b);
+  if (before != nullptr) {
+    return Last(before);
+  }
+  return n->terminal.load(std::memory_order_acquire);
+}
+
+Leaf* RadixTreeRep::Last(void* p) {
+  while (p != nullptr && !IsLeaf(p)) {
+    Node* n = static_cast<Node*>(p);
+    void* child = ChildBefore(n, 256);
+    if (child == nullptr) {
+      return n->terminal.load(std::memory_order_acquire);
+    }
+    p = child;
+  }
+  return (p == nullptr) ? nullptr : AsLeaf(p);
+}
+
+void RadixTreeRep::Get(const LookupKey& key, void* arg,
+                       bool (*callback)(void* arg, const char* entry)) {
+  Leaf* leaf = FindLeaf(key.user_key());
+  if (leaf == nullptr) {
+    return;
+  }
+  const Slice ikey = key.internal_key();
+  const uint64_t tag = DecodeFixed64(ikey.data() + ikey.size() - 8);
+  EntryNode* node = leaf->entries.load(std::memory_order_acquire);
+  while (node != nullptr && EntryTag(node->entry) > tag) {
+    node = node->next.load(std::memory_order_acquire);
+  }
+  while (node != nullptr && callback(arg, node->entry)) {
+    node = node->next.load(std::memory_order_acquire);
+  }
+}
+
+Leaf* RadixTreeRep::LinkNewLeaf(const char* entry, const Slice& key) {
+  Leaf* prev = FindLessThan(key);
+  if (prev == nullptr) {
+    prev = &head_;
+  }
+  char* mem = arena_->AllocateAligned(sizeof(Leaf));
+  Leaf* leaf = new (mem) Leaf(key);
+  mem = arena_->AllocateAligned(sizeof(EntryNode));
+  leaf->entries.store(new (mem) EntryNode(entry), std::memory_order_relaxed);
+  leaf->next.store(prev->next.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+  prev->next.store(leaf, std::memory_order_release);
+  return leaf;
+}
+
+void RadixTreeRep::AddEntry(Leaf* leaf, const char* entry) {
+  const uint64_t tag = EntryTag(entry);
+  std::atomic<EntryNode*>* link = &leaf->entries;
+  EntryNode* next;
+  while ((next = link->load(std::memory_order_relaxed)) != nullptr &&
+         EntryTag(next->entry) > tag) {
+    link = &next->next;
+  }
+  assert(next == nullptr || EntryTag(next->entry) != tag);
+  char* mem = arena_->AllocateAligned(sizeof(EntryNode));
+  EntryNode* node = new (mem) EntryNode(entry);
+  node->next.store(next, std::memory_order_relaxed);
+  link->store(node, std::memory_order_release);
+}
+
+void* RadixTreeRep::NewSubtree(Leaf* a, Leaf* b, size_t depth) {
+  Node* top = New<Node4>();
+  Node* n = top;
+  while (depth < a->key.size() && depth < b->key.size() &&
+         a->key[depth] == b->key[depth]) {
+    Node* child = New<Node4>();
+    AppendChild(n, static_cast<uint8_t>(a->key[depth]), child);
+    n = child;
+    depth++;
+  }
+  Place(n, a, depth);
+  Place(n, b, depth);
+  return top;
+}
+
+void RadixTreeRep::Place(Node* n, Leaf* leaf, size_t depth) {
+  if (leaf->key.size() == depth) {
+    n->terminal.store(leaf, std::memory_order_release);
+  } else {
+    AppendChild(n, static_cast<uint8_t>(leaf->key[depth]), TagLeaf(leaf));
+  }
+}
+
+void RadixTreeRep::AppendChild(Node* n, uint8_t b, void* child) {
+  const int count = n->count.load(std::memory_order_relaxed);
+  switch (n->type) {
+    case kNode4: {
+      Node4* n4 = static_cast<Node4*>(n);
+      assert(count < 4);
+      n4->keys[count] = b;
+      n4->children[count].store(child, std::memory_order_relaxed);
+      n->count.store(count + 1, std::memory_order_release);
+      break;
+    }
+    case kNode16: {
+      Node16* n16 = static_cast<Node16*>(n);
+      assert(count < 16);
+      n16->keys[count] = b;
+      n16->children[count].store(child, std::memory_order_relaxed);
+      n->count.store(count + 1, std::memory_order_release);
+      break;
+    }
+    case kNode48: {
+      Node48* n48 = static_cast<Node48*>(n);
+      assert(count < 48);
+      n48->children[count].store(child, std::memory_order_relaxed);
+      n48->index[b].store(count + 1, std::memory_order_release);
+      n->count.store(count + 1, std::memory_order_relaxed);
+      break;
+    }
+    case kNode256: {
+      Node256* n256 = static_cast<Node256*>(n);
+      n256->children[b].store(child, std::memory_order_release);
+      n->count.store(count + 1, std::memory_order_relaxed);
+      break;
+    }
+  }
+}
+
+Node* RadixTreeRep::Grow(Node* n) {
+  Node* bigger;
+  switch (n->type) {
+    case kNode4: {
+      Node4* n4 = static_cast<Node4*>(n);
+      bigger = New<Node16>();
+      for (int i = 0; i < 4; i++) {
+        AppendChild(bigger, n4->keys[i],
+                    n4->children[i].load(std::memory_order_relaxed));
+      }
+      break;
+    }
+    case kNode16: {
+      Node16* n16 = static_cast<Node16*>(n);
+      bigger = New<Node48>();
+      for (int i = 0; i < 16; i++) {
+        AppendChild(bigger, n16->keys[i],
+                    n16->children[i].load(std::memory_order_relaxed));
+      }
+      break;
+    }
+    case kNode48: {
+      Node48* n48 = static_cast<Node48*>(n);
+      bigger = New<Node256>();
+      for (int b = 0; b < 256; b++) {
+        const int i = n48->index[b].load(std::memory_order_relaxed);
+        if (i != 0) {
+          AppendChild(bigger, static_cast<uint8_t>(b),
+                      n48->children[i - 1].load(std::memory_order_relaxed));
+        }
+      }
+      break;
+    }
+    default:
+      assert(false);
+      return n;
+  }
+  bigger->terminal.store(n->terminal.load(std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+  return bigger;
+}
+
+void RadixTreeRep::AddChild(std::atomic<void*>* slot, Node* n, uint8_t b,
+                            void* child) {
+  const int count = n->count.load(std::memory_order_relaxed);
+  const bool full = (n->type == kNode4 && count == 4) ||
+                    (n->type == kNode16 && count == 16) ||
+                    (n->type == kNode48 && count == 48);
+  if (full) {
+    Node* bigger = Grow(n);
+    AppendChild(bigger, b, child);
+    slot->store(bigger, std::memory_order_release);
+  } else {
+    AppendChild(n, b, child);
+  }
+}
+
+void RadixTreeRep::Insert(const char* entry) {
+  const Slice key = ExtractUserKey(GetLengthPrefixedSlice(entry));
+  std::atomic<void*>* slot = &root_;
+  size_t depth = 0;
+  while (true) {
+    void* p = slot->load(std::memory_order_relaxed);
+    if (p == nullptr) {
+      slot->store(TagLeaf(LinkNewLeaf(entry, key)), std::memory_order_release);
+      return;
+    }
+    if (IsLeaf(p)) {
+      Leaf* leaf = AsLeaf(p);
+      if (leaf->key == key) {
+        AddEntry(leaf, entry);
+      } else {
+        // 惰性展开：为两个键的公共前缀建立节点
+        Leaf* added = LinkNewLeaf(entry, key);
+        slot->store(NewSubtree(leaf, added, depth), std::memory_order_release);
+      }
+      return;
+    }
+    Node* n = static_cast<Node*>(p);
+    if (depth == key.size()) {
+      Leaf* terminal = n->terminal.load(std::memory_order_relaxed);
+      if (terminal != nullptr) {
+        AddEntry(terminal, entry);
+      } else {
+        n->terminal.store(LinkNewLeaf(entry, key), std::memory_order_release);
+      }
+      return;
+    }
+    const uint8_t b = static_cast<uint8_t>(key[depth]);
+    std::atomic<void*>* child = ChildSlot(n, b);
+    if (child == nullptr) {
+      AddChild(slot, n, b, TagLeaf(LinkNewLeaf(entry, key)));
+      return;
+    }
+    slot = child;
+    depth++;
+  }
+}
+
+void RadixTreeRep::RadixTreeIterator::Next() {
+  assert(Valid());
+  node_ = node_->next.load(std::memory_order_acquire);
+  if (node_ == nullptr) {
+    SetLeaf(leaf_->next.load(std::memory_order_acquire));
+  }
+}
+
+void RadixTreeRep::RadixTreeIterator::Prev() {
+  assert(Valid());
+  EntryNode* x = leaf_->entries.load(std::memory_order_acquire);
+  if (x == node_) {
+    SeekToLastOf(rep_->FindLessThan(leaf_->key));
+    return;
+  }
+  // 单链表，从头查找前一个条目
+  EntryNode* next;
+  while ((next = x->next.load(std::memory_order_acquire)) != node_) {
+    x = next;
+  }
+  node_ = x;
+}
+
+void RadixTreeRep::RadixTreeIterator::Seek(const char* memtable_key) {
+  const Slice ikey = GetLengthPrefixedSlice(memtable_key);
+  const Slice user_key = ExtractUserKey(ikey);
+  // 用户键小于目标的最后一个叶子之后就是第一个不小于目标的叶子
+  const Leaf* prev = rep_->FindLessThan(user_key);
+  if (prev == nullptr) {
+    prev = &rep_->head_;
+  }
+  SetLeaf(prev->next.load(std::memory_order_acquire));
+  if (leaf_ == nullptr || leaf_->key != user_key) {
+    return;
+  }
+  // 同一用户键中跳过序列号比目标更新的条目
+  const uint64_t tag = DecodeFixed64(ikey.data() + ikey.size() - 8);
+  while (node_ != nullptr && EntryTag(node_->entry) > tag) {
+    node_ = node_->next.load(std::memory_order_acquire);
+  }
+  if (node_ == nullptr) {
+    SetLeaf(leaf_->next.load(std::memory_order_acquire));
+  }
+}
+
+void RadixTreeRep::RadixTreeIterator::SeekToLast() {
+  SeekToLastOf(Last(rep_->root_.load(std::memory_order_acquire)));
+}
+
+}  // namespace
+
+MemTableRep* NewRadixTreeRep(const MemTableKeyComparator& cmp, Arena* arena) {
+  // 树按字节序排列用户键
+  assert(cmp.comparator.user_comparator() == BytewiseComparator());
+  return new RadixTreeRep(arena);
+}
+
+}  // namespace leveldb
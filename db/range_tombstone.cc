@@ -0,0 +1,311 @@
+#include "db/range_tombstone.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include "leveldb/iterator.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+Status ReadRangeTombstones(Iterator* iter,
+                           std::vector<RangeTombstone>* tombstones) {
+  ParsedInternalKey ikey;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("bad range tombstone");
+    }
+    tombstones->emplace_back(ikey.user_key, iter->value(), ikey.sequence);
+  }
+  return iter->status();
+}
+
+FragmentedRangeTombstones::FragmentedRangeTombstones(
+    const Comparator* ucmp, const std::vector<RangeTombstone>& tombstones)
+    : ucmp_(ucmp) {
+  std::vector<const RangeTombstone*> sorted;
+  std::vector<Slice> bounds;
+  for (const RangeTombstone& t : tombstones) {
+    if (ucmp->Compare(t.begin, t.end) < 0) {
+      sorted.push_back(&t);
+      bounds.push_back(t.begin);
+      bounds.push_back(t.end);
+    }
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [ucmp](const RangeTombstone* a, const RangeTombstone* b) {
+              return ucmp->Compare(a->begin, b->begin) < 0;
+            });
+  std::sort(bounds.begin(), bounds.end(), [ucmp](const Slice& a, const Slice& b) {
+    return ucmp->Compare(a, b) < 0;
+  });
+  bounds.erase(std::unique(bounds.begin(), bounds.end(),
+                           [ucmp](const Slice& a, const Slice& b) {
+                             return ucmp->Compare(a, b) == 0;
+                           }),
+               bounds.end());
+
+  // 从左到右扫过相邻的边界，[bounds[i], bounds[i + 1]) 内被覆盖的情况不变
+  std::vector<const RangeTombstone*> active;
+  size_t next = 0;
+  for (size_t i = 0; i + 1 < bounds.size(); i++) {
+    const Slice& lo = bounds[i];
+    while (next < sorted.size() && ucmp->Compare(sorted[next]->begin, lo) <= 0) {
+      active.push_back(sorted[next++]);
+    }
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [ucmp, &lo](const RangeTombstone* t) {
+                                  return ucmp->Compare(t->end, lo) <= 0;
+                                }),
+                 active.end());
+    if (active.empty()) {
+      continue;
+    }
+    std::vector<SequenceNumber> seqs;
+    for (const RangeTombstone* t : active) {
+      seqs.push_back(t->sequence);
+    }
+    std::sort(seqs.begin(), seqs.end(), std::greater<SequenceNumber>());
+    seqs.erase(std::unique(seqs.begin(), seqs.end()), seqs.end());
+    // 与前一个片段相邻且序列号相同时合并
+    if (!fragments_.empty() && fragments_.back().seqs == seqs &&
+        ucmp->Compare(fragments_.back().end, lo) == 0) {
+      fragments_.back().end = bounds[i + 1].ToString();
+      continue;
+    }
+    Fragment f;
+    f.begin = lo.ToString();
+    f.end = bounds[i + 1].ToString();
+    f.seqs.swap(seqs);
+    fragments_.push_back(std::move(f));
+  }
+}
+
+bool FragmentedRangeTombstones::IsFirstAfter(size_t i,
+                                             const Slice& user_key) const {
+  return (i == fragments_.size() ||
+          ucmp_->Compare(fragments_[i].end, user_key) > 0) &&
+         (i == 0 || ucmp_->Compare(fragments_[i - 1].end, user_key) <= 0);
+}
+
+size_t FragmentedRangeTombstones::FindFragment(const Slice& user_key,
+                                               size_t* cursor) const {
+  if (cursor != nullptr && *cursor <= fragments_.size()) {
+    // 按键顺序查询时，目标通常是上次的片段或与它相邻的片段
+    const size_t i = *cursor;
+    if (IsFirstAfter(i, user_key)) {
+      return i;
+    }
+    if (i < fragments_.size() && IsFirstAfter(i + 1, user_key)) {
+      *cursor = i + 1;
+      return i + 1;
+    }
+    if (i > 0 && IsFirstAfter(i - 1, user_key)) {
+      *cursor = i - 1;
+      return i - 1;
+    }
+  }
+  const Comparator* ucmp = ucmp_;
+  const size_t i =
+      std::upper_bound(fragments_.begin(), fragments_.end(), user_key,
+                       [ucmp](const Slice& key, const Fragment& f) {
+                         return ucmp->Compare(key, f.end) < 0;
+                       }) -
+      fragments_.begin();
+  if (cursor != nullptr) {
+    *cursor = i;
+  }
+  return i;
+}
+
+SequenceNumber FragmentedRangeTombstones::SeqAtSnapshot(
+    size_t i, SequenceNumber snapshot) const {
+  const std::vector<SequenceNumber>& seqs = fragments_[i].seqs;
+  auto it = std::lower_bound(seqs.begin(), seqs.end(), snapshot,
+                             std::greater<SequenceNumber>());
+  return it == seqs.end() ? 0 : *it;
+}
+
+SequenceNumber FragmentedRangeTombstones::MaxCoveringSeq(
+    const Slice& user_key, SequenceNumber snapshot, size_t* cursor) const {
+  const size_t i = FindFragment(user_key, cursor);
+  if (i == fragments_.size() ||
+      ucmp_->Compare(fragments_[i].begin, user_key) > 0) {
+    return 0;
+  }
+  return SeqAtSnapshot(i, snapshot);
+}
+
+bool FragmentedRangeTombstones::CoversRange(const Slice& smallest_user_key,
+                                            const Slice& largest_user_key,
+                                            SequenceNumber largest_seq,
+                                            SequenceNumber snapshot) const {
+  size_t i = FindFragment(smallest_user_key, nullptr);
+  if (i == fragments_.size() ||
+      ucmp_->Compare(fragments_[i].begin, smallest_user_key) > 0) {
+    return false;
+  }
+  // 区间跨过的片段必须首尾相接，且每个片段都有合适的标记
+  for (const size_t first = i; i < fragments_.size(); i++) {
+    if (i > first &&
+        ucmp_->Compare(fragments_[i - 1].end, fragments_[i].begin) != 0) {
+      return false;
+    }
+    if (SeqAtSnapshot(i, snapshot) <= largest_seq) {
+      return false;
+    }
+    if (ucmp_->Compare(largest_user_key, fragments_[i].end) < 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FragmentedRangeTombstones::Overlaps(const Slice* lower,
+                                         const Slice* upper) const {
+  const size_t i = (lower == nullptr) ? 0 : FindFragment(*lower, nullptr);
+  return i < fragments_.size() &&
+         (upper == nullptr || ucmp_->Compare(fragments_[i].begin, *upper) < 0);
+}
+
+void RangeTombstoneSet::Add(
+    std::shared_ptr<const FragmentedRangeTombstones> fragments) {
+  if (fragments != nullptr && !fragments->empty()) {
+    sources_.push_back(std::move(fragments));
+    cursors_.push_back(0);
+  }
+}
+
+SequenceNumber RangeTombstoneSet::MaxCoveringSeq(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  SequenceNumber result = 0;
+  for (size_t i = 0; i < sources_.size(); i++) {
+    result = std::max(result,
+                      sources_[i]->MaxCoveringSeq(user_key, snapshot,
+                                                  &cursors_[i]));
+  }
+  return result;
+}
+
+RangeTombstoneList::RangeTombstoneList(const InternalKeyComparator* icmp)
+    : icmp_(icmp), fragments_(nullptr), cursor_(0) {}
+
+RangeTombstoneList::~RangeTombstoneList() { delete fragments_; }
+
+void RangeTombstoneList::Add(const Slice& begin, const Slice& end,
+                             SequenceNumber seq) {
+  if (icmp_->user_comparator()->Compare(begin, end) >= 0) {
+    return;
+  }
+  tombstones_.emplace_back(begin, end, seq);
+  delete fragments_;
+  fragments_ = nullptr;
+}
+
+Status RangeTombstoneList::AddTombstones(Iterator* iter) {
+  std::vector<RangeTombstone> tombstones;
+  Status s = ReadRangeTombstones(iter, &tombstones);
+  if (s.ok()) {
+    for (const RangeTombstone& t : tombstones) {
+      Add(t.begin, t.end, t.sequence);
+    }
+  }
+  return s;
+}
+
+const FragmentedRangeTombstones* RangeTombstoneList::fragments() const {
+  if (fragments_ == nullptr) {
+    fragments_ =
+        new FragmentedRangeTombstones(icmp_->user_comparator(), tombstones_);
+    cursor_ = 0;
+  }
+  return fragments_;
+}
+
+SequenceNumber RangeTombstoneList::MaxCoveringSeq(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  return fragments()->MaxCoveringSeq(user_key, snapshot, &cursor_);
+}
+
+bool RangeTombstoneList::CoversRange(const Slice& smallest_user_key,
+                                     const Slice& largest_user_key,
+                                     SequenceNumber largest_seq,
+                                     SequenceNumber snapshot) const {
+  return fragments()->CoversRange(smallest_user_key, largest_user_key,
+                                  largest_seq, snapshot);
+}
+
+bool RangeTombstoneList::Overlaps(const Slice* lower,
+                                  const Slice* upper) const {
+  return fragments()->Overlaps(lower, upper);
+}
+
+int RangeTombstoneList::AddToTable(TableBuilder* builder, const Slice* lower,
+                                   const Slice* upper, InternalKey* smallest,
+                                   InternalKey* largest,
+                                   SequenceNumber* largest_seq) const {
+  const Comparator* ucmp = icmp_->user_comparator();
+
+  // 截断到 [lower, upper)
+  std::vector<RangeTombstone> fragments;
+  for (const RangeTombstone& t : tombstones_) {
+    if (upper != nullptr && ucmp->Compare(t.begin, *upper) >= 0) {
+      continue;
+    }
+    if (lower != nullptr && ucmp->Compare(t.end, *lower) <= 0) {
+      continue;
+    }
+    RangeTombstone f = t;
+    if (lower != nullptr && ucmp->Compare(f.begin, *lower) < 0) {
+      f.begin = lower->ToString();
+    }
+    if (upper != nullptr && ucmp->Compare(f.end, *upper) > 0) {
+      f.end = upper->ToString();
+    }
+    fragments.push_back(std::move(f));
+  }
+  if (fragments.empty()) {
+    return 0;
+  }
+
+  // TableBuilder 要求键按内部键严格递增：begin 递增、序列号递减。
+  // 键相同时 end 大的排在前面，去重时保留覆盖范围最大的一个
+  std::sort(fragments.begin(), fragments.end(),
+            [ucmp](const RangeTombstone& a, const RangeTombstone& b) {
+              int r = ucmp->Compare(a.begin, b.begin);
+              if (r != 0) return r < 0;
+              if (a.sequence != b.sequence) return a.sequence > b.sequence;
+              return ucmp->Compare(a.end, b.end) > 0;
+            });
+
+  const RangeTombstone* largest_end = nullptr;
+  *largest_seq = 0;
+  int written = 0;
+  InternalKey prev;
+  for (size_t i = 0; i < fragments.size(); i++) {
+    const RangeTombstone& f = fragments[i];
+    InternalKey key(f.begin, f.sequence, kTypeRangeDeletion);
+    // 不同来源可能产生完全相同的标记，只保留一份
+    if (i > 0 && icmp_->Compare(key, prev) == 0) {
+      continue;
+    }
+    builder->AddRangeTombstone(key.Encode(), f.end);
+    written++;
+    prev = key;
+    if (largest_end == nullptr || ucmp->Compare(f.end, largest_end->end) > 0) {
+      largest_end = &f;
+    }
+    *largest_seq = std::max(*largest_seq, f.sequence);
+  }
+  *smallest = InternalKey(fragments[0].begin, fragments[0].sequence,
+                          kTypeRangeDeletion);
+  // end 是开区间，用 end 上序列号最大的哨兵作为上界，它排在 end
+  // 的所有真实条目之前
+  *largest =
+      InternalKey(largest_end->end, kMaxSequenceNumber, kTypeRangeDeletion);
+  return written;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,168 @@
+#ifndef STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+#define STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+
+namespace leveldb {
+class Iterator;
+class TableBuilder;
+
+// 范围删除标记 [begin, end) @ sequence：删除用户键位于 [begin, end)
+// 且序列号小于 sequence 的所有条目。
+//
+// 在 memtable 与 sstable 中，范围删除标记都存放在独立于点数据的有序结构中，
+// 每个标记编码为
+//    key   := InternalKey(begin, sequence, kTypeRangeDeletion)
+//    value := end
+// 并按内部键排序，即按 begin 递增、序列号递减排列。
+struct RangeTombstone {
+  RangeTombstone() : sequence(0) {}
+  RangeTombstone(const Slice& b, const Slice& e, SequenceNumber s)
+      : begin(b.ToString()), end(e.ToString()), sequence(s) {}
+
+  std::string begin;
+  std::string end;
+  SequenceNumber sequence;
+};
+
+// 把 "*iter" 中按上述格式编码的范围删除标记追加到 *tombstones。
+// 不接管 iter 的所有权。
+Status ReadRangeTombstones(Iterator* iter,
+                           std::vector<RangeTombstone>* tombstones);
+
+// 把一组可能相互重叠的范围删除标记按用户键切分成有序且互不重叠的片段，
+// 每个片段记录覆盖它的所有标记的序列号（递减）。查询时二分查找键所在的
+// 片段，再二分查找不大于快照的最大序列号。
+//
+// 构造之后只读，可以被多个线程同时查询。
+class FragmentedRangeTombstones {
+ public:
+  // tombstones 不必有序，begin >= end 的空区间会被忽略
+  FragmentedRangeTombstones(const Comparator* ucmp,
+                            const std::vector<RangeTombstone>& tombstones);
+
+  FragmentedRangeTombstones(const FragmentedRangeTombstones&) = delete;
+  FragmentedRangeTombstones& operator=(const FragmentedRangeTombstones&) =
+      delete;
+
+  bool empty() const { return fragments_.empty(); }
+  size_t num_fragments() const { return fragments_.size(); }
+
+  // 返回覆盖 "user_key" 且序列号不大于 "snapshot" 的最大序列号，没有则返回 0。
+  // "*cursor" 记录上次查询所在的片段，按键的顺序（正向或反向）连续查询时
+  // 通常不需要二分查找。cursor 为 nullptr 时总是二分查找。
+  SequenceNumber MaxCoveringSeq(const Slice& user_key, SequenceNumber snapshot,
+                                size_t* cursor = nullptr) const;
+
+  // 用户键区间 [smallest_user_key, largest_user_key] 中的每个键是否都被
+  // 序列号在 (largest_seq, snapshot] 之间的标记覆盖？
+  bool CoversRange(const Slice& smallest_user_key,
+                   const Slice& largest_user_key, SequenceNumber largest_seq,
+                   SequenceNumber snapshot) const;
+
+  // 是否有片段与用户键区间 [*lower, *upper) 相交？nullptr 表示无界。
+  bool Overlaps(const Slice* lower, const Slice* upper) const;
+
+ private:
+  struct Fragment {
+    std::string begin;
+    std::string end;
+    std::vector<SequenceNumber> seqs;  // 递减
+  };
+
+  // 返回第一个 end 大于 user_key 的片段，没有则返回 fragments_.size()
+  size_t FindFragment(const Slice& user_key, size_t* cursor) const;
+  // 片段 i 是否正是第一个 end 大于 user_key 的片段？
+  bool IsFirstAfter(size_t i, const Slice& user_key) const;
+  // 片段 i 中不大于 snapshot 的最大序列号，没有则返回 0
+  SequenceNumber SeqAtSnapshot(size_t i, SequenceNumber snapshot) const;
+
+  const Comparator* const ucmp_;
+  std::vector<Fragment> fragments_;
+};
+
+// 若干组切分好的范围删除标记，共享而不复制。迭代器用它同时查询 memtable、
+// 不可变 memtable 与版本中的标记，每组各有一个游标。非线程安全。
+class RangeTombstoneSet {
+ public:
+  RangeTombstoneSet() = default;
+
+  RangeTombstoneSet(const RangeTombstoneSet&) = delete;
+  RangeTombstoneSet& operator=(const RangeTombstoneSet&) = delete;
+
+  // 添加一组标记。nullptr 或空的一组会被忽略。
+  void Add(std::shared_ptr<const FragmentedRangeTombstones> fragments);
+
+  bool empty() const { return sources_.empty(); }
+
+  // 返回覆盖 "user_key" 且序列号不大于 "snapshot" 的最大序列号，没有则返回 0。
+  SequenceNumber MaxCoveringSeq(const Slice& user_key,
+                                SequenceNumber snapshot) const;
+
+ private:
+  std::vector<std::shared_ptr<const FragmentedRangeTombstones>> sources_;
+  mutable std::vector<size_t> cursors_;
+};
+
+// 一组范围删除标记，用于压缩中判断条目是否被删除。
+// 查询前按需切分成 FragmentedRangeTombstones，并用内部的游标加速
+// 按键顺序的连续查询。非线程安全。
+class RangeTombstoneList {
+ public:
+  explicit RangeTombstoneList(const InternalKeyComparator* icmp);
+
+  RangeTombstoneList(const RangeTombstoneList&) = delete;
+  RangeTombstoneList& operator=(const RangeTombstoneList&) = delete;
+
+  ~RangeTombstoneList();
+
+  // 添加一个标记。begin >= end 的空区间会被忽略。
+  void Add(const Slice& begin, const Slice& end, SequenceNumber seq);
+
+  // 添加 "*iter" 中的所有标记。不接管 iter 的所有权。
+  Status AddTombstones(Iterator* iter);
+
+  bool empty() const { return tombstones_.empty(); }
+  size_t size() const { return tombstones_.size(); }
+
+  // 返回覆盖 "user_key" 且序列号不大于 "snapshot" 的最大序列号，没有则返回 0。
+  SequenceNumber MaxCoveringSeq(const Slice& user_key,
+                                SequenceNumber snapshot) const;
+
+  // 是否存在序列号在 (largest_seq, snapshot] 之间的标记完整覆盖
+  // 用户键区间 [smallest_user_key, largest_user_key]？
+  bool CoversRange(const Slice& smallest_user_key,
+                   const Slice& largest_user_key, SequenceNumber largest_seq,
+                   SequenceNumber snapshot) const;
+
+  // 是否有标记与用户键区间 [*lower, *upper) 相交？nullptr 表示无界。
+  bool Overlaps(const Slice* lower, const Slice* upper) const;
+
+  // 返回所有添加的标记（未切分，不保证有序）
+  const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+
+  // 将与 [*lower, *upper) 相交的标记截断到该区间后写入 "builder"。
+  // lower/upper 为 nullptr 表示无界。
+  // 返回写入的标记数。若大于 0，*smallest 与 *largest 被设置为所写标记
+  // 覆盖的内部键范围，*largest_seq 为其中最大的序列号。
+  int AddToTable(TableBuilder* builder, const Slice* lower, const Slice* upper,
+                 InternalKey* smallest, InternalKey* largest,
+                 SequenceNumber* largest_seq) const;
+
+ private:
+  const FragmentedRangeTombstones* fragments() const;
+
+  const InternalKeyComparator* const icmp_;
+  std::vector<RangeTombstone> tombstones_;
+  // 由 tombstones_ 切分而来（惰性），Add 之后重建
+  mutable FragmentedRangeTombstones* fragments_;
+  mutable size_t cursor_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
@@ -0,0 +1,154 @@
+#include "db/range_tombstone.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/comparator.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "%04d", i);
+  return std::string(buf);
+}
+
+// 逐个检查所有标记的朴素实现
+static SequenceNumber BruteForceSeq(const std::vector<RangeTombstone>& list,
+                                    const std::string& user_key,
+                                    SequenceNumber snapshot) {
+  SequenceNumber result = 0;
+  for (const RangeTombstone& t : list) {
+    if (t.begin <= user_key && user_key < t.end && t.sequence <= snapshot &&
+        t.sequence > result) {
+      result = t.sequence;
+    }
+  }
+  return result;
+}
+
+TEST(RangeTombstoneTest, Fragments) {
+  std::vector<RangeTombstone> list;
+  list.emplace_back("a", "e", 10);
+  list.emplace_back("c", "g", 20);
+  list.emplace_back("c", "g", 5);
+  list.emplace_back("x", "z", 7);
+  list.emplace_back("m", "m", 30);  // 空区间
+  FragmentedRangeTombstones fragments(BytewiseComparator(), list);
+  // [a,c) {10}  [c,e) {20,10,5}  [e,g) {20,5}  [x,z) {7}
+  ASSERT_EQ(4, fragments.num_fragments());
+
+  ASSERT_EQ(0, fragments.MaxCoveringSeq("0", 100));
+  ASSERT_EQ(10, fragments.MaxCoveringSeq("a", 100));
+  ASSERT_EQ(0, fragments.MaxCoveringSeq("a", 9));
+  ASSERT_EQ(20, fragments.MaxCoveringSeq("d", 100));
+  ASSERT_EQ(10, fragments.MaxCoveringSeq("d", 19));
+  ASSERT_EQ(5, fragments.MaxCoveringSeq("d", 9));
+  ASSERT_EQ(5, fragments.MaxCoveringSeq("f", 19));
+  ASSERT_EQ(0, fragments.MaxCoveringSeq("g", 100));
+  ASSERT_EQ(0, fragments.MaxCoveringSeq("m", 100));
+  ASSERT_EQ(7, fragments.MaxCoveringSeq("y", 100));
+  ASSERT_EQ(0, fragments.MaxCoveringSeq("z", 100));
+
+  // [a,g) 被首尾相接的片段覆盖，每个片段都有 (4, 100] 之间的标记
+  ASSERT_TRUE(fragments.CoversRange("a", "f", 4, 100));
+  ASSERT_FALSE(fragments.CoversRange("a", "f", 10, 100));
+  ASSERT_FALSE(fragments.CoversRange("a", "g", 4, 100));
+  ASSERT_FALSE(fragments.CoversRange("f", "y", 4, 100));
+  ASSERT_TRUE(fragments.CoversRange("c", "d", 10, 20));
+  ASSERT_FALSE(fragments.CoversRange("c", "d", 10, 19));
+
+  Slice a("a"), g("g"), x("x"), h("h");
+  ASSERT_TRUE(fragments.Overlaps(nullptr, nullptr));
+  ASSERT_FALSE(fragments.Overlaps(&g, &x));
+  ASSERT_TRUE(fragments.Overlaps(&h, nullptr));
+  ASSERT_FALSE(fragments.Overlaps(nullptr, &a));
+}
+
+TEST(RangeTombstoneTest, MatchesBruteForce) {
+  Random rnd(301);
+  for (int round = 0; round < 20; round++) {
+    std::vector<RangeTombstone> list;
+    const int n = 1 + rnd.Uniform(30);
+    for (int i = 0; i < n; i++) {
+      const int begin = rnd.Uniform(100);
+      const int end = begin + rnd.Uniform(30);
+      list.emplace_back(Key(begin), Key(end), 1 + rnd.Uniform(50));
+    }
+    FragmentedRangeTombstones fragments(BytewiseComparator(), list);
+
+    // 随机查询、正向与反向的连续查询结果都与朴素实现一致
+    size_t cursor = 0;
+    for (int i = 0; i < 200; i++) {
+      const std::string key = Key(rnd.Uniform(140));
+      const SequenceNumber snapshot = rnd.Uniform(60);
+      ASSERT_EQ(BruteForceSeq(list, key, snapshot),
+                fragments.MaxCoveringSeq(key, snapshot, &cursor));
+    }
+    for (int i = 0; i < 140; i++) {
+      ASSERT_EQ(BruteForceSeq(list, Key(i), 60),
+                fragments.MaxCoveringSeq(Key(i), 60, &cursor));
+    }
+    for (int i = 139; i >= 0; i--) {
+      ASSERT_EQ(BruteForceSeq(list, Key(i), 25),
+                fragments.MaxCoveringSeq(Key(i), 25, &cursor));
+    }
+  }
+}
+
+TEST(RangeTombstoneTest, ListRebuildsAfterAdd) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  RangeTombstoneList list(&icmp);
+  ASSERT_TRUE(list.empty());
+  list.Add("b", "d", 5);
+  ASSERT_EQ(5, list.MaxCoveringSeq("c", 100));
+  ASSERT_EQ(0, list.MaxCoveringSeq("e", 100));
+  list.Add("c", "f", 8);
+  ASSERT_EQ(8, list.MaxCoveringSeq("c", 100));
+  ASSERT_EQ(8, list.MaxCoveringSeq("e", 100));
+  ASSERT_EQ(5, list.MaxCoveringSeq("c", 7));
+  ASSERT_EQ(2, list.size());
+}
+
+
+TEST(RangeTombstoneTest, SetMatchesBruteForce) {
+  Random rnd(302);
+  for (int round = 0; round < 20; round++) {
+    // 多组标记分别切分，合并查询的结果与所有标记放在一起的朴素实现一致
+    std::vector<RangeTombstone> all;
+    RangeTombstoneSet set;
+    set.Add(nullptr);
+    set.Add(std::make_shared<FragmentedRangeTombstones>(
+        BytewiseComparator(), std::vector<RangeTombstone>()));
+    ASSERT_TRUE(set.empty());
+    for (int source = 0; source < 3; source++) {
+      std::vector<RangeTombstone> list;
+      const int n = 1 + rnd.Uniform(10);
+      for (int i = 0; i < n; i++) {
+        const int begin = rnd.Uniform(100);
+        const int end = begin + 1 + rnd.Uniform(30);
+        list.emplace_back(Key(begin), Key(end), 1 + rnd.Uniform(50));
+      }
+      all.insert(all.end(), list.begin(), list.end());
+      set.Add(std::make_shared<FragmentedRangeTombstones>(BytewiseComparator(),
+                                                          list));
+    }
+    ASSERT_FALSE(set.empty());
+
+    for (int i = 0; i < 200; i++) {
+      const std::string key = Key(rnd.Uniform(140));
+      const SequenceNumber snapshot = rnd.Uniform(60);
+      ASSERT_EQ(BruteForceSeq(all, key, snapshot),
+                set.MaxCoveringSeq(key, snapshot));
+    }
+    for (int i = 0; i < 140; i++) {
+      ASSERT_EQ(BruteForceSeq(all, Key(i), 60), set.MaxCoveringSeq(Key(i), 60));
+    }
+  }
+}
+
+}  // namespace leveldb
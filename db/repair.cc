@@ -0,0 +1,655 @@
+// 当数据库无法打开时（例如 MANIFEST 损坏或丢失），我们尝试按以下步骤
+// 恢复尽可能多的数据：
+//
+// (1) 扫描（Find files）
+//     找出数据库目录中的所有日志、表文件与 blob 文件，记录最大的文件编号。
+// (2) 转换日志（Convert logs to tables）
+//     重放每个日志，将其内容写成新的表文件，然后把日志移入 lost/ 目录。
+//     损坏的记录被忽略。
+// (3) 提取元数据（Extract metadata）
+//     并行扫描每个表文件，计算最小/最大键、最大序列号与条目统计。
+//     无法读取的表被移入 lost/；读到一半出错的表会把读出的条目复制到
+//     新的表中，原文件移入 lost/。同时统计表中的 blob 索引对各 blob 文件的
+//     引用，用于计算 blob 文件的垃圾量。
+// (4) 写出描述符（Write descriptor）
+//     生成新的 MANIFEST：所有表文件都放在 level-0，next_file_number 为
+//     最大文件编号加一，last_sequence 为所有表中最大的序列号，日志编号为零。
+//     level-0 的读取按文件编号从新到旧查找，而压缩与 RepairTable 产生的
+//     旧数据可能拿到更大的编号，所以先按最大序列号给表重新编号。
+//     之后打开数据库时的压缩会按序列号合并这些表。
+//
+// 可能的优化：
+// (1) 对表按键范围分层，避免打开后大量的 level-0 压缩。
+// (2) 表中保存了键范围时可以跳过扫描。
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#include "db/blob_file.h"
+#include "db/builder.h"
+#include "db/db_impl.h"
+#include "db/dbformat.h"
+#include "db/filename.h"
+#include "db/log_reader.h"
+#include "db/log_writer.h"
+#include "db/memtable.h"
+#include "db/table_cache.h"
+#include "db/version_edit.h"
+#include "db/write_batch_internal.h"
+#include "leveldb/comparator.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+#include "port/port.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+#include "util/parallel.h"
+
+namespace leveldb {
+
+namespace {
+
+// 并行扫描的最大线程数
+const int kMaxScanThreads = 16;
+
+class Repairer {
+ public:
+  Repairer(const std::string& dbname, const Options& options)
+      : dbname_(dbname),
+        env_(options.env),
+        icmp_(options.comparator),
+        ipolicy_(options.filter_policy),
+        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
+        owns_info_log_(options_.info_log != options.info_log),
+        owns_cache_(options_.block_cache != options.block_cache),
+        next_file_number_(1) {
+    // TableCache 可以很小，因为每个表只被扫描一次
+    table_cache_ = new TableCache(dbname_, options_, 2 * kMaxScanThreads);
+  }
+
+  ~Repairer() {
+    delete table_cache_;
+    if (owns_info_log_) {
+      delete options_.info_log;
+    }
+    if (owns_cache_) {
+      delete options_.block_cache;
+    }
+  }
+
+  Status Run() {
+    Status status = FindFiles();
+    if (status.ok()) {
+      const uint64_t start_micros = env_->NowMicros();
+      ConvertLogFilesToTables();
+      ExtractMetaData();
+      status = RenumberTables();
+      if (status.ok()) {
+        status = WriteDescriptor();
+      }
+      if (status.ok()) {
+        unsigned long long bytes = 0;
+        for (size_t i = 0; i < tables_.size(); i++) {
+          bytes += tables_[i].meta.file_size;
+        }
+        Log(options_.info_log,
+            "**** Repaired leveldb %s; "
+            "recovered %d files; %llu bytes. "
+            "Some data may have been lost. "
+            "%llu micros\n",
+            dbname_.c_str(), static_cast<int>(tables_.size()), bytes,
+            static_cast<unsigned long long>(env_->NowMicros() - start_micros));
+      }
+    }
+    return status;
+  }
+
+ private:
+  struct TableInfo {
+    TableInfo() : ok(false) {}
+
+    bool ok;  // 扫描成功，可以放入新的 MANIFEST
+    FileMetaData meta;
+    // 表中的 blob 索引对每个 blob 文件的引用：记录数与字节数
+    std::map<uint64_t, std::pair<uint64_t, uint64_t>> blob_refs;
+  };
+
+  struct BlobInfo {
+    BlobInfo() : ok(false) {}
+
+    bool ok;
+    BlobFileMetaData meta;
+  };
+
+  static void ScanTableWork(void* arg, size_t i) {
+    reinterpret_cast<Repairer*>(arg)->ScanTable(i);
+  }
+
+  static void ScanBlobFileWork(void* arg, size_t i) {
+    reinterpret_cast<Repairer*>(arg)->ScanBlobFile(i);
+  }
+
+  Status FindFiles() {
+    std::vector<std::string> filenames;
+    Status status = env_->GetChildren(dbname_, &filenames);
+    if (!status.ok()) {
+      return status;
+    }
+    if (filenames.empty()) {
+      return Status::IOError(dbname_, "repair found no files");
+    }
+
+    uint64_t number;
+    FileType type;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type)) {
+        if (type == kDescriptorFile) {
+          manifests_.push_back(filenames[i]);
+        } else {
+          if (number + 1 > next_file_number_) {
+            next_file_number_ = number + 1;
+          }
+          if (type == kLogFile) {
+            logs_.push_back(number);
+          } else if (type == kTableFile) {
+            table_numbers_.push_back(number);
+          } else if (type == kBlobFile) {
+            blob_numbers_.push_back(number);
+          } else {
+            // 忽略其他文件
+          }
+        }
+      }
+    }
+    return status;
+  }
+
+  void ConvertLogFilesToTables() {
+    for (size_t i = 0; i < logs_.size(); i++) {
+      std::string logname = LogFileName(dbname_, logs_[i]);
+      Status status = ConvertLogToTable(logs_[i]);
+      if (!status.ok()) {
+        Log(options_.info_log, "Log #%llu: ignoring conversion error: %s",
+            (unsigned long long)logs_[i], status.ToString().c_str());
+      }
+      ArchiveFile(logname);
+    }
+  }
+
+  Status ConvertLogToTable(uint64_t log) {
+    struct LogReporter : public log::Reader::Reporter {
+      Env* env;
+      Logger* info_log;
+      uint64_t lognum;
+      void Corruption(size_t bytes, const Status& s) override {
+        // 我们打印错误信息，但继续读取其余的记录
+        Log(info_log, "Log #%llu: dropping %d bytes; %s",
+            (unsigned long long)lognum, static_cast<int>(bytes),
+            s.ToString().c_str());
+      }
+    };
+
+    // 打开日志文件
+    std::string logname = LogFileName(dbname_, log);
+    SequentialFile* lfile;
+    Status status = env_->NewSequentialFile(logname, &lfile);
+    if (!status.ok()) {
+      return status;
+    }
+
+    // 创建日志读取器
+    LogReporter reporter;
+    reporter.env = env_;
+    reporter.info_log = options_.info_log;
+    reporter.lognum = log;
+    // 即使不需要校验和也打开它，避免把损坏的数据写入表中。
+    // 由于之后不会再读取这个日志，不需要记录初始偏移。
+    log::Reader reader(lfile, &reporter, false /*do not checksum*/,
+                       0 /*initial_offset*/);
+
+    // 把所有记录读入 memtable
+    std::string scratch;
+    Slice record;
+    WriteBatch batch;
+    MemTable* mem = new MemTable(icmp_, options_);
+    mem->Ref();
+    int counter = 0;
+    while (reader.ReadRecord(&record, &scratch)) {
+      if (record.size() < 12) {
+        reporter.Corruption(record.size(),
+                            Status::Corruption("log record too small"));
+        continue;
+      }
+      WriteBatchInternal::SetContents(&batch, record);
+      status = WriteBatchInternal::InsertInto(&batch, mem);
+      if (status.ok()) {
+        counter += WriteBatchInternal::Count(&batch);
+      } else {
+        Log(options_.info_log, "Log #%llu: ignoring %s",
+            (unsigned long long)log, status.ToString().c_str());
+        status = Status::OK();  // 继续处理日志的其余部分
+      }
+    }
+    delete lfile;
+
+    // 不需要删除日志，FindFiles() 之后它会被移入 lost/
+    FileMetaData meta;
+    meta.number = next_file_number_++;
+    Iterator* iter = mem->NewIterator();
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
+    delete iter;
+    delete range_del_iter;
+    mem->Unref();
+    mem = nullptr;
+    if (status.ok()) {
+      if (meta.file_size > 0) {
+        table_numbers_.push_back(meta.number);
+      }
+    }
+    Log(options_.info_log, "Log #%llu: %d ops saved to Table #%llu %s",
+        (unsigned long long)log, counter, (unsigned long long)meta.number,
+        status.ToString().c_str());
+    return status;
+  }
+
+  void ExtractMetaData() {
+    tables_.resize(table_numbers_.size());
+    ParallelFor(env_, table_numbers_.size(), kMaxScanThreads,
+                &Repairer::ScanTableWork, this);
+    blobs_.resize(blob_numbers_.size());
+    ParallelFor(env_, blob_numbers_.size(), kMaxScanThreads,
+                &Repairer::ScanBlobFileWork, this);
+  }
+
+  Iterator* NewTableIterator(const FileMetaData& meta) {
+    // 与 Version::AddIterators 一样，使用 TableCache 打开表文件
+    ReadOptions r;
+    r.verify_checksums = options_.paranoid_checks;
+    return table_cache_->NewIterator(r, meta.number, meta.file_size);
+  }
+
+  // 扫描 table_numbers_[i]，结果存入 tables_[i]。可以在多个线程中并发调用。
+  void ScanTable(size_t i) {
+    TableInfo* t = &tables_[i];
+    t->meta.number = table_numbers_[i];
+    std::string fname = TableFileName(dbname_, t->meta.number);
+    Status status = env_->GetFileSize(fname, &t->meta.file_size);
+    if (!status.ok()) {
+      // 尝试其他的表文件名
+      std::string fname2 = SSTTableFileName(dbname_, t->meta.number);
+      Status s2 = env_->GetFileSize(fname2, &t->meta.file_size);
+      if (s2.ok()) {
+        fname = fname2;
+        status = Status::OK();
+      }
+    }
+    if (!status.ok()) {
+      ArchiveFile(TableFileName(dbname_, t->meta.number));
+      ArchiveFile(SSTTableFileName(dbname_, t->meta.number));
+      Log(options_.info_log, "Table #%llu: dropped: %s",
+          (unsigned long long)t->meta.number, status.ToString().c_str());
+      return;
+    }
+
+    status = ExtractTableMetaData(t);
+    if (!status.ok() && t->meta.num_entries + t->meta.num_range_deletions > 0) {
+      // 把能读出的条目复制到新的表中
+      Log(options_.info_log, "Table #%llu: %s; repairing",
+          (unsigned long long)t->meta.number, status.ToString().c_str());
+      status = RepairTable(fname, t);
+    }
+    Log(options_.info_log, "Table #%llu: %d entries %s",
+        (unsigned long long)t->meta.number,
+        static_cast<int>(t->meta.num_entries), status.ToString().c_str());
+    if (status.ok()) {
+      t->ok = true;
+    } else {
+      ArchiveFile(fname);
+    }
+  }
+
+  // 读取表中的所有条目与范围删除标记，填写 t->meta 中的键范围与统计
+  Status ExtractTableMetaData(TableInfo* t) {
+    FileMetaData* meta = &t->meta;
+    meta->num_entries = 0;
+    meta->num_deletions = 0;
+    meta->num_range_deletions = 0;
+    meta->largest_seqno = 0;
+    t->blob_refs.clear();
+    bool empty = true;
+    ParsedInternalKey parsed;
+    Iterator* iter = NewTableIterator(*meta);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      Slice key = iter->key();
+      if (!ParseInternalKey(key, &parsed)) {
+        Log(options_.info_log, "Table #%llu: unparsable key %s",
+            (unsigned long long)meta->number, EscapeString(key).c_str());
+        continue;
+      }
+
+      meta->num_entries++;
+      if (empty) {
+        empty = false;
+        meta->smallest.DecodeFrom(key);
+      }
+      meta->largest.DecodeFrom(key);
+      if (parsed.type == kTypeDeletion) {
+        meta->num_deletions++;
+      } else if (parsed.type == kTypeBlobIndex) {
+        BlobIndex index;
+        if (index.DecodeFrom(iter->value())) {
+          std::pair<uint64_t, uint64_t>& ref = t->blob_refs[index.file_number];
+          ref.first++;
+          ref.second += index.size;
+        }
+      }
+      meta->largest_seqno = std::max(meta->largest_seqno, parsed.sequence);
+    }
+    Status status = iter->status();
+    delete iter;
+
+    // 与 BuildTable 一样，用范围删除标记扩展键范围
+    Iterator* range_del_iter =
+        table_cache_->NewRangeTombstoneIterator(meta->number, meta->file_size);
+    for (range_del_iter->SeekToFirst(); range_del_iter->Valid();
+         range_del_iter->Next()) {
+      if (!ParseInternalKey(range_del_iter->key(), &parsed)) {
+        continue;
+      }
+      meta->num_range_deletions++;
+      meta->largest_seqno = std::max(meta->largest_seqno, parsed.sequence);
+      InternalKey end(range_del_iter->value(), kMaxSequenceNumber,
+                      kTypeRangeDeletion);
+      if (empty ||
+          icmp_.Compare(range_del_iter->key(), meta->smallest.Encode()) < 0) {
+        meta->smallest.DecodeFrom(range_del_iter->key());
+      }
+      if (empty || icmp_.Compare(end.Encode(), meta->largest.Encode()) > 0) {
+        meta->largest = end;
+      }
+      empty = false;
+    }
+    if (status.ok()) {
+      status = range_del_iter->status();
+    }
+    delete range_del_iter;
+
+    if (status.ok() && empty) {
+      status = Status::Corruption("empty table");
+    }
+    return status;
+  }
+
+  Status RepairTable(const std::string& src, TableInfo* t) {
+    // 把 "src" 中能读出的内容复制到一个新的表中，然后用它替换原文件
+    uint64_t new_number;
+    {
+      MutexLock l(&mutex_);
+      new_number = next_file_number_++;
+    }
+    std::string copy = TableFileName(dbname_, new_number);
+    WritableFile* file;
+    Status s = env_->NewWritableFile(copy, &file);
+    if (!s.ok()) {
+      return s;
+    }
+    TableBuilder* builder = new TableBuilder(options_, file);
+
+    // 复制数据
+    Iterator* iter = NewTableIterator(t->meta);
+    int counter = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      builder->Add(iter->key(), iter->value());
+      counter++;
+    }
+    delete iter;
+    Iterator* range_del_iter = table_cache_->NewRangeTombstoneIterator(
+        t->meta.number, t->meta.file_size);
+    for (range_del_iter->SeekToFirst(); range_del_iter->Valid();
+         range_del_iter->Next()) {
+      builder->AddRangeTombstone(range_del_iter->key(),
+                                 range_del_iter->value());
+      counter++;
+    }
+    delete range_del_iter;
+
+    ArchiveFile(src);
+    if (counter == 0) {
+      builder->Abandon();  // 不需要保留空表
+    } else {
+      s = builder->Finish();
+      if (s.ok()) {
+        t->meta.file_size = builder->FileSize();
+      }
+    }
+    delete builder;
+    builder = nullptr;
+
+    if (s.ok()) {
+      s = file->Close();
+    }
+    delete file;
+    file = nullptr;
+
+    if (counter > 0 && s.ok()) {
+      std::string orig = TableFileName(dbname_, t->meta.number);
+      s = env_->RenameFile(copy, orig);
+      if (s.ok()) {
+        table_cache_->Evict(t->meta.number);
+        s = ExtractTableMetaData(t);
+      }
+    } else if (s.ok()) {
+      s = Status::Corruption("no readable entries");
+    }
+    if (!s.ok()) {
+      env_->RemoveFile(copy);
+    }
+    return s;
+  }
+
+  // 统计 blob_numbers_[i] 中完整的记录数，结果存入 blobs_[i]
+  void ScanBlobFile(size_t i) {
+    BlobInfo* b = &blobs_[i];
+    b->meta.number = blob_numbers_[i];
+    const std::string fname = BlobFileName(dbname_, b->meta.number);
+    std::string contents;
+    Status s = ReadFileToString(env_, fname, &contents);
+    Slice input(contents);
+    Slice key, value;
+    while (s.ok() && !input.empty()) {
+      s = ConsumeBlobRecord(&input, &key, &value);
+      if (s.ok()) {
+        b->meta.total_count++;
+      }
+    }
+    // 记录中的索引以偏移量定位，损坏的尾部不影响前面的记录
+    b->meta.total_bytes = contents.size();
+    b->ok = b->meta.total_count > 0;
+    Log(options_.info_log, "Blob file #%llu: %llu records %s",
+        (unsigned long long)b->meta.number,
+        (unsigned long long)b->meta.total_count, s.ToString().c_str());
+  }
+
+  Status WriteDescriptor() {
+    std::string tmp = TempFileName(dbname_, 1);
+    WritableFile* file;
+    Status status = env_->NewWritableFile(tmp, &file);
+    if (!status.ok()) {
+      return status;
+    }
+
+    // 汇总各表对 blob 文件的引用
+    std::map<uint64_t, std::pair<uint64_t, uint64_t>> blob_refs;
+    SequenceNumber max_sequence = 0;
+    std::vector<TableInfo> tables;
+    for (size_t i = 0; i < tables_.size(); i++) {
+      if (!tables_[i].ok) {
+        continue;
+      }
+      const TableInfo& t = tables_[i];
+      if (max_sequence < t.meta.largest_seqno) {
+        max_sequence = t.meta.largest_seqno;
+      }
+      for (const auto& kvp : t.blob_refs) {
+        blob_refs[kvp.first].first += kvp.second.first;
+        blob_refs[kvp.first].second += kvp.second.second;
+      }
+      tables.push_back(t);
+    }
+    tables_.swap(tables);
+
+    edit_.SetComparatorName(icmp_.user_comparator()->Name());
+    edit_.SetLogNumber(0);
+    edit_.SetNextFile(next_file_number_);
+    edit_.SetLastSequence(max_sequence);
+
+    for (size_t i = 0; i < tables_.size(); i++) {
+      // TODO(opt): separate out into multiple levels
+      edit_.AddFile(0, tables_[i].meta);
+    }
+    for (size_t i = 0; i < blobs_.size(); i++) {
+      const BlobInfo& b = blobs_[i];
+      auto ref = blob_refs.find(b.meta.number);
+      if (!b.ok || ref == blob_refs.end()) {
+        continue;  // 没有被引用的 blob 文件在打开数据库时被删除
+      }
+      const uint64_t live_count = std::min(ref->second.first,
+                                           b.meta.total_count);
+      const uint64_t live_bytes = std::min(ref->second.second,
+                                           b.meta.total_bytes);
+      edit_.AddBlobFile(b.meta.number, b.meta.total_count,
+                        b.meta.total_bytes);
+      if (live_count < b.meta.total_count) {
+        edit_.AddBlobGarbage(b.meta.number, b.meta.total_count - live_count,
+                             b.meta.total_bytes - live_bytes);
+      }
+    }
+
+    {
+      log::Writer log(file);
+      std::string record;
+      edit_.EncodeTo(&record);
+      status = log.AddRecord(record);
+    }
+    if (status.ok()) {
+      status = file->Close();
+    }
+    delete file;
+    file = nullptr;
+
+    if (!status.ok()) {
+      env_->RemoveFile(tmp);
+    } else {
+      // 删除旧的清单文件，只保留新生成的
+      for (size_t i = 0; i < manifests_.size(); i++) {
+        ArchiveFile(dbname_ + "/" + manifests_[i]);
+      }
+
+      // 安装新的清单文件
+      status = env_->RenameFile(tmp, DescriptorFileName(dbname_, 1));
+      if (status.ok()) {
+        status = SetCurrentFile(env_, dbname_, 1);
+      } else {
+        env_->RemoveFile(tmp);
+      }
+    }
+    return status;
+  }
+
+  // 所有表都放在 level-0，读取时编号大的表被当作较新的表。
+  // 按最大序列号排序，如果编号顺序与之不符，按这个顺序重新编号
+  Status RenumberTables() {
+    tables_.erase(std::remove_if(tables_.begin(), tables_.end(),
+                                 [](const TableInfo& t) { return !t.ok; }),
+                  tables_.end());
+    std::sort(tables_.begin(), tables_.end(),
+              [](const TableInfo& a, const TableInfo& b) {
+                if (a.meta.largest_seqno != b.meta.largest_seqno) {
+                  return a.meta.largest_seqno < b.meta.largest_seqno;
+                }
+                return a.meta.number < b.meta.number;
+              });
+    bool ordered = true;
+    for (size_t i = 1; i < tables_.size(); i++) {
+      if (tables_[i - 1].meta.number > tables_[i].meta.number) {
+        ordered = false;
+        break;
+      }
+    }
+    if (ordered) {
+      return Status::OK();
+    }
+
+    for (size_t i = 0; i < tables_.size(); i++) {
+      FileMetaData* meta = &tables_[i].meta;
+      const uint64_t new_number = next_file_number_++;
+      const std::string dst = TableFileName(dbname_, new_number);
+      Status s = env_->RenameFile(TableFileName(dbname_, meta->number), dst);
+      if (!s.ok()) {
+        s = env_->RenameFile(SSTTableFileName(dbname_, meta->number), dst);
+      }
+      if (!s.ok()) {
+        return s;
+      }
+      Log(options_.info_log, "Table #%llu: renumbered to #%llu",
+          (unsigned long long)meta->number, (unsigned long long)new_number);
+      table_cache_->Evict(meta->number);
+      meta->number = new_number;
+    }
+    return Status::OK();
+  }
+
+  void ArchiveFile(const std::string& fname) {
+    // 将文件移动到 "lost" 目录中。例如：
+    //   dir/foo
+    // 被移动到
+    //   dir/lost/foo
+    const char* slash = strrchr(fname.c_str(), '/');
+    std::string new_dir;
+    if (slash != nullptr) {
+      new_dir.assign(fname.data(), slash - fname.data());
+    }
+    new_dir.append("/lost");
+    env_->CreateDir(new_dir);  // 忽略错误
+    std::string new_file = new_dir;
+    new_file.append("/");
+    new_file.append((slash == nullptr) ? fname.c_str() : slash + 1);
+    Status s = env_->RenameFile(fname, new_file);
+    Log(options_.info_log, "Archiving %s: %s\n", fname.c_str(),
+        s.ToString().c_str());
+  }
+
+  const std::string dbname_;
+  Env* const env_;
+  InternalKeyComparator const icmp_;
+  InternalFilterPolicy const ipolicy_;
+  const Options options_;
+  bool owns_info_log_;
+  bool owns_cache_;
+  TableCache* table_cache_;
+  VersionEdit edit_;
+
+  std::vector<std::string> manifests_;
+  std::vector<uint64_t> table_numbers_;
+  std::vector<uint64_t> blob_numbers_;
+  std::vector<uint64_t> logs_;
+  std::vector<TableInfo> tables_;
+  std::vector<BlobInfo> blobs_;
+
+  // 保护并行扫描期间的 next_file_number_
+  port::Mutex mutex_;
+  uint64_t next_file_number_;
+};
+
+}  // namespace
+
+Status RepairDB(const std::string& dbname, const Options& options) {
+  Repairer repairer(dbname, options);
+  return repairer.Run();
+}
+
+}  // namespace leveldb
@@ -36,7 +36,7 @@ class SnapshotList {
   bool empty() const { return head_.next_ == &head_; }
   SnapshotImpl* oldest() const {
     assert(!empty());
-    return head_.prev_;
+    return head_.next_;
   }
   SnapshotImpl* newset() const {
     assert(!empty());
@@ -1,23 +1,35 @@
 
 #include "db/table_cache.h"
 
+#include <atomic>
+
+#include "db/blob_file.h"
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  // 切分后的范围删除标记，第一次查询时生成
+  std::atomic<FragmentedRangeTombstones*> range_dels;
 };
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  delete tf->range_dels.load(std::memory_order_relaxed);
   delete tf->table;
   delete tf->file;
   delete tf;
 }
 
+static void DeleteBlobFile(const Slice& key, void* value) {
+  delete reinterpret_cast<RandomAccessFile*>(value);
+}
+
 static void UnrefEntry(void* arg1, void* arg2) {
   Cache* cache = reinterpret_cast<Cache*>(arg1);
   Cache::Handle* h = reinterpret_cast<Cache::Handle*>(arg2);
@@ -31,7 +43,14 @@ TableCache::TableCache(const std::string& dbname, const Options& options,
       options_(options),
       cache_(NewLRUCache(entries)) {}
 
-TableCache::~TableCache() { delete cache_; }
+TableCache::~TableCache() {
+  for (const auto& kvp : pinned_) {
+    if (kvp.second != nullptr) {
+      cache_->Release(kvp.second);
+    }
+  }
+  delete cache_;
+}
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
                              Cache::Handle** handle) {
@@ -62,21 +81,79 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->range_dels.store(nullptr, std::memory_order_relaxed);
       // 存入的value是一个指针
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
+      MaybePin(file_number, key);
     }
   }
   return s;  // 如果未执行if，返回ok
 }
+
+void TableCache::MaybePin(uint64_t file_number, const Slice& key) {
+  MutexLock l(&pin_mutex_);
+  auto it = pinned_.find(file_number);
+  if (it != pinned_.end() && it->second == nullptr) {
+    it->second = cache_->Lookup(key);
+    if (it->second != nullptr) {
+      reinterpret_cast<TableAndFile*>(cache_->Value(it->second))
+          ->table->SetMetaBlocksPinned(true);
+    }
+  }
+}
+
+Status TableCache::Prefetch(uint64_t file_number, uint64_t file_size) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+void TableCache::SetPinnedFiles(const std::vector<uint64_t>& file_numbers) {
+  std::vector<Cache::Handle*> to_release;
+  {
+    MutexLock l(&pin_mutex_);
+    std::map<uint64_t, Cache::Handle*> pinned;
+    for (uint64_t number : file_numbers) {
+      auto it = pinned_.find(number);
+      if (it != pinned_.end()) {
+        pinned[number] = it->second;
+        pinned_.erase(it);
+      } else {
+        char buf[sizeof(number)];
+        EncodeFixed64(buf, number);
+        Cache::Handle* handle = cache_->Lookup(Slice(buf, sizeof(buf)));
+        if (handle != nullptr) {
+          reinterpret_cast<TableAndFile*>(cache_->Value(handle))
+              ->table->SetMetaBlocksPinned(true);
+        }
+        pinned[number] = handle;
+      }
+    }
+    for (const auto& kvp : pinned_) {
+      if (kvp.second != nullptr) {
+        reinterpret_cast<TableAndFile*>(cache_->Value(kvp.second))
+            ->table->SetMetaBlocksPinned(false);
+        to_release.push_back(kvp.second);
+      }
+    }
+    pinned_.swap(pinned);
+  }
+  // 释放引用可能关闭文件，不需要持有锁
+  for (Cache::Handle* handle : to_release) {
+    cache_->Release(handle);
+  }
+}
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number, uint64_t file_size,
                                   Table** tableptr) {
   // 指向table*的指针非空，代表分配了存放table*的空间
 
-  // 重复
-  // if (tableptr != nullptr) {
-  //   *tableptr == nullptr;
-  // }
+  if (tableptr != nullptr) {
+    *tableptr = nullptr;
+  }
 
   Cache::Handle* handle = nullptr;
   Status s = FindTable(file_number, file_size, &handle);
@@ -92,6 +169,57 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewRangeTombstoneIterator(uint64_t file_number,
+                                                uint64_t file_size) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  Iterator* result = table->NewRangeTombstoneIterator();
+  result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  return result;
+}
+
+Status TableCache::MaxCoveringTombstoneSeq(uint64_t file_number,
+                                           uint64_t file_size,
+                                           const Comparator* ucmp,
+                                           const Slice& user_key,
+                                           SequenceNumber snapshot,
+                                           SequenceNumber* seq) {
+  *seq = 0;
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (!s.ok()) {
+    return s;
+  }
+  TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+  FragmentedRangeTombstones* fragments =
+      tf->range_dels.load(std::memory_order_acquire);
+  if (fragments == nullptr) {
+    std::vector<RangeTombstone> tombstones;
+    Iterator* iter = tf->table->NewRangeTombstoneIterator();
+    s = ReadRangeTombstones(iter, &tombstones);
+    delete iter;
+    if (s.ok()) {
+      // 多个线程可能同时切分，只保留第一个装入的结果
+      fragments = new FragmentedRangeTombstones(ucmp, tombstones);
+      FragmentedRangeTombstones* expected = nullptr;
+      if (!tf->range_dels.compare_exchange_strong(expected, fragments,
+                                                  std::memory_order_acq_rel)) {
+        delete fragments;
+        fragments = expected;
+      }
+    }
+  }
+  if (s.ok()) {
+    *seq = fragments->MaxCoveringSeq(user_key, snapshot);
+  }
+  cache_->Release(handle);
+  return s;
+}
+
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
@@ -106,7 +234,61 @@ Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
   return s;
 }
 
+Status TableCache::FindBlobFile(uint64_t file_number, Cache::Handle** handle) {
+  Status s;
+  char buf[sizeof(file_number)];
+  EncodeFixed64(buf, file_number);
+  Slice key(buf, sizeof(buf));
+  *handle = cache_->Lookup(key);
+  if (*handle == nullptr) {
+    RandomAccessFile* file = nullptr;
+    s = env_->NewRandomAccessFile(BlobFileName(dbname_, file_number), &file);
+    if (s.ok()) {
+      *handle = cache_->Insert(key, file, 1, &DeleteBlobFile);
+    }
+  }
+  return s;
+}
+
+Status TableCache::GetBlob(const BlobIndex& index, std::string* value) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindBlobFile(index.file_number, &handle);
+  if (!s.ok()) {
+    return s;
+  }
+  RandomAccessFile* file =
+      reinterpret_cast<RandomAccessFile*>(cache_->Value(handle));
+  std::string scratch;
+  scratch.resize(index.size);
+  Slice record;
+  s = file->Read(index.offset, index.size, &record, &scratch[0]);
+  cache_->Release(handle);
+  if (s.ok() && record.size() != index.size) {
+    s = Status::Corruption("truncated blob record");
+  }
+  Slice key, blob_value;
+  if (s.ok()) {
+    s = DecodeBlobRecord(record, &key, &blob_value);
+  }
+  if (s.ok()) {
+    value->assign(blob_value.data(), blob_value.size());
+  }
+  return s;
+}
+
 void TableCache::Evict(uint64_t file_number) {
+  Cache::Handle* pinned = nullptr;
+  {
+    MutexLock l(&pin_mutex_);
+    auto it = pinned_.find(file_number);
+    if (it != pinned_.end()) {
+      pinned = it->second;
+      pinned_.erase(it);
+    }
+  }
+  if (pinned != nullptr) {
+    cache_->Release(pinned);
+  }
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
   cache_->Erase(Slice(buf, sizeof(buf)));
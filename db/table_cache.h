@@ -2,16 +2,20 @@
 #define STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 
 #include <cstdint>
+#include <map>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "leveldb/cache.h"
 #include "leveldb/table.h"
 #include "port/port.h"
+#include "port/thread_annotations.h"
 
 namespace leveldb {
 
 class Env;
+struct BlobIndex;
 
 class TableCache {
  public:
@@ -30,22 +34,50 @@ class TableCache {
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
                         uint64_t file_size, Table** tableptr = nullptr);
 
+  // 返回指定文件中范围删除标记的迭代器，格式见 db/range_tombstone.h。
+  Iterator* NewRangeTombstoneIterator(uint64_t file_number, uint64_t file_size);
+
+  // 将 *seq 设为指定文件中覆盖 "user_key" 且序列号不大于 "snapshot" 的
+  // 范围删除标记的最大序列号，没有则为 0。文件中的标记在第一次查询时
+  // 切分，随表一起缓存。
+  Status MaxCoveringTombstoneSeq(uint64_t file_number, uint64_t file_size,
+                                 const Comparator* ucmp, const Slice& user_key,
+                                 SequenceNumber snapshot, SequenceNumber* seq);
+
   // 如果在指定文件中查找内部键 "k" 找到了一个条目，
   // 则调用 (*handle_result)(arg, found_key, found_value)。
   Status Get(const ReadOptions& options, uint64_t file_number,
              uint64_t file_size, const Slice& k, void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
+  // 读取 "index" 指向的 blob 记录，校验后将其中的值存入 *value。
+  // blob 文件与表文件共用缓存，以文件编号为键。
+  Status GetBlob(const BlobIndex& index, std::string* value);
+
+  // 打开指定的表文件并放入缓存，读取其 footer、索引与过滤器。
+  Status Prefetch(uint64_t file_number, uint64_t file_size);
+
+  // 指定常驻缓存的表文件，替换之前的集合。已在缓存中的表立即常驻，
+  // 其余的在下次打开时常驻。不再常驻的条目恢复由 LRU 管理。
+  void SetPinnedFiles(const std::vector<uint64_t>& file_numbers);
+
   // 驱逐指定文件编号的任何条目
   void Evict(uint64_t file_number);
 
  private:
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status FindBlobFile(uint64_t file_number, Cache::Handle**);
+  // 如果 file_number 应常驻且尚未常驻，保留对其缓存条目的一个引用
+  void MaybePin(uint64_t file_number, const Slice& key);
 
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
   Cache* cache_;
+
+  // 常驻的表文件编号到所持有的缓存引用（尚未打开时为 nullptr）
+  port::Mutex pin_mutex_;
+  std::map<uint64_t, Cache::Handle*> pinned_ GUARDED_BY(pin_mutex_);
 };
 
 }  // namespace leveldb
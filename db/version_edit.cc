@@ -14,7 +14,17 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  // 与 kNewFile 相同，末尾附加文件创建时间
+  kNewFile2 = 10,
+  // 与 kNewFile2 相同，末尾附加条目数与删除标记数
+  kNewFile3 = 11,
+  // 与 kNewFile3 相同，末尾附加范围删除标记数与最大序列号
+  kNewFile4 = 12,
+  // blob 文件：编号、记录数、字节数
+  kNewBlobFile = 13,
+  // blob 文件新增的垃圾：编号、记录数、字节数
+  kBlobGarbage = 14
 };
 
 void VersionEdit::Clear() {
@@ -31,6 +41,8 @@ void VersionEdit::Clear() {
   compact_pointers_.clear();
   deleted_files_.clear();
   new_files_.clear();
+  new_blob_files_.clear();
+  blob_garbage_.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
@@ -69,12 +81,46 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    // 只写出必要的字段，没有附加元数据时仍写 kNewFile，保持与旧格式兼容
+    Tag tag = kNewFile;
+    if (f.num_range_deletions != 0 || f.largest_seqno != 0) {
+      tag = kNewFile4;
+    } else if (f.num_entries != 0) {
+      tag = kNewFile3;
+    } else if (f.creation_time != 0) {
+      tag = kNewFile2;
+    }
+    PutVarint32(dst, tag);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (tag != kNewFile) {
+      PutVarint64(dst, f.creation_time);
+    }
+    if (tag == kNewFile3 || tag == kNewFile4) {
+      PutVarint64(dst, f.num_entries);
+      PutVarint64(dst, f.num_deletions);
+    }
+    if (tag == kNewFile4) {
+      PutVarint64(dst, f.num_range_deletions);
+      PutVarint64(dst, f.largest_seqno);
+    }
+  }
+
+  for (const BlobFileMetaData& b : new_blob_files_) {
+    PutVarint32(dst, kNewBlobFile);
+    PutVarint64(dst, b.number);
+    PutVarint64(dst, b.total_count);
+    PutVarint64(dst, b.total_bytes);
+  }
+
+  for (const BlobFileMetaData& b : blob_garbage_) {
+    PutVarint32(dst, kBlobGarbage);
+    PutVarint64(dst, b.number);
+    PutVarint64(dst, b.garbage_count);
+    PutVarint64(dst, b.garbage_bytes);
   }
 }
 
@@ -105,6 +151,7 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   int level;
   uint64_t number;
   FileMetaData f;
+  BlobFileMetaData b;
   Slice str;
   InternalKey key;
   while (msg == nullptr && GetVarint32(&input, &tag)) {
@@ -173,11 +220,87 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
           // new_files_.push_back(std::make_pair(level, f));
+          f.creation_time = 0;
+          f.num_entries = 0;
+          f.num_deletions = 0;
+          f.num_range_deletions = 0;
+          f.largest_seqno = 0;
           new_files_.emplace_back(level, f);
         } else {
           msg = "new-file entry";
         }
         break;
+
+      case kNewFile2:
+        if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.creation_time)) {
+          f.num_entries = 0;
+          f.num_deletions = 0;
+          f.num_range_deletions = 0;
+          f.largest_seqno = 0;
+          new_files_.emplace_back(level, f);
+        } else {
+          msg = "new-file2 entry";
+        }
+        break;
+
+      case kNewFile3:
+        if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.creation_time) &&
+            GetVarint64(&input, &f.num_entries) &&
+            GetVarint64(&input, &f.num_deletions)) {
+          f.num_range_deletions = 0;
+          f.largest_seqno = 0;
+          new_files_.emplace_back(level, f);
+        } else {
+          msg = "new-file3 entry";
+        }
+        break;
+
+      case kNewFile4:
+        if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.creation_time) &&
+            GetVarint64(&input, &f.num_entries) &&
+            GetVarint64(&input, &f.num_deletions) &&
+            GetVarint64(&input, &f.num_range_deletions) &&
+            GetVarint64(&input, &f.largest_seqno)) {
+          new_files_.emplace_back(level, f);
+        } else {
+          msg = "new-file4 entry";
+        }
+        break;
+
+      case kNewBlobFile:
+        b = BlobFileMetaData();
+        if (GetVarint64(&input, &b.number) &&
+            GetVarint64(&input, &b.total_count) &&
+            GetVarint64(&input, &b.total_bytes)) {
+          new_blob_files_.push_back(b);
+        } else {
+          msg = "new-blob-file entry";
+        }
+        break;
+
+      case kBlobGarbage:
+        b = BlobFileMetaData();
+        if (GetVarint64(&input, &b.number) &&
+            GetVarint64(&input, &b.garbage_count) &&
+            GetVarint64(&input, &b.garbage_bytes)) {
+          blob_garbage_.push_back(b);
+        } else {
+          msg = "blob-garbage entry";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -242,6 +365,36 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.creation_time != 0) {
+      r.append(" @");
+      AppendNumberTo(&r, f.creation_time);
+    }
+    if (f.num_entries != 0) {
+      r.append(" entries=");
+      AppendNumberTo(&r, f.num_entries);
+      r.append(" deletions=");
+      AppendNumberTo(&r, f.num_deletions);
+    }
+    if (f.num_range_deletions != 0) {
+      r.append(" range_deletions=");
+      AppendNumberTo(&r, f.num_range_deletions);
+    }
+  }
+  for (const BlobFileMetaData& b : new_blob_files_) {
+    r.append("\n  AddBlobFile: ");
+    AppendNumberTo(&r, b.number);
+    r.append(" count=");
+    AppendNumberTo(&r, b.total_count);
+    r.append(" bytes=");
+    AppendNumberTo(&r, b.total_bytes);
+  }
+  for (const BlobFileMetaData& b : blob_garbage_) {
+    r.append("\n  BlobGarbage: ");
+    AppendNumberTo(&r, b.number);
+    r.append(" count=");
+    AppendNumberTo(&r, b.garbage_count);
+    r.append(" bytes=");
+    AppendNumberTo(&r, b.garbage_bytes);
   }
   r.append("\n}\n");
   return r;
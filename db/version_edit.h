@@ -10,7 +10,15 @@
 namespace leveldb {
 class VersionSet;
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        creation_time(0),
+        num_entries(0),
+        num_deletions(0),
+        num_range_deletions(0),
+        largest_seqno(0) {}
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction
@@ -18,6 +26,29 @@ struct FileMetaData {
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+  uint64_t creation_time;  // 文件创建时间（秒），0 表示未知
+  uint64_t num_entries;    // 生成表时统计的条目数，0 表示未知
+  uint64_t num_deletions;  // 其中 kTypeDeletion 条目的数量
+  uint64_t num_range_deletions;  // 范围删除标记的数量
+  SequenceNumber largest_seqno;  // 文件中最大的序列号，0 表示未知
+};
+
+// 键值分离时一个 blob 文件的元数据。
+// garbage_* 统计已经不再被任何 sstable 引用的记录，由 compaction 累加；
+// 当全部记录都成为垃圾时文件会从版本中移除。
+struct BlobFileMetaData {
+  BlobFileMetaData()
+      : number(0),
+        total_count(0),
+        total_bytes(0),
+        garbage_count(0),
+        garbage_bytes(0) {}
+
+  uint64_t number;
+  uint64_t total_count;    // 文件中的记录数
+  uint64_t total_bytes;    // 文件中记录的总字节数
+  uint64_t garbage_count;  // 已成为垃圾的记录数
+  uint64_t garbage_bytes;  // 已成为垃圾的字节数
 };
 
 class VersionEdit {
@@ -58,20 +89,49 @@ class VersionEdit {
   // 添加指定编号的文件。
   // 要求：此版本尚未保存（参见 VersionSet::SaveTo）
   // 要求："smallest" 和 "largest" 是文件中的最小和最大键
+  // "creation_time" 为文件创建时间（秒），0 表示未知
   void AddFile(int level, uint64_t file, uint64_t file_size,
-               const InternalKey& smallest, const InternalKey& largest) {
+               const InternalKey& smallest, const InternalKey& largest,
+               uint64_t creation_time = 0) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.creation_time = creation_time;
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // 同上，但保留 "f" 中的全部元数据（创建时间、条目统计等）。
+  void AddFile(int level, const FileMetaData& f) {
+    FileMetaData copy = f;
+    copy.refs = 0;
+    copy.allowed_seeks = 1 << 30;
+    new_files_.push_back(std::make_pair(level, copy));
+  }
+
   void RemoveFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
   }
 
+  // 添加一个新写出的 blob 文件，包含 "count" 条共 "bytes" 字节的记录。
+  void AddBlobFile(uint64_t file, uint64_t count, uint64_t bytes) {
+    BlobFileMetaData b;
+    b.number = file;
+    b.total_count = count;
+    b.total_bytes = bytes;
+    new_blob_files_.push_back(b);
+  }
+
+  // 记录 blob 文件 "file" 中新增了 "count" 条共 "bytes" 字节的垃圾。
+  void AddBlobGarbage(uint64_t file, uint64_t count, uint64_t bytes) {
+    BlobFileMetaData b;
+    b.number = file;
+    b.garbage_count = count;
+    b.garbage_bytes = bytes;
+    blob_garbage_.push_back(b);
+  }
+
   void EncodeTo(std::string* dst) const;
 
   Status DecodeFrom(const Slice& src);
@@ -97,6 +157,8 @@ class VersionEdit {
   std::vector<std::pair<int, InternalKey>> compact_pointers_;
   DeletedFileSet deleted_files_;
   std::vector<std::pair<int, FileMetaData>> new_files_;
+  std::vector<BlobFileMetaData> new_blob_files_;
+  std::vector<BlobFileMetaData> blob_garbage_;
 };
 
 }  // namespace leveldb
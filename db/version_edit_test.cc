@@ -21,8 +21,14 @@ TEST(VersionEditTest, EncodeDecode) {
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
                  InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+    edit.AddFile(5, kBig + 800 + i, kBig + 400 + i,
+                 InternalKey("bar", kBig + 500 + i, kTypeValue),
+                 InternalKey("baz", kBig + 600 + i, kTypeDeletion),
+                 kBig + 1100 + i);
     edit.RemoveFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
+    edit.AddBlobFile(kBig + 1200 + i, 100 + i, kBig + 1300 + i);
+    edit.AddBlobGarbage(kBig + 1400 + i, 10 + i, kBig + 1500 + i);
   }
   edit.SetComparatorName("foo");
   edit.SetLogNumber(kBig + 100);
@@ -30,4 +36,38 @@ TEST(VersionEditTest, EncodeDecode) {
   edit.SetLastSequence(kBig + 1000);
   TestEncodeDecode(edit);
 }
+
+TEST(VersionEditTest, CreationTime) {
+  VersionEdit edit;
+  edit.AddFile(0, 7, 100, InternalKey("a", 1, kTypeValue),
+               InternalKey("b", 2, kTypeValue), 12345);
+  edit.AddFile(1, 8, 100, InternalKey("c", 1, kTypeValue),
+               InternalKey("d", 2, kTypeValue));
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  ASSERT_NE(std::string::npos, parsed.DebugString().find("@12345"));
+}
+
+TEST(VersionEditTest, EntryStats) {
+  FileMetaData f;
+  f.number = 9;
+  f.file_size = 4096;
+  f.smallest = InternalKey("a", 1, kTypeValue);
+  f.largest = InternalKey("z", 2, kTypeDeletion);
+  f.creation_time = 0;
+  f.num_entries = 300;
+  f.num_deletions = 120;
+  VersionEdit edit;
+  edit.AddFile(2, f);
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  ASSERT_NE(std::string::npos,
+            parsed.DebugString().find("entries=300 deletions=120"));
+}
 }  // namespace leveldb
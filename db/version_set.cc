@@ -3,10 +3,12 @@
 #include <algorithm>
 #include <cstdio>
 
+#include "db/blob_file.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -14,6 +16,7 @@
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 static size_t TargetFileSize(const Options* options) {
@@ -226,6 +229,7 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerge,  // 找到了合并操作数，需要继续查找更早的条目
 };
 
 struct Saver {
@@ -233,6 +237,10 @@ struct Saver {
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  SequenceNumber sequence;  // 找到的条目的序列号
+  SequenceNumber max_covering_tombstone_seq;
+  std::vector<std::string>* merge_operands;
+  bool is_blob_index;  // *value 中是否为 blob 索引
 };
 
 }  // namespace
@@ -244,9 +252,20 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
+      s->sequence = parsed_key.sequence;
+      if (parsed_key.sequence < s->max_covering_tombstone_seq) {
+        // 被更新的范围删除标记覆盖
+        s->state = kDeleted;
+      } else if (parsed_key.type == kTypeValue ||
+                 parsed_key.type == kTypeBlobIndex) {
+        s->state = kFound;
+        s->is_blob_index = (parsed_key.type == kTypeBlobIndex);
         s->value->assign(v.data(), v.size());
+      } else if (parsed_key.type == kTypeMerge) {
+        s->state = kMerge;
+        s->merge_operands->push_back(v.ToString());
+      } else {
+        s->state = kDeleted;
       }
     }
   }
@@ -297,7 +316,10 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
   }
 }
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    SequenceNumber max_covering_tombstone_seq,
+                    std::string* value,
+                    std::vector<std::string>* merge_operands,
+                    GetStats* stats) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
   struct State {
@@ -305,6 +327,7 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
     GetStats* stats;
     const ReadOptions* options;
     Slice ikey;
+    SequenceNumber snapshot;
     FileMetaData* last_file_read;
     int last_file_read_level;
     VersionSet* vset;
@@ -323,6 +346,22 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
 
       state->last_file_read = f;
       state->last_file_read_level = level;
+      if (f->num_range_deletions > 0) {
+        SequenceNumber seq;
+        state->s = state->vset->table_cache_->MaxCoveringTombstoneSeq(
+            f->number, f->file_size, state->saver.ucmp, state->saver.user_key,
+            state->snapshot, &seq);
+        if (!state->s.ok()) {
+          state->found = true;
+          return false;
+        }
+        state->saver.max_covering_tombstone_seq =
+            std::max(state->saver.max_covering_tombstone_seq, seq);
+      }
+      if (state->saver.state == kMerge) {
+        // 之前的文件中已有合并操作数，在本文件中继续查找更早的条目
+        return MergeFromFile(state, f);
+      }
       // SaveValue加不加&均可
       state->s = state->vset->table_cache_->Get(*state->options, f->number,
                                                 f->file_size, state->ikey,
@@ -339,8 +378,11 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
           return false;
         case kDeleted:
           return false;
+        case kMerge:
+          return MergeFromFile(state, f);
         case kCorrupt:
-          Status::Corruption("corrupted key for ", state->saver.user_key);
+          state->s =
+              Status::Corruption("corrupted key for ", state->saver.user_key);
           state->found = true;
           return false;
       }
@@ -348,6 +390,51 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       // "control reaches end of non-void function".
       return false;
     }
+
+    // 收集 "f" 中序列号小于 saver.sequence 的同一用户键的条目，
+    // 直到遇到值或删除记录。返回 true 表示需要继续查找下一个文件。
+    static bool MergeFromFile(State* state, FileMetaData* f) {
+      if (state->saver.sequence == 0) {
+        return true;  // 不存在更早的条目
+      }
+      Iterator* iter = state->vset->table_cache_->NewIterator(
+          *state->options, f->number, f->file_size);
+      InternalKey start(state->saver.user_key, state->saver.sequence - 1,
+                        kValueTypeForSeek);
+      ParsedInternalKey ikey;
+      for (iter->Seek(start.Encode());
+           iter->Valid() && state->saver.state == kMerge; iter->Next()) {
+        if (!ParseInternalKey(iter->key(), &ikey)) {
+          state->saver.state = kCorrupt;
+          break;
+        }
+        if (state->saver.ucmp->Compare(ikey.user_key, state->saver.user_key) !=
+            0) {
+          break;
+        }
+        SaveValue(&state->saver, iter->key(), iter->value());
+      }
+      state->s = iter->status();
+      delete iter;
+      if (!state->s.ok()) {
+        state->found = true;
+        return false;
+      }
+      switch (state->saver.state) {
+        case kMerge:
+          return true;
+        case kFound:
+          state->found = true;
+          return false;
+        case kCorrupt:
+          state->s =
+              Status::Corruption("corrupted key for ", state->saver.user_key);
+          state->found = true;
+          return false;
+        default:
+          return false;
+      }
+    }
   };
 
   State state;
@@ -358,19 +445,72 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
 
   state.options = &options;
   state.ikey = k.internal_key();
+  state.snapshot =
+      DecodeFixed64(state.ikey.data() + state.ikey.size() - 8) >> 8;
   state.vset = vset_;
   state.saver.state = kNotFound;
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
+  state.saver.sequence = 0;
+  state.saver.max_covering_tombstone_seq = max_covering_tombstone_seq;
+  state.saver.merge_operands = merge_operands;
+  state.saver.is_blob_index = false;
 
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, State::Match);
-  return state.found ? state.s : Status::NotFound(Slice());
+  if (!state.found) {
+    return Status::NotFound(Slice());
+  }
+  if (state.s.ok() && state.saver.is_blob_index) {
+    // 找到的是 blob 索引，从 blob 文件中取回真实值
+    BlobIndex index;
+    if (!index.DecodeFrom(*value)) {
+      return Status::Corruption("bad blob index for ", state.saver.user_key);
+    }
+    state.s = vset_->table_cache_->GetBlob(index, value);
+  }
+  return state.s;
+}
+
+Status Version::RangeTombstones(
+    std::shared_ptr<const FragmentedRangeTombstones>* result) {
+  MutexLock l(&range_del_mutex_);
+  if (range_dels_loaded_) {
+    *result = range_dels_;
+    return Status::OK();
+  }
+  std::vector<RangeTombstone> tombstones;
+  Status s;
+  for (int level = 0; level < config::kNumLevels && s.ok(); level++) {
+    for (size_t i = 0; i < files_[level].size() && s.ok(); i++) {
+      FileMetaData* f = files_[level][i];
+      if (f->num_range_deletions == 0) {
+        continue;
+      }
+      Iterator* iter =
+          vset_->table_cache_->NewRangeTombstoneIterator(f->number, f->file_size);
+      s = ReadRangeTombstones(iter, &tombstones);
+      delete iter;
+    }
+  }
+  if (!s.ok()) {
+    // 不缓存错误，下次重新读取
+    return s;
+  }
+  if (!tombstones.empty()) {
+    range_dels_ = std::make_shared<FragmentedRangeTombstones>(
+        vset_->icmp_.user_comparator(), tombstones);
+  }
+  range_dels_loaded_ = true;
+  *result = range_dels_;
+  return s;
 }
 
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
-  if (f != nullptr) {
+  // FIFO 风格从不合并文件，因此也不需要基于查找的压缩
+  if (f != nullptr &&
+      vset_->options_->compaction_style != kCompactionStyleFIFO) {
     f->allowed_seeks--;
     if (f->allowed_seeks <= 0 && file_to_compact_ == nullptr) {
       file_to_compact_ = f;
@@ -524,6 +664,26 @@ std::string Version::DebugString() const {
       r.append("]\n");
     }
   }
+  if (!blob_files_.empty()) {
+    // E.g.,
+    //   --- blob files ---
+    //   12: 100/409600 garbage 40/163840
+    r.append("--- blob files ---\n");
+    for (const auto& kvp : blob_files_) {
+      const BlobFileMetaData& b = kvp.second;
+      r.push_back(' ');
+      AppendNumberTo(&r, b.number);
+      r.append(": ");
+      AppendNumberTo(&r, b.total_count);
+      r.push_back('/');
+      AppendNumberTo(&r, b.total_bytes);
+      r.append(" garbage ");
+      AppendNumberTo(&r, b.garbage_count);
+      r.push_back('/');
+      AppendNumberTo(&r, b.garbage_bytes);
+      r.push_back('\n');
+    }
+  }
   return r;
 }
 
@@ -549,17 +709,22 @@ class VersionSet::Builder {
   typedef std::set<FileMetaData*, BySmallestKey> FileSet;
 
   struct LevelState {
+    // 从 base_ 中删除的文件
     std::set<uint64_t> deleted_files;
     FileSet* added_files;
+    // added_files 中的文件，以文件编号为键
+    std::map<uint64_t, FileMetaData*> added_by_number;
   };
 
   VersionSet* vset_;
   Version* base_;
   LevelState levels_[config::kNumLevels];
+  std::map<uint64_t, BlobFileMetaData> blob_files_;
 
  public:
   // 使用 *base 中的文件和 *vset 中的其他信息初始化一个构建器
-  Builder(VersionSet* vset, Version* base) : vset_(vset), base_(base) {
+  Builder(VersionSet* vset, Version* base)
+      : vset_(vset), base_(base), blob_files_(base->blob_files_) {
     base_->Ref();
     BySmallestKey cmp;
     cmp.internal_comparator = &vset_->icmp_;
@@ -600,11 +765,25 @@ class VersionSet::Builder {
           edit->compact_pointers_[i].second.Encode().ToString();
     }
 
-    // 记录删除的文件
+    // 记录删除的文件。恢复时一次应用整个 MANIFEST 中的记录，其中添加的
+    // 文件大多又被之后的记录删除，这些文件直接丢弃，使内存与 SaveTo 的
+    // 开销只与存活的文件数相关。base_ 中同编号的文件同样要删除，所以
+    // 编号总是记入 deleted_files。
     for (const auto& deleted_file_set_kvp : edit->deleted_files_) {
       const int level = deleted_file_set_kvp.first;
       const uint64_t number = deleted_file_set_kvp.second;
-      levels_[level].deleted_files.insert(number);
+      LevelState* state = &levels_[level];
+      auto it = state->added_by_number.find(number);
+      if (it != state->added_by_number.end()) {
+        FileMetaData* f = it->second;
+        state->added_files->erase(f);
+        state->added_by_number.erase(it);
+        f->refs--;
+        if (f->refs <= 0) {
+          delete f;
+        }
+      }
+      state->deleted_files.insert(number);
     }
 
     // 记录增加的文件
@@ -628,8 +807,22 @@ class VersionSet::Builder {
         f->allowed_seeks = 100;
       }
 
-      levels_[level].deleted_files.erase(f->number);
+      // deleted_files 只作用于 base_ 中的文件，先删后加同一编号时
+      // 新添加的文件替换 base_ 中的旧文件
       levels_[level].added_files->insert(f);
+      levels_[level].added_by_number[f->number] = f;
+    }
+
+    // 记录新增的 blob 文件及其垃圾
+    for (const BlobFileMetaData& b : edit->new_blob_files_) {
+      blob_files_[b.number] = b;
+    }
+    for (const BlobFileMetaData& b : edit->blob_garbage_) {
+      auto it = blob_files_.find(b.number);
+      if (it != blob_files_.end()) {
+        it->second.garbage_count += b.garbage_count;
+        it->second.garbage_bytes += b.garbage_bytes;
+      }
     }
   }
 
@@ -653,7 +846,7 @@ class VersionSet::Builder {
           //  bpos初始化为base_iter的上界
           MaybeAddFile(v, level, *base_iter);  // base 是老版本 数据往v中写
         }
-        MaybeAddFile(v, level, added_file);
+        AddFile(v, level, added_file);
         //               add1              add2
         // b1 b2 .... b3      b4 b5 ... b6
         // 按以上顺序逐步添加至v
@@ -678,22 +871,34 @@ class VersionSet::Builder {
 
 #endif
     }
+
+    // 全部记录都已成为垃圾的 blob 文件不再属于新版本
+    for (const auto& kvp : blob_files_) {
+      if (kvp.second.garbage_count < kvp.second.total_count) {
+        v->blob_files_.insert(kvp);
+      }
+    }
   }
 
+  // 加入 base_ 中的文件，除非它已被删除
   void MaybeAddFile(Version* v, int level, FileMetaData* f) {
     if (levels_[level].deleted_files.count(f->number) > 0) {
       // 文件已被删除不做处理
     } else {
-      std::vector<FileMetaData*>* files = &v->files_[level];
-      if (level > 0 && !files->empty()) {
-        // 不可有重叠键
-        assert(vset_->icmp_.Compare((*files)[files->size() - 1]->largest,
-                                    f->smallest) < 0);
-        f->refs++;
-        files->push_back(f);
-      }
+      AddFile(v, level, f);
     }
   }
+
+  void AddFile(Version* v, int level, FileMetaData* f) {
+    std::vector<FileMetaData*>* files = &v->files_[level];
+    if (level > 0 && !files->empty()) {
+      // 不可有重叠键
+      assert(vset_->icmp_.Compare((*files)[files->size() - 1]->largest,
+                                  f->smallest) < 0);
+    }
+    f->refs++;
+    files->push_back(f);
+  }
 };
 
 VersionSet::VersionSet(const std::string& dbname, const Options* options,
@@ -710,6 +915,8 @@ VersionSet::VersionSet(const std::string& dbname, const Options* options,
       last_sequence_(0),
       log_number_(0),
       prev_log_number_(0),
+      manifest_file_size_(0),
+      manifest_snapshot_size_(0),
       descriptor_file_(nullptr),
       descriptor_log_(nullptr),
       dummy_versions_(this),
@@ -734,6 +941,16 @@ void VersionSet::AppendVersion(Version* v) {
   current_ = v;
   v->Ref();
 
+  if (options_->pin_l0_l1_index_and_filter) {
+    std::vector<uint64_t> pinned;
+    for (int level = 0; level < 2; level++) {
+      for (FileMetaData* f : v->files_[level]) {
+        pinned.push_back(f->number);
+      }
+    }
+    table_cache_->SetPinnedFiles(pinned);
+  }
+
   // p - d - v - q - ...
   // v->next_ = dummy_versions_.next_;
   // v->next_->prev_ = v;
@@ -752,6 +969,27 @@ void VersionSet::AppendVersion(Version* v) {
 // 要求：进入时持有 *mu。
 // 要求：没有其他线程同时调用 LogAndApply()
 Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
+  // MANIFEST 过大时切换到一个以当前版本快照开头的新文件，避免恢复时重放
+  // 过多的记录。快照本身很大时等到文件长度翻倍再切换，避免频繁切换。
+  // 旧文件在 CURRENT 指向新文件后由 DBImpl::RemoveObsoleteFiles 删除。
+  // 新文件的编号在 CURRENT 指向它之后才写入 manifest_file_number_，
+  // 在此之前并发的 RemoveObsoleteFiles 不会删除旧文件。
+  WritableFile* old_descriptor_file = nullptr;
+  log::Writer* old_descriptor_log = nullptr;
+  uint64_t new_manifest_file_number = manifest_file_number_;
+  if (descriptor_log_ != nullptr &&
+      manifest_file_size_ >= options_->max_manifest_file_size &&
+      manifest_file_size_ >= 2 * manifest_snapshot_size_) {
+    Log(options_->info_log, "Rolling over MANIFEST #%llu: %llu bytes\n",
+        (unsigned long long)manifest_file_number_,
+        (unsigned long long)manifest_file_size_);
+    old_descriptor_file = descriptor_file_;
+    old_descriptor_log = descriptor_log_;
+    descriptor_file_ = nullptr;
+    descriptor_log_ = nullptr;
+    new_manifest_file_number = NewFileNumber();
+  }
+
   if (edit->has_log_number_) {
     assert(edit->log_number_ >= log_number_);
     assert(edit->log_number_ < next_file_number_);
@@ -774,24 +1012,25 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   }
   Finalize(v);  // TODO
 
-  // 如果有必要，通过创建一个包含当前版本快照的临时文件来初始化新的描述符日志文件。
+  // 如果有必要，创建新的描述符日志文件，并以当前版本的快照开头。
   std::string new_manifest_file;
   Status s;
   if (descriptor_log_ == nullptr) {
-    // 没有理由在这里解锁 *mu，因为我们只在第一次调用 LogAndApply
-    // 时（打开数据库时）会走到这条路径。
     assert(descriptor_file_ == nullptr);
-    new_manifest_file = DescriptorFileName(dbname_, manifest_file_number_);
+    new_manifest_file = DescriptorFileName(dbname_, new_manifest_file_number);
     s = env_->NewWritableFile(new_manifest_file, &descriptor_file_);
     if (s.ok()) {
       descriptor_log_ = new log::Writer(descriptor_file_);
-      s = WriteSnapshot(descriptor_log_);  // todo
     }
   }
 
   // Unlock during expensive MANIFEST log write
   {
     mu->Unlock();
+    // 同一时刻只有一个线程调用 LogAndApply，快照读取的当前版本不会改变
+    if (s.ok() && !new_manifest_file.empty()) {
+      s = WriteSnapshot(descriptor_log_);
+    }
     // Write new record to MANIFEST log
     if (s.ok()) {  // 默认的s是ok状态
       std::string record;
@@ -807,7 +1046,18 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     // If we just created a new descriptor file, install it by writing a
     // new CURRENT file that points to it.
     if (s.ok() && !new_manifest_file.empty()) {
-      s = SetCurrentFile(env_, dbname_, manifest_file_number_);
+      s = SetCurrentFile(env_, dbname_, new_manifest_file_number);
+    }
+    if (s.ok()) {
+      uint64_t size;
+      if (env_->GetFileSize(
+                  DescriptorFileName(dbname_, new_manifest_file_number), &size)
+              .ok()) {
+        manifest_file_size_ = size;
+        if (!new_manifest_file.empty()) {
+          manifest_snapshot_size_ = size;
+        }
+      }
     }
     mu->Lock();
   }
@@ -816,6 +1066,9 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     AppendVersion(v);
     log_number_ = edit->log_number_;
     prev_log_number_ = edit->prev_log_number_;
+    manifest_file_number_ = new_manifest_file_number;
+    delete old_descriptor_log;
+    delete old_descriptor_file;
   } else {
     delete v;
     if (!new_manifest_file.empty()) {
@@ -825,6 +1078,11 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
       descriptor_file_ = nullptr;
       env_->RemoveFile(new_manifest_file);
     }
+    if (old_descriptor_log != nullptr) {
+      // 切换失败，CURRENT 仍指向旧文件，继续追加到旧文件中
+      descriptor_log_ = old_descriptor_log;
+      descriptor_file_ = old_descriptor_file;
+    }
   }
 
   return s;
@@ -982,6 +1240,8 @@ bool VersionSet::ReuseManifest(const std::string& dscname,
   Log(options_->info_log, "Reusing MANIFEST %s\n", dscname.c_str());
   descriptor_log_ = new log::Writer(descriptor_file_, manifest_size);
   manifest_file_number_ = manifest_number;
+  manifest_file_size_ = manifest_size;
+  manifest_snapshot_size_ = 0;
   return true;
 }
 
@@ -992,6 +1252,16 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
 }
 
 void VersionSet::Finalize(Version* v) {
+  if (options_->compaction_style == kCompactionStyleFIFO) {
+    // FIFO 风格下只有 level-0 上的文件删除，有可删除的文件即需要压缩。
+    // 文件随时间过期，记下下一次过期的时间，供没有新版本时检查
+    std::vector<FileMetaData*> expired;
+    PickFIFOFilesToDrop(v, &expired, &v->fifo_expire_time_);
+    v->compaction_level_ = 0;
+    v->compaction_score_ = expired.empty() ? 0 : 1;
+    return;
+  }
+
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
@@ -1019,6 +1289,26 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // 找出删除标记比例最高的文件。最后一层的文件没有下一层可以合并，跳过。
+  const double ratio_limit = options_->tombstone_compaction_ratio;
+  if (ratio_limit > 0) {
+    double best_ratio = ratio_limit;
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      for (FileMetaData* f : v->files_[level]) {
+        if (f->num_entries == 0) {
+          continue;
+        }
+        const double ratio =
+            static_cast<double>(f->num_deletions) / f->num_entries;
+        if (ratio >= best_ratio) {
+          best_ratio = ratio;
+          v->tombstone_file_to_compact_ = f;
+          v->tombstone_file_to_compact_level_ = level;
+        }
+      }
+    }
+  }
 }
 Status VersionSet::WriteSnapshot(log::Writer* log) {
   // metadata
@@ -1037,7 +1327,15 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, *f);
+    }
+  }
+
+  for (const auto& kvp : current_->blob_files_) {
+    const BlobFileMetaData& b = kvp.second;
+    edit.AddBlobFile(b.number, b.total_count, b.total_bytes);
+    if (b.garbage_count > 0) {
+      edit.AddBlobGarbage(b.number, b.garbage_count, b.garbage_bytes);
     }
   }
 
@@ -1094,6 +1392,12 @@ void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
        v = v->next_) {
     for (int level = 0; level < config::kNumLevels; level++) {
       const std::vector<FileMetaData*>& files = v->files_[level];
+      for (size_t i = 0; i < files.size(); i++) {
+        live->insert(files[i]->number);
+      }
+    }
+    for (const auto& kvp : v->blob_files_) {
+      live->insert(kvp.first);
     }
   }
 }
@@ -1138,7 +1442,7 @@ void VersionSet::GetRange(const std::vector<FileMetaData*>& inputs,
       if (icmp_.Compare(*smallest, f->smallest) > 0) {
         *smallest = f->smallest;
       }
-      if (icmp_.Compare(*largest, f->largest) > 0) {
+      if (icmp_.Compare(f->largest, *largest) > 0) {
         *largest = f->largest;
       }
     }
@@ -1163,21 +1467,24 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
   // TODO(opt): use concatenating iterator for level-0 if there is no overlap
-  const int space = (c->level() == 0 ? c->inputs_[0].size() + 1 : 2);
+  // 被范围删除标记完整覆盖的文件不需要读取
+  std::vector<FileMetaData*>* inputs =
+      c->skipped_inputs_ ? c->merge_inputs_ : c->inputs_;
+  const int space = (c->level() == 0 ? inputs[0].size() + 1 : 2);
   Iterator** list = new Iterator*[space];
   int num = 0;
   for (int which = 0; which < 2; which++) {
-    if (!c->inputs_[which].empty()) {
+    if (!inputs[which].empty()) {
       // level = 0 && which == 0
       if (c->level() + which == 0) {
-        const std::vector<FileMetaData*>& files = c->inputs_[which];
+        const std::vector<FileMetaData*>& files = inputs[which];
         for (size_t i = 0; i < files.size(); i++) {
           list[num++] = table_cache_->NewIterator(options, files[i]->number,
                                                   files[i]->file_size);
         }
       } else {
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
+            new Version::LevelFileNumIterator(icmp_, &inputs[which]),
             &GetFileIterator, table_cache_, options);
       }
     }
@@ -1188,10 +1495,88 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
+bool VersionSet::NeedsCompaction() const {
+  Version* v = current_;
+  return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr) ||
+         (v->tombstone_file_to_compact_ != nullptr) ||
+         (v->fifo_expire_time_ != 0 &&
+          v->fifo_expire_time_ <= env_->NowMicros() / 1000000);
+}
+
+void VersionSet::PickFIFOFilesToDrop(Version* v,
+                                     std::vector<FileMetaData*>* inputs,
+                                     uint64_t* next_expire_time) {
+  inputs->clear();
+  if (next_expire_time != nullptr) {
+    *next_expire_time = 0;
+  }
+  // level-0 文件按最小键排序，文件编号越小越旧
+  std::vector<FileMetaData*> files = v->files_[0];
+  std::sort(files.begin(), files.end(), [](FileMetaData* a, FileMetaData* b) {
+    return a->number < b->number;
+  });
+
+  uint64_t total = TotalFileSize(files);
+  const uint64_t now = env_->NowMicros() / 1000000;
+  const uint64_t ttl = options_->fifo_ttl_seconds;
+  for (size_t i = 0; i < files.size(); i++) {
+    FileMetaData* f = files[i];
+    const bool expired =
+        ttl > 0 && f->creation_time != 0 && f->creation_time + ttl <= now;
+    if (total <= options_->fifo_max_table_files_size && !expired) {
+      // 之后的文件更新，无需继续检查。总大小不随时间变化，
+      // 下一次删除发生在这个文件过期时
+      if (next_expire_time != nullptr && ttl > 0 && f->creation_time != 0) {
+        *next_expire_time = f->creation_time + ttl;
+      }
+      break;
+    }
+    inputs->push_back(f);
+    total -= f->file_size;
+  }
+}
+
+FileMetaData* VersionSet::PickMinOverlappingFile(int level) {
+  assert(level >= 1);
+  assert(!current_->files_[level].empty());
+  FileMetaData* best = nullptr;
+  double best_score = 0;
+  std::vector<FileMetaData*> overlaps;
+  for (FileMetaData* f : current_->files_[level]) {
+    current_->GetOverlappingInputs(level + 1, &f->smallest, &f->largest,
+                                   &overlaps);
+    // 重叠比例越小，写放大越小；删除标记越多，压缩后回收的空间越多
+    double score = static_cast<double>(TotalFileSize(overlaps)) /
+                   std::max<uint64_t>(f->file_size, 1);
+    if (f->num_entries != 0) {
+      score *= 1.0 - static_cast<double>(f->num_deletions) / f->num_entries;
+    }
+    if (best == nullptr || score < best_score) {
+      best = f;
+      best_score = score;
+    }
+  }
+  return best;
+}
+
 Compaction* VersionSet::PickCompaction() {
   Compaction* c;
   int level;
 
+  if (options_->compaction_style == kCompactionStyleFIFO) {
+    std::vector<FileMetaData*> expired;
+    PickFIFOFilesToDrop(current_, &expired);
+    if (expired.empty()) {
+      return nullptr;
+    }
+    c = new Compaction(options_, 0);
+    c->deletion_compaction_ = true;
+    c->inputs_[0] = expired;
+    c->input_version_ = current_;
+    c->input_version_->Ref();
+    return c;
+  }
+
   // We prefer compactions triggered by too much data in a level over
   // the compactions triggered by seeks.
   const bool size_compaction = (current_->compaction_score_ >= 1);
@@ -1201,12 +1586,16 @@ Compaction* VersionSet::PickCompaction() {
     assert(level >= 0);
     assert(level + 1 < config::kNumLevels);
     c = new Compaction(options_, level);
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
+    if (level > 0 && options_->compaction_pri == kMinOverlappingRatio) {
+      c->inputs_[0].push_back(PickMinOverlappingFile(level));
+    } else {
+      for (size_t i = 0; i < current_->files_[level].size(); i++) {
+        FileMetaData* f = current_->files_[level][i];
+        if (compact_pointer_[level].empty() ||
+            icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
+          c->inputs_[0].push_back(f);
+          break;
+        }
       }
     }
     if (c->inputs_[0].empty()) {
@@ -1217,6 +1606,11 @@ Compaction* VersionSet::PickCompaction() {
     level = current_->file_to_compact_level_;
     c = new Compaction(options_, level);
     c->inputs_[0].push_back(current_->file_to_compact_);
+  } else if (current_->tombstone_file_to_compact_ != nullptr) {
+    level = current_->tombstone_file_to_compact_level_;
+    c = new Compaction(options_, level);
+    c->tombstone_compaction_ = true;
+    c->inputs_[0].push_back(current_->tombstone_file_to_compact_);
   } else {
     return nullptr;
   }
@@ -1404,8 +1798,11 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
 
 Compaction::Compaction(const Options* options, int level)
     : level_(level),
+      deletion_compaction_(false),
+      tombstone_compaction_(false),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
+      skipped_inputs_(false),
       grandparent_index_(0),
       seen_key_(false),
       overlapped_bytes_(0) {
@@ -1424,7 +1821,9 @@ bool Compaction::IsTrivialMove() const {
   const VersionSet* vset = input_version_->vset_;
   // 如果有大量重叠的祖父层数据，则避免移动。
   // 否则，这次移动可能会创建一个父层文件，之后需要进行非常昂贵的合并。
-  return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
+  // 为清理删除标记而发起的压缩必须重写文件，移动文件无法丢弃任何条目。
+  return (!tombstone_compaction_ && num_input_files(0) == 1 &&
+          num_input_files(1) == 0 &&
           TotalFileSize(grandparents_) <=
               MaxGrandParentOverlapBytes(vset->options_));
 }
@@ -1456,6 +1855,55 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
+bool Compaction::IsBaseLevelForRange(const Slice& begin, const Slice& end) {
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Status Compaction::AddRangeTombstones(RangeTombstoneList* list) {
+  TableCache* table_cache = input_version_->vset_->table_cache_;
+  Status s;
+  for (int which = 0; which < 2 && s.ok(); which++) {
+    for (size_t i = 0; i < inputs_[which].size() && s.ok(); i++) {
+      FileMetaData* f = inputs_[which][i];
+      if (f->num_range_deletions == 0) {
+        continue;
+      }
+      Iterator* iter = table_cache->NewRangeTombstoneIterator(f->number,
+                                                              f->file_size);
+      s = list->AddTombstones(iter);
+      delete iter;
+    }
+  }
+  return s;
+}
+
+int Compaction::SkipCoveredInputs(const RangeTombstoneList& range_dels,
+                                  SequenceNumber smallest_snapshot) {
+  int skipped = 0;
+  for (int which = 0; which < 2; which++) {
+    merge_inputs_[which].clear();
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      FileMetaData* f = inputs_[which][i];
+      // largest_seqno 未知的旧文件无法判断，只能照常读取
+      if (f->largest_seqno != 0 &&
+          range_dels.CoversRange(f->smallest.user_key(),
+                                 f->largest.user_key(), f->largest_seqno,
+                                 smallest_snapshot)) {
+        skipped++;
+      } else {
+        merge_inputs_[which].push_back(f);
+      }
+    }
+  }
+  skipped_inputs_ = (skipped > 0);
+  return skipped;
+}
+
 bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
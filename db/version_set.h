@@ -2,6 +2,7 @@
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -18,6 +19,8 @@ class Writer;
 class Compaction;
 class Iterator;
 class MemTable;
+class FragmentedRangeTombstones;
+class RangeTombstoneList;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -52,9 +55,20 @@ class Version {
   void AddIterators(const ReadOptions& options, std::vector<Iterator*>* iters);
 
   // 查找键的值。如果找到，将其存储在*val中并返回OK。否则返回非OK状态。填充*stats。
+  // "max_covering_tombstone_seq" 为 memtable 中覆盖该键的范围删除标记的最大序列号，
+  // 序列号小于它的条目视为已删除。
+  // 遇到的合并操作数追加到 *merge_operands（从新到旧），并继续向更早的数据查找，
+  // 直到找到值（返回 OK）或删除记录、数据耗尽（返回 NotFound）。
   // 要求：未持有锁
-  Status Get(const ReadOptions& options, const LookupKey& key, std::string* val,
-             GetStats* stats);
+  Status Get(const ReadOptions& options, const LookupKey& key,
+             SequenceNumber max_covering_tombstone_seq, std::string* val,
+             std::vector<std::string>* merge_operands, GetStats* stats);
+
+  // 将此版本所有文件中的范围删除标记切分后存入 *result，没有标记时存入
+  // nullptr。第一次调用时读取并缓存，同一版本的迭代器共享。
+  // 要求：未持有锁
+  Status RangeTombstones(
+      std::shared_ptr<const FragmentedRangeTombstones>* result);
 
   // 将"stats"添加到当前状态中。如果可能需要触发新的压缩，则返回true，否则返回false。
   // 要求：持有锁
@@ -88,6 +102,16 @@ class Version {
 
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // "level" 中的文件，按键的顺序排列（level-0 按添加的顺序）。
+  const std::vector<FileMetaData*>& files(int level) const {
+    return files_[level];
+  }
+
+  // 此版本中仍有存活记录的 blob 文件，以文件编号为键。
+  const std::map<uint64_t, BlobFileMetaData>& blob_files() const {
+    return blob_files_;
+  }
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
@@ -103,8 +127,12 @@ class Version {
         refs_(0),
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
+        tombstone_file_to_compact_(nullptr),
+        tombstone_file_to_compact_level_(-1),
         compaction_level_(-1),
-        compaction_score_(-1) {}
+        compaction_score_(-1),
+        fifo_expire_time_(0),
+        range_dels_loaded_(false) {}
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -127,13 +155,30 @@ class Version {
 
   std::vector<FileMetaData*> files_[config::kNumLevels];
 
+  std::map<uint64_t, BlobFileMetaData> blob_files_;
+
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
 
+  // 删除标记比例最高且超过 Options::tombstone_compaction_ratio 的文件。
+  // 由 Finalize() 初始化。
+  FileMetaData* tombstone_file_to_compact_;
+  int tombstone_file_to_compact_level_;
+
   // 下一个应该进行压缩的层级及其压缩得分。
   // 得分 < 1 表示不严格需要压缩。这些字段由 Finalize() 初始化。
   double compaction_score_;
   int compaction_level_;
+
+  // FIFO 风格下剩余文件中最早过期的时间（秒），到达后需要压缩。
+  // 0 表示不会过期。由 Finalize() 初始化。
+  uint64_t fifo_expire_time_;
+
+  // 由 RangeTombstones() 惰性生成，文件列表不变，生成后不再修改
+  port::Mutex range_del_mutex_;
+  bool range_dels_loaded_ GUARDED_BY(range_del_mutex_);
+  std::shared_ptr<const FragmentedRangeTombstones> range_dels_
+      GUARDED_BY(range_del_mutex_);
 };
 
 // TODO
@@ -216,10 +261,7 @@ class VersionSet {
   Iterator* MakeInputIterator(Compaction* c);
 
   // 当且仅当某个层级需要压缩时返回 true。
-  bool NeedsCompaction() const {
-    Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
-  }
+  bool NeedsCompaction() const;
 
   // 将任何活动版本中列出的所有文件添加到 *live。
   // 也可能会改变一些内部状态。
@@ -252,6 +294,17 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // kMinOverlappingRatio：返回 "level" 中与下一层重叠比例最小的文件。
+  // 要求：level >= 1 且该层非空
+  FileMetaData* PickMinOverlappingFile(int level);
+
+  // FIFO 压缩风格：按从旧到新的顺序，将 v 中超出总大小上限或已过期的
+  // level-0 文件存入 *inputs。
+  // 如果 next_expire_time 非空，存入之后最早的文件过期的时间（秒），
+  // 不会过期时存入 0。
+  void PickFIFOFilesToDrop(Version* v, std::vector<FileMetaData*>* inputs,
+                           uint64_t* next_expire_time = nullptr);
+
   Status WriteSnapshot(log::Writer* log);
 
   void AppendVersion(Version* v);
@@ -266,6 +319,9 @@ class VersionSet {
   uint64_t last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
+  // 当前 MANIFEST 的长度，以及它开头的快照（加上第一条记录）的长度
+  uint64_t manifest_file_size_;
+  uint64_t manifest_snapshot_size_;
 
   WritableFile* descriptor_file_;
   log::Writer* descriptor_log_;
@@ -285,6 +341,9 @@ class Compaction {
   // 返回正在压缩的层级。"level"和"level+1"的输入将被合并以生成一组"level+1"文件。
   int level() const { return level_; }
 
+  // 返回压缩开始时的版本。
+  Version* input_version() const { return input_version_; }
+
   // 返回保存此压缩所做的描述符编辑的对象。
   VersionEdit* edit() { return &edit_; }
 
@@ -303,9 +362,25 @@ class Compaction {
   // 将此压缩的所有输入作为删除操作添加到 *edit。
   void AddInputDeletions(VersionEdit* edit);
 
+  // 是否为只删除输入文件、不产生输出的压缩（FIFO 风格）？
+  bool IsDeletionCompaction() const { return deletion_compaction_; }
+
   // 如果我们现有的信息保证压缩在"level+1"生成的数据在高于"level+1"的层级中不存在，则返回true。
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // 与 IsBaseLevelForKey 类似：如果高于"level+1"的层级中没有文件与
+  // [begin, end] 重叠，则返回 true。
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end);
+
+  // 将所有输入文件中的范围删除标记添加到 *list。
+  Status AddRangeTombstones(RangeTombstoneList* list);
+
+  // 找出被 "range_dels" 中所有快照都可见的标记完整覆盖的输入文件。
+  // 这些文件不会被 VersionSet::MakeInputIterator 读取，但仍会被
+  // AddInputDeletions 删除。返回这样的文件数。
+  int SkipCoveredInputs(const RangeTombstoneList& range_dels,
+                        SequenceNumber smallest_snapshot);
+
   // 当且仅当我们应该在处理"internal_key"之前停止构建当前输出时返回true。
   bool ShouldStopBefore(const Slice& internal_key);
 
@@ -319,11 +394,17 @@ class Compaction {
   Compaction(const Options* options, int level);
 
   int level_;
+  bool deletion_compaction_;
+  bool tombstone_compaction_;  // 由删除标记比例触发
   uint64_t max_output_file_size_;
   Version* input_version_;
   VersionEdit edit_;
   // 每次压缩从 "level_" 和 "level_+1" 读取输入
   std::vector<FileMetaData*> inputs_[2];
+  // 去掉被范围删除标记完整覆盖的文件后，需要合并读取的输入。
+  // 只有 skipped_inputs_ 为 true 时有效。
+  std::vector<FileMetaData*> merge_inputs_[2];
+  bool skipped_inputs_;
   // 用于检查重叠祖父文件数量的状态
   // （父级 == level_ + 1，祖父级 == level_ + 2）
   std::vector<FileMetaData*> grandparents_;
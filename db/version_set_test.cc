@@ -1,6 +1,11 @@
 #include "db/version_set.h"
 
 #include "gtest/gtest.h"
+#include "db/table_cache.h"
+#include "db/version_edit.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "port/port.h"
 #include "util/logging.h"
 #include "util/testutil.h"
 
@@ -338,4 +343,52 @@ TEST_F(AddBoundaryInputsTest, TestDisjoinFilePointers) {
   ASSERT_EQ(f3, compaction_files_[2]);
 }
 
+TEST(VersionSetBuilderTest, DeleteAndReAddSameNumber) {
+  const std::string dbname = testing::TempDir() + "version_set_builder_test";
+  Options options;
+  options.create_if_missing = true;
+  DestroyDB(dbname, options);
+  DB* db;
+  ASSERT_LEVELDB_OK(DB::Open(options, dbname, &db));
+  delete db;
+
+  InternalKeyComparator icmp(BytewiseComparator());
+  options.comparator = &icmp;
+  TableCache table_cache(dbname, options, 10);
+  VersionSet vset(dbname, &options, &table_cache, &icmp);
+  bool save_manifest;
+  ASSERT_LEVELDB_OK(vset.Recover(&save_manifest));
+
+  port::Mutex mu;
+  mu.Lock();
+  const uint64_t number = vset.NewFileNumber();
+  const InternalKey smallest("a", 1, kTypeValue);
+  const InternalKey largest("b", 1, kTypeValue);
+  VersionEdit add;
+  add.AddFile(1, number, 100, smallest, largest);
+  ASSERT_LEVELDB_OK(vset.LogAndApply(&add, &mu));
+  ASSERT_EQ(1, vset.NumLevelFiles(1));
+
+  // 同一编号先删后加：新文件替换 base 中的旧文件，而不是两者并存
+  VersionEdit replace;
+  replace.RemoveFile(1, number);
+  replace.AddFile(1, number, 200, smallest, largest);
+  ASSERT_LEVELDB_OK(vset.LogAndApply(&replace, &mu));
+  ASSERT_EQ(1, vset.NumLevelFiles(1));
+  ASSERT_EQ(200, vset.NumLevelBytes(1));
+
+  // 再次删除后 base 中的文件也不会重新出现
+  VersionEdit remove;
+  remove.RemoveFile(1, number);
+  ASSERT_LEVELDB_OK(vset.LogAndApply(&remove, &mu));
+  ASSERT_EQ(0, vset.NumLevelFiles(1));
+  mu.Unlock();
+
+  // 重放 MANIFEST 得到相同的结果
+  VersionSet recovered(dbname, &options, &table_cache, &icmp);
+  ASSERT_LEVELDB_OK(recovered.Recover(&save_manifest));
+  ASSERT_EQ(0, recovered.NumLevelFiles(1));
+  DestroyDB(dbname, Options());
+}
+
 }  // namespace leveldb
@@ -0,0 +1,67 @@
+#ifndef STORAGE_LEVELDB_INCLUDE_BACKUP_ENGINE_H_
+#define STORAGE_LEVELDB_INCLUDE_BACKUP_ENGINE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+class DB;
+class Env;
+
+struct LEVELDB_EXPORT BackupInfo {
+  uint32_t backup_id = 0;
+  uint64_t timestamp = 0;  // 创建时间，单位为秒
+  uint64_t size = 0;       // 该备份引用的全部文件的字节数
+  uint32_t number_files = 0;
+};
+
+// 将数据库增量备份到一个目录中。目录布局为
+//    shared/       所有备份共享的表文件与 blob 文件，文件名中带有文件末尾
+//                  （表文件的索引与 footer）的 crc32c
+//    private/<id>/ 每个备份自己的 MANIFEST 与日志
+//    meta/<id>     每个备份引用的文件列表，以及各文件的长度与 crc32c
+// 表文件与 blob 文件一经生成便不再修改，因此 shared/ 中编号、长度与末尾
+// 都相同的文件不会再次复制，创建备份时也只读取这些文件的末尾。一个备份目录只应用于一个数据库（及从其恢复出的数据库）。
+//
+// 所有文件操作都通过 Env 完成。BackupEngine 不是线程安全的。
+class LEVELDB_EXPORT BackupEngine {
+ public:
+  // 打开位于 "backup_dir" 的备份目录，不存在时创建。
+  // 成功时在 *result 中存储一个堆分配的对象，调用者负责删除。
+  static Status Open(Env* env, const std::string& backup_dir,
+                     BackupEngine** result);
+
+  BackupEngine() = default;
+  BackupEngine(const BackupEngine&) = delete;
+  BackupEngine& operator=(const BackupEngine&) = delete;
+
+  virtual ~BackupEngine();
+
+  // 为 "db" 的当前状态创建一个新的备份，备份期间 "db" 可以继续写入。
+  // backup_id 不为 nullptr 时在其中存储新备份的编号。
+  virtual Status CreateNewBackup(DB* db, uint32_t* backup_id = nullptr) = 0;
+
+  // 按编号从小到大返回所有备份的信息。
+  virtual void GetBackupInfo(std::vector<BackupInfo>* backup_info) = 0;
+
+  // 检查备份引用的文件是否齐全、长度与 crc32c 是否与备份时一致，并通过
+  // 文件自带的校验和（表文件的块 CRC、blob 记录与日志记录的 CRC）检查内容。
+  virtual Status VerifyBackup(uint32_t backup_id) = 0;
+
+  // 删除一个备份，以及不再被任何备份引用的共享文件。
+  virtual Status DeleteBackup(uint32_t backup_id) = 0;
+
+  // 将备份复制到 "db_dir"，之后可以用 DB::Open 打开。
+  // "db_dir" 中已有的数据库文件会被删除。REQUIRES: 该数据库没有被打开。
+  virtual Status RestoreDBFromBackup(uint32_t backup_id,
+                                     const std::string& db_dir) = 0;
+  virtual Status RestoreDBFromLatestBackup(const std::string& db_dir) = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_BACKUP_ENGINE_H_
@@ -26,6 +26,19 @@ class LEVELDB_EXPORT Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  enum Priority { kLowPriority, kHighPriority };
+
+  // 与 Insert 相同，但指定优先级。容量不足时先淘汰所有未被引用的
+  // 低优先级条目，再淘汰高优先级条目。用于索引与过滤器块。
+  // 默认实现忽略优先级。
+  virtual Handle* InsertWithPriority(const Slice& key, void* value,
+                                     size_t charge,
+                                     void (*deleter)(const Slice& key,
+                                                     void* value),
+                                     Priority priority) {
+    return Insert(key, value, charge, deleter);
+  }
+
   // 返回对应于key相关联映射的Handle
   virtual Handle* Lookup(const Slice& key) = 0;
 
@@ -0,0 +1,43 @@
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+// 数据库可以配置一个自定义的 CompactionFilter 对象。压缩时，对每个在压缩后
+// 仍然存活的用户键，leveldb 用它的最新值调用 Filter()，由用户决定保留、
+// 删除或改写该值。例如可以用它清理值中带有过期时间戳的记录，
+// 而不必扫描整个数据库再逐个 Delete。
+//
+// 只有任何快照都看不到的值才会交给过滤器：没有快照时是每个用户键的
+// 最新值，有快照时只有最新快照之后写入的最新值。因此压缩开始前创建的
+// 快照读到的内容不受影响。
+// memtable 写入 level-0 时不调用过滤器。
+//
+// CompactionFilter 会在后台线程中被调用，其实现必须是线程安全的。
+
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT CompactionFilter {
+ public:
+  enum Decision {
+    kKeep,         // 保留原值
+    kRemove,       // 删除该键
+    kChangeValue,  // 用 *new_value 替换原值
+  };
+
+  virtual ~CompactionFilter();
+
+  // 返回此过滤器的名称。
+  virtual const char* Name() const = 0;
+
+  // "level" 为压缩输出所在的层级。返回 kChangeValue 时须将新值存入 *new_value。
+  virtual Decision Filter(int level, const Slice& key,
+                          const Slice& existing_value,
+                          std::string* new_value) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif
@@ -3,6 +3,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
@@ -33,6 +35,13 @@ struct LEVELDB_EXPORT Range {
   Slice limit;
 };
 
+// 数据库目录中的一个文件，参见 DB::GetLiveFiles
+struct LEVELDB_EXPORT LiveFile {
+  std::string name;  // 不含目录的文件名
+  std::string path;  // 完整路径
+  uint64_t size;     // 有效的字节数，之后追加的内容不属于返回时的状态
+};
+
 // DB 是一个从键到值的持久有序映射。
 // DB 对多个线程的并发访问是安全的，无需任何外部同步。
 class LEVELDB_EXPORT DB {
@@ -44,6 +53,14 @@ class LEVELDB_EXPORT DB {
   static Status Open(const Options& options, const std::string& name,
                      DB** dbptr);
 
+  // 以批量导入模式打开数据库，其余语义与 Open 相同。
+  // 该模式下所有写入都不记录日志（相当于 WriteOptions::disable_wal），
+  // level-0 文件数量不再触发写入减速与停顿，也不会自动安排压缩，只刷写
+  // memtable。导入结束后调用 CompactRange(nullptr, nullptr) 得到完整分层的树，
+  // 之后应关闭并以 Open 重新打开数据库。
+  static Status OpenForBulkLoad(const Options& options, const std::string& name,
+                                DB** dbptr);
+
   DB() = default;
   DB(const DB&) = delete;
   DB& operator=(const DB&) = delete;
@@ -60,6 +77,18 @@ class LEVELDB_EXPORT DB {
   // options.sync 设置为 true。
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // 移除用户键位于 [begin, end) 内的所有数据库条目。成功时返回 OK。
+  // begin > end 时返回 InvalidArgument；begin == end 时不删除任何数据。
+  // 删除以单个范围删除标记的形式写入，代价与区间内的键数无关。
+  virtual Status DeleteRange(const WriteOptions& options, const Slice& begin,
+                             const Slice& end) = 0;
+
+  // 为 "key" 写入一个合并操作数，读取时由 Options::merge_operator
+  // 将它与键的已有值合并，无需先读出旧值。成功时返回 OK。
+  // 未配置 merge_operator 时返回 NotSupported。
+  virtual Status Merge(const WriteOptions& options, const Slice& key,
+                       const Slice& value) = 0;
+
   // 将指定的更新应用到数据库。
   // 成功时返回 OK，失败时返回非 OK 状态。
   // 注意：考虑将 options.sync 设置为 true。
@@ -99,6 +128,7 @@ class LEVELDB_EXPORT DB {
   //  "leveldb.sstables" - 返回一个多行字符串，描述组成数据库内容的所有
   //  sstables。 "leveldb.approximate-memory-usage" - 返回 DB
   //  使用的大致内存字节数。
+  //  "leveldb.blob-stats" - 返回 blob 文件的数量、总字节数与垃圾字节数。
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // 对于 [0,n-1] 中的每个 i，将 "[range[i].start .. range[i].limit)"
@@ -120,6 +150,30 @@ class LEVELDB_EXPORT DB {
   // 因此，以下调用将压缩整个数据库：
   //    db->CompactRange(nullptr, nullptr);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
+
+  // 将用公开的 TableBuilder（使用与数据库相同的比较器）生成的表文件
+  // 直接导入数据库，不经过日志与 memtable。
+  // 每个文件中的键必须严格递增，文件之间的键范围不能重叠。
+  // 导入的数据共用一个新的序列号，比导入前写入的数据都新；每个文件被放到
+  // 与其键范围不重叠的最深层级。只有刷写重叠的 memtable 与安装文件时
+  // 短暂阻塞写入，转换文件期间的写入比导入的数据新。如果这期间写入同一
+  // 范围的数据已被压缩到 level-1 及以下，或这期间创建的快照仍未释放，
+  // 则阻塞写入并用新的序列号重新转换文件，导入的数据比这些写入新。
+  // 原文件不会被修改或删除。任一文件不合法时返回 InvalidArgument，不导入任何文件。
+  virtual Status IngestExternalFile(const std::vector<std::string>& files) = 0;
+
+  // 在目录 "checkpoint_dir" 中创建数据库当前状态的一致副本，可以直接用
+  // DB::Open 打开。不可变的表文件以硬链接共享（不支持时复制），MANIFEST 与
+  // 日志复制当前内容。创建期间写入只会短暂阻塞。
+  // "checkpoint_dir" 不能已经存在。
+  virtual Status CreateCheckpoint(const std::string& checkpoint_dir) = 0;
+
+  // 返回恢复数据库当前状态所需的全部文件：表文件、blob 文件、MANIFEST 与仍需
+  // 重放的日志（不含 CURRENT）。按返回的长度复制这些文件，再写入指向该 MANIFEST
+  // 的 CURRENT，即得到一致的副本。没有写入日志的数据会先被刷写。
+  // 成功时暂停删除过期文件，调用者复制完毕后必须调用 ReleaseLiveFiles()。
+  virtual Status GetLiveFiles(std::vector<LiveFile>* files) = 0;
+  virtual void ReleaseLiveFiles() = 0;
 };
 
 // ?
@@ -128,7 +182,7 @@ class LEVELDB_EXPORT DB {
 //
 // 注意：为了向后兼容，如果 DestroyDB 无法列出数据库文件，仍将返回
 // Status::OK()，掩盖此失败。
-LEVELDB_EXPORT Status DestoryDB(const std::string& name,
+LEVELDB_EXPORT Status DestroyDB(const std::string& name,
                                 const Options& options);
 
 // 如果无法打开数据库，您可以尝试调用此方法尽可能恢复数据库的内容。
@@ -82,6 +82,11 @@ class LEVELDB_EXPORT Env {
   virtual Status RenameFile(const std::string& src,
                             const std::string& target) = 0;
 
+  // 为已有文件 src 创建硬链接 target，target 已存在时失败。
+  //
+  // 环境可能不支持硬链接，此时返回 NotSupported。
+  virtual Status LinkFile(const std::string& src, const std::string& target);
+
   // 锁定指定的文件。用于防止并发访问。失败时，将nullptr存储在*lock并返回非OK。
   //
   // 成功后，指向获取的锁的指针存储在*lock中，返回OK。调用者应调用UnlockFile(*lock)以解锁。如果该过程退出，锁将自动解锁。
@@ -244,6 +249,9 @@ class EnvWrapper : public Env {
   Status RenameFile(const std::string& s, const std::string& t) override {
     return target_->RenameFile(s, t);
   }
+  Status LinkFile(const std::string& s, const std::string& t) override {
+    return target_->LinkFile(s, t);
+  }
   Status LockFile(const std::string& f, FileLock** l) override {
     return target_->LockFile(f, l);
   }
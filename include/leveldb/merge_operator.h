@@ -0,0 +1,42 @@
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+// 数据库可以配置一个自定义的 MergeOperator 对象，以支持 DB::Merge()。
+// Merge 写入的是一个 "操作数"，而不是完整的值；读取或压缩时，leveldb
+// 调用 MergeOperator 把键的已有值与之后写入的所有操作数合并为新值。
+// 这样计数器累加、列表追加之类的读-改-写操作只需一次写入，
+// 不再需要先 Get 再 Put。
+//
+// MergeOperator 的实现必须是线程安全的，且结果只能取决于参数。
+
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // 返回此合并操作的名称。
+  virtual const char* Name() const = 0;
+
+  // 将 "operands"（按写入顺序，从旧到新）依次应用到 "key" 的已有值上，
+  // 结果存入 *new_value。existing_value 为 nullptr 表示键之前不存在或已被删除。
+  // 返回 false 表示操作数无法合并，对应的读取会返回 Corruption 错误。
+  virtual bool FullMerge(const Slice& key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+
+  // 在没有已有值的情况下，把多个操作数（从旧到新）合并为一个等价的操作数，
+  // 存入 *new_operand。压缩时用它缩短无法完全合并的操作数序列。
+  // 不支持时返回 false，操作数会原样保留。默认实现返回 false。
+  virtual bool PartialMerge(const Slice& key, const std::vector<Slice>& operands,
+                            std::string* new_operand) const;
+};
+
+}  // namespace leveldb
+
+#endif
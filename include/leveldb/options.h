@@ -2,16 +2,20 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
 
 #include "leveldb/export.h"
 
 namespace leveldb {
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
 class Snapshot;  // TODO
+class WriteBufferManager;
 
 // DB contents are stored in a set of blocks, each of which holds a
 // sequence of key,value pairs.  Each block may be compressed before
@@ -23,6 +27,38 @@ enum CompressionType {
   kZstdCompression = 0x2,
 };
 
+// 压缩风格。kCompactionStyleLevel 为默认的分层压缩；
+// kCompactionStyleFIFO 从不合并文件，所有表文件都停留在 level-0，
+// 超出容量或存活时间的最旧文件会被直接删除，适用于按时间保留的数据。
+enum CompactionStyle {
+  kCompactionStyleLevel = 0x0,
+  kCompactionStyleFIFO = 0x1,
+};
+
+// 分层压缩时，在一个层级内选择输入文件的策略。
+enum CompactionPri {
+  // 按 compact_pointer 在键空间中轮转选择
+  kByCompactPointer = 0x0,
+  // 选择与下一层重叠字节数 / 自身大小最小的文件，
+  // 删除标记比例越高的文件越优先
+  kMinOverlappingRatio = 0x1,
+};
+
+// memtable 的存储结构。
+enum MemTableRepType {
+  // 跳表，适合各种读写模式
+  kSkipListRep = 0x0,
+  // 按用户键的前 memtable_prefix_length 字节哈希到多个跳表，点查只需搜索
+  // 一个较小的跳表；完整遍历（包括刷写）时需要先排序全部条目
+  kHashSkipListRep = 0x1,
+  // 以用户键为键的自适应基数树，点查按字节逐层查找，无需比较完整的键。
+  // 要求 comparator 为 BytewiseComparator()，否则使用跳表
+  kRadixTreeRep = 0x2,
+  // 只追加的数组，插入时不做比较，适合写完之前没有读取的批量导入。
+  // 读取时按需排序并加锁，memtable 落盘时并行排序一次
+  kVectorRep = 0x3,
+};
+
 // 控制数据库行为的选项(passed to DB::Open)
 struct LEVELDB_EXPORT Options {
   // 默认选项
@@ -65,10 +101,70 @@ struct LEVELDB_EXPORT Options {
   // 此外，较大的写缓冲区将导致下次打开数据库时恢复时间更长。
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // 如果非空，memtable 的内存记入这个与其他数据库共享的预算，总量超出
+  // 预算时提前切换 memtable 并落盘，参见 WriteBufferManager。
+  // 不接管所有权，它必须比使用它的数据库活得久。
+  WriteBufferManager* write_buffer_manager = nullptr;
+
+  // memtable 中点数据的存储结构，见 MemTableRepType。
+  MemTableRepType memtable_rep = kSkipListRep;
+
+  // kHashSkipListRep 用于选择哈希桶的用户键前缀长度，较短的键使用整个键。
+  size_t memtable_prefix_length = 8;
+
+  // memtable 每次向系统申请的内存块大小。为 0 时取 write_buffer_size 的
+  // 1/8，并限制在 [4KB, 2MB] 之间。
+  size_t arena_block_size = 0;
+
+  // 如果为 true，memtable 以 2MB 大页为单位（块大小向上取整）通过 mmap
+  // 申请内存：先尝试 MAP_HUGETLB，失败则使用普通映射并建议内核使用
+  // 透明大页，以减少 SkipList 遍历时的 TLB 缺失。仅在 Linux 上生效，
+  // 适合较大的 write_buffer_size。
+  bool memtable_huge_page = false;
+
+  // 如果为 true，memtable 申请的内存优先放在申请时写入线程所在的
+  // NUMA 节点上。仅在 Linux 上生效。
+  bool memtable_numa_aware = false;
+
   // 数据库可以使用的打开文件数量。如果您的数据库有大量工作集，
   // 您可能需要增加此值（每 2MB 工作集预算一个打开文件）。
   int max_open_files = 1000;
 
+  // MANIFEST 超过此长度后切换到新文件，新文件以当前版本的快照开头，
+  // 避免打开数据库时重放过多的记录。
+  uint64_t max_manifest_file_size = 64 * 1024 * 1024;
+
+  // 同步写入的组提交窗口。队列头部的同步写入在写日志前最多等待这么多
+  // 微秒，让更多写入加入同一组、共用一次 Sync。实际等待时间取此值与
+  // 测得的 Sync 平均耗时中较小的一个，并且只在最近的同步写入确实有并发
+  // 时等待。为 0 时不等待。
+  uint64_t group_commit_max_delay_micros = 0;
+
+  // 组提交窗口内排队的写入达到此字节数时不再等待。
+  size_t group_commit_max_bytes = 64 * 1024;
+
+  // 如果为 true，DB::Open 返回前用 max_file_opening_threads 个线程并行
+  // 打开表文件（读取 footer、索引与过滤器），按层级从低到高，最多打开
+  // 表缓存能容纳的数量，避免重启后首次读取每个文件时的延迟。
+  bool prefetch_tables_on_open = false;
+
+  // 打开数据库时并行打开表文件的线程数。
+  int max_file_opening_threads = 16;
+
+  // 表的索引与过滤器随表一起保存在表缓存中。如果为 true，level-0 与
+  // level-1 文件的表缓存条目不会被 LRU 换出，直到文件离开这两层。
+  // 这些条目仍计入 max_open_files。与 cache_index_and_filter_blocks
+  // 同时使用时，这些文件的索引与过滤器块也常驻 block_cache。
+  bool pin_l0_l1_index_and_filter = false;
+
+  // 如果为 true，表的索引与过滤器块以高优先级存放在 block_cache 中，
+  // 而不是在表打开期间一直占用单独的堆内存，这样它们也计入 block_cache
+  // 的容量，所有表的读缓存内存由同一个预算约束。容量不足时先淘汰数据块。
+  // 代价是每次读取多一次缓存查找，缓存过小时还要重新读取索引。
+  // 分区索引（参见 index_partition_size）只有各分区放在 block_cache 中，
+  // 较小的顶层索引仍随表常驻。
+  bool cache_index_and_filter_blocks = false;
+
   // 控制块（用户数据存储在一组块中，块是从磁盘读取的单位）。
 
   // 如果非空，使用指定的缓存来存储块。
@@ -91,6 +187,13 @@ struct LEVELDB_EXPORT Options {
   // 另一个增加此参数的原因可能是在最初填充大型数据库时。
   size_t max_file_size = 2 * 1024 * 1024;
 
+  // 为 0 时每个表的索引是一个块，打开表时整块读入。大于 0 时索引按
+  // 这个大小切成多个分区，另写一个指向各分区的顶层索引：打开表只读
+  // 顶层索引，分区在查找时经 block_cache 按需读取。适合 max_file_size
+  // 较大、单个索引块达到数 MB 的情况。只有一个分区的表仍写成单块索引。
+  // 分区索引的表不能被不支持该格式的旧版本读取。此参数可以动态更改。
+  size_t index_partition_size = 0;
+
   // 使用指定的压缩算法压缩块。此参数可以动态更改。
   //
   // 默认值：kSnappyCompression，提供轻量但快速的压缩。
@@ -118,6 +221,50 @@ struct LEVELDB_EXPORT Options {
   // 如果非空，使用指定的过滤策略来减少磁盘读取。
   // 许多应用程序将受益于在此传递 NewBloomFilterPolicy() 的结果。
   const FilterPolicy* filter_policy = nullptr;
+
+  // 如果非空，用于合并 DB::Merge() 写入的操作数，参见 merge_operator.h。
+  // 打开一个含有合并操作数的数据库时，必须使用与写入时相同的合并操作。
+  const MergeOperator* merge_operator = nullptr;
+
+  // 如果非空，压缩时对存活的值调用此过滤器，以删除或改写它们，
+  // 参见 compaction_filter.h。
+  const CompactionFilter* compaction_filter = nullptr;
+
+  // 分层压缩时层级内的文件选择策略，参见 CompactionPri。
+  CompactionPri compaction_pri = kByCompactPointer;
+
+  // 如果大于 0，删除标记占条目数比例不小于此值的文件会在没有其他压缩
+  // 需要执行时被单独压缩到下一层，使删除标记尽早被清理，
+  // 避免范围扫描反复跳过大量已删除的键。0 表示禁用。
+  double tombstone_compaction_ratio = 0;
+
+  // 压缩风格，参见 CompactionStyle。
+  // 注意：FIFO 风格下最旧的数据会被无条件丢弃，且写入不会因 level-0
+  // 文件过多而被限速，因此只适合可以容忍数据过期的场景。
+  // 以 FIFO 风格打开时，所有表文件必须都在 level-0，否则返回
+  // InvalidArgument；分层风格的数据库需要先整理后再切换。
+  CompactionStyle compaction_style = kCompactionStyleLevel;
+
+  // 仅用于 kCompactionStyleFIFO：所有表文件的总大小上限。
+  // 超过后从最旧的文件开始删除，直到总大小不超过此值。
+  uint64_t fifo_max_table_files_size = 1024 * 1024 * 1024;
+
+  // 仅用于 kCompactionStyleFIFO：表文件的最长存活时间（秒），
+  // 以文件创建时间计算。0 表示不按时间删除。
+  // 过期检查在写入、读取与打开数据库时进行，完全没有访问的数据库
+  // 在下一次访问时才删除过期文件。
+  uint64_t fifo_ttl_seconds = 0;
+
+  // 键值分离：如果大于 0，memtable 落盘与压缩输出时，不小于此字节数的值
+  // 写入独立的 blob 文件，sstable 中只保存指向它的索引，以减少压缩时
+  // 搬运大 value 的写放大。读取时会透明地取回真实值。0 表示禁用。
+  // FIFO 压缩风格下不进行分离。
+  size_t min_blob_size = 0;
+
+  // 压缩遇到垃圾字节比例不小于此值的 blob 文件中的存活记录时，
+  // 将其重写到新的 blob 文件中，使旧文件尽快全部成为垃圾并被删除。
+  // 大于 1 表示从不重写。
+  double blob_gc_ratio = 0.5;
 };
 
 // 控制数据库读取操作的选项
@@ -150,6 +297,11 @@ struct LEVELDB_EXPORT WriteOptions {
   // sync==true 的数据库写入具有类似于 "write()" 系统调用后跟 "fsync()"
   // 的崩溃语义。
   bool sync = false;
+
+  // 如果为 true，该写入不记录到日志文件，只写入 memtable。
+  // 在 memtable 被刷到磁盘之前进程或机器崩溃会丢失这些写入；正常关闭数据库
+  // 时会先刷写 memtable。适用于可以重新执行的批量导入。
+  bool disable_wal = false;
 };
 
 }  // namespace leveldb
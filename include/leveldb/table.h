@@ -3,6 +3,7 @@
 
 #include <cstdint>
 
+#include "leveldb/cache.h"
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 
@@ -37,6 +38,10 @@ class LEVELDB_EXPORT Table {
   // 的结果最初是无效的（调用者必须在使用迭代器之前调用其中一个Seek 方法）。
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // 返回一个新的迭代器，遍历表中的范围删除标记。
+  // 没有范围删除标记的表返回空迭代器。
+  Iterator* NewRangeTombstoneIterator() const;
+
   // 给定一个键，返回文件中该键的数据开始（或如果键存在于文件中将开始）的近似字节偏移量。返回值以文件字节为单位，因此包括底层数据压缩等影响。
   // 例如，表中最后一个键的近似偏移量将接近文件长度。
   uint64_t ApproximateOffsetOf(const Slice& key) const;
@@ -46,6 +51,8 @@ class LEVELDB_EXPORT Table {
   struct Rep;
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
 
   explicit Table(Rep* rep) : rep_(rep) {}
   // 在调用 Seek(key) 后，使用找到的条目调用 (*handle_result)(arg, ...)
@@ -54,8 +61,33 @@ class LEVELDB_EXPORT Table {
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
+  // footer 所指索引块的迭代器，分区索引时是顶层索引。索引放在
+  // block_cache 中时，迭代器持有缓存引用
+  Iterator* NewIndexBlockIterator() const;
+
+  // 值为数据块 BlockHandle 的索引迭代器。分区索引时是顶层索引与
+  // 各分区组成的两级迭代器
+  Iterator* NewIndexIterator(const ReadOptions& options) const;
+
+  // 读取 index_value 所指的块并返回其迭代器。block_cache 非空时经缓存
+  // 读取，新读入的块以 priority 插入
+  Iterator* ReadBlockIterator(const ReadOptions& options,
+                              const Slice& index_value,
+                              Cache::Priority priority) const;
+
+  // 在 block_cache 中查找 handle 处的索引（或过滤器）块，不在缓存中时
+  // 读入并以高优先级插入。*result 由调用者释放。
+  // REQUIRES: rep_->meta_in_cache
+  Status GetMetaBlock(const BlockHandle& handle, bool is_filter,
+                      Cache::Handle** result) const;
+
+  // 索引与过滤器放在 block_cache 中时，持有（或放弃）它们的缓存引用，
+  // 使其不被淘汰。只在缓存中查找，不读文件。
+  void SetMetaBlocksPinned(bool pinned);
+
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadRangeDel(const Slice& range_del_handle_value);
 
   Rep* const rep_;
 };
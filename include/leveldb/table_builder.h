@@ -30,6 +30,12 @@ class LEVELDB_EXPORT TableBuilder {
   // 要求：未调用 Finish() 或 Abandon()
   void Add(const Slice& key, const Slice& value);
 
+  // 向表的范围删除标记块中添加一个条目。该块与数据块分开存放，
+  // 可通过 Table::NewRangeTombstoneIterator() 读出。
+  // 要求：根据比较器，键必须在先前添加的范围删除标记之后。
+  // 要求：未调用 Finish() 或 Abandon()
+  void AddRangeTombstone(const Slice& key, const Slice& value);
+
   // 高级操作：将任何缓冲的键/值对刷新到文件中。
   // 可用于确保两个相邻的条目永远不会存在于同一个数据块中。大多数客户端不需要使用此方法。
   // 要求：未调用 Finish() 或 Abandon()。
@@ -47,6 +53,9 @@ class LEVELDB_EXPORT TableBuilder {
   // 调用add的次数
   uint64_t NumEntries() const;
 
+  // 调用 AddRangeTombstone 的次数
+  uint64_t NumRangeTombstones() const;
+
   // 目前为止生成的文件大小。如果在成功调用 Finish()之后调用，则返回最终生成的文件大小。
   uint64_t FileSize() const;
 
@@ -54,6 +63,10 @@ class LEVELDB_EXPORT TableBuilder {
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  // 以 last_key 为键把 pending_handle 加入索引，分区已满时写出该分区
+  void AddIndexEntry();
+  // 写出当前的索引分区并在顶层索引中记录它
+  void FlushIndexPartition();
 
   struct Rep;
   Rep* rep_;
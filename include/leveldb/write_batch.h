@@ -29,6 +29,8 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    virtual void DeleteRange(const Slice& begin, const Slice& end) = 0;
+    virtual void Merge(const Slice& key, const Slice& value) = 0;
   };
 
   WriteBatch();
@@ -41,6 +43,13 @@ class LEVELDB_EXPORT WriteBatch {
 
   void Delete(const Slice& key);
 
+  // 删除用户键位于 [begin, end) 内的所有条目。begin >= end 时不删除任何数据。
+  void DeleteRange(const Slice& begin, const Slice& end);
+
+  // 为 "key" 写入一个合并操作数，读取时由 Options::merge_operator
+  // 与键的已有值合并。
+  void Merge(const Slice& key, const Slice& value);
+
   void Clear();
   // 由此批处理引起的数据库大小变化。
   //
@@ -0,0 +1,70 @@
+#ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BUFFER_MANAGER_H_
+#define STORAGE_LEVELDB_INCLUDE_WRITE_BUFFER_MANAGER_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+class Cache;
+
+// 多个数据库共享的 memtable 内存预算。通过 Options::write_buffer_manager
+// 交给各个数据库，它们把 memtable（包括等待落盘的不可变 memtable）占用的
+// 内存记在这里。总量超出预算时，正在写入的数据库即使 memtable 没有写满
+// write_buffer_size 也会切换并落盘，从而约束整个进程的 memtable 内存。
+// 这是软上限：不会阻塞写入，只会提前触发落盘。
+//
+// 如果 cache 非空，memtable 占用的内存以固定大小的占位条目计入 cache。
+// 占位条目一直被引用，不会被淘汰，块缓存可用的容量相应减少，
+// 块缓存与 memtable 就共用 cache 的容量。
+//
+// 线程安全。必须在所有使用它的数据库关闭之后再删除。
+class LEVELDB_EXPORT WriteBufferManager {
+ public:
+  // buffer_size 为 0 时不限制总量，只统计内存（以及计入 cache）。
+  // 不接管 cache 的所有权，cache 必须比 WriteBufferManager 活得久。
+  explicit WriteBufferManager(size_t buffer_size, Cache* cache = nullptr);
+
+  WriteBufferManager(const WriteBufferManager&) = delete;
+  WriteBufferManager& operator=(const WriteBufferManager&) = delete;
+
+  ~WriteBufferManager();
+
+  size_t buffer_size() const;
+
+  // 所有 memtable 占用的内存，包括等待落盘的不可变 memtable
+  size_t memory_usage() const;
+
+  // 其中仍在接受写入的 memtable 占用的内存
+  size_t mutable_memtable_memory_usage() const;
+
+  // 占位条目计入 cache 的总量，没有 cache 时为 0
+  size_t cache_charge() const;
+
+  // 可写的 memtable 超过预算的 7/8，或总量超出预算且可写部分占一半
+  // 以上时返回 true。不可变 memtable 已经在落盘，再切换也无济于事，
+  // 所以只看总量是不够的。
+  bool ShouldFlush() const;
+
+  // 以下由数据库内部调用
+
+  // 注册（注销）一个使用该预算的数据库
+  void RegisterDB();
+  void UnregisterDB();
+  int num_dbs() const;
+
+  // 可写的 memtable 新占用了 mem 字节
+  void ReserveMem(size_t mem);
+  // 可写的 memtable 变为不可变，其 mem 字节即将随落盘释放
+  void ScheduleFreeMem(size_t mem);
+  // memtable 被释放，归还 mem 字节
+  void FreeMem(size_t mem);
+
+ private:
+  struct Rep;
+  Rep* const rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_WRITE_BUFFER_MANAGER_H_
@@ -32,6 +32,7 @@
 // NOLINT 让代码分析工具略过，不发生告警
 
 #include <cassert>
+#include <chrono>  // NOLINT
 #include <condition_variable>  // NOLINT
 #include <cstddef>
 #include <cstdint>
@@ -76,6 +77,12 @@ public:
     // 释放所有权，但并不解锁
     lock.release();
   }
+  // 与 Wait 相同，但最多等待 micros 微秒
+  void TimedWait(uint64_t micros) {
+    std::unique_lock<std::mutex> lock(mu_->mu_, std::adopt_lock);
+    cv_.wait_for(lock, std::chrono::microseconds(micros));
+    lock.release();
+  }
   void Signal() {cv_.notify_one();}
   void SignalAll(){cv_.notify_all();}
 private:
@@ -38,6 +38,42 @@ Block::~Block() {
   }
 }
 
+// DecodeEntry 的慢速路径，条目头中有多字节 varint 时调用。
+// 最常见的是值长 128~16383 字节、只有 value_length 占 2 字节，直接拼出；
+// 其余情况下三个 varint 合计不超过 8 字节时，从同一次 8 字节读取中
+// 无分支地全部解出，否则逐个解析。
+// 单独成函数，使 DecodeEntry 足够小，能内联进迭代器的热循环。
+static const char* DecodeEntryHeaderSlow(const char* p, const char* limit,
+                                         uint32_t* shared,
+                                         uint32_t* non_shared,
+                                         uint32_t* value_length) {
+  const uint8_t* u = reinterpret_cast<const uint8_t*>(p);
+  if (limit - p >= 4 && (u[0] | u[1]) < 128 && u[3] < 128) {
+    *value_length = (u[2] & 127) | (static_cast<uint32_t>(u[3]) << 7);
+    return p + 4;
+  }
+  if (limit - p >= 8) {
+    uint64_t word = DecodeFixed64(p);
+    const int n1 = DecodeVarint32Word(word, shared);
+    word >>= 8 * n1;  // n1 <= 5
+    const int n2 = DecodeVarint32Word(word, non_shared);
+    if (n1 != 0 && n2 != 0 && n1 + n2 < 8) {
+      word >>= 8 * n2;
+      const int n3 = DecodeVarint32Word(word, value_length);
+      if (n3 != 0 && n1 + n2 + n3 <= 8) {
+        return p + n1 + n2 + n3;
+      }
+    }
+  }
+  if ((p = GetVarint32Ptr(p, limit, shared)) == nullptr) {
+    return nullptr;
+  }
+  if ((p = GetVarint32Ptr(p, limit, non_shared)) == nullptr) {
+    return nullptr;
+  }
+  return GetVarint32Ptr(p, limit, value_length);
+}
+
 // 辅助例程：从 "p" 开始解码下一个块条目，
 // 分别将共享键字节数、非共享键字节数和值的长度存储在
 // "*shared"、"*non_shared" 和 "*value_length" 中。不会解引用超过 "limit"
@@ -59,16 +95,9 @@ static inline const char* DecodeEntry(const char* p, const char* limit,
   // 判断方式是最高位是否为1
   if ((*shared | *non_shared | *value_length) < 128) {
     p += 3;
-  } else {
-    if ((p = GetVarint32Ptr(p, limit, shared)) == nullptr) {
-      return nullptr;
-    }
-    if ((p = GetVarint32Ptr(p, limit, non_shared)) == nullptr) {
-      return nullptr;
-    }
-    if ((p = GetVarint32Ptr(p, limit, value_length)) == nullptr) {
-      return nullptr;
-    }
+  } else if ((p = DecodeEntryHeaderSlow(p, limit, shared, non_shared,
+                                        value_length)) == nullptr) {
+    return nullptr;
   }
   // 不够读取存放的key_delta的长度了
   if (static_cast<uint32_t>(limit - p) < (*non_shared + *value_length)) {
@@ -84,7 +113,9 @@ class Block::Iter : public Iterator {
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
-        num_restarts_(num_restarts) {
+        num_restarts_(num_restarts),
+        current_(restarts_),
+        restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
   }
 
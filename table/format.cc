@@ -29,7 +29,8 @@ void Footer::EncodeTo(std::string* dst) const {
   dst->resize(2 * BlockHandle::kMaxEncodedLength);
   // PutFixed32(dst,static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
   // PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
-  PutFixed64(dst, kTableMagicNumber);
+  PutFixed64(dst, partitioned_index_ ? kPartitionedIndexMagicNumber
+                                    : kTableMagicNumber);
   assert(dst->size() == original_size + kEncodedLength);
   (void)original_size;  // Disable unused variable warning.
 }
@@ -46,9 +47,10 @@ Status Footer::DecodeFrom(Slice* input) {
   // const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
   //                         (static_cast<uint64_t>(magic_lo)));
   const uint64_t magic = DecodeFixed64(magic_ptr);
-  if (magic != kTableMagicNumber) {
+  if (magic != kTableMagicNumber && magic != kPartitionedIndexMagicNumber) {
     return Status::Corruption("not an sstable (footer too short)");
   }
+  partitioned_index_ = (magic == kPartitionedIndexMagicNumber);
   Status result = metaindex_handle_.DecodeFrom(input);
   if (result.ok()) {
     result = index_handle_.DecodeFrom(input);
@@ -13,6 +13,9 @@ class Block;
 class RandomAccessFile;
 struct ReadOptions;
 
+// metaindex 中指向范围删除标记块的键
+static const char kRangeDelBlockName[] = "leveldb.rangedel";
+
 class BlockHandle {
  public:
   // 一个BlockHandle长度编码后的最大值
@@ -49,12 +52,17 @@ class Footer {
   const BlockHandle& index_handle() const { return index_handle_; }
   void set_index_handle(const BlockHandle& h) { index_handle_ = h; }
 
+  // 为 true 时 index_handle 指向顶层索引，其值是索引分区的 BlockHandle
+  bool partitioned_index() const { return partitioned_index_; }
+  void set_partitioned_index(bool b) { partitioned_index_ = b; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool partitioned_index_ = false;
 };
 
 // kTableMagicNumber was picked by running
@@ -62,6 +70,10 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// 使用分区索引的表换用另一个魔数，不认识分区索引的旧版本打开时报错，
+// 而不是把索引分区当作数据块读取
+static const uint64_t kPartitionedIndexMagicNumber = 0xdb4775248b80fb58ull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
@@ -1,11 +1,16 @@
 #include "table/merger.h"
 
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/iterator.h"
 #include "table/iterator_wrapper.h"
 
 namespace leveldb {
 namespace {
+// 有效的子迭代器组成二叉堆，堆顶即 current_：正向时是最小堆，反向时是
+// 最大堆。Next/Prev 只移动堆顶再下沉一次，比较次数为 O(log n)，
+// 不必每一步都与全部 n 个子迭代器比较。
 class MergingIterator : public Iterator {
  public:
   MergingIterator(const Comparator* comparator, Iterator** children, int n)
@@ -17,6 +22,7 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
     }
+    heap_.reserve(n);
   }
 
   ~MergingIterator() override { delete[] children_; }
@@ -27,24 +33,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   void SeekToLast() override {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    BuildHeap();
   }
 
   void Seek(const Slice& target) override {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();  // kForward时current_是最小的迭代器
     direction_ = kForward;
+    BuildHeap();  // kForward时current_是最小的迭代器
   }
 
   void Next() override {
@@ -52,7 +58,7 @@ class MergingIterator : public Iterator {
     // 确保所有子迭代器都定位在 key() 之后。
     // 如果我们在向前移动，对于所有非 current_ 的子迭代器来说，这已经是正确的，
     // 因为 current_ 是最小的子迭代器，并且 key() == current_->key()。否则，
-    // 我们需要显式地定位非 current_ 的子迭代器。
+    // 我们需要显式地定位非 current_ 的子迭代器，并按新方向重建堆。
     if (direction_ != kForward) {
       for (int i = 0; i < n_; i++) {
         IteratorWrapper* child = &children_[i];
@@ -66,10 +72,13 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kForward;
+      current_->Next();
+      BuildHeap();
+      return;
     }
     current_->Next();
     // 所有迭代器都至少比key()后一位
-    FindSmallest();
+    ReplaceTop();
   }
 
   void Prev() override {
@@ -96,10 +105,13 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      current_->Prev();
+      BuildHeap();
+      return;
     }
 
     current_->Prev();
-    FindLargest();
+    ReplaceTop();
   }
 
   Slice key() const override {
@@ -126,44 +138,74 @@ class MergingIterator : public Iterator {
  private:
   enum Direction { kForward, kReverse };
 
-  void FindSmallest();
-  void FindLargest();
+  // 按当前方向 a 是否应排在 b 之前。键相同时正向取下标小的子迭代器、
+  // 反向取下标大的，与逐个扫描的结果一致。
+  bool Before(const IteratorWrapper* a, const IteratorWrapper* b) const {
+    const int r = comparator_->Compare(a->key(), b->key());
+    if (r != 0) {
+      return (direction_ == kForward) ? (r < 0) : (r > 0);
+    }
+    return (direction_ == kForward) ? (a < b) : (a > b);
+  }
+
+  void BuildHeap();
+  void ReplaceTop();
+  void SiftDown(size_t i);
 
   const Comparator* comparator_;
   IteratorWrapper* children_;
   int n_;
   IteratorWrapper* current_;
   Direction direction_;
+  std::vector<IteratorWrapper*> heap_;  // 有效的子迭代器，heap_[0] 即 current_
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = nullptr;
+// 用所有有效的子迭代器按 direction_ 重建堆
+void MergingIterator::BuildHeap() {
+  heap_.clear();
   for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == nullptr) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
+    if (children_[i].Valid()) {
+      heap_.push_back(&children_[i]);
     }
   }
-  current_ = smallest;
+  for (size_t i = heap_.size() / 2; i > 0; i--) {
+    SiftDown(i - 1);
+  }
+  current_ = heap_.empty() ? nullptr : heap_[0];
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = nullptr;
-  for (int i = n_ - 1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == nullptr) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
-      }
+// 堆顶移动后恢复堆序，失效的迭代器移出堆
+void MergingIterator::ReplaceTop() {
+  if (!current_->Valid()) {
+    heap_[0] = heap_.back();
+    heap_.pop_back();
+  }
+  if (heap_.empty()) {
+    current_ = nullptr;
+    return;
+  }
+  SiftDown(0);
+  current_ = heap_[0];
+}
+
+void MergingIterator::SiftDown(size_t i) {
+  const size_t n = heap_.size();
+  IteratorWrapper* item = heap_[i];
+  while (true) {
+    size_t child = 2 * i + 1;
+    if (child >= n) {
+      break;
+    }
+    if (child + 1 < n && Before(heap_[child + 1], heap_[child])) {
+      child++;
+    }
+    if (!Before(heap_[child], item)) {
+      break;
     }
+    heap_[i] = heap_[child];
+    i = child;
   }
-  current_ = largest;
+  heap_[i] = item;
 }
 }  // namespace
 
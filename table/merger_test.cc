@@ -0,0 +1,188 @@
+#include "table/merger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+namespace {
+
+// 遍历有序 vector 的迭代器
+class VectorIterator : public Iterator {
+ public:
+  VectorIterator(const std::vector<std::string>& keys,
+                 const std::vector<std::string>& values)
+      : keys_(keys), values_(values), pos_(keys.size()) {}
+
+  bool Valid() const override { return pos_ < keys_.size(); }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override {
+    pos_ = keys_.empty() ? keys_.size() : keys_.size() - 1;
+  }
+  void Seek(const Slice& target) override {
+    pos_ = std::lower_bound(keys_.begin(), keys_.end(), target.ToString()) -
+           keys_.begin();
+  }
+  void Next() override {
+    assert(Valid());
+    pos_++;
+  }
+  void Prev() override {
+    assert(Valid());
+    pos_ = (pos_ == 0) ? keys_.size() : pos_ - 1;
+  }
+  Slice key() const override { return keys_[pos_]; }
+  Slice value() const override { return values_[pos_]; }
+  Status status() const override { return Status::OK(); }
+
+ private:
+  const std::vector<std::string> keys_;
+  const std::vector<std::string> values_;
+  size_t pos_;
+};
+
+// 统计比较次数的字典序比较器
+class CountingComparator : public Comparator {
+ public:
+  CountingComparator() : count_(0) {}
+  const char* Name() const override { return "CountingComparator"; }
+  int Compare(const Slice& a, const Slice& b) const override {
+    count_++;
+    return a.compare(b);
+  }
+  void FindShortestSeparator(std::string*, const Slice&) const override {}
+  void FindShortSuccessor(std::string*) const override {}
+  size_t count() const { return count_; }
+
+ private:
+  mutable size_t count_;
+};
+
+std::string Key(int i) {
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "%08d", i);
+  return buf;
+}
+
+}  // namespace
+
+TEST(MergerTest, RandomOperations) {
+  Random rnd(test::RandomSeed());
+  for (int n : {2, 3, 7, 16, 40}) {
+    // 每个键随机分到一个子迭代器，有的子迭代器为空
+    const int total = 500;
+    std::vector<std::vector<std::string>> keys(n);
+    std::vector<std::string> model;
+    for (int i = 0; i < total; i++) {
+      const std::string key = Key(i * 2);
+      keys[rnd.Uniform(n)].push_back(key);
+      model.push_back(key);
+    }
+    std::vector<Iterator*> children;
+    for (int c = 0; c < n; c++) {
+      children.push_back(new VectorIterator(keys[c], keys[c]));
+    }
+    Iterator* iter =
+        NewMergingIterator(BytewiseComparator(), &children[0], n);
+
+    size_t pos = model.size();  // model.size() 表示无效
+    for (int step = 0; step < 5000; step++) {
+      const int op = rnd.Uniform(pos == model.size() ? 3 : 6);
+      switch (op) {
+        case 0:
+          iter->SeekToFirst();
+          pos = 0;
+          break;
+        case 1:
+          iter->SeekToLast();
+          pos = model.size() - 1;
+          break;
+        case 2: {
+          const std::string target = Key(rnd.Uniform(total * 2 + 2));
+          iter->Seek(target);
+          pos = std::lower_bound(model.begin(), model.end(), target) -
+                model.begin();
+          break;
+        }
+        case 3:
+        case 4:
+          iter->Next();
+          pos++;
+          break;
+        default:
+          iter->Prev();
+          pos = (pos == 0) ? model.size() : pos - 1;
+          break;
+      }
+      ASSERT_EQ(pos != model.size(), iter->Valid()) << n << " " << step;
+      if (iter->Valid()) {
+        ASSERT_EQ(model[pos], iter->key().ToString());
+      }
+    }
+    delete iter;
+  }
+}
+
+TEST(MergerTest, DuplicateKeysOrderedByChild) {
+  // 相同的键正向按子迭代器下标从小到大产出，反向从大到小
+  const int n = 5;
+  std::vector<Iterator*> children;
+  for (int c = 0; c < n; c++) {
+    std::vector<std::string> keys, values;
+    for (int i = 0; i < 10; i++) {
+      keys.push_back(Key(i));
+      values.push_back(Key(i) + "@" + std::to_string(c));
+    }
+    children.push_back(new VectorIterator(keys, values));
+  }
+  Iterator* iter = NewMergingIterator(BytewiseComparator(), &children[0], n);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), count++) {
+    ASSERT_EQ(Key(count / n) + "@" + std::to_string(count % n),
+              iter->value().ToString());
+  }
+  ASSERT_EQ(10 * n, count);
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count--;
+    ASSERT_EQ(Key(count / n) + "@" + std::to_string(count % n),
+              iter->value().ToString());
+  }
+  ASSERT_EQ(0, count);
+  delete iter;
+}
+
+TEST(MergerTest, LogarithmicComparisons) {
+  // 64 个子迭代器交错存放键，逐个扫描每一步需要 63 次比较
+  const int n = 64;
+  const int per_child = 100;
+  std::vector<Iterator*> children;
+  for (int c = 0; c < n; c++) {
+    std::vector<std::string> keys;
+    for (int i = 0; i < per_child; i++) {
+      keys.push_back(Key(i * n + c));
+    }
+    children.push_back(new VectorIterator(keys, keys));
+  }
+  CountingComparator cmp;
+  Iterator* iter = NewMergingIterator(&cmp, &children[0], n);
+  iter->SeekToFirst();
+  const size_t start = cmp.count();
+  int count = 0;
+  for (; iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(n * per_child, count);
+  // 每一步最多下沉 log2(64) = 6 层，每层 2 次比较
+  ASSERT_LE(cmp.count() - start, static_cast<size_t>(count) * 12);
+  delete iter;
+}
+
+}  // namespace leveldb
@@ -1,19 +1,30 @@
 #include "leveldb/table.h"
 
+#include <cstring>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 struct Table::Rep {
-  ~Rep() {}
+  ~Rep() {
+    delete filter;
+    delete[] filter_data;
+    delete index_block;
+    delete range_del_block;
+  }
+
   Options options;
   Status status;
   RandomAccessFile* file;
@@ -23,8 +34,58 @@ struct Table::Rep {
 
   BlockHandle metaindex_handle;
   Block* index_block;
+  // 为 true 时 index_block 是顶层索引，值指向各索引分区
+  bool partitioned_index;
+  Block* range_del_block;  // 范围删除标记，没有则为 nullptr
+
+  // 为 true 时索引与过滤器块存放在 block_cache 中，filter 为空，只记录
+  // 块的位置。分区索引只有分区放在缓存中，较小的顶层索引仍常驻
+  // index_block，关闭表时用它找到要移除的分区；否则 index_block 为空
+  bool meta_in_cache;
+  BlockHandle index_handle;
+  BlockHandle filter_handle;
+  bool has_filter;
+
+  // 常驻时持有的缓存引用，使索引与过滤器块不被淘汰
+  port::Mutex pin_mutex;
+  bool pin_meta GUARDED_BY(pin_mutex);
+  Cache::Handle* pinned_index GUARDED_BY(pin_mutex);
+  Cache::Handle* pinned_filter GUARDED_BY(pin_mutex);
+};
+
+namespace {
+
+// 缓存中的过滤器块
+struct CachedFilter {
+  FilterBlockReader* reader;
+  const char* data;
 };
 
+void DeleteCachedFilter(const Slice& key, void* value) {
+  CachedFilter* filter = reinterpret_cast<CachedFilter*>(value);
+  delete filter->reader;
+  delete[] filter->data;
+  delete filter;
+}
+
+void ReleaseBlock(void* arg, void* h) {
+  Cache* cache = reinterpret_cast<Cache*>(arg);
+  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
+  cache->Release(handle);
+}
+
+void DeleteCachedIndex(const Slice& key, void* value) {
+  delete reinterpret_cast<Block*>(value);
+}
+
+// block_cache 中的键：cache_id 加块在文件中的偏移
+void EncodeBlockCacheKey(uint64_t cache_id, uint64_t offset, char* buf) {
+  EncodeFixed64(buf, cache_id);
+  EncodeFixed64(buf + 8, offset);
+}
+
+}  // namespace
+
 Status Table::Open(const Options& options, RandomAccessFile* file,
                    uint64_t size, Table** table) {
   *table = nullptr;
@@ -46,38 +107,162 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     return s;
   }
 
+  const bool meta_in_cache =
+      options.cache_index_and_filter_blocks && options.block_cache != nullptr;
+  const bool index_in_cache = meta_in_cache && !footer.partitioned_index();
   BlockContents index_block_contents;
-  ReadOptions opt;
-  if (options.paranoid_checks) {
-    opt.verify_checksums = true;
+  if (!index_in_cache) {
+    ReadOptions opt;
+    if (options.paranoid_checks) {
+      opt.verify_checksums = true;
+    }
+    s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
   }
-  s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
 
   if (s.ok()) {
-    Block* index_block = new Block(index_block_contents);
     Rep* rep = new Rep;
     rep->options = options;
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
-    rep->index_block = index_block;
+    rep->index_block =
+        index_in_cache ? nullptr : new Block(index_block_contents);
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = nullptr;
     rep->filter = nullptr;
-    *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    rep->partitioned_index = footer.partitioned_index();
+    rep->range_del_block = nullptr;
+    rep->meta_in_cache = meta_in_cache;
+    rep->index_handle = footer.index_handle();
+    rep->has_filter = false;
+    rep->pin_meta = false;
+    rep->pinned_index = nullptr;
+    rep->pinned_filter = nullptr;
+    Table* t = new Table(rep);
+    if (index_in_cache) {
+      // 现在就读入索引块：既检查它能否读取，也预热缓存
+      Cache::Handle* handle;
+      s = t->GetMetaBlock(rep->index_handle, false, &handle);
+      if (!s.ok()) {
+        delete t;
+        return s;
+      }
+      options.block_cache->Release(handle);
+    }
+    *table = t;
+    t->ReadMeta(footer);
   }
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
+Status Table::GetMetaBlock(const BlockHandle& handle, bool is_filter,
+                           Cache::Handle** result) const {
+  Cache* cache = rep_->options.block_cache;
+  char buf[16];
+  EncodeBlockCacheKey(rep_->cache_id, handle.offset(), buf);
+  const Slice key(buf, sizeof(buf));
+  *result = cache->Lookup(key);
+  if (*result != nullptr) {
+    return Status::OK();
+  }
+
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents contents;
+  Status s = ReadBlock(rep_->file, opt, handle, &contents);
+  if (!s.ok()) {
+    return s;
+  }
+  if (!contents.heap_allocated) {
+    // 指向 mmap 区域，缓存条目可能比文件活得久，复制一份
+    char* copy = new char[contents.data.size()];
+    std::memcpy(copy, contents.data.data(), contents.data.size());
+    contents.data = Slice(copy, contents.data.size());
+    contents.heap_allocated = true;
+  }
+
+  if (is_filter) {
+    CachedFilter* filter = new CachedFilter;
+    filter->data = contents.data.data();
+    filter->reader =
+        new FilterBlockReader(rep_->options.filter_policy, contents.data);
+    *result = cache->InsertWithPriority(key, filter, contents.data.size(),
+                                        &DeleteCachedFilter,
+                                        Cache::kHighPriority);
+  } else {
+    Block* block = new Block(contents);
+    *result = cache->InsertWithPriority(key, block, block->size(),
+                                        &DeleteCachedIndex,
+                                        Cache::kHighPriority);
+  }
+
+  MutexLock l(&rep_->pin_mutex);
+  Cache::Handle** pinned =
+      is_filter ? &rep_->pinned_filter : &rep_->pinned_index;
+  if (rep_->pin_meta && *pinned == nullptr) {
+    *pinned = cache->Lookup(key);
+  }
+  return s;
+}
+
+void Table::SetMetaBlocksPinned(bool pinned) {
+  if (!rep_->meta_in_cache) {
     return;
   }
+  Cache* cache = rep_->options.block_cache;
+  MutexLock l(&rep_->pin_mutex);
+  rep_->pin_meta = pinned;
+  if (pinned) {
+    // 只在缓存中查找，不读文件；不在缓存中的块在下次读入时常驻
+    char buf[16];
+    if (rep_->index_block == nullptr && rep_->pinned_index == nullptr) {
+      EncodeBlockCacheKey(rep_->cache_id, rep_->index_handle.offset(), buf);
+      rep_->pinned_index = cache->Lookup(Slice(buf, sizeof(buf)));
+    }
+    if (rep_->has_filter && rep_->pinned_filter == nullptr) {
+      EncodeBlockCacheKey(rep_->cache_id, rep_->filter_handle.offset(), buf);
+      rep_->pinned_filter = cache->Lookup(Slice(buf, sizeof(buf)));
+    }
+  } else {
+    if (rep_->pinned_index != nullptr) {
+      cache->Release(rep_->pinned_index);
+      rep_->pinned_index = nullptr;
+    }
+    if (rep_->pinned_filter != nullptr) {
+      cache->Release(rep_->pinned_filter);
+      rep_->pinned_filter = nullptr;
+    }
+  }
+}
 
-  // if (footer.metaindex_handle().size() == 0) {
-  //   return;
-  // }
+Iterator* Table::NewIndexBlockIterator() const {
+  if (rep_->index_block != nullptr) {
+    return rep_->index_block->NewIterator(rep_->options.comparator);
+  }
+  Cache* cache = rep_->options.block_cache;
+  Cache::Handle* handle;
+  Status s = GetMetaBlock(rep_->index_handle, false, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  Block* block = reinterpret_cast<Block*>(cache->Value(handle));
+  Iterator* iter = block->NewIterator(rep_->options.comparator);
+  iter->RegisterCleanup(&ReleaseBlock, cache, handle);
+  return iter;
+}
 
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  if (!rep_->partitioned_index) {
+    return NewIndexBlockIterator();
+  }
+  return NewTwoLevelIterator(NewIndexBlockIterator(),
+                             &Table::IndexPartitionReader,
+                             const_cast<Table*>(this), options);
+}
+
+void Table::ReadMeta(const Footer& footer) {
+  // 即使没有过滤策略，也需要读取 metaindex 以找到范围删除标记
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
@@ -89,11 +274,17 @@ void Table::ReadMeta(const Footer& footer) {
 
   Block* meta = new Block(contents);
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value());
+    }
+  }
+  iter->Seek(kRangeDelBlockName);
+  if (iter->Valid() && iter->key() == Slice(kRangeDelBlockName)) {
+    ReadRangeDel(iter->value());
   }
   delete iter;
   delete meta;
@@ -111,6 +302,17 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
     opt.verify_checksums = true;
   }
 
+  if (rep_->meta_in_cache) {
+    // 预热缓存；读取失败时与下面一样当作没有过滤器
+    Cache::Handle* handle;
+    if (GetMetaBlock(filter_handle, true, &handle).ok()) {
+      rep_->filter_handle = filter_handle;
+      rep_->has_filter = true;
+      rep_->options.block_cache->Release(handle);
+    }
+    return;
+  }
+
   BlockContents block;
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
@@ -122,7 +324,55 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
-Table::~Table() { delete rep_; }
+void Table::ReadRangeDel(const Slice& range_del_handle_value) {
+  Slice v = range_del_handle_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, handle, &block).ok()) {
+    return;
+  }
+  rep_->range_del_block = new Block(block);
+}
+
+Table::~Table() {
+  if (rep_->meta_in_cache) {
+    SetMetaBlocksPinned(false);
+    // 高优先级的条目要在所有低优先级条目之后才会被淘汰，表关闭后
+    // 不会再被访问，主动移除
+    Cache* cache = rep_->options.block_cache;
+    char buf[16];
+    if (rep_->has_filter) {
+      EncodeBlockCacheKey(rep_->cache_id, rep_->filter_handle.offset(), buf);
+      cache->Erase(Slice(buf, sizeof(buf)));
+    }
+    if (rep_->index_block == nullptr) {
+      EncodeBlockCacheKey(rep_->cache_id, rep_->index_handle.offset(), buf);
+      cache->Erase(Slice(buf, sizeof(buf)));
+    } else {
+      // 常驻的顶层索引，不需要读文件
+      Iterator* iter = rep_->index_block->NewIterator(rep_->options.comparator);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        Slice input = iter->value();
+        BlockHandle handle;
+        if (handle.DecodeFrom(&input).ok()) {
+          EncodeBlockCacheKey(rep_->cache_id, handle.offset(), buf);
+          cache->Erase(Slice(buf, sizeof(buf)));
+        }
+      }
+      delete iter;
+    }
+  }
+  delete rep_;
+}
 
 static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
@@ -132,17 +382,28 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete reinterpret_cast<Block*>(value);
 }
 
-static void ReleaseBlock(void* arg, void* h) {
-  Cache* cache = reinterpret_cast<Cache*>(arg);
-  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
-  cache->Release(handle);
-}
-
 // 将索引迭代器的值（即编码的 BlockHandle）转换为对应块内容的迭代器。
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
+  return table->ReadBlockIterator(options, index_value, Cache::kLowPriority);
+}
+
+// 将顶层索引的值转换为索引分区的迭代器。索引放在 block_cache 中时
+// 分区与索引块一样以高优先级缓存
+Iterator* Table::IndexPartitionReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  return table->ReadBlockIterator(options, index_value,
+                                  table->rep_->meta_in_cache
+                                      ? Cache::kHighPriority
+                                      : Cache::kLowPriority);
+}
+
+Iterator* Table::ReadBlockIterator(const ReadOptions& options,
+                                   const Slice& index_value,
+                                   Cache::Priority priority) const {
+  Cache* block_cache = rep_->options.block_cache;
   Block* block = nullptr;
   Cache::Handle* cache_handle = nullptr;
 
@@ -154,24 +415,23 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
     BlockContents contents;
     if (block_cache != nullptr) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer + 8, handle.offset());
+      EncodeBlockCacheKey(rep_->cache_id, handle.offset(), cache_key_buffer);
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadBlock(rep_->file, options, handle, &contents);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(key, block, block->size(),
-                                               &DeleteCachedBlock);
+            cache_handle = block_cache->InsertWithPriority(
+                key, block, block->size(), &DeleteCachedBlock, priority);
           }
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(rep_->file, options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -180,7 +440,7 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 
   Iterator* iter;
   if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    iter = block->NewIterator(rep_->options.comparator);
     if (cache_handle == nullptr) {
       iter->RegisterCleanup(&DeleteBlock, block, nullptr);
     } else {
@@ -193,26 +453,40 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 }
 
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  return NewTwoLevelIterator(NewIndexIterator(options), &Table::BlockReader,
+                             const_cast<Table*>(this), options);
+}
+
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (rep_->range_del_block == nullptr) {
+    return NewEmptyIterator();
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* iiter = NewIndexIterator(options);
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
     FilterBlockReader* filter = rep_->filter;
+    Cache::Handle* filter_cache_handle = nullptr;
+    if (rep_->has_filter &&
+        GetMetaBlock(rep_->filter_handle, true, &filter_cache_handle).ok()) {
+      filter = reinterpret_cast<CachedFilter*>(
+                   rep_->options.block_cache->Value(filter_cache_handle))
+                   ->reader;
+    }
     BlockHandle handle;
     if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
+      Iterator* block_iter =
+          ReadBlockIterator(options, iiter->value(), Cache::kLowPriority);
       block_iter->Seek(k);
       if (block_iter->Valid()) {
         (*handle_result)(arg, block_iter->key(), block_iter->value());
@@ -220,6 +494,9 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
       s = block_iter->status();
       delete block_iter;
     }
+    if (filter_cache_handle != nullptr) {
+      rep_->options.block_cache->Release(filter_cache_handle);
+    }
   }
   if (s.ok()) {
     s = iiter->status();
@@ -229,8 +506,7 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
 }
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
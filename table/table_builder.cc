@@ -21,7 +21,10 @@ struct TableBuilder::Rep {
         offset(0),
         data_block(&options),
         index_block(&index_block_options),
+        range_del_block(&options),
+        top_index_block(&index_block_options),
         num_entries(0),
+        num_range_deletions(0),
         closed(false),
         filter_block(opt.filter_policy == nullptr
                          ? nullptr
@@ -36,8 +39,13 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  BlockBuilder range_del_block;
+  // 分区索引的顶层索引，键为各分区最后一个索引键。为空说明还没有
+  // 写出过分区，Finish 时 index_block 按单块索引写出
+  BlockBuilder top_index_block;
   std::string last_key;
   int64_t num_entries;
+  int64_t num_range_deletions;
   bool closed;  // 是否调用Finish() 或者 Abandon()
   FilterBlockBuilder* filter_block;
 
@@ -94,13 +102,7 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     assert(r->data_block.empty());
     // r->last_key 此时大于前一个data块所有键，小于新data块的第一个键
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-
-    // pending_handle 值在上次写入块时设置
-    r->pending_handle.EncodeTo(
-        &handle_encoding);  // 上一个data块的起始位置和大小
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
-    r->pending_index_entry = false;
+    AddIndexEntry();
   }
 
   if (r->filter_block != nullptr) {
@@ -117,6 +119,16 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) {
+    return;
+  }
+  r->range_del_block.Add(key, value);
+  r->num_range_deletions++;
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -199,6 +211,7 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
     char trailer[kBlockTrailerSize];
     trailer[0] = type;
     uint32_t crc = crc32c::Value(block_contents.data(), block_contents.size());
+    crc = crc32c::Extend(crc, trailer, 1);  // 校验和同时覆盖块类型
     EncodeFixed32(trailer + 1, crc32c::Mask(crc));
     r->status = r->file->Append(Slice(trailer, kBlockTrailerSize));
     if (r->status.ok()) {
@@ -206,6 +219,36 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
     }
   }
 }
+void TableBuilder::AddIndexEntry() {
+  Rep* r = rep_;
+  std::string handle_encoding;
+  // pending_handle 值在上次写入块时设置，是上一个data块的起始位置和大小
+  r->pending_handle.EncodeTo(&handle_encoding);
+  r->index_block.Add(r->last_key, Slice(handle_encoding));
+  r->pending_index_entry = false;
+  if (r->options.index_partition_size > 0 &&
+      r->index_block.CurrentSizeEstimate() >= r->options.index_partition_size) {
+    FlushIndexPartition();
+  }
+}
+
+void TableBuilder::FlushIndexPartition() {
+  Rep* r = rep_;
+  // 分区内最后一个索引键不小于分区覆盖的所有键，且小于之后的所有键，
+  // 可以直接作为顶层索引的键
+  BlockHandle handle;
+  WriteBlock(&r->index_block, &handle);
+  if (ok()) {
+    std::string handle_encoding;
+    handle.EncodeTo(&handle_encoding);
+    r->top_index_block.Add(r->last_key, Slice(handle_encoding));
+  }
+  if (r->filter_block != nullptr && !r->closed) {
+    // 分区写在两个数据块之间，过滤器按数据块偏移分组，需跟上新的偏移
+    r->filter_block->StartBlock(r->offset);
+  }
+}
+
 Status TableBuilder::status() const { return rep_->status; }
 Status TableBuilder::Finish() {
   Rep* r = rep_;
@@ -213,13 +256,19 @@ Status TableBuilder::Finish() {
   Flush();
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle,
+      range_del_block_handle;
+  bool partitioned_index = false;
 
   if (ok() && r->filter_block != nullptr) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
   }
 
+  if (ok() && r->num_range_deletions > 0) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
+
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
     if (r->filter_block != nullptr) {
@@ -230,18 +279,30 @@ Status TableBuilder::Finish() {
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->num_range_deletions > 0) {
+      // metaindex 的键必须有序，"leveldb.rangedel" 排在 "filter.*" 之后
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kRangeDelBlockName, handle_encoding);
+    }
     WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
 
   if (ok()) {
     if (r->pending_index_entry) {
       r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
+      AddIndexEntry();
+    }
+    if (!r->top_index_block.empty()) {
+      if (!r->index_block.empty()) {
+        FlushIndexPartition();
+      }
+      partitioned_index = true;
     }
-    WriteBlock(&r->index_block, &index_block_handle);
+  }
+  if (ok()) {
+    WriteBlock(partitioned_index ? &r->top_index_block : &r->index_block,
+               &index_block_handle);
   }
 
     // Write footer
@@ -249,6 +310,7 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_partitioned_index(partitioned_index);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
@@ -265,6 +327,10 @@ void TableBuilder::Abandon() {
 }
 uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
+uint64_t TableBuilder::NumRangeTombstones() const {
+  return rep_->num_range_deletions;
+}
+
 uint64_t TableBuilder::FileSize() const { return rep_->offset; }
 
 }  // namespace leveldb
\ No newline at end of file
@@ -121,6 +121,7 @@ void TwoLevelIterator::SkipEmptyDataBlocksForward() {
     // Move to next block
     if (!index_iter_.Valid()) {
       SetDataIterator(nullptr);
+      return;
     }
     index_iter_.Next();
     InitDataBlock();
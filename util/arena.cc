@@ -1,20 +1,73 @@
 #include "util/arena.h"
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace leveldb {
 static const int kBlockSize = 4096;
+static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+static size_t RoundUpBlockSize(size_t block_size, bool huge_page) {
+#if defined(__linux__)
+  if (huge_page) {
+    return (block_size + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+  }
+#endif
+  return block_size;
+}
+
+#if defined(__linux__)
+// 将 [addr, addr + bytes) 的内存策略设为优先使用当前线程所在的 NUMA 节点。
+// 必须在页面第一次被访问之前调用；失败时保持默认策略。
+static void PreferCurrentNumaNode(char* addr, size_t bytes) {
+#if defined(SYS_mbind) && defined(SYS_getcpu)
+  static const int kMpolPreferred = 1;
+  static const size_t kBitsPerLong = 8 * sizeof(unsigned long);
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+    return;
+  }
+  std::vector<unsigned long> mask(node / kBitsPerLong + 1, 0);
+  mask[node / kBitsPerLong] |= 1UL << (node % kBitsPerLong);
+  // 内核只使用 maxnode - 1 位
+  syscall(SYS_mbind, addr, bytes, kMpolPreferred, mask.data(),
+          mask.size() * kBitsPerLong + 1, 0);
+#else
+  (void)addr;
+  (void)bytes;
+#endif
+}
+#endif
 
-Arena::Arena()
-    : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
+Arena::Arena() : Arena(kBlockSize, false, false) {}
+
+Arena::Arena(size_t block_size, bool huge_page, bool numa_aware)
+    : block_size_(RoundUpBlockSize(block_size, huge_page)),
+      huge_page_(huge_page),
+      numa_aware_(numa_aware),
+      alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      memory_usage_(0) {
+  assert(block_size_ > 0);
+}
 
 Arena::~Arena() {
   for (size_t i = 0; i < blocks_.size(); i++) {
     delete[] blocks_[i];
   }
+#if defined(__linux__)
+  for (size_t i = 0; i < mapped_blocks_.size(); i++) {
+    munmap(mapped_blocks_[i].first, mapped_blocks_[i].second);
+  }
+#endif
 }
 
 char* Arena::AllocateFallback(size_t bytes){
   // 进入该函数的前提是剩余空间不足以分配
-  if (bytes > kBlockSize /4)
+  if (bytes > block_size_ / 4)
   {
     // 如果需要分配的大小大于块的四分之一
     // 单独存放
@@ -23,11 +76,11 @@ char* Arena::AllocateFallback(size_t bytes){
   }
 
   // 抛弃当前块的剩余空间
-  alloc_ptr_ = AllocateNewBlock(kBlockSize);
-  alloc_bytes_remaining_ = kBlockSize;
+  alloc_ptr_ = AllocateNewBlock(block_size_);
   char* result = alloc_ptr_;
   alloc_ptr_ += bytes;
-  alloc_bytes_remaining_ -= bytes;
+  // 在 memory_usage_ 增加之后发布，MemoryUsage() 不会读到偏小的总量
+  alloc_bytes_remaining_.store(block_size_ - bytes, std::memory_order_release);
   return result;
 }
 
@@ -41,14 +94,16 @@ char* Arena::AllocateAligned(size_t bytes){
   // 从当前位置开始需要分配的字节数
   size_t needed = bytes + slop;
   char* result;
-  if (needed <= alloc_bytes_remaining_)
+  const size_t remaining =
+      alloc_bytes_remaining_.load(std::memory_order_relaxed);
+  if (needed <= remaining)
   {
     result = alloc_ptr_ + slop;
     alloc_ptr_ += needed;
-    alloc_bytes_remaining_ -= needed;
+    alloc_bytes_remaining_.store(remaining - needed, std::memory_order_release);
   } else{
     // AllocateFallback always returned aligned memory
-    // 块大小为4k,必定对齐
+    // new[] 与 mmap 返回的块必定对齐
     result = AllocateFallback(bytes);
   }
   // 对齐
@@ -57,10 +112,70 @@ char* Arena::AllocateAligned(size_t bytes){
 }
 
 char* Arena::AllocateNewBlock(size_t block_bytes) {
-  char* result = new char[block_bytes];
-  blocks_.push_back(result);
+  char* result = nullptr;
+  if (block_bytes == block_size_) {
+    result = MapBlock(block_bytes);
+  }
+  if (result == nullptr) {
+    result = new char[block_bytes];
+    blocks_.push_back(result);
+  }
   memory_usage_.fetch_add(block_bytes + sizeof(char*), std::memory_order_relaxed);
   return result;
 }
 
+char* Arena::MapBlock(size_t block_bytes) {
+#if defined(__linux__)
+  if (!huge_page_ && !numa_aware_) {
+    return nullptr;
+  }
+  char* result = nullptr;
+  void* p;
+#if defined(MAP_HUGETLB)
+  if (huge_page_) {
+    // 需要系统预留了大页，否则失败
+    p = mmap(nullptr, block_bytes, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      result = static_cast<char*>(p);
+    }
+  }
+#endif
+  if (result == nullptr) {
+    // 多映射一个大页，把块对齐到大页边界后再释放多余部分，
+    // 这样透明大页可以覆盖整个块
+    const size_t extra = huge_page_ ? kHugePageSize : 0;
+    p = mmap(nullptr, block_bytes + extra, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      return nullptr;
+    }
+    char* base = static_cast<char*>(p);
+    result = base;
+    if (extra > 0) {
+      uintptr_t addr = reinterpret_cast<uintptr_t>(base);
+      result = reinterpret_cast<char*>((addr + extra - 1) & ~(extra - 1));
+      const size_t head = result - base;
+      if (head > 0) {
+        munmap(base, head);
+      }
+      if (extra - head > 0) {
+        munmap(result + block_bytes, extra - head);
+      }
+#if defined(MADV_HUGEPAGE)
+      madvise(result, block_bytes, MADV_HUGEPAGE);
+#endif
+    }
+  }
+  if (numa_aware_) {
+    PreferCurrentNumaNode(result, block_bytes);
+  }
+  mapped_blocks_.emplace_back(result, block_bytes);
+  return result;
+#else
+  (void)block_bytes;
+  return nullptr;
+#endif
+}
+
 }  // namespace leveldb
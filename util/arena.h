@@ -5,12 +5,19 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <utility>
 #include <vector>
 
 namespace leveldb {
 class Arena {
  public:
   Arena();
+
+  // block_size 为每次向系统申请的块大小。huge_page 为 true 时以 2MB 大页
+  // 为单位映射内存（块大小向上取整）；numa_aware 为 true 时新块优先放在
+  // 申请线程所在的 NUMA 节点上。两者仅在 Linux 上生效。
+  Arena(size_t block_size, bool huge_page, bool numa_aware);
+
   Arena(const Arena&) = delete;
   Arena& operator=(const Arena&) = delete;
 
@@ -20,22 +27,35 @@ class Arena {
 
   char* AllocateAligned(size_t bytes);
 
-  // 估计内存使用量
+  // 估计内存使用量：已申请的块减去当前块中尚未分配的部分。大块只有
+  // 被用到的部分才计入，mmap 映射中未访问的页面也不占用物理内存。
+  // 先读剩余量再读总量，结果不会小于 0。
   size_t MemoryUsage() const {
-    return memory_usage_.load(std::memory_order_relaxed);
+    const size_t remaining =
+        alloc_bytes_remaining_.load(std::memory_order_acquire);
+    return memory_usage_.load(std::memory_order_relaxed) - remaining;
   }
 
  private:
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
+  char* MapBlock(size_t block_bytes);
+
+  const size_t block_size_;
+  const bool huge_page_;
+  const bool numa_aware_;
 
   // Allocation state
   char* alloc_ptr_;
-  size_t alloc_bytes_remaining_;
+  // 只有分配线程修改；原子变量仅为了 MemoryUsage() 可以并发读取
+  std::atomic<size_t> alloc_bytes_remaining_;
 
   // Array of new[] allocated memory blocks
   std::vector<char*> blocks_;
 
+  // 通过 mmap 映射的块及其长度
+  std::vector<std::pair<char*, size_t>> mapped_blocks_;
+
   std::atomic<size_t> memory_usage_;
 };
 
@@ -43,10 +63,12 @@ inline char* Arena::Allocate(size_t bytes) {
   assert(bytes > 0);
   // 如果允许 0 字节分配，返回值的语义会有点混乱，
   // 所以我们在这里不允许 0 字节分配（我们内部使用不需要它们）。
-  if (bytes <= alloc_bytes_remaining_) {
+  const size_t remaining =
+      alloc_bytes_remaining_.load(std::memory_order_relaxed);
+  if (bytes <= remaining) {
     char* result = alloc_ptr_;
     alloc_ptr_ += bytes;
-    alloc_bytes_remaining_ -= bytes;
+    alloc_bytes_remaining_.store(remaining - bytes, std::memory_order_release);
     return result;
   }
   return AllocateFallback(bytes);
@@ -4,6 +4,8 @@
 
 #include "util/arena.h"
 
+#include <cstring>
+
 #include "gtest/gtest.h"
 #include "util/random.h"
 
@@ -58,4 +60,34 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+TEST(ArenaTest, HugePageNumaAware) {
+  std::vector<std::pair<size_t, char*>> allocated;
+  Arena arena(1 << 20, true, true);
+  // 大块中只有已分配的部分计入内存使用量
+  arena.Allocate(16);
+  ASSERT_LE(arena.MemoryUsage(), 16 + sizeof(char*));
+  const int N = 20000;
+  size_t bytes = 16;
+  Random rnd(301);
+  for (int i = 0; i < N; i++) {
+    size_t s = rnd.OneIn(1000) ? rnd.Uniform(1 << 20) : rnd.Uniform(200);
+    if (s == 0) {
+      s = 1;
+    }
+    char* r = rnd.OneIn(10) ? arena.AllocateAligned(s) : arena.Allocate(s);
+    memset(r, i % 256, s);
+    bytes += s;
+    allocated.push_back(std::make_pair(s, r));
+    // 当前块中未分配的部分不计入内存使用量
+    ASSERT_GE(arena.MemoryUsage(), bytes);
+    ASSERT_LE(arena.MemoryUsage(), bytes * 1.10 + (512 << 10));
+  }
+  for (size_t i = 0; i < allocated.size(); i++) {
+    const char* p = allocated[i].second;
+    for (size_t b = 0; b < allocated[i].first; b++) {
+      ASSERT_EQ(int(p[b]) & 0xff, i % 256);
+    }
+  }
+}
+
 }  // namespace leveldb
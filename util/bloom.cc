@@ -7,6 +7,19 @@ namespace {
 static uint32_t BloomHash(const Slice& key) {
   return Hash(key.data(), key.size(), 0xbc9f1d34);
 }
+
+static uint64_t BloomHash64(const Slice& key) {
+  return Hash64(key.data(), key.size(), 0xbc9f1d34);
+}
+
+// 新格式的过滤器在 k 之后再追加这个字节。旧版本读到的末字节大于 30，
+// 会把所有键都当作命中，不会产生假阴性。
+static const uint8_t kHash64Format = 0x40;
+
+// 把 h 均匀映射到 [0, n)，用乘法代替取模
+static inline uint32_t FastRange(uint32_t h, size_t n) {
+  return static_cast<uint32_t>((static_cast<uint64_t>(h) * n) >> 32);
+}
 }  // namespace
 class BloomFilterPolicy : public FilterPolicy {
  public:
@@ -32,17 +45,16 @@ class BloomFilterPolicy : public FilterPolicy {
     const size_t init_size = dst->size();
     dst->resize(init_size + bytes, 0);
     dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    dst->push_back(static_cast<char>(kHash64Format));
     char* array = &(*dst)[init_size];
     for (int i = 0; i < n; i++) {
-      uint32_t h = BloomHash(keys[i]);
-      const uint32_t delta = (h >> 17) | (h << 15);  // 后17位换至最前
+      // 低 32 位作起点，高 32 位作步长，一次哈希得到全部探测位置
+      const uint64_t h64 = BloomHash64(keys[i]);
+      uint32_t h = static_cast<uint32_t>(h64);
+      const uint32_t delta = static_cast<uint32_t>(h64 >> 32);
       for (size_t j = 0; j < k_; j++) {
-        // 可操作的位一共bits个，h先对bits取模
-        const uint32_t bitops = h % bits;
-        // 取模结果bitops代表第bitops个位应该置1
-        // 换算到char数组中就是下面的表达式
+        const uint32_t bitops = FastRange(h, bits);
         array[bitops / 8] |= (1 << (bitops % 8));
-        // 轮换h
         h += delta;
       }
     }
@@ -53,6 +65,9 @@ class BloomFilterPolicy : public FilterPolicy {
       return false;  // filter 长度至少为2
     }
     const char* array = filter.data();
+    if (static_cast<uint8_t>(array[len - 1]) == kHash64Format) {
+      return KeyMayMatch64(key, filter);
+    }
     const size_t bits = (len - 1) * 8;
     // 读取filter中的k_
     const size_t k = array[len - 1];
@@ -78,6 +93,31 @@ class BloomFilterPolicy : public FilterPolicy {
   }
 
  private:
+  // 新格式：位数组 + k + kHash64Format
+  static bool KeyMayMatch64(const Slice& key, const Slice& filter) {
+    const size_t len = filter.size();
+    if (len < 3) {
+      return false;
+    }
+    const char* array = filter.data();
+    const size_t bits = (len - 2) * 8;
+    const size_t k = array[len - 2];
+    if (k > 30) {
+      return true;
+    }
+    const uint64_t h64 = BloomHash64(key);
+    uint32_t h = static_cast<uint32_t>(h64);
+    const uint32_t delta = static_cast<uint32_t>(h64 >> 32);
+    for (size_t j = 0; j < k; j++) {
+      const uint32_t bitops = FastRange(h, bits);
+      if ((array[bitops / 8] & (1 << (bitops % 8))) == 0) {
+        return false;
+      }
+      h += delta;
+    }
+    return true;
+  }
+
   size_t bits_per_key_;
   size_t k_;  // 哈希函数的数量
 };
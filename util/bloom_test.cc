@@ -3,6 +3,7 @@
 #include "gtest/gtest.h"
 #include "leveldb/filter_policy.h"
 #include "util/coding.h"
+#include "util/hash.h"
 #include "util/logging.h"
 #include "util/testutil.h"
 
@@ -43,7 +44,8 @@ class BloomTest : public testing::Test {
 
   void DumpFilter() {
     std::fprintf(stderr, "F(");
-    for (size_t i = 0; i < filter_.size() - 1; i++) {
+    // 末尾两个字节是 k 与格式标记
+    for (size_t i = 0; i + 2 < filter_.size(); i++) {
       const unsigned int c = static_cast<unsigned int>(filter_[i]);
       for (int j = 0; j < 8; j++) {
         std::fprintf(stderr, "%c", (c & (1 << j)) ? '1' : '.');
@@ -88,6 +90,58 @@ TEST_F(BloomTest, Small) {
   ASSERT_TRUE(!Matches("x"));
   ASSERT_TRUE(!Matches("foo"));
 }
+// 按旧格式（32 位 Hash、位数组 + k）构造过滤器，即已有 sstable 中的内容
+static std::string LegacyFilter(const std::vector<std::string>& keys,
+                                int bits_per_key) {
+  size_t bits = keys.size() * bits_per_key;
+  if (bits < 64) {
+    bits = 64;
+  }
+  const size_t bytes = (bits + 7) / 8;
+  bits = bytes * 8;
+  const size_t k = static_cast<size_t>(bits_per_key * 0.69);
+  std::string filter(bytes, '\0');
+  filter.push_back(static_cast<char>(k));
+  for (size_t i = 0; i < keys.size(); i++) {
+    uint32_t h = Hash(keys[i].data(), keys[i].size(), 0xbc9f1d34);
+    const uint32_t delta = (h >> 17) | (h << 15);
+    for (size_t j = 0; j < k; j++) {
+      const uint32_t bitpos = h % bits;
+      filter[bitpos / 8] |= (1 << (bitpos % 8));
+      h += delta;
+    }
+  }
+  return filter;
+}
+
+TEST(BloomFormatTest, ReadsLegacyFilter) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  char buffer[sizeof(int)];
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  const std::string filter = LegacyFilter(keys, 10);
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_TRUE(policy->KeyMayMatch(keys[i], filter)) << i;
+  }
+  int false_positives = 0;
+  for (int i = 0; i < 10000; i++) {
+    if (policy->KeyMayMatch(Key(i + 1000000000, buffer), filter)) {
+      false_positives++;
+    }
+  }
+  ASSERT_LE(false_positives, 200);
+
+  // 新格式的末字节大于 30，旧版本读到时一律视为命中
+  std::vector<Slice> slices(keys.begin(), keys.end());
+  std::string current;
+  policy->CreateFilter(&slices[0], static_cast<int>(slices.size()), &current);
+  ASSERT_GT(static_cast<uint8_t>(current[current.size() - 1]), 30);
+  ASSERT_NE(filter, current.substr(0, current.size() - 1));
+  delete policy;
+}
+
 static int NextLength(int length) {
   if (length < 10) {
     length += 1;
@@ -41,6 +41,7 @@ struct LRUHandle {
   size_t charge;
   size_t key_length;
   bool in_cache;     // 是否在缓存中
+  bool high_priority;  // 未被引用时放在 high_pri_lru_ 而不是 lru_ 中
   uint32_t refs;     // 引用计数
   uint32_t hash;     // key的hash值，用于快速分片与比较
   char key_data[1];  // key的开始位置
@@ -150,7 +151,8 @@ class LRUCache {
   // 返回值被修改为抽象类 Cache::Handle
   Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
                         size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        bool high_priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
 
   void Release(Cache::Handle* handle);
@@ -166,6 +168,8 @@ class LRUCache {
   void LRU_Append(LRUHandle* list, LRUHandle* e);
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);
+  // 最早应被淘汰的未引用条目，没有时返回 nullptr
+  LRUHandle* OldestUnused() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   size_t capacity_;
@@ -179,6 +183,9 @@ class LRUCache {
   // Entries have refs==1 and in_cache==true. 这唯一的引用来自于cache
   LRUHandle lru_ GUARDED_BY(mutex_);
 
+  // 未被引用的高优先级条目，lru_ 为空时才从这里淘汰
+  LRUHandle high_pri_lru_ GUARDED_BY(mutex_);
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
@@ -189,19 +196,23 @@ class LRUCache {
 LRUCache::LRUCache() : capacity_(0), usage_(0) {
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  high_pri_lru_.next = &high_pri_lru_;
+  high_pri_lru_.prev = &high_pri_lru_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
 
 LRUCache::~LRUCache() {
   assert(in_use_.next = &in_use_);  // 确保无被引用的handle
-  for (LRUHandle* e = lru_.next; e != &lru_;) {
-    LRUHandle* next = e->next;
-    assert(e->in_cache);
-    e->in_cache = false;
-    assert(e->refs == 1);
-    Unref(e);
-    e = next;
+  for (LRUHandle* list : {&lru_, &high_pri_lru_}) {
+    for (LRUHandle* e = list->next; e != list;) {
+      LRUHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);
+      Unref(e);
+      e = next;
+    }
   }
 }
 
@@ -223,10 +234,20 @@ void LRUCache::Unref(LRUHandle* e) {
     free(e);
   } else if (e->in_cache && e->refs == 1) {
     LRU_Remove(e);
-    LRU_Append(&lru_, e);
+    LRU_Append(e->high_priority ? &high_pri_lru_ : &lru_, e);
   }
 }
 
+LRUHandle* LRUCache::OldestUnused() {
+  if (lru_.next != &lru_) {
+    return lru_.next;
+  }
+  if (high_pri_lru_.next != &high_pri_lru_) {
+    return high_pri_lru_.next;
+  }
+  return nullptr;
+}
+
 void LRUCache::LRU_Remove(LRUHandle* e) {
   e->next->prev = e->prev;
   e->prev->next = e->next;
@@ -256,7 +277,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
                                 void (*deleter)(const Slice& key,
-                                                void* value)) {
+                                                void* value),
+                                bool high_priority) {
   MutexLock l(&mutex_);
   LRUHandle* e =
       reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle) - 1 + key.size()));
@@ -266,6 +288,7 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->high_priority = high_priority;
   e->refs = 1;
   std::memcpy(e->key_data, key.data(), key.size());
 
@@ -281,8 +304,8 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
     // next is read by key() in an assert, so it must be initialized
     e->next = nullptr;
   }
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next; // 插入位置在lru_前
+  LRUHandle* old;
+  while (usage_ > capacity_ && (old = OldestUnused()) != nullptr) {
     assert(old->refs == 1);
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {
@@ -310,8 +333,8 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
 
 void LRUCache::Prune() {
   MutexLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
+  LRUHandle* e;
+  while ((e = OldestUnused()) != nullptr) {
     assert(e->refs == 1);
     bool erased = FinishErase(table_.Remove(e->key(), e->hash));
     if (!erased) {
@@ -335,7 +358,16 @@ class ShardedLRUCache : public Cache {
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      false);
+  }
+
+  Handle* InsertWithPriority(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) override {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority == kHighPriority);
   }
 
   Handle* Lookup(const Slice& key) override {
@@ -379,7 +411,8 @@ class ShardedLRUCache : public Cache {
   uint64_t last_id_;
 
   static inline uint32_t HashSlice(const Slice& s) {
-    return Hash(s.data(), s.size(), 0);
+    // Hash64 的每一位都充分混合，直接截取低 32 位
+    return static_cast<uint32_t>(Hash64(s.data(), s.size(), 0));
   }
 
   static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
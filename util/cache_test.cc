@@ -141,6 +141,33 @@ TEST_F(CacheTest, EvictionPolicy) {
   cache_->Release(h);
 }
 
+TEST_F(CacheTest, HighPriorityEvictedLast) {
+  for (int i = 0; i < 10; i++) {
+    cache_->Release(cache_->InsertWithPriority(
+        EncodeKey(100 + i), EncodeValue(200 + i), 1, &CacheTest::Deleter,
+        Cache::kHighPriority));
+  }
+  // 大量低优先级条目只会互相淘汰
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000 + i, 2000 + i);
+  }
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(200 + i, Lookup(100 + i));
+  }
+  ASSERT_EQ(-1, Lookup(1000));
+
+  // 只剩高优先级条目时按 LRU 淘汰
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    cache_->Release(cache_->InsertWithPriority(
+        EncodeKey(10000 + i), EncodeValue(i), 1, &CacheTest::Deleter,
+        Cache::kHighPriority));
+  }
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(-1, Lookup(100 + i));
+  }
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + kCacheSize / 10);
+}
+
 TEST_F(CacheTest, UseExceedsCacheSize) {
   // Overfill the cache, keeping handles on all inserted entries.
   std::vector<Cache::Handle*> h;
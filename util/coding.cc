@@ -116,6 +116,10 @@ const char* GetVarint64Ptr(const char* p, const char* limit, uint64_t* v) {
 
 const char* GetVarint32PtrFallback(const char* p, const char* limit,
                                    uint32_t* value) {
+  if (limit - p >= 8) {
+    const int n = DecodeVarint32Word(DecodeFixed64(p), value);
+    return (n == 0) ? nullptr : p + n;
+  }
   uint32_t result = 0;
   for (uint32_t shift = 0; shift <= 28 && p < limit; shift += 7) {
     uint32_t byte = *(reinterpret_cast<const uint8_t*>(p));
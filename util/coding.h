@@ -7,10 +7,14 @@
 #include <cstring>
 #include <string>
 
+#include "leveldb/slice.h"
 #include "port/port.h"
 
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 namespace leveldb {
-class Slice;
 
 // 将数据添加到string
 
@@ -89,9 +93,79 @@ inline uint64_t DecodeFixed64(const char* ptr) {
          (static_cast<uint64_t>(buffer[0]));
 }
 
+// 按大端序读取 8 字节，整数大小与逐字节比较的顺序一致
+inline uint64_t DecodeBigEndian64(const char* ptr) {
+  const uint8_t* const buffer = reinterpret_cast<const uint8_t*>(ptr);
+
+  return (static_cast<uint64_t>(buffer[0]) << 56) |
+         (static_cast<uint64_t>(buffer[1]) << 48) |
+         (static_cast<uint64_t>(buffer[2]) << 40) |
+         (static_cast<uint64_t>(buffer[3]) << 32) |
+         (static_cast<uint64_t>(buffer[4]) << 24) |
+         (static_cast<uint64_t>(buffer[5]) << 16) |
+         (static_cast<uint64_t>(buffer[6]) << 8) |
+         (static_cast<uint64_t>(buffer[7]));
+}
+
+// 与 Slice::compare 结果相同的字节序比较。两者都不短于 8 字节时，
+// 先把前 8 字节当作整数比较，多数键在这一步就能分出大小，不必调用 memcmp。
+inline int BytewiseCompare(const Slice& a, const Slice& b) {
+  if (a.size() >= 8 && b.size() >= 8) {
+    const uint64_t x = DecodeBigEndian64(a.data());
+    const uint64_t y = DecodeBigEndian64(b.data());
+    if (x != y) {
+      return (x < y) ? -1 : +1;
+    }
+    return Slice(a.data() + 8, a.size() - 8)
+        .compare(Slice(b.data() + 8, b.size() - 8));
+  }
+  return a.compare(b);
+}
+
 const char* GetVarint32PtrFallback(const char* p, const char* limit,
                                    uint32_t* value);
 
+// REQUIRES: x != 0
+inline int CountTrailingZeros64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+// 从 word（按小端序读入的 8 字节）的最低字节开始解析一个 varint32，
+// 用掩码找结束字节、用移位拼接 7 位分组，不逐字节分支。
+// 返回占用的字节数；前 5 个字节都没有结束时返回 0。
+// 注意 word 中超出有效数据的高位字节若为 0，也会被当作结束字节，
+// 调用者需要检查返回的长度没有越界。
+inline int DecodeVarint32Word(uint64_t word, uint32_t* v) {
+  const uint64_t stops = ~word & 0x8080808080808080ull;
+  if (stops == 0) {
+    return 0;
+  }
+  const int len = (CountTrailingZeros64(stops) + 1) / 8;
+  if (len > 5) {
+    return 0;
+  }
+  const uint64_t mask = 0x7f7f7f7f7f7f7f7full >> (64 - 8 * len);
+#if defined(__BMI2__)
+  *v = static_cast<uint32_t>(_pext_u64(word, mask));
+#else
+  uint64_t x = word & mask;
+  x = ((x & 0x7f007f007f007f00ull) >> 1) | (x & 0x007f007f007f007full);
+  x = ((x & 0x3fff00003fff0000ull) >> 2) | (x & 0x00003fff00003fffull);
+  x = ((x & 0x0fffffff00000000ull) >> 4) | (x & 0x000000000fffffffull);
+  *v = static_cast<uint32_t>(x);
+#endif
+  return len;
+}
+
 // 读出的数字存于v，返回读取后指针位置
 inline const char* GetVarint32Ptr(const char* p, const char* limit,
                                   uint32_t* v) {
@@ -3,6 +3,7 @@
 #include <vector>
 #include "leveldb/slice.h"
 #include "gtest/gtest.h"
+#include "util/random.h"
 
 namespace leveldb {
 TEST(Coding, Fixed32) {
@@ -129,6 +130,37 @@ TEST(Coding, Varint32Overflow) {
                              &result) == nullptr);
 }
 
+TEST(Coding, Varint32WordDecode) {
+  // 后面跟着足够的字节时走 8 字节整字解析，结果须与逐字节解析一致。
+  // 填充 0xff（继续位为 1），结束字节判断错误时会读出不同的值。
+  for (uint32_t power = 0; power <= 32; power++) {
+    const uint64_t base = (power == 32) ? 0 : (1ull << power);
+    for (int delta = -1; delta <= 1; delta++) {
+      const uint32_t v = static_cast<uint32_t>(base + delta);
+      std::string s;
+      PutVarint32(&s, v);
+      const size_t encoded = s.size();
+      s.append(8, '\xff');
+      uint32_t actual;
+      const char* p = GetVarint32Ptr(s.data(), s.data() + s.size(), &actual);
+      ASSERT_TRUE(p != nullptr);
+      ASSERT_EQ(v, actual);
+      ASSERT_EQ(encoded, p - s.data());
+
+      int n = DecodeVarint32Word(DecodeFixed64(s.data()), &actual);
+      ASSERT_EQ(static_cast<int>(encoded), n);
+      ASSERT_EQ(v, actual);
+    }
+  }
+
+  std::string overflow("\x81\x82\x83\x84\x85\x11");
+  overflow.append(8, '\0');
+  uint32_t result;
+  ASSERT_TRUE(GetVarint32Ptr(overflow.data(),
+                             overflow.data() + overflow.size(),
+                             &result) == nullptr);
+}
+
 TEST(Coding, Varint32Truncation) {
   uint32_t large_value = (1u << 31) + 100;
   std::string s;
@@ -164,6 +196,32 @@ TEST(Coding, Varint64Truncation) {
   ASSERT_EQ(large_value, result);
 }
 
+TEST(Coding, BytewiseCompare) {
+  // 长度 0~20、字节取自很小的字母表（含 0x00 与 0xff），
+  // 让前 8 字节经常相同或互为前缀
+  Random rnd(301);
+  const char alphabet[] = {'\0', 'a', 'b', '\x7f', '\x80', '\xff'};
+  for (int i = 0; i < 100000; i++) {
+    std::string a, b;
+    const int alen = rnd.Uniform(21);
+    const int blen = rnd.Uniform(21);
+    for (int j = 0; j < alen; j++) {
+      a.push_back(alphabet[rnd.Uniform(sizeof(alphabet))]);
+    }
+    for (int j = 0; j < blen; j++) {
+      b.push_back(alphabet[rnd.Uniform(sizeof(alphabet))]);
+    }
+    if (rnd.OneIn(4)) {
+      b = a.substr(0, blen);  // 前缀
+    }
+    const int expected = Slice(a).compare(b);
+    const int actual = BytewiseCompare(a, b);
+    ASSERT_EQ(expected < 0, actual < 0) << i;
+    ASSERT_EQ(expected == 0, actual == 0) << i;
+    ASSERT_EQ(expected > 0, actual > 0) << i;
+  }
+}
+
 TEST(Coding, Strings) {
   std::string s;
   PutLengthPrefixedSlice(&s, Slice(""));
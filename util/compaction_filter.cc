@@ -0,0 +1,7 @@
+#include "leveldb/compaction_filter.h"
+
+namespace leveldb {
+
+CompactionFilter::~CompactionFilter() {}
+
+}  // namespace leveldb
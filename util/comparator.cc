@@ -6,6 +6,7 @@
 #include <type_traits>
 
 #include "leveldb/slice.h"
+#include "util/coding.h"
 #include "util/no_destructor.h"
 
 namespace leveldb {
@@ -16,7 +17,7 @@ class BytewiseComparatorImpl : public Comparator {
   BytewiseComparatorImpl() = default;
   const char* Name() const override { return "leveldb.BytewiseComparator"; }
   int Compare(const Slice& a, const Slice& b) const override {
-    return a.compare(b);
+    return BytewiseCompare(a, b);
   }
 
   void FindShortestSeparator(std::string* start,
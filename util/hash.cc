@@ -44,4 +44,88 @@ uint32_t Hash(const char* data, size_t n, uint32_t seed) {
   }
   return h;
 }
+
+namespace {
+
+const uint64_t kSecret0 = 0xa0761d6478bd642full;
+const uint64_t kSecret1 = 0xe7037ed1a0b428dbull;
+const uint64_t kSecret2 = 0x8ebc6af09c88c6e3ull;
+const uint64_t kSecret3 = 0x589965cc75374cc3ull;
+
+// *a, *b 分别替换为 (*a) * (*b) 的低 64 位与高 64 位
+inline void Multiply128(uint64_t* a, uint64_t* b) {
+#if defined(__SIZEOF_INT128__)
+  const unsigned __int128 r = static_cast<unsigned __int128>(*a) * *b;
+  *a = static_cast<uint64_t>(r);
+  *b = static_cast<uint64_t>(r >> 64);
+#else
+  const uint64_t ha = *a >> 32, hb = *b >> 32;
+  const uint64_t la = static_cast<uint32_t>(*a), lb = static_cast<uint32_t>(*b);
+  const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  const uint64_t t = rl + (rm0 << 32);
+  uint64_t carry = (t < rl) ? 1 : 0;
+  const uint64_t lo = t + (rm1 << 32);
+  carry += (lo < t) ? 1 : 0;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+inline uint64_t Mix(uint64_t a, uint64_t b) {
+  Multiply128(&a, &b);
+  return a ^ b;
+}
+
+inline uint64_t Read32(const char* p) { return DecodeFixed32(p); }
+
+}  // namespace
+
+uint64_t Hash64(const char* data, size_t n, uint64_t seed) {
+  const char* p = data;
+  seed ^= Mix(seed ^ kSecret0, kSecret1);
+  uint64_t a, b;
+  if (n <= 16) {
+    if (n >= 4) {
+      // 两对可能重叠的 4 字节覆盖全部输入
+      const size_t shift = (n >> 3) << 2;
+      a = (Read32(p) << 32) | Read32(p + shift);
+      b = (Read32(p + n - 4) << 32) | Read32(p + n - 4 - shift);
+    } else if (n > 0) {
+      a = (static_cast<uint64_t>(static_cast<uint8_t>(p[0])) << 16) |
+          (static_cast<uint64_t>(static_cast<uint8_t>(p[n >> 1])) << 8) |
+          static_cast<uint8_t>(p[n - 1]);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = n;
+    if (i > 48) {
+      // 三路互不依赖的乘法，可以流水执行
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = Mix(DecodeFixed64(p) ^ kSecret1, DecodeFixed64(p + 8) ^ seed);
+        see1 = Mix(DecodeFixed64(p + 16) ^ kSecret2,
+                   DecodeFixed64(p + 24) ^ see1);
+        see2 = Mix(DecodeFixed64(p + 32) ^ kSecret3,
+                   DecodeFixed64(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = Mix(DecodeFixed64(p) ^ kSecret1, DecodeFixed64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    // 最后 16 字节，可能与已处理的部分重叠
+    a = DecodeFixed64(p + i - 16);
+    b = DecodeFixed64(p + i - 8);
+  }
+  a ^= kSecret1;
+  b ^= seed;
+  Multiply128(&a, &b);
+  return Mix(a ^ kSecret0 ^ n, b ^ kSecret1);
+}
 }  // namespace leveldb
@@ -6,8 +6,14 @@
 
 namespace leveldb {
 
+// 32 位哈希，逐 4 字节处理。已有 bloom 过滤器块按它的结果写入，
+// 结果不能改变。
 uint32_t Hash(const char* data, size_t n, uint32_t seed);
 
+// 64 位哈希（wyhash 风格），用 64x64->128 位乘法混合，每次处理 16 字节，
+// 长输入分三路并行。比 Hash() 更快、分布更好，用于缓存与新格式的过滤器。
+uint64_t Hash64(const char* data, size_t n, uint64_t seed);
+
 }  // namespace leveldb
 
 #endif
\ No newline at end of file
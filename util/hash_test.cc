@@ -1,5 +1,8 @@
 #include "util/hash.h"
 
+#include <set>
+#include <string>
+
 #include "gtest/gtest.h"
 
 namespace leveldb {
@@ -32,4 +35,59 @@ TEST(HASH, SignedUnsignedIssue) {
       Hash(reinterpret_cast<const char*>(data5), sizeof(data5), 0x12345678),
       0xf333dabb);
 }
+
+TEST(HASH, Hash64Vectors) {
+  const uint8_t data1[1] = {0x62};
+  const uint8_t data2[2] = {0xc3, 0x97};
+  const uint8_t data3[3] = {0xe2, 0x99, 0xa5};
+  const uint8_t data4[4] = {0xe1, 0x80, 0xb9, 0x32};
+  const uint8_t data5[48] = {
+      0x01, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00,
+      0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x18, 0x28, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  };
+  char data6[200];  // 走三路并行的主循环
+  for (int i = 0; i < 200; i++) {
+    data6[i] = static_cast<char>(i * 7 + 1);
+  }
+
+  ASSERT_EQ(Hash64(0, 0, 0xbc9f1d34), 0x25ae910defbba1c8ull);
+  ASSERT_EQ(
+      Hash64(reinterpret_cast<const char*>(data1), sizeof(data1), 0xbc9f1d34),
+      0x2b557d23e048fdcfull);
+  ASSERT_EQ(
+      Hash64(reinterpret_cast<const char*>(data2), sizeof(data2), 0xbc9f1d34),
+      0xc98235573e6bf3dcull);
+  ASSERT_EQ(
+      Hash64(reinterpret_cast<const char*>(data3), sizeof(data3), 0xbc9f1d34),
+      0xcf541428444448bdull);
+  ASSERT_EQ(
+      Hash64(reinterpret_cast<const char*>(data4), sizeof(data4), 0xbc9f1d34),
+      0x0f66a201d37f4917ull);
+  ASSERT_EQ(
+      Hash64(reinterpret_cast<const char*>(data5), sizeof(data5), 0x12345678),
+      0x0ea58e9523a1ef01ull);
+  ASSERT_EQ(Hash64(data6, sizeof(data6), 0), 0x1852ea06dbaac616ull);
+}
+
+TEST(HASH, Hash64Distinct) {
+  // 每种长度（覆盖所有分支）、每个种子都得到不同的结果
+  std::string data(130, '\0');
+  std::set<uint64_t> seen;
+  for (size_t n = 0; n <= data.size(); n++) {
+    ASSERT_TRUE(seen.insert(Hash64(data.data(), n, 0)).second) << n;
+    ASSERT_TRUE(seen.insert(Hash64(data.data(), n, 1)).second) << n;
+  }
+  // 任一字节的任一位改变都会影响结果
+  for (size_t i = 0; i < data.size(); i++) {
+    for (int bit = 0; bit < 8; bit++) {
+      std::string flipped = data;
+      flipped[i] ^= static_cast<char>(1 << bit);
+      ASSERT_NE(Hash64(data.data(), data.size(), 0),
+                Hash64(flipped.data(), flipped.size(), 0))
+          << i << " " << bit;
+    }
+  }
+}
 }  // namespace leveldb
@@ -0,0 +1,13 @@
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+MergeOperator::~MergeOperator() {}
+
+bool MergeOperator::PartialMerge(const Slice& key,
+                                 const std::vector<Slice>& operands,
+                                 std::string* new_operand) const {
+  return false;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,73 @@
+#include "util/parallel.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+struct ParallelForState {
+  ParallelForState(size_t n, void (*function)(void*, size_t), void* arg)
+      : n(n), function(function), arg(arg), next(0), running(0), cv(&mu) {}
+
+  const size_t n;
+  void (*const function)(void*, size_t);
+  void* const arg;
+
+  port::Mutex mu;
+  size_t next GUARDED_BY(mu);  // 下一个待处理的下标
+  int running GUARDED_BY(mu);  // 仍在运行的线程数
+  port::CondVar cv GUARDED_BY(mu);
+};
+
+void ParallelForWorker(void* arg) {
+  ParallelForState* state = reinterpret_cast<ParallelForState*>(arg);
+  state->mu.Lock();
+  while (state->next < state->n) {
+    const size_t i = state->next++;
+    state->mu.Unlock();
+    (*state->function)(state->arg, i);
+    state->mu.Lock();
+  }
+  state->running--;
+  state->cv.SignalAll();
+  state->mu.Unlock();
+}
+
+}  // namespace
+
+void ParallelFor(Env* env, size_t n, int max_threads,
+                 void (*function)(void* arg, size_t i), void* arg) {
+  if (n == 0) {
+    return;
+  }
+  if (max_threads <= 0) {
+    max_threads = static_cast<int>(std::thread::hardware_concurrency());
+  }
+  const int threads =
+      static_cast<int>(std::min<size_t>(std::max(max_threads, 1), n));
+  if (threads == 1) {
+    for (size_t i = 0; i < n; i++) {
+      (*function)(arg, i);
+    }
+    return;
+  }
+
+  ParallelForState state(n, function, arg);
+  MutexLock l(&state.mu);
+  state.running = threads;
+  for (int i = 0; i < threads; i++) {
+    env->StartThread(&ParallelForWorker, &state);
+  }
+  while (state.running > 0) {
+    state.cv.Wait();
+  }
+}
+
+}  // namespace leveldb
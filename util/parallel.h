@@ -0,0 +1,18 @@
+#ifndef STORAGE_LEVELDB_UTIL_PARALLEL_H_
+#define STORAGE_LEVELDB_UTIL_PARALLEL_H_
+
+#include <cstddef>
+
+namespace leveldb {
+
+class Env;
+
+// 通过 env->StartThread() 启动至多 max_threads 个线程，对 [0, n) 中的每个 i
+// 调用 (*function)(arg, i)，全部完成后返回。下标按从小到大的顺序分发，
+// 但各次调用之间没有顺序保证。max_threads <= 0 时使用硬件线程数。
+void ParallelFor(Env* env, size_t n, int max_threads,
+                 void (*function)(void* arg, size_t i), void* arg);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_PARALLEL_H_
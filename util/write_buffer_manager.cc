@@ -0,0 +1,146 @@
+#include "leveldb/write_buffer_manager.h"
+
+#include <atomic>
+#include <cassert>
+#include <vector>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// 计入 cache 的占位条目大小。条目太小时频繁插入删除，太大时计费粗糙
+const size_t kCacheEntrySize = 256 << 10;
+
+void DeleteCacheEntry(const Slice& key, void* value) {}
+
+}  // namespace
+
+struct WriteBufferManager::Rep {
+  size_t buffer_size;
+  Cache* cache;
+  uint64_t cache_id;
+
+  std::atomic<size_t> memory_used;
+  std::atomic<size_t> memory_active;  // 可写 memtable 占用的部分
+  std::atomic<int> num_dbs;
+
+  port::Mutex mutex;
+  // 持有的占位条目，编号与缓存键一一对应
+  std::vector<Cache::Handle*> entries GUARDED_BY(mutex);
+
+  void EncodeKey(uint64_t number, char* buf) const {
+    EncodeFixed64(buf, cache_id);
+    EncodeFixed64(buf + 8, number);
+  }
+
+  // 按当前的 memory_used 增减占位条目。多保留一个条目的余量，
+  // 避免用量在条目边界附近来回波动时反复插入删除
+  void AdjustCacheCharge() EXCLUSIVE_LOCKS_REQUIRED(mutex) {
+    const size_t used = memory_used.load(std::memory_order_relaxed);
+    char buf[16];
+    while (entries.size() * kCacheEntrySize < used) {
+      EncodeKey(entries.size(), buf);
+      entries.push_back(cache->Insert(Slice(buf, sizeof(buf)), nullptr,
+                                      kCacheEntrySize, &DeleteCacheEntry));
+    }
+    while (entries.size() * kCacheEntrySize > used + kCacheEntrySize) {
+      EncodeKey(entries.size() - 1, buf);
+      cache->Release(entries.back());
+      cache->Erase(Slice(buf, sizeof(buf)));
+      entries.pop_back();
+    }
+  }
+};
+
+WriteBufferManager::WriteBufferManager(size_t buffer_size, Cache* cache)
+    : rep_(new Rep) {
+  rep_->buffer_size = buffer_size;
+  rep_->cache = cache;
+  rep_->cache_id = (cache != nullptr ? cache->NewId() : 0);
+  rep_->memory_used.store(0, std::memory_order_relaxed);
+  rep_->memory_active.store(0, std::memory_order_relaxed);
+  rep_->num_dbs.store(0, std::memory_order_relaxed);
+}
+
+WriteBufferManager::~WriteBufferManager() {
+  assert(rep_->num_dbs.load(std::memory_order_relaxed) == 0);
+  if (rep_->cache != nullptr) {
+    MutexLock l(&rep_->mutex);
+    char buf[16];
+    while (!rep_->entries.empty()) {
+      rep_->EncodeKey(rep_->entries.size() - 1, buf);
+      rep_->cache->Release(rep_->entries.back());
+      rep_->cache->Erase(Slice(buf, sizeof(buf)));
+      rep_->entries.pop_back();
+    }
+  }
+  delete rep_;
+}
+
+size_t WriteBufferManager::buffer_size() const { return rep_->buffer_size; }
+
+size_t WriteBufferManager::memory_usage() const {
+  return rep_->memory_used.load(std::memory_order_relaxed);
+}
+
+size_t WriteBufferManager::mutable_memtable_memory_usage() const {
+  return rep_->memory_active.load(std::memory_order_relaxed);
+}
+
+size_t WriteBufferManager::cache_charge() const {
+  MutexLock l(&rep_->mutex);
+  return rep_->entries.size() * kCacheEntrySize;
+}
+
+bool WriteBufferManager::ShouldFlush() const {
+  const size_t limit = rep_->buffer_size;
+  if (limit == 0) {
+    return false;
+  }
+  const size_t active = mutable_memtable_memory_usage();
+  if (active > limit - limit / 8) {
+    return true;
+  }
+  return memory_usage() >= limit && active >= limit / 2;
+}
+
+void WriteBufferManager::RegisterDB() {
+  rep_->num_dbs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void WriteBufferManager::UnregisterDB() {
+  rep_->num_dbs.fetch_sub(1, std::memory_order_relaxed);
+}
+
+int WriteBufferManager::num_dbs() const {
+  return rep_->num_dbs.load(std::memory_order_relaxed);
+}
+
+void WriteBufferManager::ReserveMem(size_t mem) {
+  rep_->memory_active.fetch_add(mem, std::memory_order_relaxed);
+  rep_->memory_used.fetch_add(mem, std::memory_order_relaxed);
+  if (rep_->cache != nullptr) {
+    MutexLock l(&rep_->mutex);
+    rep_->AdjustCacheCharge();
+  }
+}
+
+void WriteBufferManager::ScheduleFreeMem(size_t mem) {
+  rep_->memory_active.fetch_sub(mem, std::memory_order_relaxed);
+}
+
+void WriteBufferManager::FreeMem(size_t mem) {
+  rep_->memory_used.fetch_sub(mem, std::memory_order_relaxed);
+  if (rep_->cache != nullptr) {
+    MutexLock l(&rep_->mutex);
+    rep_->AdjustCacheCharge();
+  }
+}
+
+}  // namespace leveldb
@@ -0,0 +1,83 @@
+#include "leveldb/write_buffer_manager.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "leveldb/cache.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+static void NoopDeleter(const Slice& key, void* value) {}
+
+TEST(WriteBufferManagerTest, ShouldFlush) {
+  WriteBufferManager manager(1000);
+  ASSERT_FALSE(manager.ShouldFlush());
+
+  // 可写部分超过 7/8
+  manager.ReserveMem(800);
+  ASSERT_FALSE(manager.ShouldFlush());
+  manager.ReserveMem(100);
+  ASSERT_TRUE(manager.ShouldFlush());
+  ASSERT_EQ(900, manager.memory_usage());
+  ASSERT_EQ(900, manager.mutable_memtable_memory_usage());
+
+  // 转为不可变后，总量超出但可写部分不到一半，不再需要切换
+  manager.ScheduleFreeMem(900);
+  ASSERT_FALSE(manager.ShouldFlush());
+  manager.ReserveMem(400);
+  ASSERT_EQ(1300, manager.memory_usage());
+  ASSERT_FALSE(manager.ShouldFlush());
+  manager.ReserveMem(100);
+  ASSERT_TRUE(manager.ShouldFlush());
+
+  // 不可变部分落盘后恢复正常
+  manager.FreeMem(900);
+  ASSERT_EQ(500, manager.memory_usage());
+  ASSERT_FALSE(manager.ShouldFlush());
+  manager.ScheduleFreeMem(500);
+  manager.FreeMem(500);
+  ASSERT_EQ(0, manager.memory_usage());
+
+  // buffer_size 为 0 时只统计
+  WriteBufferManager unlimited(0);
+  unlimited.ReserveMem(1 << 30);
+  ASSERT_FALSE(unlimited.ShouldFlush());
+  unlimited.ScheduleFreeMem(1 << 30);
+  unlimited.FreeMem(1 << 30);
+}
+
+TEST(WriteBufferManagerTest, ChargeCache) {
+  const size_t kMB = 1 << 20;
+  Cache* cache = NewLRUCache(8 * kMB);
+  {
+    WriteBufferManager manager(4 * kMB, cache);
+    ASSERT_EQ(0, manager.cache_charge());
+
+    manager.ReserveMem(3 * kMB + 1);
+    ASSERT_GE(manager.cache_charge(), 3 * kMB + 1);
+    ASSERT_GE(cache->TotalCharge(), manager.cache_charge());
+
+    // 占位条目一直被引用，不会被填满缓存的其他条目挤掉
+    std::string key;
+    for (int i = 0; i < 100; i++) {
+      key.clear();
+      PutFixed32(&key, i);
+      cache->Release(cache->Insert(key, nullptr, kMB / 4, &NoopDeleter));
+    }
+    ASSERT_GE(cache->TotalCharge(), manager.cache_charge());
+    ASSERT_LE(cache->TotalCharge() - manager.cache_charge(), 8 * kMB);
+
+    // 释放后计费随之减少，最多保留一个条目的余量
+    manager.ScheduleFreeMem(3 * kMB + 1);
+    manager.FreeMem(3 * kMB);
+    ASSERT_LE(manager.cache_charge(), kMB);
+    manager.FreeMem(1);
+  }
+  // 删除 manager 时归还全部计费
+  cache->Prune();
+  ASSERT_EQ(0, cache->TotalCharge());
+  delete cache;
+}
+
+}  // namespace leveldb